@@ -0,0 +1,796 @@
+/**
+ * @file kestrel_bench.cpp
+ * @brief Microbenchmarks for the core rendering kernels
+ * @author Alexei Czornyj
+ * @date 2025
+ *
+ * Times Sphere::hit, Scene::hit at several scene sizes (also with compact
+ * leaves, as ray packets, instanced versus flattened, and a linear scan
+ * with heavy overlap along the rays),
+ * Camera::get_ray, PCG32 and the samplers, ray_color per recursion depth,
+ * with many lights and with an area light, a Wavefront batch, image output
+ * and scene loading. Every benchmark is calibrated to run for at least
+ * --min-time per repetition, warmed up once, then repeated --repetitions
+ * times; ns/op statistics and item throughput are printed and optionally
+ * written as JSON for regression tracking.
+ *
+ * Usage: kestrel_bench [--json FILE] [--filter SUBSTRING]
+ *                      [--repetitions N] [--min-time MS]
+ */
+
+#include "bvh.h"
+#include "bsdfs/lambertian.h"
+#include "camera.h"
+#include "default_scene.h"
+#include "fast_math.h"
+#include "image.h"
+#include "instance.h"
+#include "mesh.h"
+#include "mesh_file.h"
+#include "pcg32.h"
+#include "ray_packet.h"
+#include "renderer.h"
+#include "sampler.h"
+#include "scene.h"
+#include "scene_file.h"
+#include "sphere.h"
+#include "sphere_soa.h"
+#include "wavefront.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+/// Results are folded into this so the compiler cannot drop the work
+volatile float sink = 0.0f;
+
+struct BenchOptions {
+  std::string json_path;
+  std::string filter;
+  int repetitions = 5;
+  double min_time_ms = 100.0;
+};
+
+struct BenchResult {
+  std::string name;
+  std::string item; ///< What items_per_second counts ("rays", "ops", ...)
+  uint64_t iterations = 0;
+  std::vector<double> ns_per_op; ///< One entry per repetition
+  double mean = 0, median = 0, min = 0, max = 0, stddev = 0;
+  double items_per_second = 0;
+};
+
+/**
+ * Runs benchmarks and collects their statistics. A benchmark is a callable
+ * `void(uint64_t n)` that performs n operations, each worth items_per_op
+ * items.
+ */
+class BenchRunner {
+public:
+  explicit BenchRunner(const BenchOptions &options) : options(options) {}
+
+  void run(const std::string &name, const std::string &item,
+           double items_per_op, const std::function<void(uint64_t)> &fn) {
+    if (!options.filter.empty() && name.find(options.filter) == std::string::npos)
+      return;
+
+    // Calibrate: double n until one batch takes a tenth of the target time
+    uint64_t n = 1;
+    double ms = time_ms(fn, n);
+    while (ms < options.min_time_ms / 10.0 && n < (1ull << 40)) {
+      n *= 2;
+      ms = time_ms(fn, n);
+    }
+    n = std::max<uint64_t>(
+        1, static_cast<uint64_t>(n * options.min_time_ms / std::max(ms, 1e-6)));
+
+    time_ms(fn, n); // Warmup at full batch size
+
+    BenchResult result;
+    result.name = name;
+    result.item = item;
+    result.iterations = n;
+    for (int r = 0; r < options.repetitions; ++r)
+      result.ns_per_op.push_back(time_ms(fn, n) * 1e6 / n);
+
+    std::vector<double> sorted = result.ns_per_op;
+    std::sort(sorted.begin(), sorted.end());
+    size_t count = sorted.size();
+    result.min = sorted.front();
+    result.max = sorted.back();
+    result.median = count % 2 ? sorted[count / 2]
+                              : 0.5 * (sorted[count / 2 - 1] + sorted[count / 2]);
+    for (double v : sorted)
+      result.mean += v / count;
+    for (double v : sorted)
+      result.stddev += (v - result.mean) * (v - result.mean) / count;
+    result.stddev = std::sqrt(result.stddev);
+    result.items_per_second = items_per_op * 1e9 / result.median;
+
+    std::cout << std::left << std::setw(28) << name << std::right
+              << std::setw(16) << std::fixed << std::setprecision(2)
+              << result.median << " ns/op  +-" << std::setw(12)
+              << result.stddev << "  " << std::setw(12) << std::setprecision(3)
+              << result.items_per_second / 1e6 << " M " << item << "/s\n";
+    results.push_back(result);
+  }
+
+  bool write_json(const std::string &path) const {
+    std::ofstream out(path);
+    if (!out)
+      return false;
+    out << std::setprecision(6);
+    out << "{\n  \"context\": {\"simd\": \"" << sphere_kernels().name
+        << "\", \"repetitions\": " << options.repetitions
+        << ", \"min_time_ms\": " << options.min_time_ms << "},\n";
+    out << "  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+      const BenchResult &r = results[i];
+      out << "    {\"name\": \"" << r.name << "\", \"iterations\": "
+          << r.iterations << ", \"repetitions\": " << r.ns_per_op.size()
+          << ", \"ns_per_op\": {\"mean\": " << r.mean
+          << ", \"median\": " << r.median << ", \"min\": " << r.min
+          << ", \"max\": " << r.max << ", \"stddev\": " << r.stddev
+          << "}, \"item\": \"" << r.item
+          << "\", \"items_per_second\": " << r.items_per_second << "}"
+          << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+    return static_cast<bool>(out);
+  }
+
+private:
+  BenchOptions options;
+  std::vector<BenchResult> results;
+
+  static double time_ms(const std::function<void(uint64_t)> &fn, uint64_t n) {
+    auto start = std::chrono::steady_clock::now();
+    fn(n);
+    return std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+  }
+};
+
+Camera make_camera() {
+  return Camera(Point3(0, 0, 0), Point3(0, 0, -1), Vec3(0, 1, 0), 45.0f,
+                16.0f / 9.0f);
+}
+
+/// Random rays from the origin region into the -z half space
+std::vector<Ray> make_rays(size_t count, PCG32 &rng) {
+  std::vector<Ray> rays;
+  rays.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    Vec3 dir(rng.next_float() - 0.5f, rng.next_float() - 0.5f,
+             -1.0f + 0.2f * rng.next_float());
+    rays.emplace_back(Point3(0.0f), dir);
+  }
+  return rays;
+}
+
+/// Camera rays through random PACKET_EDGE x PACKET_EDGE blocks of a
+/// 1024x576 image, one packet per block
+std::vector<RayPacket> make_packets(size_t count, const Camera &camera,
+                                    PCG32 &rng) {
+  const int width = 1024, height = 576;
+  std::vector<RayPacket> packets(count);
+  for (RayPacket &packet : packets) {
+    int x0 = static_cast<int>(rng.next_float() * (width - PACKET_EDGE));
+    int y0 = static_cast<int>(rng.next_float() * (height - PACKET_EDGE));
+    packet.reset(camera.get_ray(0.0f, 0.0f).origin);
+    for (int j = 0; j < PACKET_EDGE; ++j)
+      for (int i = 0; i < PACKET_EDGE; ++i)
+        packet.add(camera
+                       .get_ray((x0 + i + 0.5f) / width,
+                                (y0 + j + 0.5f) / height)
+                       .direction);
+  }
+  return packets;
+}
+
+/// Scene of count random spheres in a 100-unit box in front of the camera
+void add_random_spheres(Scene &scene, size_t count, uint32_t material,
+                        PCG32 &rng) {
+  float radius = 20.0f / std::cbrt(static_cast<float>(count));
+  for (size_t i = 0; i < count; ++i) {
+    Point3 center(rng.next_float() * 100.0f - 50.0f,
+                  rng.next_float() * 100.0f - 50.0f,
+                  -rng.next_float() * 100.0f - 1.0f);
+    scene.add_object(Sphere(center, radius * (0.5f + rng.next_float()),
+                            material));
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  BenchOptions options;
+  for (int a = 1; a < argc; ++a) {
+    std::string arg = argv[a];
+    if (arg == "--json" && a + 1 < argc) {
+      options.json_path = argv[++a];
+    } else if (arg == "--filter" && a + 1 < argc) {
+      options.filter = argv[++a];
+    } else if (arg == "--repetitions" && a + 1 < argc) {
+      options.repetitions = std::max(1, std::stoi(argv[++a]));
+    } else if (arg == "--min-time" && a + 1 < argc) {
+      options.min_time_ms = std::max(1.0, std::stod(argv[++a]));
+    } else {
+      std::cerr << "Usage: " << argv[0]
+                << " [--json FILE] [--filter SUBSTRING] [--repetitions N]"
+                   " [--min-time MS]\n";
+      return 1;
+    }
+  }
+
+  std::cout << "SIMD: " << sphere_kernels().name << ", " << options.repetitions
+            << " repetitions of >= " << options.min_time_ms << " ms\n";
+  BenchRunner runner(options);
+  PCG32 rng(1234);
+  const size_t ray_mask = 4095;
+  std::vector<Ray> rays = make_rays(ray_mask + 1, rng);
+  Camera camera = make_camera();
+  std::vector<RayPacket> packets = make_packets(64, camera, rng);
+
+  // Sphere::hit: a single sphere that roughly half of the rays hit
+  {
+    Sphere sphere(Point3(0, 0, -5), 1.5f);
+    runner.run("sphere_hit", "rays", 1.0, [&](uint64_t n) {
+      float acc = 0.0f;
+      for (uint64_t i = 0; i < n; ++i) {
+        HitRecord rec;
+        if (sphere.hit(rays[i & ray_mask], 0.001f, 1000.0f, rec))
+          acc += rec.t;
+      }
+      sink = sink + acc;
+    });
+  }
+
+  // Scene::hit and Scene::occluded over the BVH at several scene sizes
+  for (size_t count : {10, 1000, 100000}) {
+    Scene scene(camera);
+    uint32_t material = scene.materials.add(Lambertian(Color(0.5f)));
+    add_random_spheres(scene, count, material, rng);
+    std::string suffix = "/" + std::to_string(count);
+
+    runner.run("bvh_build" + suffix, "spheres", static_cast<double>(count),
+               [&](uint64_t n) {
+                 for (uint64_t i = 0; i < n; ++i)
+                   scene.build_bvh();
+               });
+
+    runner.run("scene_hit" + suffix, "rays", 1.0, [&](uint64_t n) {
+      float acc = 0.0f;
+      for (uint64_t i = 0; i < n; ++i) {
+        HitRecord rec;
+        if (scene.hit(rays[i & ray_mask], 0.001f, 1000.0f, rec))
+          acc += rec.t;
+      }
+      sink = sink + acc;
+    });
+
+    runner.run("scene_occluded" + suffix, "rays", 1.0, [&](uint64_t n) {
+      int acc = 0;
+      for (uint64_t i = 0; i < n; ++i)
+        acc += scene.occluded(rays[i & ray_mask], 0.001f, 1000.0f);
+      sink = sink + static_cast<float>(acc);
+    });
+
+    // Camera rays of pixel blocks, one by one and as packets
+    const size_t packet_mask = 63;
+    runner.run("scene_hit/block" + suffix, "rays", RayPacket::MAX_RAYS,
+               [&](uint64_t n) {
+                 float acc = 0.0f;
+                 for (uint64_t i = 0; i < n; ++i) {
+                   const RayPacket &packet = packets[i & packet_mask];
+                   for (int r = 0; r < packet.count; ++r) {
+                     HitRecord rec;
+                     if (scene.hit(packet.ray(r), 0.001f, 1000.0f, rec))
+                       acc += rec.t;
+                   }
+                 }
+                 sink = sink + acc;
+               });
+    runner.run("scene_hit/packet" + suffix, "rays", RayPacket::MAX_RAYS,
+               [&](uint64_t n) {
+                 float acc = 0.0f;
+                 HitRecord recs[RayPacket::MAX_RAYS];
+                 bool hits[RayPacket::MAX_RAYS];
+                 for (uint64_t i = 0; i < n; ++i)
+                   acc += static_cast<float>(
+                       scene.hit_packet(packets[i & packet_mask], 0.001f,
+                                        1000.0f, recs, hits));
+                 sink = sink + acc;
+               });
+
+    // The same queries against quantized leaves
+    scene.compact_leaves = true;
+    scene.build_bvh();
+    runner.run("scene_hit/compact" + suffix, "rays", 1.0, [&](uint64_t n) {
+      float acc = 0.0f;
+      for (uint64_t i = 0; i < n; ++i) {
+        HitRecord rec;
+        if (scene.hit(rays[i & ray_mask], 0.001f, 1000.0f, rec))
+          acc += rec.t;
+      }
+      sink = sink + acc;
+    });
+  }
+
+  // Instancing: a cluster of 64 spheres placed 1000 times, as instances of
+  // one geometry block versus flattened into 64000 scene spheres
+  {
+    const int cluster = 64, copies = 1000;
+    GeometryBlock block;
+    for (int i = 0; i < cluster; ++i)
+      block.spheres.emplace_back(Point3(rng.next_float() * 2.0f - 1.0f,
+                                        rng.next_float() * 2.0f - 1.0f,
+                                        rng.next_float() * 2.0f - 1.0f),
+                                 0.15f + 0.1f * rng.next_float(), 0);
+    std::vector<Transform> placements;
+    for (int c = 0; c < copies; ++c)
+      placements.push_back(
+          Transform::rotation(Vec3(0, 1, 0), rng.next_float() * 360.0f)
+              .then(Transform::translation(
+                  Vec3(rng.next_float() * 100.0f - 50.0f,
+                       rng.next_float() * 100.0f - 50.0f,
+                       -rng.next_float() * 100.0f - 2.0f))));
+
+    Scene instanced(camera);
+    instanced.materials.add(Lambertian(Color(0.5f)));
+    uint32_t geometry = instanced.add_geometry(block);
+    for (const Transform &placement : placements)
+      instanced.add_instance(geometry, placement);
+    Scene flat(camera);
+    flat.materials.add(Lambertian(Color(0.5f)));
+    for (const Transform &placement : placements)
+      for (const Sphere &sphere : block.spheres)
+        flat.add_object(Sphere(placement.point(sphere.center), sphere.radius,
+                               sphere.material));
+
+    const double spheres = static_cast<double>(cluster) * copies;
+    for (Scene *scene : {&instanced, &flat}) {
+      const std::string suffix =
+          scene == &instanced ? "/instanced" : "/flattened";
+      runner.run("bvh_build" + suffix, "spheres", spheres, [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i)
+          scene->build_bvh();
+      });
+      runner.run("scene_hit" + suffix, "rays", 1.0, [&](uint64_t n) {
+        float acc = 0.0f;
+        for (uint64_t i = 0; i < n; ++i) {
+          HitRecord rec;
+          if (scene->hit(rays[i & ray_mask], 0.001f, 1000.0f, rec))
+            acc += rec.t;
+        }
+        sink = sink + acc;
+      });
+    }
+  }
+
+  // Triangle meshes: a tessellated sphere of about 100k triangles in front
+  // of the camera, traced through its BVH and loaded from OBJ and binary PLY
+  {
+    const int segments = 224, rings = 224;
+    TriangleMesh mesh;
+    for (int r = 0; r <= rings; ++r) {
+      const float theta = 3.14159265f * r / rings;
+      for (int s = 0; s < segments; ++s) {
+        const float phi = 2.0f * 3.14159265f * s / segments;
+        mesh.vertices.push_back(
+            Point3(0, 0, -3) + 1.2f * Vec3(std::sin(theta) * std::cos(phi),
+                                           std::cos(theta),
+                                           std::sin(theta) * std::sin(phi)));
+      }
+    }
+    for (int r = 0; r < rings; ++r) {
+      for (int s = 0; s < segments; ++s) {
+        const uint32_t a = r * segments + s;
+        const uint32_t b = r * segments + (s + 1) % segments;
+        const uint32_t c = a + segments, d = b + segments;
+        mesh.indices.insert(mesh.indices.end(), {a, c, b, b, c, d});
+      }
+    }
+    const double triangles = static_cast<double>(mesh.triangle_count());
+
+    runner.run("bvh_build/mesh", "triangles", triangles, [&](uint64_t n) {
+      for (uint64_t i = 0; i < n; ++i)
+        mesh.build();
+    });
+    Scene scene(camera);
+    scene.materials.add(Lambertian(Color(0.5f)));
+    scene.add_mesh(mesh);
+    scene.build_bvh();
+    runner.run("scene_hit/mesh", "rays", 1.0, [&](uint64_t n) {
+      float acc = 0.0f;
+      for (uint64_t i = 0; i < n; ++i) {
+        HitRecord rec;
+        if (scene.hit(rays[i & ray_mask], 0.001f, 1000.0f, rec))
+          acc += rec.t;
+      }
+      sink = sink + acc;
+    });
+    runner.run("scene_occluded/mesh", "rays", 1.0, [&](uint64_t n) {
+      int blocked = 0;
+      for (uint64_t i = 0; i < n; ++i)
+        blocked += scene.occluded(rays[i & ray_mask], 0.001f, 1000.0f);
+      sink = sink + static_cast<float>(blocked);
+    });
+
+    const char *obj_path = "kestrel_bench_mesh.obj";
+    const char *ply_path = "kestrel_bench_mesh.ply";
+    {
+      std::ofstream obj(obj_path);
+      for (const Point3 &v : mesh.vertices)
+        obj << "v " << v.x << " " << v.y << " " << v.z << "\n";
+      for (size_t i = 0; i < mesh.indices.size(); i += 3)
+        obj << "f " << mesh.indices[i] + 1 << " " << mesh.indices[i + 1] + 1
+            << " " << mesh.indices[i + 2] + 1 << "\n";
+      // Written on an x86 (little-endian) host
+      std::ofstream ply(ply_path, std::ios::binary);
+      ply << "ply\nformat binary_little_endian 1.0\nelement vertex "
+          << mesh.vertices.size()
+          << "\nproperty float x\nproperty float y\nproperty float z\n"
+          << "element face " << mesh.triangle_count()
+          << "\nproperty list uchar uint vertex_indices\nend_header\n";
+      ply.write(reinterpret_cast<const char *>(mesh.vertices.data()),
+                mesh.vertices.size() * sizeof(Point3));
+      for (size_t i = 0; i < mesh.indices.size(); i += 3) {
+        const unsigned char corners = 3;
+        ply.write(reinterpret_cast<const char *>(&corners), 1);
+        ply.write(reinterpret_cast<const char *>(&mesh.indices[i]),
+                  3 * sizeof(uint32_t));
+      }
+    }
+    std::string error;
+    for (const char *path : {obj_path, ply_path}) {
+      const std::string name =
+          path == obj_path ? "mesh_load/obj" : "mesh_load/ply";
+      runner.run(name, "triangles", triangles, [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) {
+          TriangleMesh loaded;
+          load_mesh(path, loaded, error);
+          sink = sink + static_cast<float>(loaded.triangle_count());
+        }
+      });
+    }
+    std::remove(obj_path);
+    std::remove(ply_path);
+  }
+
+  // Scene::hit with heavy overlap: without a BVH, rays run down a column of
+  // spheres stored far to near, so each sphere becomes the closest hit in
+  // turn. "eager" is the former loop that filled a HitRecord for every
+  // candidate; "deferred" is Scene::hit, which finalizes only the winner.
+  {
+    const int depth = 64;
+    Scene scene(camera);
+    uint32_t material = scene.materials.add(Lambertian(Color(0.5f)));
+    for (int i = 0; i < depth; ++i)
+      scene.add_object(
+          Sphere(Point3(0, 0, -2.0f - 2.0f * (depth - i)), 1.0f, material));
+    std::vector<Ray> column_rays;
+    column_rays.reserve(ray_mask + 1);
+    for (size_t i = 0; i <= ray_mask; ++i)
+      column_rays.emplace_back(Point3(0.5f * rng.next_float() - 0.25f,
+                                      0.5f * rng.next_float() - 0.25f, 0.0f),
+                               Vec3(0, 0, -1));
+    std::string prefix = "scene_hit/overlap=" + std::to_string(depth);
+
+    runner.run(prefix + "/eager", "rays", 1.0, [&](uint64_t n) {
+      float acc = 0.0f;
+      for (uint64_t i = 0; i < n; ++i) {
+        const Ray &ray = column_rays[i & ray_mask];
+        HitRecord rec;
+        float closest = 1000.0f;
+        bool hit_anything = false;
+        for (const Sphere &sphere : scene.objects) {
+          if (sphere.hit(ray, 0.001f, closest, rec)) {
+            hit_anything = true;
+            closest = rec.t;
+          }
+        }
+        if (hit_anything)
+          acc += rec.normal.z;
+      }
+      sink = sink + acc;
+    });
+    runner.run(prefix + "/deferred", "rays", 1.0, [&](uint64_t n) {
+      float acc = 0.0f;
+      for (uint64_t i = 0; i < n; ++i) {
+        HitRecord rec;
+        if (scene.hit(column_rays[i & ray_mask], 0.001f, 1000.0f, rec))
+          acc += rec.normal.z;
+      }
+      sink = sink + acc;
+    });
+  }
+
+  runner.run("camera_get_ray", "rays", 1.0, [&](uint64_t n) {
+    float acc = 0.0f;
+    float step = 1.0f / 4096.0f;
+    for (uint64_t i = 0; i < n; ++i) {
+      float u = (i & 4095) * step;
+      Ray ray = camera.get_ray(u, 1.0f - u);
+      acc += ray.direction.x;
+    }
+    sink = sink + acc;
+  });
+
+  runner.run("pcg32_next", "numbers", 1.0, [&](uint64_t n) {
+    uint32_t acc = 0;
+    for (uint64_t i = 0; i < n; ++i)
+      acc ^= rng.next();
+    sink = sink + static_cast<float>(acc);
+  });
+
+  // Camera sample (start a pixel sample, draw its two dimensions) per
+  // sampler type, continuing one stream and with per-pixel seeds
+  for (SamplerType type : {SamplerType::RANDOM, SamplerType::HALTON,
+                           SamplerType::SOBOL, SamplerType::ZSOBOL}) {
+    for (bool pixel_seeds : {false, true}) {
+      Sampler sampler(42, 0, type);
+      sampler.set_resolution(1920, 1080, 16);
+      sampler.set_pixel_seeds(pixel_seeds);
+      runner.run(std::string("sampler/") + sampler_type_name(type) +
+                     (pixel_seeds ? "/pixel_seeds" : ""),
+                 "samples", 1.0, [&](uint64_t n) {
+                   float acc = 0.0f;
+                   for (uint64_t i = 0; i < n; ++i) {
+                     sampler.start_pixel_sample(
+                         {static_cast<uint32_t>(i >> 4) % 1920,
+                          static_cast<uint32_t>(i >> 4) / 1920 % 1080,
+                          static_cast<uint32_t>(i & 15)});
+                     acc += sampler.next_1d() + sampler.next_1d();
+                   }
+                   sink = sink + acc;
+                 });
+    }
+  }
+
+  // Fast math: accuracy of the fast variants against double precision, then
+  // normalize and sincos over arrays in both variants
+  {
+    const size_t count = 1024;
+    std::vector<Vec3> vectors(count);
+    std::vector<float> angles(count);
+    for (size_t i = 0; i < count; ++i) {
+      vectors[i] = Vec3(rng.next_float() * 2.0f - 1.0f,
+                        rng.next_float() * 2.0f - 1.0f,
+                        rng.next_float() * 2.0f - 1.0f) *
+                   (0.01f + rng.next_float() * 100.0f);
+      angles[i] = rng.next_float() * 6.28318531f;
+    }
+
+    // Reported whenever one of the math/ benchmarks below runs
+    const char *math_names[] = {"math/normalize/precise", "math/normalize/fast",
+                                "math/sincos/precise", "math/sincos/fast"};
+    bool report = false;
+    for (const char *name : math_names)
+      report |= std::string(name).find(options.filter) != std::string::npos;
+    if (report) {
+      double rsqrt_error[2] = {0, 0}, length_error[2] = {0, 0};
+      double sin_error[2] = {0, 0}, cos_error[2] = {0, 0};
+      for (size_t i = 0; i < count; ++i) {
+        const float len2 = vectors[i].length_squared();
+        const double exact = 1.0 / std::sqrt(static_cast<double>(len2));
+        const float rsqrt[2] = {precise_rsqrt(len2), fast_rsqrt(len2)};
+        float s[2], c[2];
+        precise_sincos(angles[i], s[0], c[0]);
+        fast_sincos(angles[i], s[1], c[1]);
+        for (int v = 0; v < 2; ++v) {
+          const Vec3 unit = vectors[i] * rsqrt[v];
+          rsqrt_error[v] = std::max(rsqrt_error[v],
+                                    std::fabs(rsqrt[v] - exact) / exact);
+          length_error[v] = std::max(
+              length_error[v],
+              std::fabs(std::sqrt(static_cast<double>(unit.length_squared())) -
+                        1.0));
+          sin_error[v] = std::max(
+              sin_error[v], std::fabs(s[v] - std::sin(double(angles[i]))));
+          cos_error[v] = std::max(
+              cos_error[v], std::fabs(c[v] - std::cos(double(angles[i]))));
+        }
+      }
+      std::cout << std::scientific << std::setprecision(2)
+                << "Math (" << (FAST_MATH ? "fast" : "precise")
+                << " in shading), max error precise / fast: rsqrt "
+                << rsqrt_error[0] << " / " << rsqrt_error[1] << " (relative), "
+                << "unit length " << length_error[0] << " / "
+                << length_error[1] << ", sin " << sin_error[0] << " / "
+                << sin_error[1] << ", cos " << cos_error[0] << " / "
+                << cos_error[1] << "\n";
+    }
+
+    std::vector<Vec3> units(count);
+    // One operation normalizes (or turns into sin and cos) the whole array
+    auto normalize_all = [&](uint64_t n, auto rsqrt) {
+      for (uint64_t i = 0; i < n; ++i)
+        for (size_t j = 0; j < count; ++j)
+          units[j] = vectors[j] * rsqrt(vectors[j].length_squared());
+      sink = sink + units[0].x;
+    };
+    runner.run("math/normalize/precise", "vectors", count, [&](uint64_t n) {
+      normalize_all(n, precise_rsqrt);
+    });
+    runner.run("math/normalize/fast", "vectors", count, [&](uint64_t n) {
+      normalize_all(n, fast_rsqrt);
+    });
+
+    std::vector<float> sines(count), cosines(count);
+    auto sincos_all = [&](uint64_t n, auto sincos) {
+      for (uint64_t i = 0; i < n; ++i)
+        for (size_t j = 0; j < count; ++j)
+          sincos(angles[j], sines[j], cosines[j]);
+      sink = sink + sines[0] + cosines[0];
+    };
+    runner.run("math/sincos/precise", "angles", count, [&](uint64_t n) {
+      sincos_all(n, precise_sincos);
+    });
+    runner.run("math/sincos/fast", "angles", count, [&](uint64_t n) {
+      sincos_all(n, fast_sincos);
+    });
+  }
+
+  // ray_color on the built-in scene, per maximum recursion depth
+  {
+    Scene scene(camera);
+    populate_default_scene(scene);
+    scene.build_bvh();
+    std::vector<Ray> camera_rays;
+    for (size_t i = 0; i <= ray_mask; ++i)
+      camera_rays.push_back(camera.get_ray(rng.next_float(), rng.next_float()));
+    Sampler sampler(42, 0);
+
+    for (int depth : {1, 2, 4, 10}) {
+      runner.run("ray_color/depth=" + std::to_string(depth), "rays", 1.0,
+                 [&](uint64_t n) {
+                   float acc = 0.0f;
+                   for (uint64_t i = 0; i < n; ++i)
+                     acc += ray_color(camera_rays[i & ray_mask], scene,
+                                      sampler, depth)
+                                .x;
+                   sink = sink + acc;
+                 });
+    }
+
+    // Many lights: shading every light versus a few importance-sampled ones
+    Scene many_lights(camera);
+    populate_default_scene(many_lights);
+    for (int l = 0; l < 200; ++l)
+      many_lights.add_light(Light(Vec3(rng.next_float() * 4.0f - 2.0f,
+                                       rng.next_float() * 4.0f - 2.0f,
+                                       -rng.next_float() * 4.0f - 1.0f),
+                                  Vec3(0.05f)));
+    many_lights.build_bvh();
+    const std::string lights_suffix =
+        "/lights=" + std::to_string(many_lights.lights.size());
+    for (int light_samples : {0, 2}) {
+      runner.run("ray_color" + lights_suffix +
+                     (light_samples > 0
+                          ? "/sampled=" + std::to_string(light_samples)
+                          : std::string("/all")),
+                 "rays", 1.0, [&](uint64_t n) {
+                   float acc = 0.0f;
+                   for (uint64_t i = 0; i < n; ++i)
+                     acc += ray_color(camera_rays[i & ray_mask], many_lights,
+                                      sampler, MAX_BOUNCES, light_samples)
+                                .x;
+                   sink = sink + acc;
+                 });
+    }
+
+    // A rectangular area light over the scene, per shadow samples per hit
+    Scene area_light(camera);
+    populate_default_scene(area_light);
+    area_light.add_light(Light::rect(Vec3(-0.5f, 1.5f, -1.5f),
+                                     Vec3(1.0f, 0.0f, 0.0f),
+                                     Vec3(0.0f, 0.0f, 1.0f), Vec3(2.0f)));
+    area_light.build_bvh();
+    for (int samples : {1, 4, 16}) {
+      area_light.lights.back().samples = samples;
+      runner.run("ray_color/area_light/samples=" + std::to_string(samples),
+                 "rays", 1.0, [&](uint64_t n) {
+                   float acc = 0.0f;
+                   for (uint64_t i = 0; i < n; ++i)
+                     acc += ray_color(camera_rays[i & ray_mask], area_light,
+                                      sampler)
+                                .x;
+                   sink = sink + acc;
+                 });
+    }
+
+    // The same rays traced breadth-first, one tile-sized batch at a time
+    Wavefront wavefront;
+    const uint64_t batch = 1024;
+    runner.run("wavefront/batch=" + std::to_string(batch), "rays", batch,
+               [&](uint64_t n) {
+                 float acc = 0.0f;
+                 for (uint64_t b = 0; b < n; ++b) {
+                   wavefront.clear();
+                   for (uint64_t i = 0; i < batch; ++i)
+                     wavefront.add_path(camera_rays[(b * batch + i) & ray_mask]);
+                   wavefront.trace(scene, sampler);
+                   acc += wavefront.radiance()[0].x;
+                 }
+                 sink = sink + acc;
+               });
+  }
+
+  // Image output of a 1920x1080 buffer
+  {
+    const int width = 1920, height = 1080;
+    std::vector<Color> pixels(static_cast<size_t>(width) * height);
+    for (auto &p : pixels)
+      p = Color(rng.next_float(), rng.next_float(), rng.next_float());
+    const char *path = "kestrel_bench_output.tmp";
+    double pixel_count = static_cast<double>(width) * height;
+
+    runner.run("write_ppm/p6", "pixels", pixel_count, [&](uint64_t n) {
+      for (uint64_t i = 0; i < n; ++i)
+        write_ppm(path, pixels, width, height, ImageFormat::PPM_BINARY);
+    });
+    runner.run("write_ppm/p3", "pixels", pixel_count, [&](uint64_t n) {
+      for (uint64_t i = 0; i < n; ++i)
+        write_ppm(path, pixels, width, height, ImageFormat::PPM_ASCII);
+    });
+    runner.run("write_pfm", "pixels", pixel_count, [&](uint64_t n) {
+      for (uint64_t i = 0; i < n; ++i)
+        write_pfm(path, pixels, width, height);
+    });
+    std::remove(path);
+  }
+
+  // Scene loading: 100k spheres from text and from a binary cache with BVH
+  {
+    const size_t count = 100000;
+    Scene source(camera);
+    uint32_t material = source.materials.add(Lambertian(Color(0.5f)));
+    add_random_spheres(source, count, material, rng);
+    source.build_bvh();
+    const char *text_path = "kestrel_bench_scene.tmp";
+    const char *cache_path = "kestrel_bench_cache.tmp";
+    {
+      std::ofstream text(text_path);
+      text << "material m lambertian 0.5 0.5 0.5\n";
+      for (const Sphere &sphere : source.objects)
+        text << "sphere " << sphere.center.x << " " << sphere.center.y << " "
+             << sphere.center.z << " " << sphere.radius << " m\n";
+    }
+    SceneCamera view;
+    std::string error;
+    write_scene_cache(cache_path, source, view, error);
+
+    Scene scene(camera);
+    runner.run("scene_load/text", "spheres", static_cast<double>(count),
+               [&](uint64_t n) {
+                 for (uint64_t i = 0; i < n; ++i)
+                   load_scene(text_path, scene, view, error);
+               });
+    runner.run("scene_load/cache", "spheres", static_cast<double>(count),
+               [&](uint64_t n) {
+                 for (uint64_t i = 0; i < n; ++i)
+                   load_scene(cache_path, scene, view, error);
+               });
+    std::remove(text_path);
+    std::remove(cache_path);
+  }
+
+  if (!options.json_path.empty()) {
+    if (!runner.write_json(options.json_path)) {
+      std::cerr << "Failed to write " << options.json_path << "\n";
+      return 1;
+    }
+    std::cout << "Results written to " << options.json_path << "\n";
+  }
+  return 0;
+}
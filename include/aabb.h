@@ -0,0 +1,119 @@
+/**
+ * @file aabb.h
+ * @brief Axis-aligned bounding box used by acceleration structures
+ * @author Alexei Czornyj
+ * @date 2025
+ */
+
+#ifndef AABB_H
+#define AABB_H
+
+#include "ray.h"
+#include "vec3.h"
+#include <algorithm>
+#include <limits>
+
+/**
+ * @struct AABB
+ * @brief Axis-aligned bounding box defined by its min and max corners
+ *
+ * A default-constructed box is empty (min = +inf, max = -inf) so that growing
+ * it by any point or box yields exactly that point or box.
+ */
+struct AABB {
+  Point3 min; ///< Minimum corner
+  Point3 max; ///< Maximum corner
+
+  /**
+   * @brief Construct an empty box
+   */
+  HOST_DEVICE AABB()
+      : min(std::numeric_limits<float>::infinity()),
+        max(-std::numeric_limits<float>::infinity()) {}
+
+  /**
+   * @brief Construct a box from its corners
+   * @param min Minimum corner
+   * @param max Maximum corner
+   */
+  HOST_DEVICE AABB(const Point3 &min, const Point3 &max) : min(min), max(max) {}
+
+  /**
+   * @brief Enlarge the box to contain a point
+   * @param p Point to include
+   */
+  HOST_DEVICE void grow(const Point3 &p) {
+    min = Vec3(std::min(min.x, p.x), std::min(min.y, p.y),
+               std::min(min.z, p.z));
+    max = Vec3(std::max(max.x, p.x), std::max(max.y, p.y),
+               std::max(max.z, p.z));
+  }
+
+  /**
+   * @brief Enlarge the box to contain another box
+   * @param b Box to include
+   */
+  HOST_DEVICE void grow(const AABB &b) {
+    min = Vec3(std::min(min.x, b.min.x), std::min(min.y, b.min.y),
+               std::min(min.z, b.min.z));
+    max = Vec3(std::max(max.x, b.max.x), std::max(max.y, b.max.y),
+               std::max(max.z, b.max.z));
+  }
+
+  /**
+   * @brief Test whether the box is empty
+   * @return True if no point has been added to the box
+   */
+  HOST_DEVICE bool empty() const { return min.x > max.x; }
+
+  /**
+   * @brief Get the center of the box
+   * @return Midpoint between min and max
+   */
+  HOST_DEVICE Point3 centroid() const { return (min + max) * 0.5f; }
+
+  /**
+   * @brief Get the edge lengths of the box
+   * @return max - min
+   */
+  HOST_DEVICE Vec3 extent() const { return max - min; }
+
+  /**
+   * @brief Surface area of the box, used by the SAH cost model
+   * @return Surface area (0 for an empty box)
+   */
+  HOST_DEVICE float surface_area() const {
+    if (empty())
+      return 0.0f;
+    Vec3 e = extent();
+    return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+  }
+
+  /**
+   * @brief Slab test against a ray
+   * @param ray Ray to test
+   * @param inv_dir Component-wise reciprocal of the ray direction
+   * @param t_min Minimum valid t parameter
+   * @param t_max Maximum valid t parameter
+   * @param t_entry Output parameter set to the entry distance on a hit
+   * @return True if the ray overlaps the box within [t_min, t_max]
+   */
+  HOST_DEVICE bool hit(const Ray &ray, const Vec3 &inv_dir, float t_min,
+                       float t_max, float &t_entry) const {
+    float tx0 = (min.x - ray.origin.x) * inv_dir.x;
+    float tx1 = (max.x - ray.origin.x) * inv_dir.x;
+    float ty0 = (min.y - ray.origin.y) * inv_dir.y;
+    float ty1 = (max.y - ray.origin.y) * inv_dir.y;
+    float tz0 = (min.z - ray.origin.z) * inv_dir.z;
+    float tz1 = (max.z - ray.origin.z) * inv_dir.z;
+
+    float t0 = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)),
+                        std::max(std::min(tz0, tz1), t_min));
+    float t1 = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)),
+                        std::min(std::max(tz0, tz1), t_max));
+    t_entry = t0;
+    return t0 <= t1;
+  }
+};
+
+#endif // AABB_H
@@ -0,0 +1,90 @@
+/**
+ * @file aligned_allocator.h
+ * @brief Standard allocator returning over-aligned storage
+ * @author Alexei Czornyj
+ * @date 2025
+ */
+
+#ifndef ALIGNED_ALLOCATOR_H
+#define ALIGNED_ALLOCATOR_H
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+/**
+ * @class AlignedAllocator
+ * @brief Allocator for std::vector whose storage starts on an Alignment
+ * boundary
+ * @tparam T Element type
+ * @tparam Alignment Required alignment in bytes (e.g. 64 for a cache line)
+ */
+template <typename T, std::size_t Alignment> class AlignedAllocator {
+public:
+  using value_type = T;
+
+  template <typename U> struct rebind {
+    using other = AlignedAllocator<U, Alignment>;
+  };
+
+  AlignedAllocator() noexcept = default;
+
+  template <typename U>
+  AlignedAllocator(const AlignedAllocator<U, Alignment> &) noexcept {}
+
+  T *allocate(std::size_t n) {
+    return static_cast<T *>(
+        ::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+  }
+
+  void deallocate(T *p, std::size_t) noexcept {
+    ::operator delete(p, std::align_val_t(Alignment));
+  }
+
+  template <typename U>
+  bool operator==(const AlignedAllocator<U, Alignment> &) const noexcept {
+    return true;
+  }
+
+  template <typename U>
+  bool operator!=(const AlignedAllocator<U, Alignment> &) const noexcept {
+    return false;
+  }
+};
+
+/**
+ * @class FirstTouchAllocator
+ * @brief AlignedAllocator that leaves elements a container default-constructs
+ * unconstructed
+ * @tparam T Element type (trivially destructible)
+ * @tparam Alignment Required alignment in bytes
+ *
+ * resize() then only reserves the memory, so the thread that will use the
+ * elements can construct them (and fault their pages in) itself.
+ */
+template <typename T, std::size_t Alignment>
+class FirstTouchAllocator : public AlignedAllocator<T, Alignment> {
+public:
+  template <typename U> struct rebind {
+    using other = FirstTouchAllocator<U, Alignment>;
+  };
+
+  FirstTouchAllocator() noexcept = default;
+
+  template <typename U>
+  FirstTouchAllocator(const FirstTouchAllocator<U, Alignment> &) noexcept {}
+
+  template <typename U> void construct(U *) noexcept {}
+
+  template <typename U, typename... Args>
+  void construct(U *p, Args &&...args) {
+    ::new (static_cast<void *>(p)) U(std::forward<Args>(args)...);
+  }
+};
+
+/// std::vector whose data() is aligned to a 64-byte cache line
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T, 64>>;
+
+#endif // ALIGNED_ALLOCATOR_H
@@ -0,0 +1,119 @@
+/**
+ * @file animation.h
+ * @brief Keyframed camera and object motion for frame sequences
+ * @author Alexei Czornyj
+ * @date 2025
+ *
+ * An animation moves the camera and translates ranges of spheres over a
+ * number of frames. Both are given as keyframes and interpolated linearly
+ * in between; before the first and after the last key the nearest key
+ * holds. Object motion is an offset from the position the sphere has in
+ * the scene, so the scene file stays the rest pose.
+ */
+
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include "scene.h"
+#include "scene_file.h"
+#include "vec3.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @struct CameraKey
+ * @brief Camera placement at one frame
+ */
+struct CameraKey {
+  int frame = 0;      ///< Frame the key applies to
+  Point3 look_from;   ///< Camera position
+  Point3 look_at;     ///< Point the camera looks at
+  float vfov = 45.0f; ///< Vertical field of view in degrees
+};
+
+/**
+ * @struct MotionKey
+ * @brief Offset of a range of spheres at one frame
+ */
+struct MotionKey {
+  int frame = 0; ///< Frame the key applies to
+  Vec3 offset;   ///< Translation from the rest position
+};
+
+/**
+ * @struct ObjectTrack
+ * @brief Keyframed translation of the spheres [first, first + count)
+ */
+struct ObjectTrack {
+  uint32_t first = 0;          ///< First sphere (index into Scene::objects)
+  uint32_t count = 0;          ///< Number of spheres moved together
+  std::vector<MotionKey> keys; ///< Keys in increasing frame order
+};
+
+/**
+ * @class Animation
+ * @brief Camera and object tracks of a frame sequence
+ */
+class Animation {
+public:
+  int frame_count = 1;                ///< Frames in the sequence
+  std::vector<CameraKey> camera_keys; ///< Keys in increasing frame order
+  std::vector<ObjectTrack> tracks;    ///< Object tracks
+
+  /**
+   * @brief Check the tracks against a scene and record its rest pose
+   * @param scene Scene the animation will be applied to
+   * @param error Set to a message on failure
+   * @return False if a track refers to spheres the scene does not have
+   */
+  bool bind(const Scene &scene, std::string &error);
+
+  /**
+   * @brief Check whether any sphere moves
+   * @return True if there are object tracks
+   */
+  bool moves_objects() const { return !tracks.empty(); }
+
+  /**
+   * @brief Camera placement at a frame
+   * @param frame Frame number
+   * @param rest Placement used when there are no camera keys (and for the
+   *        "up" direction)
+   * @return Interpolated placement
+   */
+  SceneCamera camera_at(int frame, const SceneCamera &rest) const;
+
+  /**
+   * @brief Move the tracked spheres to their positions at a frame
+   * @param frame Frame number
+   * @param scene Scene passed to bind()
+   *
+   * Only sphere centers change; call Scene::refit_bvh() afterwards.
+   */
+  void apply(int frame, Scene &scene) const;
+
+private:
+  /// Rest centers of the spheres of each track, recorded by bind()
+  std::vector<std::vector<Point3>> rest_centers;
+};
+
+/**
+ * @brief Load an animation file
+ * @param path Animation file
+ * @param animation Output animation
+ * @param error Set to a message with the line number on failure
+ * @return True on success
+ *
+ * One statement per line, '#' starts a comment:
+ *
+ *     frames <count>
+ *     camera <frame> <look_from> <look_at> <vfov>
+ *     move <first sphere> <sphere count> <frame> <offset>
+ *
+ * Every move line with the same sphere range adds a key to one track.
+ */
+bool load_animation(const std::string &path, Animation &animation,
+                    std::string &error);
+
+#endif // ANIMATION_H
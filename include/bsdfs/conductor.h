@@ -31,7 +31,7 @@ public:
    * @brief Construct a Conductor with specified albedo color
    * @param albedo Reflective color of the conductor surface
    */
-  HOST_DEVICE Conductor(Color albedo) : albedo(albedo), Material(1.0f) {}
+  HOST_DEVICE Conductor(Color albedo) : Material(1.0f), albedo(albedo) {}
 
   /**
    *  * @brief Generate a reflection direction
@@ -39,19 +39,27 @@ public:
    * @param rec Hit record with surface normal
    * @param attenuation Output color attenuation
    * @param scattered Output scattered ray
+   * @param sampler Sample source
    * @return True if scattering occurred
    *
    * Computes the perfect reflection direction based on the incoming ray
    * and the surface normal at the hit point.
    */
   HOST_DEVICE bool scatter(const Ray &incoming, const HitRecord &rec,
-                           Color &attenuation, Ray &scattered) const;
+                           Color &attenuation, Ray &scattered,
+                           Sampler &sampler) const;
 
   /**
    * @brief Get the color of the conductor
    * @return Albedo color
    */
-  HOST_DEVICE Color get_color() const;
+  HOST_DEVICE Color get_color() const { return albedo; }
+
+  /**
+   * @brief Get the albedo the conductor was constructed with
+   * @return Albedo color
+   */
+  HOST_DEVICE Color get_albedo() const { return albedo; }
 
 private:
   Color albedo;
@@ -9,6 +9,7 @@
 #define LAMBERTIAN_H
 
 #include "kestrel.h"
+#include "material.h"
 #include "ray.h"
 #include "vec3.h"
 
@@ -34,7 +35,9 @@ public:
    * Uses cosine-weighted hemisphere sampling to favor directions
    * closer to the normal, simulating Lambertian reflection.
    */
-  HOST_DEVICE Lambertian(Color albedo) : albedo(albedo), Material(0.0f) {}
+  HOST_DEVICE Lambertian(Color albedo)
+      : Material(0.0f), albedo(albedo),
+        color(albedo / 3.14159265358979323846f) {}
 
   /**
    * @brief Generate a diffuse scatter direction
@@ -42,19 +45,28 @@ public:
    * @param rec Hit record with surface normal
    * @param attenuation Output color attenuation
    * @param scattered Output scattered ray
+   * @param sampler Sample source
    * @return True if scattering occurred
    */
   HOST_DEVICE bool scatter(const Ray &incoming, const HitRecord &rec,
-                           Color &attenuation, Ray &scattered) const;
+                           Color &attenuation, Ray &scattered,
+                           Sampler &sampler) const;
 
   /**
    * @brief Get the color of the Lambertian material
-   * @return Albedo color normalized by pi
+   * @return Albedo color normalized by pi (precomputed)
    */
-  HOST_DEVICE Color get_color() const;
+  HOST_DEVICE Color get_color() const { return color; }
+
+  /**
+   * @brief Get the albedo the material was constructed with
+   * @return Albedo color (not normalized)
+   */
+  HOST_DEVICE Color get_albedo() const { return albedo; }
 
 private:
   Color albedo;
+  Color color; ///< albedo / pi, normalized for energy conservation
 };
 
 #endif
\ No newline at end of file
@@ -10,40 +10,28 @@
 
 #include "kestrel.h"
 #include "ray.h"
+#include "sampler.h"
 #include "vec3.h"
 
-class HitRecord;
 /**
  * @class Material
- * @brief Material base class for ray tracing
+ * @brief Data shared by every material type
+ *
+ * Materials are plain values kept in a MaterialTable (see
+ * material_table.h) and dispatched on their type tag instead of through
+ * virtual calls, so they can be copied to device memory unchanged. Every
+ * material type provides get_color() and scatter().
  */
 class Material {
 public:
   /**
    * @brief Default constructor
+   * @param reflectivity Fraction of light reflected as a mirror
    */
   HOST_DEVICE Material(float reflectivity = 0.0f)
       : reflectivity(reflectivity) {}
 
-  /**
-   * @brief Scatter an incoming ray
-   * @param incoming Incoming ray direction
-   * @param rec Hit record with surface normal
-   * @param attenuation Output color attenuation
-   * @param scattered Output scattered ray
-   * @return True if scattering occurred
-   */
-  HOST_DEVICE virtual bool scatter(const Ray &incoming, const HitRecord &rec,
-                                   Color &attenuation,
-                                   Ray &scattered) const = 0;
-
-  /**
-   * @brief Get the color of the material
-   * @return Material color
-   */
-  HOST_DEVICE virtual Color get_color() const = 0;
-
-  float reflectivity;
+  float reflectivity; ///< Fraction of light reflected as a mirror
 };
 
-#endif
\ No newline at end of file
+#endif
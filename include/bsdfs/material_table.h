@@ -0,0 +1,108 @@
+/**
+ * @file material_table.h
+ * @brief Contiguous storage and tag dispatch for scene materials
+ * @author Alexei Czornyj
+ * @date 2025
+ *
+ * Materials live by value in one table owned by the scene and are referred
+ * to by a 32-bit id (Sphere::material, HitRecord::material). The shading
+ * loops read the precomputed color and reflectivity arrays directly;
+ * scatter() dispatches on the variant's type tag with a switch.
+ */
+
+#ifndef MATERIAL_TABLE_H
+#define MATERIAL_TABLE_H
+
+#include "bsdfs/conductor.h"
+#include "bsdfs/lambertian.h"
+#include "kestrel.h"
+#include "ray.h"
+#include "sampler.h"
+#include "vec3.h"
+#include <cstdint>
+#include <variant>
+#include <vector>
+
+/// Any material a MaterialTable can hold
+using MaterialVariant = std::variant<Lambertian, Conductor>;
+
+/**
+ * @brief Type tag of a material (the index of its MaterialVariant
+ * alternative)
+ */
+enum class MaterialType : uint8_t {
+  LAMBERTIAN = 0, ///< Lambertian diffuse
+  CONDUCTOR = 1   ///< Perfect mirror
+};
+
+/**
+ * @class MaterialTable
+ * @brief Materials of a scene, addressed by id
+ */
+class MaterialTable {
+public:
+  /**
+   * @brief Append a material
+   * @param material Material to store (copied)
+   * @return Id of the material
+   */
+  uint32_t add(const MaterialVariant &material);
+
+  /**
+   * @brief Remove every material
+   */
+  void clear();
+
+  /**
+   * @brief Number of materials in the table
+   */
+  size_t size() const { return materials.size(); }
+
+  /**
+   * @brief Access a material
+   * @param id Material id returned by add()
+   */
+  const MaterialVariant &operator[](uint32_t id) const {
+    return materials[id];
+  }
+
+  /**
+   * @brief Type tag of a material
+   * @param id Material id returned by add()
+   */
+  MaterialType type(uint32_t id) const {
+    return static_cast<MaterialType>(materials[id].index());
+  }
+
+  /**
+   * @brief Color of a material (get_color(), evaluated when it was added)
+   * @param id Material id returned by add()
+   */
+  const Color &color(uint32_t id) const { return colors[id]; }
+
+  /**
+   * @brief Mirror reflectivity of a material
+   * @param id Material id returned by add()
+   */
+  float reflectivity(uint32_t id) const { return reflectivities[id]; }
+
+  /**
+   * @brief Scatter an incoming ray off a material
+   * @param id Material id returned by add()
+   * @param incoming Incoming ray direction
+   * @param rec Hit record with surface normal
+   * @param attenuation Output color attenuation
+   * @param scattered Output scattered ray
+   * @param sampler Sample source for stochastic BSDFs
+   * @return True if scattering occurred
+   */
+  bool scatter(uint32_t id, const Ray &incoming, const HitRecord &rec,
+               Color &attenuation, Ray &scattered, Sampler &sampler) const;
+
+private:
+  std::vector<MaterialVariant> materials;
+  std::vector<Color> colors;
+  std::vector<float> reflectivities;
+};
+
+#endif // MATERIAL_TABLE_H
@@ -0,0 +1,463 @@
+/**
+ * @file bvh.h
+ * @brief Bounding volume hierarchy over primitive bounding boxes
+ * @author Alexei Czornyj
+ * @date 2025
+ *
+ * The hierarchy is built with a binned surface area heuristic (SAH) and
+ * stored as a flat, depth-first array of 32-byte nodes. It only knows about
+ * primitive bounds; intersecting the primitives themselves is delegated to
+ * a leaf callback so the same structure can index any geometry type.
+ */
+
+#ifndef BVH_H
+#define BVH_H
+
+#include "aabb.h"
+#include "ray.h"
+#include "ray_packet.h"
+#include "vec3.h"
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/**
+ * @struct BVHNode
+ * @brief A single node of the flattened hierarchy (32 bytes)
+ *
+ * Interior nodes store the index of their left child; the right child is
+ * always stored right after it. Leaves store a range into
+ * BVH::prim_indices.
+ */
+struct BVHNode {
+  AABB bounds;         ///< Bounds of everything below this node
+  uint32_t left_first = 0; ///< Left child index (interior) or first primitive
+  uint32_t prim_count = 0; ///< Number of primitives (0 for interior nodes)
+
+  /**
+   * @brief Check whether this node is a leaf
+   * @return True if the node references primitives directly
+   */
+  HOST_DEVICE bool is_leaf() const { return prim_count > 0; }
+};
+
+/**
+ * @struct BVHStats
+ * @brief Summary of a built hierarchy, used for build-time reports
+ */
+struct BVHStats {
+  size_t node_count = 0;  ///< Total number of nodes
+  size_t leaf_count = 0;  ///< Number of leaf nodes
+  int max_depth = 0;      ///< Depth of the deepest leaf (root = 0)
+  size_t max_leaf = 0;    ///< Largest number of primitives in a leaf
+  float sah_cost = 0.0f;  ///< SAH cost of the whole tree
+  double build_ms = 0.0;  ///< Wall-clock build time in milliseconds
+};
+
+/**
+ * @struct TraversalStats
+ * @brief Work done by BVH queries, summed over many rays
+ */
+struct TraversalStats {
+  uint64_t nodes = 0;      ///< Nodes visited
+  uint64_t primitives = 0; ///< Primitives handed to the leaf callbacks
+};
+
+/**
+ * @class BVH
+ * @brief Binned-SAH bounding volume hierarchy with stack-based traversal
+ */
+class BVH {
+public:
+  std::vector<BVHNode> nodes;         ///< Flattened nodes, root at index 0
+  std::vector<uint32_t> prim_indices; ///< Primitive ids referenced by leaves
+
+  /// Maximum traversal stack depth; the builder never exceeds it
+  static constexpr int MAX_DEPTH = 64;
+
+  /**
+   * @brief Build the hierarchy over a set of primitive bounds
+   * @param prim_bounds Bounding box of each primitive, indexed by primitive id
+   * @param max_leaf_size Leaves larger than this are always split if possible
+   * @param leaf_batch Primitives tested together by one leaf intersection
+   *        (the SIMD width); the SAH charges one intersection per batch
+   */
+  void build(const std::vector<AABB> &prim_bounds, int max_leaf_size = 4,
+             int leaf_batch = 1);
+
+  /**
+   * @brief Adopt a previously built hierarchy (e.g. from a scene cache)
+   * @param tree Flattened nodes as produced by build()
+   * @param indices Primitive ids referenced by the leaves
+   * @param prim_count Number of primitives the ids refer to
+   * @param leaf_batch Leaf batch the tree was built for (for the SAH cost)
+   * @return True if the tree is well formed and was adopted; false leaves
+   *         the hierarchy empty
+   *
+   * Checks that every child and leaf range is in bounds, that children come
+   * after their parent and that no leaf is deeper than the traversal stack
+   * allows, so a corrupt file cannot make traversal read out of bounds.
+   */
+  bool assign(std::vector<BVHNode> tree, std::vector<uint32_t> indices,
+              size_t prim_count, int leaf_batch = 1);
+
+  /**
+   * @brief Update the node bounds after the primitives moved
+   * @param prim_bounds New bounding box of each primitive, same ids and
+   *        count as for build()
+   * @param leaf_batch Leaf batch the tree was built for (for the SAH cost)
+   *
+   * Keeps the topology and recomputes every box bottom-up in one pass over
+   * the nodes, which is far cheaper than a rebuild. The tree degrades as
+   * primitives drift away from the neighbours they were grouped with;
+   * stats().sah_cost tells when a rebuild pays off again. stats().build_ms
+   * is set to the refit time.
+   */
+  void refit(const std::vector<AABB> &prim_bounds, int leaf_batch = 1);
+
+  /**
+   * @brief Discard the hierarchy
+   */
+  void clear();
+
+  /**
+   * @brief Check whether the hierarchy has been built
+   * @return True if there are no nodes
+   */
+  bool empty() const { return nodes.empty(); }
+
+  /**
+   * @brief Statistics gathered during the last build
+   * @return Node counts, depth, SAH cost and build time
+   */
+  const BVHStats &stats() const { return build_stats; }
+
+  /**
+   * @brief Find the closest primitive hit along a ray
+   * @param ray The ray to trace
+   * @param t_min Minimum valid t parameter
+   * @param t_max In: maximum valid t parameter. Out: t of the closest hit
+   * @param intersect_leaf Callable `bool(const BVHNode &leaf, float t_min,
+   *        float &t_max)` that intersects the leaf primitives
+   *        prim_indices[leaf.left_first, leaf.left_first + leaf.prim_count)
+   *        and shrinks t_max when it finds a closer hit
+   * @param stats Optional counters the visited nodes and primitives are
+   *        added to
+   * @return True if any primitive was hit
+   *
+   * Children are visited front to back and subtrees whose entry distance is
+   * beyond the current closest hit are skipped.
+   */
+  template <typename LeafFn>
+  bool intersect(const Ray &ray, float t_min, float &t_max,
+                 LeafFn &&intersect_leaf,
+                 TraversalStats *stats = nullptr) const {
+    if (nodes.empty())
+      return false;
+
+    Vec3 inv_dir(1.0f / ray.direction.x, 1.0f / ray.direction.y,
+                 1.0f / ray.direction.z);
+
+    float t_entry;
+    if (!nodes[0].bounds.hit(ray, inv_dir, t_min, t_max, t_entry)) {
+      if (stats)
+        stats->nodes++;
+      return false;
+    }
+
+    std::pair<uint32_t, float> stack[MAX_DEPTH];
+    int stack_size = 0;
+    uint32_t node_index = 0;
+    bool hit_anything = false;
+    uint32_t visited = 0, tested = 0; // Kept in registers, added at the end
+
+    while (true) {
+      const BVHNode &node = nodes[node_index];
+      visited++;
+      if (node.is_leaf()) {
+        tested += node.prim_count;
+        if (intersect_leaf(node, t_min, t_max))
+          hit_anything = true;
+      } else {
+        uint32_t near_child = node.left_first;
+        uint32_t far_child = near_child + 1;
+        float t_near, t_far;
+        bool hit_near =
+            nodes[near_child].bounds.hit(ray, inv_dir, t_min, t_max, t_near);
+        bool hit_far =
+            nodes[far_child].bounds.hit(ray, inv_dir, t_min, t_max, t_far);
+
+        if (hit_near && hit_far) {
+          if (t_far < t_near) {
+            std::swap(near_child, far_child);
+            std::swap(t_near, t_far);
+          }
+          stack[stack_size++] = {far_child, t_far};
+          node_index = near_child;
+          continue;
+        }
+        if (hit_near || hit_far) {
+          node_index = hit_near ? near_child : far_child;
+          continue;
+        }
+      }
+
+      // Pop the next subtree that can still contain a closer hit
+      bool found = false;
+      while (stack_size > 0) {
+        auto entry = stack[--stack_size];
+        if (entry.second <= t_max) {
+          node_index = entry.first;
+          found = true;
+          break;
+        }
+      }
+      if (!found)
+        break;
+    }
+
+    if (stats) {
+      stats->nodes += visited;
+      stats->primitives += tested;
+    }
+    return hit_anything;
+  }
+
+  /**
+   * @brief Test whether any primitive is hit along a ray
+   * @param ray The ray to trace
+   * @param t_min Minimum valid t parameter
+   * @param t_max Maximum valid t parameter
+   * @param occludes_leaf Callable `bool(const BVHNode &leaf, float t_min,
+   *        float t_max)` that tests the leaf primitives
+   *        prim_indices[leaf.left_first, leaf.left_first + leaf.prim_count)
+   * @param stats Optional counters the visited nodes and primitives are
+   *        added to
+   * @return True as soon as one leaf reports a hit
+   *
+   * Any-hit variant of intersect(): no closest hit is tracked, so children
+   * are visited in storage order and traversal exits on the first hit.
+   */
+  template <typename LeafFn>
+  bool occluded(const Ray &ray, float t_min, float t_max,
+                LeafFn &&occludes_leaf,
+                TraversalStats *stats = nullptr) const {
+    if (nodes.empty())
+      return false;
+
+    Vec3 inv_dir(1.0f / ray.direction.x, 1.0f / ray.direction.y,
+                 1.0f / ray.direction.z);
+
+    uint32_t stack[MAX_DEPTH];
+    int stack_size = 0;
+    stack[stack_size++] = 0;
+    uint32_t visited = 0, tested = 0;
+    bool hit = false;
+
+    while (stack_size > 0) {
+      const BVHNode &node = nodes[stack[--stack_size]];
+      visited++;
+      float t_entry;
+      if (!node.bounds.hit(ray, inv_dir, t_min, t_max, t_entry))
+        continue;
+
+      if (node.is_leaf()) {
+        tested += node.prim_count;
+        if (occludes_leaf(node, t_min, t_max)) {
+          hit = true;
+          break;
+        }
+      } else {
+        stack[stack_size++] = node.left_first + 1;
+        stack[stack_size++] = node.left_first;
+      }
+    }
+
+    if (stats) {
+      stats->nodes += visited;
+      stats->primitives += tested;
+    }
+    return hit;
+  }
+
+  /**
+   * @brief Find the closest primitive hit along every ray of a packet
+   * @param packet Rays to trace
+   * @param t_min Minimum valid t parameter of every ray
+   * @param t_max In: maximum valid t of each ray. Out: t of its closest hit
+   * @param intersect_leaf Callable `bool(int ray, const BVHNode &leaf,
+   *        float t_min, float &t_max)` that intersects one ray of the packet
+   *        with the leaf primitives, like the callback of intersect()
+   * @param stats Optional counters; a node counts once per packet, a
+   *        primitive once per ray it is handed to
+   * @return True if any ray hit a primitive
+   *
+   * Rays stay in the packet down to the leaves. A node is culled for the
+   * whole packet when its frustum misses it; otherwise the rays before the
+   * first one that enters the node are dropped for its whole subtree, and
+   * the children are visited in the order that ray meets them.
+   */
+  template <typename LeafFn>
+  bool intersect_packet(const RayPacket &packet, float t_min, float *t_max,
+                        LeafFn &&intersect_leaf,
+                        TraversalStats *stats = nullptr) const {
+    if (nodes.empty() || packet.count == 0)
+      return false;
+
+    float packet_t_max = *std::max_element(t_max, t_max + packet.count);
+    // Node to visit and the first ray that may still hit something in it
+    std::pair<uint32_t, int> stack[MAX_DEPTH];
+    int stack_size = 0;
+    uint32_t node_index = 0;
+    int first = 0;
+    bool hit_anything = false;
+    uint32_t visited = 0, tested = 0;
+
+    while (true) {
+      const BVHNode &node = nodes[node_index];
+      visited++;
+      float t_entry;
+      int r = first;
+      if (!packet.frustum_misses(node.bounds, t_min, packet_t_max)) {
+        while (r < packet.count &&
+               !node.bounds.hit(packet.ray(r), packet.inv_dir[r], t_min,
+                                t_max[r], t_entry))
+          ++r;
+      } else {
+        r = packet.count;
+      }
+
+      if (r < packet.count && node.is_leaf()) {
+        bool shrunk = false;
+        for (int i = r; i < packet.count; ++i) {
+          if (i > r && !node.bounds.hit(packet.ray(i), packet.inv_dir[i],
+                                        t_min, t_max[i], t_entry))
+            continue;
+          tested += node.prim_count;
+          if (intersect_leaf(i, node, t_min, t_max[i]))
+            shrunk = true;
+        }
+        if (shrunk) {
+          hit_anything = true;
+          packet_t_max = *std::max_element(t_max, t_max + packet.count);
+        }
+      } else if (r < packet.count) {
+        // Front to back along the first active ray; a child it misses is
+        // still visited for the rays after it
+        uint32_t near_child = node.left_first;
+        uint32_t far_child = near_child + 1;
+        const Ray ray = packet.ray(r);
+        float t_near, t_far;
+        bool hit_near = nodes[near_child].bounds.hit(ray, packet.inv_dir[r],
+                                                     t_min, t_max[r], t_near);
+        bool hit_far = nodes[far_child].bounds.hit(ray, packet.inv_dir[r],
+                                                   t_min, t_max[r], t_far);
+        if (!hit_near || (hit_far && t_far < t_near))
+          std::swap(near_child, far_child);
+        stack[stack_size++] = {far_child, r};
+        node_index = near_child;
+        first = r;
+        continue;
+      }
+
+      if (stack_size == 0)
+        break;
+      node_index = stack[--stack_size].first;
+      first = stack[stack_size].second;
+    }
+
+    if (stats) {
+      stats->nodes += visited;
+      stats->primitives += tested;
+    }
+    return hit_anything;
+  }
+
+  /**
+   * @brief Test which rays of a packet are blocked by any primitive
+   * @param packet Rays to trace
+   * @param t_min Minimum valid t parameter of every ray
+   * @param t_max Maximum valid t parameter of each ray
+   * @param occluded Output: set for every ray that hits a primitive
+   * @param occludes_leaf Callable `bool(int ray, const BVHNode &leaf,
+   *        float t_min, float t_max)` that tests one ray of the packet
+   *        against the leaf primitives, like the callback of occluded()
+   * @param stats Optional counters, as for intersect_packet()
+   * @return Number of occluded rays
+   *
+   * Any-hit variant of intersect_packet(): children are visited in storage
+   * order, blocked rays drop out of the packet and traversal ends once all
+   * of them are blocked.
+   */
+  template <typename LeafFn>
+  int occluded_packet(const RayPacket &packet, float t_min,
+                      const float *t_max, bool *occluded,
+                      LeafFn &&occludes_leaf,
+                      TraversalStats *stats = nullptr) const {
+    if (packet.count <= 0)
+      return 0;
+    std::fill(occluded, occluded + packet.count, false);
+    if (nodes.empty())
+      return 0;
+
+    const float packet_t_max =
+        *std::max_element(t_max, t_max + packet.count);
+    std::pair<uint32_t, int> stack[MAX_DEPTH];
+    int stack_size = 0;
+    stack[stack_size++] = {0, 0};
+    int blocked = 0;
+    uint32_t visited = 0, tested = 0;
+
+    while (stack_size > 0 && blocked < packet.count) {
+      const std::pair<uint32_t, int> entry = stack[--stack_size];
+      const BVHNode &node = nodes[entry.first];
+      visited++;
+      if (packet.frustum_misses(node.bounds, t_min, packet_t_max))
+        continue;
+      float t_entry;
+      int r = entry.second;
+      while (r < packet.count &&
+             (occluded[r] ||
+              !node.bounds.hit(packet.ray(r), packet.inv_dir[r], t_min,
+                               t_max[r], t_entry)))
+        ++r;
+      if (r == packet.count)
+        continue;
+
+      if (node.is_leaf()) {
+        for (int i = r; i < packet.count; ++i) {
+          if (occluded[i] ||
+              (i > r && !node.bounds.hit(packet.ray(i), packet.inv_dir[i],
+                                         t_min, t_max[i], t_entry)))
+            continue;
+          tested += node.prim_count;
+          if (occludes_leaf(i, node, t_min, t_max[i])) {
+            occluded[i] = true;
+            blocked++;
+          }
+        }
+      } else {
+        stack[stack_size++] = {node.left_first + 1, r};
+        stack[stack_size++] = {node.left_first, r};
+      }
+    }
+
+    if (stats) {
+      stats->nodes += visited;
+      stats->primitives += tested;
+    }
+    return blocked;
+  }
+
+private:
+  BVHStats build_stats;
+
+  void compute_stats(int leaf_batch);
+  void build_recursive(const std::vector<AABB> &prim_bounds,
+                       const std::vector<Point3> &centroids,
+                       uint32_t node_index, uint32_t first, uint32_t count,
+                       int depth, int max_leaf_size, int leaf_batch);
+};
+
+#endif // BVH_H
@@ -0,0 +1,55 @@
+/**
+ * @file cuda_renderer.h
+ * @brief Optional CUDA backend for render_scene (KESTREL_CUDA builds)
+ * @author Alexei Czornyj
+ * @date 2025
+ *
+ * The scene is uploaded as flat device buffers (BVH nodes, spheres in BVH
+ * leaf order, a material table and the lights) and rendered with the
+ * wavefront stages of wavefront.h as kernels: camera rays, intersect,
+ * shade, shadow rays, repeated per bounce. The result comes back in the
+ * same pixel buffer layout as the CPU engines, so image output is
+ * unchanged.
+ */
+
+#ifndef CUDA_RENDERER_H
+#define CUDA_RENDERER_H
+
+#include "camera.h"
+#include "renderer.h"
+#include "scene.h"
+#include "vec3.h"
+#include <string>
+#include <vector>
+
+/**
+ * @brief Check for a usable CUDA device
+ * @param name Output parameter set to the device name on success
+ * @return True if at least one device is present and the runtime works
+ */
+bool cuda_device_available(std::string &name);
+
+/**
+ * @brief Render the scene on the GPU
+ * @param scene The scene to render (the BVH is built on the host if missing)
+ * @param camera The camera through which to render
+ * @param settings Image size and sampling parameters; progressive passes
+ *        are honoured, adaptive sampling is not (samples are uniform)
+ * @param pixels Output pixel buffer (size = image_width * image_height)
+ * @param report Output pass and sample counts; threads holds one entry whose
+ *        busy_ms is the device time
+ * @param on_pass Optional callback invoked after every pass
+ * @return False if a CUDA call failed or the scene has instances or
+ *         meshes, which the device kernels do not trace (the error is
+ *         printed to std::cerr)
+ *
+ * Paths use a counter-based random sequence keyed by pixel and sample
+ * index, so the image does not match the CPU engines bit for bit, but it
+ * converges to the same estimate.
+ */
+bool render_scene_cuda(const Scene &scene, const Camera &camera,
+                       const RenderSettings &settings,
+                       std::vector<Color> &pixels, RenderReport &report,
+                       const PassCallback &on_pass = PassCallback());
+
+#endif // CUDA_RENDERER_H
@@ -0,0 +1,23 @@
+/**
+ * @file default_scene.h
+ * @brief Built-in demo scene used by the renderer and benchmarks
+ * @author Alexei Czornyj
+ * @date 2025
+ */
+
+#ifndef DEFAULT_SCENE_H
+#define DEFAULT_SCENE_H
+
+#include "scene.h"
+
+/**
+ * @brief Add the built-in spheres and lights to a scene
+ * @param scene Scene to populate
+ *
+ * Nine spheres (Lambertian and conductor materials, one of radius 100
+ * enclosing the camera) lit by three point lights. The materials are added
+ * to the scene's material table.
+ */
+void populate_default_scene(Scene &scene);
+
+#endif // DEFAULT_SCENE_H
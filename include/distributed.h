@@ -0,0 +1,115 @@
+/**
+ * @file distributed.h
+ * @brief Rendering one frame on several machines over TCP
+ * @author Alexei Czornyj
+ * @date 2025
+ *
+ * A coordinator cuts the frame into ranges of consecutive tiles (in the
+ * Morton order of make_tiles) and hands them to the workers that connect
+ * to it. Workers load the same scene themselves, render the tiles they are
+ * sent with render_scene (per-tile seeds, all their threads) and stream the
+ * float pixels back; the coordinator assembles them into the image.
+ *
+ * Every worker keeps a couple of batches queued so it never waits for the
+ * network. Once no range is left to hand out, a worker that runs dry gets
+ * a backup copy of the longest-running range of another worker; whichever
+ * copy comes back first is kept. Since a tile renders the same on every
+ * node, the copies are interchangeable and a slow or stalled node no
+ * longer sets the frame time. Ranges of a worker that disconnects are
+ * handed out again.
+ *
+ * Messages use the native byte order and record layout, like scene caches:
+ * all nodes of a farm are expected to be the same kind of machine.
+ */
+
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#include "camera.h"
+#include "renderer.h"
+#include "scene.h"
+#include "scene_file.h"
+#include "thread_pool.h"
+#include "vec3.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// Default TCP port of the coordinator
+constexpr int DEFAULT_COORDINATOR_PORT = 7420;
+
+/**
+ * @struct WorkerReport
+ * @brief What one worker contributed to a frame
+ */
+struct WorkerReport {
+  std::string address;   ///< Host and port the worker connected from
+  int threads = 0;       ///< Render threads of the worker
+  int ranges = 0;        ///< Tile ranges it returned first
+  int wasted_ranges = 0; ///< Ranges it returned after a backup copy won
+  int backups = 0;       ///< Backup copies it was sent
+  bool lost = false;     ///< Disconnected before the frame was done
+};
+
+/**
+ * @struct CoordinatorReport
+ * @brief Scheduling statistics of a distributed frame
+ */
+struct CoordinatorReport {
+  std::vector<WorkerReport> workers; ///< Every worker that connected
+  int ranges = 0;                    ///< Tile ranges the frame was cut into
+  int reissued = 0; ///< Ranges handed out again after a worker was lost
+};
+
+/**
+ * @brief Hash of the scene contents, to check that workers render the
+ *        scene the coordinator loaded
+ * @param scene Scene to hash: spheres, instances, meshes, materials and
+ *        lights (with their shape, edges and sample counts)
+ * @return 64-bit fingerprint
+ */
+uint64_t scene_fingerprint(const Scene &scene);
+
+/**
+ * @brief Render a frame on the workers that connect to this node
+ * @param port TCP port to listen on
+ * @param settings Frame settings sent to the workers (image size, tiles,
+ *        samples, engine, sampler, light samples, pixel seeds); the
+ *        thread count is each worker's own
+ * @param view Camera placement sent to the workers
+ * @param aspect_ratio Aspect ratio of the camera the workers build from it
+ * @param fingerprint scene_fingerprint of the coordinator's scene; workers
+ *        reporting another one are turned away
+ * @param range_tiles Tiles per range (at least 1)
+ * @param pixels Output pixel buffer (size = image_width * image_height)
+ * @param report Output scheduling statistics
+ * @param error Set to a message on failure
+ * @return True once every tile has been assembled
+ *
+ * Waits for workers as long as tiles are left; workers may join at any
+ * time during the frame. Adaptive sampling is not supported (each tile's
+ * budget would depend on the others). Messages from the workers are
+ * reassembled without blocking, so a worker that stalls mid-message only
+ * delays its own ranges (which idle workers back up); one whose connection
+ * dies silently is noticed by TCP keep-alive probes and dropped.
+ */
+bool run_coordinator(int port, const RenderSettings &settings,
+                     const SceneCamera &view, float aspect_ratio,
+                     uint64_t fingerprint, int range_tiles,
+                     std::vector<Color> &pixels, CoordinatorReport &report,
+                     std::string &error);
+
+/**
+ * @brief Connect to a coordinator and render the tiles it sends
+ * @param host Coordinator host name or address
+ * @param port Coordinator TCP port
+ * @param scene Scene to render (the same one the coordinator loaded); the
+ *        camera comes from the coordinator
+ * @param pool Render threads of this node, reused for every batch
+ * @param error Set to a message on failure
+ * @return True once the coordinator has finished the frame
+ */
+bool run_worker(const std::string &host, int port, const Scene &scene,
+                ThreadPool &pool, std::string &error);
+
+#endif // DISTRIBUTED_H
@@ -0,0 +1,157 @@
+/**
+ * @file fast_math.h
+ * @brief Precise and fast variants of the scalar math in the shading code
+ * @author Alexei Czornyj
+ * @date 2025
+ *
+ * Every bounce normalizes a handful of vectors and turns a random angle into
+ * a direction or a disk point. The fast variants replace the square root
+ * and three divides of a normalization with a reciprocal square root
+ * estimate refined by one Newton-Raphson step (rsqrtss on x86, rsqrtf on
+ * CUDA devices, a bit-level estimate elsewhere), and the two libm calls of
+ * sin and cos with one range reduction and two polynomials. Both are branch
+ * free, so loops over them vectorize. Measured errors (kestrel_bench prints
+ * them): normalized vectors are within 3e-7 of unit length, sin and cos
+ * within 3e-7 of the exact values. The fast_math_report CMake target
+ * renders the built-in scene both ways and prints how the images differ.
+ *
+ * Both variants are always defined, so they can be compared in one build.
+ * math_rsqrt and math_sincos, used by Vec3::normalized and the samplers of
+ * directions, pick one at compile time: the fast one when KESTREL_FAST_MATH
+ * is defined (the CMake option of the same name), the precise one
+ * otherwise, which keeps the images bit exact with earlier builds.
+ */
+
+#ifndef FAST_MATH_H
+#define FAST_MATH_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE__) && !defined(__CUDA_ARCH__)
+#include <xmmintrin.h>
+#endif
+
+#ifdef __CUDACC__
+#define FAST_MATH_HOST_DEVICE __host__ __device__
+#else
+#define FAST_MATH_HOST_DEVICE
+#endif
+
+#ifdef KESTREL_FAST_MATH
+constexpr bool FAST_MATH = true; ///< math_* use the fast variants
+#else
+constexpr bool FAST_MATH = false; ///< math_* use the precise variants
+#endif
+
+/**
+ * @brief 1 / sqrt(x) through the standard library
+ * @param x Positive value
+ * @return Correctly rounded square root, then a divide
+ */
+FAST_MATH_HOST_DEVICE inline float precise_rsqrt(float x) {
+  return 1.0f / std::sqrt(x);
+}
+
+/**
+ * @brief 1 / sqrt(x) from a hardware estimate and one Newton-Raphson step
+ * @param x Positive, finite value
+ * @return Approximation within about 2 ulp
+ */
+FAST_MATH_HOST_DEVICE inline float fast_rsqrt(float x) {
+#if defined(__CUDA_ARCH__)
+  return rsqrtf(x);
+#else
+#if defined(__SSE__)
+  // 12-bit estimate; one step brings it to about 23 bits
+  float y = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+#else
+  // Bit-level estimate (about 4 bits), refined once more
+  uint32_t bits;
+  std::memcpy(&bits, &x, sizeof(bits));
+  bits = 0x5f375a86U - (bits >> 1);
+  float y;
+  std::memcpy(&y, &bits, sizeof(y));
+  y = y * (1.5f - 0.5f * x * y * y);
+  y = y * (1.5f - 0.5f * x * y * y);
+#endif
+  return y * (1.5f - 0.5f * x * y * y);
+#endif
+}
+
+/**
+ * @brief Sine and cosine through the standard library
+ * @param angle Angle in radians
+ * @param s Output: sin(angle)
+ * @param c Output: cos(angle)
+ */
+FAST_MATH_HOST_DEVICE inline void precise_sincos(float angle, float &s,
+                                                 float &c) {
+  s = std::sin(angle);
+  c = std::cos(angle);
+}
+
+/**
+ * @brief Sine and cosine from one range reduction and two polynomials
+ * @param angle Angle in radians, |angle| < 2^31 turns
+ * @param s Output: approximately sin(angle)
+ * @param c Output: approximately cos(angle)
+ *
+ * The angle is reduced to [-pi, pi] and folded into [-pi/2, pi/2], where
+ * near-minimax polynomials of degree 9 (sine) and 8 (cosine) with exact
+ * leading terms are accurate to 5e-8 before float rounding.
+ */
+FAST_MATH_HOST_DEVICE inline void fast_sincos(float angle, float &s,
+                                              float &c) {
+  constexpr float PI = 3.14159265358979f;
+  constexpr float TWO_PI = 6.28318530717959f;
+  constexpr float INV_TWO_PI = 0.159154943091895f;
+  // Round to the nearest turn through an integer conversion, which
+  // vectorizes without SSE4.1 (nearbyint would not)
+  const float turns = angle * INV_TWO_PI;
+  const float nearest = static_cast<float>(
+      static_cast<int32_t>(turns + std::copysign(0.5f, turns)));
+  float x = angle - TWO_PI * nearest;
+  // sin(pi - x) = sin(x) and cos(pi - x) = -cos(x) fold |x| > pi/2 back
+  const bool folded = std::fabs(x) > 0.5f * PI;
+  x = folded ? std::copysign(PI, x) - x : x;
+  const float x2 = x * x;
+  s = x + x * x2 *
+              (-0.166666567f +
+               x2 * (8.33301712e-3f +
+                     x2 * (-1.98066162e-4f + x2 * 2.60005618e-6f)));
+  const float cos_x =
+      1.0f + x2 * (-0.499999315f +
+                   x2 * (4.16639894e-2f +
+                         x2 * (-1.38559297e-3f + x2 * 2.31944468e-5f)));
+  c = folded ? -cos_x : cos_x;
+}
+
+/**
+ * @brief 1 / sqrt(x) in the variant selected by KESTREL_FAST_MATH
+ * @param x Positive, finite value
+ * @return fast_rsqrt(x) or precise_rsqrt(x)
+ */
+FAST_MATH_HOST_DEVICE inline float math_rsqrt(float x) {
+  if constexpr (FAST_MATH)
+    return fast_rsqrt(x);
+  else
+    return precise_rsqrt(x);
+}
+
+/**
+ * @brief Sine and cosine in the variant selected by KESTREL_FAST_MATH
+ * @param angle Angle in radians
+ * @param s Output: sin(angle)
+ * @param c Output: cos(angle)
+ */
+FAST_MATH_HOST_DEVICE inline void math_sincos(float angle, float &s,
+                                              float &c) {
+  if constexpr (FAST_MATH)
+    fast_sincos(angle, s, c);
+  else
+    precise_sincos(angle, s, c);
+}
+
+#endif // FAST_MATH_H
@@ -0,0 +1,204 @@
+/**
+ * @file framebuffer.h
+ * @brief Tiled sample accumulation buffer with optional half precision
+ * @author Alexei Czornyj
+ * @date 2025
+ *
+ * The framebuffer keeps the running estimate of every pixel and the number
+ * of samples behind it, so a render can keep adding samples to an image
+ * over several passes or several render_scene calls. Pixels are stored tile
+ * by tile, in the Morton order of make_tiles, with every tile padded to
+ * whole cache lines: a thread rendering a tile writes only memory of its
+ * own, and the tiles a thread starts with form one contiguous range (which
+ * is what first-touch placement on NUMA machines wants).
+ *
+ * FramebufferFormat::FLOAT16 stores the running mean in half precision
+ * (8 bytes per pixel instead of 16) for very large renders. Every update
+ * rounds the mean to 11 significant bits, so accumulate a pixel's samples
+ * of a pass in float and add them with a single add().
+ */
+
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include "aligned_allocator.h"
+#include "scheduler.h"
+#include "thread_pool.h"
+#include "vec3.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Storage precision of a Framebuffer
+ */
+enum class FramebufferFormat {
+  FLOAT32, ///< Float color sums and 32-bit sample counts (16 bytes/pixel)
+  FLOAT16  ///< Half-precision means and 16-bit sample counts (8 bytes/pixel)
+};
+
+/**
+ * @brief Parse a framebuffer format name ("float" or "half")
+ * @param name Format name from the command line
+ * @param format Output parameter set on success
+ * @return True if the name is recognised
+ */
+bool parse_framebuffer_format(const std::string &name,
+                              FramebufferFormat &format);
+
+/**
+ * @brief Round a float to the nearest IEEE 754 half-precision value
+ * @param value Value to convert
+ * @return Half-precision bits (overflow gives infinity, NaN stays NaN)
+ */
+uint16_t float_to_half(float value);
+
+/**
+ * @brief Widen an IEEE 754 half-precision value to float
+ * @param bits Half-precision bits
+ * @return The same value as a float (exact)
+ */
+float half_to_float(uint16_t bits);
+
+/**
+ * @class Framebuffer
+ * @brief Per-pixel sample sums and counts, stored tile by tile
+ */
+class Framebuffer {
+public:
+  /// Largest sample count a FLOAT16 pixel can hold; later samples are
+  /// dropped
+  static constexpr uint32_t MAX_HALF_SAMPLES = 65535;
+
+  /**
+   * @brief Allocate an empty framebuffer (no samples anywhere)
+   * @param width Image width in pixels
+   * @param height Image height in pixels
+   * @param tile_size Edge length of the storage tiles (at least 1); use the
+   *        render tile size so every render tile is one block of memory
+   * @param format Storage precision
+   * @param pool Optional threads that clear the memory, each the range of
+   *        tiles its TileScheduler deque starts with, so the pages land on
+   *        the NUMA node of the thread that will render them
+   */
+  Framebuffer(int width, int height, int tile_size = 32,
+              FramebufferFormat format = FramebufferFormat::FLOAT32,
+              ThreadPool *pool = nullptr);
+
+  /**
+   * @brief Drop every sample
+   * @param pool Optional threads to clear with (see the constructor)
+   */
+  void clear(ThreadPool *pool = nullptr);
+
+  /**
+   * @brief Image width
+   * @return Width in pixels
+   */
+  int width() const { return image_width; }
+
+  /**
+   * @brief Image height
+   * @return Height in pixels
+   */
+  int height() const { return image_height; }
+
+  /**
+   * @brief Edge length of the storage tiles
+   * @return Tile size in pixels
+   */
+  int tile_size() const { return tile_edge; }
+
+  /**
+   * @brief Storage precision
+   * @return Format given to the constructor
+   */
+  FramebufferFormat format() const { return pixel_format; }
+
+  /**
+   * @brief Memory used by the pixels
+   * @return Size of the pixel storage in bytes, including tile padding
+   */
+  size_t bytes() const;
+
+  /**
+   * @brief Storage slot of a pixel
+   * @param x Column in [0, width)
+   * @param y Row in [0, height)
+   * @return Slot to pass to add(), count() and average()
+   */
+  size_t slot(int x, int y) const {
+    const int tx = x / tile_edge, ty = y / tile_edge;
+    return tile_offsets[static_cast<size_t>(ty) * tiles_x + tx] +
+           static_cast<size_t>(y - ty * tile_edge) * tile_edge +
+           (x - tx * tile_edge);
+  }
+
+  /**
+   * @brief Add samples to a pixel
+   * @param slot Pixel slot (see slot())
+   * @param sum Sum of the samples
+   * @param n Number of samples in sum
+   */
+  void add(size_t slot, const Color &sum, uint32_t n);
+
+  /**
+   * @brief Samples accumulated in a pixel
+   * @param slot Pixel slot (see slot())
+   * @return Sample count
+   */
+  uint32_t count(size_t slot) const {
+    return pixel_format == FramebufferFormat::FLOAT16
+               ? half_pixels[slot].count
+               : float_pixels[slot].count;
+  }
+
+  /**
+   * @brief Current estimate of a pixel
+   * @param slot Pixel slot (see slot())
+   * @return Mean of its samples (black without samples)
+   */
+  Color average(size_t slot) const;
+
+  /**
+   * @brief Copy the estimates into a row-major image
+   * @param pixels Image of width x height pixels; pixels without samples
+   *        keep their value
+   */
+  void resolve(std::vector<Color> &pixels) const;
+
+  /**
+   * @brief Number of render passes accumulated so far
+   * @return Passes counted with add_pass() since the last clear
+   *
+   * render_scene numbers its random streams from here, so a render that
+   * continues an image draws new samples instead of repeating old ones.
+   */
+  uint32_t passes() const { return pass_count; }
+
+  /// Count one more accumulated pass
+  void add_pass() { pass_count++; }
+
+private:
+  struct FloatPixel {
+    float r, g, b;  ///< Sum of the samples
+    uint32_t count; ///< Number of samples
+  };
+  struct HalfPixel {
+    uint16_t r, g, b; ///< Mean of the samples, half precision
+    uint16_t count;   ///< Number of samples
+  };
+
+  int image_width, image_height, tile_edge;
+  int tiles_x; ///< Tiles per row of the tile grid
+  FramebufferFormat pixel_format;
+  std::vector<size_t> tile_offsets; ///< First slot of each tile, row-major
+  size_t tile_count;                ///< Tiles of the image
+  size_t tile_stride;               ///< Slots per tile, padded
+  std::vector<FloatPixel, FirstTouchAllocator<FloatPixel, 64>> float_pixels;
+  std::vector<HalfPixel, FirstTouchAllocator<HalfPixel, 64>> half_pixels;
+  uint32_t pass_count = 0;
+};
+
+#endif // FRAMEBUFFER_H
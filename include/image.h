@@ -0,0 +1,146 @@
+/**
+ * @file image.h
+ * @brief Image output in PPM (ASCII/binary) and PFM formats, PFM input and
+ *        image comparison
+ * @author Alexei Czornyj
+ * @date 2025
+ *
+ * Pixel buffers are row-major with row 0 at the bottom of the image, as
+ * produced by render_scene. Tonemapping (clamp + 1/2.2 gamma) is done in
+ * parallel into a memory buffer that is written with a single call.
+ */
+
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include "vec3.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Supported output formats
+ */
+enum class ImageFormat {
+  PPM_ASCII,  ///< P3: 8-bit gamma-corrected, ASCII
+  PPM_BINARY, ///< P6: 8-bit gamma-corrected, binary
+  PFM         ///< PF: 32-bit linear float, binary
+};
+
+/**
+ * @brief Parse a format name ("p3", "p6" or "pfm")
+ * @param name Format name from the command line
+ * @param format Output parameter set on success
+ * @return True if the name is recognised
+ */
+bool parse_image_format(const std::string &name, ImageFormat &format);
+
+/**
+ * @brief Get the conventional file extension of a format
+ * @param format Image format
+ * @return "ppm" or "pfm"
+ */
+const char *image_extension(ImageFormat format);
+
+/**
+ * @brief Convert a linear value to an 8-bit gamma-corrected value
+ * @param value Linear intensity (clamped to [0, 1])
+ * @return int(255.99 * value^(1/2.2)), via a threshold lookup table
+ *
+ * Gives exactly the same result as evaluating pow() per channel.
+ */
+uint8_t encode_gamma(float value);
+
+/**
+ * @brief Tonemap a pixel buffer into top-to-bottom 8-bit RGB
+ * @param pixels Linear pixel buffer (row 0 at the bottom)
+ * @param width Image width in pixels
+ * @param height Image height in pixels
+ * @param num_threads Number of threads sharing the rows
+ * @return width * height * 3 bytes, top row first
+ */
+std::vector<uint8_t> tonemap_rgb8(const std::vector<Color> &pixels, int width,
+                                  int height, int num_threads);
+
+/**
+ * @brief Write image data to PPM file format
+ * @param filename Output filename (should end in .ppm)
+ * @param pixels Array of RGB colors, size width * height
+ * @param width Image width in pixels
+ * @param height Image height in pixels
+ * @param format PPM_ASCII (P3) or PPM_BINARY (P6)
+ * @param num_threads Number of threads used for tonemapping
+ * @return True if the file was written
+ *
+ * PPM is a simple uncompressed image format. The output can be viewed
+ * with many image viewers or converted to other formats with ImageMagick.
+ */
+bool write_ppm(const std::string &filename, const std::vector<Color> &pixels,
+               int width, int height,
+               ImageFormat format = ImageFormat::PPM_BINARY,
+               int num_threads = 1);
+
+/**
+ * @brief Write linear float image data to PFM file format
+ * @param filename Output filename (should end in .pfm)
+ * @param pixels Array of RGB colors, size width * height
+ * @param width Image width in pixels
+ * @param height Image height in pixels
+ * @return True if the file was written
+ *
+ * PFM stores rows bottom to top, which matches the pixel buffer, so the
+ * buffer is written as is with no tonemapping.
+ */
+bool write_pfm(const std::string &filename, const std::vector<Color> &pixels,
+               int width, int height);
+
+/**
+ * @brief Write an image in the given format
+ * @param filename Output filename
+ * @param pixels Array of RGB colors, size width * height
+ * @param width Image width in pixels
+ * @param height Image height in pixels
+ * @param format Output format
+ * @param num_threads Number of threads used for tonemapping
+ * @return True if the file was written
+ */
+bool write_image(const std::string &filename, const std::vector<Color> &pixels,
+                 int width, int height, ImageFormat format, int num_threads);
+
+/**
+ * @brief Read a PFM file written by write_pfm
+ * @param filename File to read
+ * @param pixels Output: the pixels, row 0 at the bottom
+ * @param width Output: image width in pixels
+ * @param height Output: image height in pixels
+ * @param error Set to a message on failure
+ * @return True if the file was read (three-channel PFM of either byte
+ *         order)
+ */
+bool read_pfm(const std::string &filename, std::vector<Color> &pixels,
+              int &width, int &height, std::string &error);
+
+/**
+ * @struct ImageDiff
+ * @brief Differences between an image and a reference of the same size
+ */
+struct ImageDiff {
+  size_t values = 0;            ///< Channel values compared
+  double max_abs = 0.0;         ///< Largest |image - reference|
+  double mean_abs = 0.0;        ///< Mean |image - reference|
+  double median_relative = 0.0; ///< Median |image - reference| / |reference|
+  size_t changed_values = 0;    ///< 8-bit values (encode_gamma) that differ
+  int max_levels = 0;           ///< Largest 8-bit difference
+  double psnr = 0.0;            ///< 8-bit PSNR in dB (infinite if identical)
+};
+
+/**
+ * @brief Compare an image to a reference, as floats and as 8-bit output
+ * @param reference Reference pixels
+ * @param image Pixels to compare, same size as reference
+ * @return Statistics over every channel value
+ */
+ImageDiff compare_images(const std::vector<Color> &reference,
+                         const std::vector<Color> &image);
+
+#endif // IMAGE_H
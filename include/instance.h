@@ -0,0 +1,205 @@
+/**
+ * @file instance.h
+ * @brief Shared geometry blocks and their transformed instances
+ * @author Alexei Czornyj
+ * @date 2025
+ *
+ * A GeometryBlock holds spheres in its own object space with its own BVH.
+ * An Instance places a block in the world with an affine transform and can
+ * override the material of all of its spheres, so a cluster repeated a
+ * thousand times is stored (and its hierarchy built) once.
+ *
+ * Scene keeps a top-level BVH over the world bounds of the instances. Rays
+ * that reach an instance are mapped into its object space and traced
+ * through the block's BVH. The mapped direction is not renormalized, so
+ * the ray parameter t means the same in both spaces and one closest-hit
+ * distance is shared by every level.
+ */
+
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include "aabb.h"
+#include "bvh.h"
+#include "kestrel.h"
+#include "ray.h"
+#include "sphere.h"
+#include "sphere_soa.h"
+#include "vec3.h"
+#include <cstdint>
+#include <vector>
+
+/**
+ * @struct Transform
+ * @brief Affine transform: a 3x3 linear part and a translation
+ *
+ * Maps p to (m[i][0] p.x + m[i][1] p.y + m[i][2] p.z + m[i][3]) for each
+ * row i.
+ */
+struct Transform {
+  float m[3][4] = {{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}}; ///< Rows
+
+  /**
+   * @brief Translation by an offset
+   * @param offset Translation
+   * @return The transform
+   */
+  static Transform translation(const Vec3 &offset);
+
+  /**
+   * @brief Scaling along the axes
+   * @param factors Scale factor of each axis
+   * @return The transform
+   */
+  static Transform scaling(const Vec3 &factors);
+
+  /**
+   * @brief Rotation about an axis through the origin
+   * @param axis Rotation axis (any length but zero)
+   * @param degrees Counter-clockwise angle looking down the axis
+   * @return The transform
+   */
+  static Transform rotation(const Vec3 &axis, float degrees);
+
+  /**
+   * @brief Compose two transforms
+   * @param next Transform applied after this one
+   * @return next(this(p)) for every p
+   */
+  Transform then(const Transform &next) const;
+
+  /**
+   * @brief Invert the transform
+   * @param inverse Output: the inverse transform
+   * @return False if the linear part is singular (inverse is untouched)
+   */
+  bool invert(Transform &inverse) const;
+
+  /**
+   * @brief Transform a point
+   * @param p Point
+   * @return Linear part times p, plus the translation
+   */
+  Point3 point(const Point3 &p) const {
+    return Point3(m[0][0] * p.x + m[0][1] * p.y + m[0][2] * p.z + m[0][3],
+                  m[1][0] * p.x + m[1][1] * p.y + m[1][2] * p.z + m[1][3],
+                  m[2][0] * p.x + m[2][1] * p.y + m[2][2] * p.z + m[2][3]);
+  }
+
+  /**
+   * @brief Transform a direction (no translation)
+   * @param v Direction
+   * @return Linear part times v
+   */
+  Vec3 vector(const Vec3 &v) const {
+    return Vec3(m[0][0] * v.x + m[0][1] * v.y + m[0][2] * v.z,
+                m[1][0] * v.x + m[1][1] * v.y + m[1][2] * v.z,
+                m[2][0] * v.x + m[2][1] * v.y + m[2][2] * v.z);
+  }
+
+  /**
+   * @brief Multiply by the transpose of the linear part
+   * @param v Vector
+   * @return Transposed linear part times v
+   *
+   * Normals leave object space through the inverse transpose of the
+   * object-to-world transform, i.e. the transpose of world-to-object.
+   */
+  Vec3 transposed_vector(const Vec3 &v) const {
+    return Vec3(m[0][0] * v.x + m[1][0] * v.y + m[2][0] * v.z,
+                m[0][1] * v.x + m[1][1] * v.y + m[2][1] * v.z,
+                m[0][2] * v.x + m[1][2] * v.y + m[2][2] * v.z);
+  }
+
+  /**
+   * @brief Bounds of a transformed box
+   * @param box Box to transform
+   * @return Tightest axis-aligned box around the transformed corners
+   */
+  AABB bounds(const AABB &box) const;
+};
+
+/**
+ * @class GeometryBlock
+ * @brief Spheres in object space with their own BVH, shared by instances
+ */
+class GeometryBlock {
+public:
+  std::vector<Sphere> spheres; ///< Spheres in object space
+  BVH bvh;                     ///< Hierarchy over spheres (see build())
+  SphereSoA packed;            ///< Spheres in leaf order for SIMD tests
+
+  /**
+   * @brief Build the BVH and pack its leaves; call after changing spheres
+   */
+  void build();
+
+  /**
+   * @brief Discard the BVH; queries fall back to a linear scan
+   */
+  void clear_bvh();
+
+  /**
+   * @brief Bounds of all spheres
+   * @return Object-space box (empty without spheres)
+   */
+  AABB bounds() const;
+
+  /**
+   * @brief Find the closest sphere along an object-space ray
+   * @param ray Ray in object space
+   * @param t_min Minimum valid t parameter
+   * @param t_max In: maximum valid t parameter. Out: t of the closest hit
+   * @param sphere Output: the sphere hit (set only on a hit)
+   * @param stats Optional counters for the traversal work
+   * @return True if a sphere is hit before t_max
+   */
+  bool hit(const Ray &ray, float t_min, float &t_max, const Sphere *&sphere,
+           TraversalStats *stats = nullptr) const;
+
+  /**
+   * @brief Test whether any sphere blocks an object-space ray segment
+   * @param ray Ray in object space
+   * @param t_min Minimum valid t parameter
+   * @param t_max Maximum valid t parameter
+   * @param stats Optional counters for the traversal work
+   * @return True if a sphere is hit within [t_min, t_max]
+   */
+  bool occluded(const Ray &ray, float t_min, float t_max,
+                TraversalStats *stats = nullptr) const;
+};
+
+/**
+ * @struct Instance
+ * @brief A GeometryBlock placed in the world
+ */
+struct Instance {
+  /// Material value that keeps the spheres' own materials
+  static constexpr uint32_t KEEP_MATERIAL = UINT32_MAX;
+
+  Transform to_world;                ///< Object space to world space
+  Transform to_object;               ///< World space to object space (inverse)
+  uint32_t geometry = 0;             ///< Index into Scene::geometries
+  uint32_t material = KEEP_MATERIAL; ///< Overrides the spheres' materials
+
+  /**
+   * @brief Map a world-space ray into object space
+   * @param ray World-space ray
+   * @return The same ray in object space, with the same t parameterization
+   */
+  Ray object_ray(const Ray &ray) const {
+    return Ray(to_object.point(ray.origin), to_object.vector(ray.direction));
+  }
+
+  /**
+   * @brief Fill a world-space hit record for a hit on one of its spheres
+   * @param ray World-space ray
+   * @param sphere Sphere of the geometry block that was hit
+   * @param t Distance of the hit (the same in both spaces)
+   * @param rec Output: point, normal, t and material in world space
+   */
+  void finalize(const Ray &ray, const Sphere &sphere, float t,
+                HitRecord &rec) const;
+};
+
+#endif // INSTANCE_H
@@ -12,8 +12,7 @@
 #include "pcg32.h"
 #include "ray.h"
 #include "vec3.h"
-
-class Material; // Forward declaration
+#include <cstdint>
 
 /**
  * @struct HitRecord
@@ -28,12 +27,12 @@ struct HitRecord {
                 ///< surface)
   float t;      ///< Ray parameter at intersection (distance along ray)
   bool front_face;          ///< True if ray hit the front face of the surface
-  const Material *material; ///< Material at the hit point
+  uint32_t material; ///< Id of the material at the hit point (MaterialTable)
 
   /**
    * @brief Construct a new Hit Record object
    */
-  HOST_DEVICE HitRecord() : material(nullptr) {}
+  HOST_DEVICE HitRecord() : material(0) {}
 
   /**
    * @brief Set the surface normal and determine which face was hit
@@ -4,19 +4,70 @@
  * @author Alexei Czornyj
  * @date 2025
  *
- * This file defines the Light class, which represents a light source
- * in the scene. It provides methods to sample light direction and intensity.
+ * This file defines the Light class, which represents a point, spherical
+ * or rectangular light source in the scene. It provides methods to sample
+ * points on the emitter for soft shadows and the emitted intensity.
+ *
+ * The renderers shade an area light as sample_count() point emitters at
+ * its stratified sample points, each carrying 1/sample_count() of the
+ * intensity with its own cosine and inverse-square falloff, so a large
+ * light close to a surface lights it from all of its extent.
  */
 
 #ifndef LIGHT_H
 #define LIGHT_H
 
 #include "vec3.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+/**
+ * @brief Shape of a light's emitting surface
+ */
+enum class LightShape : uint8_t {
+  POINT,  ///< Infinitely small: hard shadows, one shadow ray
+  SPHERE, ///< Sphere of the given radius around position
+  RECT    ///< Parallelogram spanned by edge_u and edge_v, centered on position
+};
+
+/**
+ * @brief Point i of a randomly shifted 2D Hammersley set of n points
+ * @param i Point index in [0, n)
+ * @param n Number of points
+ * @param shift_u Random shift of the first coordinate, in [0, 1)
+ * @param shift_v Random shift of the second coordinate, in [0, 1)
+ * @param u Output first coordinate in [0, 1)
+ * @param v Output second coordinate in [0, 1)
+ *
+ * The n points stratify the unit square for any n (one per 1/n column, and
+ * base-2 radical inverse rows), while the shared random shift (Cranley-
+ * Patterson rotation) makes every point uniformly distributed, so averages
+ * over the set stay unbiased.
+ */
+HOST_DEVICE inline void stratified_2d(uint32_t i, uint32_t n, float shift_u,
+                                      float shift_v, float &u, float &v) {
+  uint32_t bits = i;
+  bits = (bits << 16) | (bits >> 16);
+  bits = ((bits & 0x00ff00ffU) << 8) | ((bits & 0xff00ff00U) >> 8);
+  bits = ((bits & 0x0f0f0f0fU) << 4) | ((bits & 0xf0f0f0f0U) >> 4);
+  bits = ((bits & 0x33333333U) << 2) | ((bits & 0xccccccccU) >> 2);
+  bits = ((bits & 0x55555555U) << 1) | ((bits & 0xaaaaaaaaU) >> 1);
+  float radical_inverse = static_cast<float>(bits) * 2.3283064365386963e-10f;
+
+  u = (static_cast<float>(i) + 0.5f) / static_cast<float>(n) + shift_u;
+  v = radical_inverse + shift_v;
+  u -= std::floor(u);
+  v -= std::floor(v);
+}
 
 class Light {
 public:
+  /// Shadow rays per hit of a new area light
+  static constexpr int DEFAULT_AREA_SAMPLES = 4;
+
   /**
-   * @brief Construct a light source
+   * @brief Construct a point light source
    * @param position Position of the light in 3D space
    * @param intensity Color/intensity of the light
    */
@@ -24,16 +75,140 @@ public:
       : position(position), intensity(intensity) {}
 
   /**
-   * @brief Sample direction from a point to the light source
-   * @param point Point in space from which to sample the light direction
-   * @return Normalized direction vector from point to light
+   * @brief Construct a spherical area light
+   * @param center Center of the emitting sphere
+   * @param radius Radius of the emitting sphere
+   * @param intensity Color/intensity of the light
+   * @param samples Shadow rays per hit
+   * @return The light
+   */
+  static Light sphere(const Point3 &center, float radius,
+                      const Vec3 &intensity,
+                      int samples = DEFAULT_AREA_SAMPLES) {
+    Light light(center, intensity);
+    light.shape = LightShape::SPHERE;
+    light.radius = radius;
+    light.samples = samples;
+    return light;
+  }
+
+  /**
+   * @brief Construct a rectangular (parallelogram) area light
+   * @param corner One corner of the emitter
+   * @param edge_u First edge, from corner
+   * @param edge_v Second edge, from corner
+   * @param intensity Color/intensity of the light
+   * @param samples Shadow rays per hit
+   * @return The light
+   */
+  static Light rect(const Point3 &corner, const Vec3 &edge_u,
+                    const Vec3 &edge_v, const Vec3 &intensity,
+                    int samples = DEFAULT_AREA_SAMPLES) {
+    Light light(corner + 0.5f * (edge_u + edge_v), intensity);
+    light.shape = LightShape::RECT;
+    light.edge_u = edge_u;
+    light.edge_v = edge_v;
+    light.samples = samples;
+    return light;
+  }
+
+  /**
+   * @brief Number of shadow rays to trace per hit
+   * @return 1 for point lights (every ray would be identical), otherwise
+   *         the configured sample count
    */
-  Vec3 sample_direction(const Vec3 &point) const;
+  HOST_DEVICE int sample_count() const {
+    return shape == LightShape::POINT ? 1 : (samples > 1 ? samples : 1);
+  }
 
-  Vec3 get_intensity() const;
+  /**
+   * @brief Map a 2D sample to a point on the emitter
+   * @param from Point being shaded
+   * @param u First sample coordinate in [0, 1)
+   * @param v Second sample coordinate in [0, 1)
+   * @return Point on the emitting surface (position for point lights)
+   *
+   * Spherical lights are sampled on the disk through their center facing
+   * from, which is the silhouette the shadow rays can be blocked from.
+   */
+  HOST_DEVICE Point3 sample_point(const Point3 &from, float u, float v) const {
+    switch (shape) {
+    case LightShape::SPHERE: {
+      // Concentric mapping of the square onto the unit disk
+      float a = 2.0f * u - 1.0f;
+      float b = 2.0f * v - 1.0f;
+      float r, phi;
+      if (a == 0.0f && b == 0.0f) {
+        r = 0.0f;
+        phi = 0.0f;
+      } else if (a * a > b * b) {
+        r = a;
+        phi = 0.78539816339744831f * (b / a);
+      } else {
+        r = b;
+        phi = 1.57079632679489662f - 0.78539816339744831f * (a / b);
+      }
+      Vec3 w = (position - from).normalized();
+      Vec3 helper = std::fabs(w.x) > 0.9f ? Vec3(0, 1, 0) : Vec3(1, 0, 0);
+      Vec3 t = Vec3::cross(helper, w).normalized();
+      Vec3 s = Vec3::cross(w, t);
+      float sin_phi, cos_phi;
+      math_sincos(phi, sin_phi, cos_phi);
+      return position + (radius * r) * (cos_phi * t + sin_phi * s);
+    }
+    case LightShape::RECT:
+      return position + (u - 0.5f) * edge_u + (v - 0.5f) * edge_v;
+    default:
+      return position;
+    }
+  }
+
+  /**
+   * @brief Point i of the sample_count() stratified shadow-ray targets
+   * @param from Point being shaded
+   * @param i Sample index in [0, sample_count())
+   * @param shift_u Random shift shared by the samples of one hit
+   * @param shift_v Random shift shared by the samples of one hit
+   * @return Point on the emitting surface
+   */
+  HOST_DEVICE Point3 sample_point(const Point3 &from, int i, float shift_u,
+                                  float shift_v) const {
+    float u, v;
+    stratified_2d(static_cast<uint32_t>(i),
+                  static_cast<uint32_t>(sample_count()), shift_u, shift_v, u,
+                  v);
+    return sample_point(from, u, v);
+  }
+
+  /**
+   * @brief Radius of a sphere around position that holds the whole emitter
+   * @return 0 for point lights
+   */
+  HOST_DEVICE float bounding_radius() const {
+    switch (shape) {
+    case LightShape::SPHERE:
+      return radius;
+    case LightShape::RECT:
+      // Half of the longer diagonal of the parallelogram
+      return 0.5f * std::sqrt(std::max((edge_u + edge_v).length_squared(),
+                                       (edge_u - edge_v).length_squared()));
+    default:
+      return 0.0f;
+    }
+  }
+
+  /**
+   * @brief Get the emitted intensity
+   * @return Color/intensity of the light
+   */
+  HOST_DEVICE Vec3 get_intensity() const { return intensity; }
 
-  Vec3 position;  ///< Position of the light source
+  Vec3 position;  ///< Position (center) of the light source
   Vec3 intensity; ///< Color/intensity of the light source
+  LightShape shape = LightShape::POINT; ///< Shape of the emitter
+  float radius = 0.0f;                  ///< Radius of a SPHERE light
+  Vec3 edge_u, edge_v;                  ///< Edges of a RECT light
+  int samples = 1; ///< Shadow rays per hit for area lights
 };
 
-#endif
\ No newline at end of file
+#endif
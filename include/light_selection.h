@@ -0,0 +1,101 @@
+/**
+ * @file light_selection.h
+ * @brief Importance-sampled choice of the lights shaded at a hit
+ * @author Alexei Czornyj
+ * @date 2025
+ *
+ * Instead of tracing shadow rays to every light at every hit, a few lights
+ * are picked with probability proportional to their estimated unshadowed
+ * contribution at the shading point and weighted by the inverse of that
+ * probability, which keeps the estimate unbiased. Lights that cannot
+ * contribute (behind the surface, zero intensity) are never picked, so they
+ * cost no shadow rays.
+ */
+
+#ifndef LIGHT_SELECTION_H
+#define LIGHT_SELECTION_H
+
+#include "light.h"
+#include "sampler.h"
+#include "vec3.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+/// Upper bound on the lights picked per hit
+constexpr int MAX_SELECTED_LIGHTS = 8;
+
+/**
+ * @struct SelectedLight
+ * @brief A light chosen for one shading point
+ */
+struct SelectedLight {
+  uint32_t index; ///< Index into Scene::lights
+  float weight;   ///< Estimator weight: picks / (count * probability)
+};
+
+/**
+ * @brief Estimated unshadowed contribution of a light at a shading point
+ * @param light Light to estimate
+ * @param point Shading point
+ * @param normal Surface normal at the shading point
+ * @return Luminance of intensity * cos(theta) / distance^2 (0 if the light
+ *         is behind the surface)
+ *
+ * Area lights are bounded by the sphere of Light::bounding_radius() around
+ * their position: the cosine is that of its direction closest to the
+ * normal and the distance that of its near side (but at least the radius),
+ * so a light whose centre is behind the surface still counts when part of
+ * it is in front.
+ */
+HOST_DEVICE inline float light_importance(const Light &light,
+                                          const Point3 &point,
+                                          const Vec3 &normal) {
+  Vec3 to_light = light.position - point;
+  float distance_squared = to_light.length_squared();
+  float cos_theta =
+      Vec3::dot(normal, to_light) / std::sqrt(distance_squared + 1e-12f);
+  const float radius = light.bounding_radius();
+  if (radius > 0.0f) {
+    float distance = std::sqrt(distance_squared);
+    float sin_alpha = radius / distance; // Angular radius of the bounds
+    float cos_alpha = std::sqrt(std::max(0.0f, 1.0f - sin_alpha * sin_alpha));
+    if (sin_alpha >= 1.0f || cos_theta >= cos_alpha) {
+      cos_theta = 1.0f; // Part of the bounds straight above the surface
+    } else {
+      // cos(theta - alpha)
+      float sin_theta =
+          std::sqrt(std::max(0.0f, 1.0f - cos_theta * cos_theta));
+      cos_theta = cos_theta * cos_alpha + sin_theta * sin_alpha;
+    }
+    float near = std::max(distance - radius, radius);
+    distance_squared = near * near;
+  }
+  if (cos_theta <= 0.0f)
+    return 0.0f;
+  float luminance = 0.2126f * light.intensity.x + 0.7152f * light.intensity.y +
+                    0.0722f * light.intensity.z;
+  return luminance * cos_theta / (distance_squared + 1e-4f);
+}
+
+/**
+ * @brief Pick lights in proportion to their estimated contribution
+ * @param lights Scene lights
+ * @param point Shading point
+ * @param normal Surface normal at the shading point
+ * @param count Number of picks (clamped to MAX_SELECTED_LIGHTS)
+ * @param sampler Per-thread sample source
+ * @param selected Output array of at least MAX_SELECTED_LIGHTS entries
+ * @return Number of distinct lights written to selected (0 if no light can
+ *         contribute)
+ *
+ * The picks are stratified (one uniform per 1/count slice of the
+ * distribution) and a light picked several times is returned once with the
+ * summed weight.
+ */
+int select_lights(const std::vector<Light> &lights, const Point3 &point,
+                  const Vec3 &normal, int count, Sampler &sampler,
+                  SelectedLight *selected);
+
+#endif // LIGHT_SELECTION_H
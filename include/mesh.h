@@ -0,0 +1,282 @@
+/**
+ * @file mesh.h
+ * @brief Indexed triangle meshes with SIMD batch intersection
+ * @author Alexei Czornyj
+ * @date 2025
+ *
+ * A TriangleMesh stores shared vertex positions and three vertex ids per
+ * triangle, nothing per triangle beyond that; its BVH references triangles
+ * by id, like the scene's BVH references spheres. For tracing, the
+ * triangles are packed in leaf order as a first vertex and two edges per
+ * slot (TriangleSoA), so a leaf is tested with one Möller-Trumbore kernel
+ * call over 4, 8 or 16 triangles (SSE4.1, AVX2 or AVX-512), chosen the
+ * same way as the sphere kernels.
+ *
+ * Triangles are two-sided and flat shaded: hit records carry the geometric
+ * normal, whose outward side is the counter-clockwise one.
+ */
+
+#ifndef MESH_H
+#define MESH_H
+
+#include "aabb.h"
+#include "aligned_allocator.h"
+#include "bvh.h"
+#include "kestrel.h"
+#include "ray.h"
+#include "vec3.h"
+#include <cmath>
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+/**
+ * @brief Möller-Trumbore ray-triangle test with precomputed edges
+ * @param ray The ray to test
+ * @param v0 First vertex
+ * @param e1 Second vertex minus the first
+ * @param e2 Third vertex minus the first
+ * @param t_min Minimum valid t parameter
+ * @param t_max Maximum valid t parameter
+ * @param t Output: distance of the hit (set only on a hit)
+ * @return True if the ray hits the triangle, from either side, within
+ *         [t_min, t_max]
+ *
+ * The reference for the SIMD kernels, which evaluate the same expressions.
+ */
+inline bool intersect_triangle(const Ray &ray, const Point3 &v0,
+                               const Vec3 &e1, const Vec3 &e2, float t_min,
+                               float t_max, float &t) {
+  const Vec3 p = Vec3::cross(ray.direction, e2);
+  const float det = Vec3::dot(e1, p);
+  if (det == 0.0f)
+    return false;
+  const float inv_det = 1.0f / det;
+  const Vec3 s = ray.origin - v0;
+  const float u = Vec3::dot(s, p) * inv_det;
+  const Vec3 q = Vec3::cross(s, e1);
+  const float v = Vec3::dot(ray.direction, q) * inv_det;
+  const float root = Vec3::dot(e2, q) * inv_det;
+  if (!(u >= 0.0f && v >= 0.0f && u + v <= 1.0f && root >= t_min &&
+        root <= t_max))
+    return false;
+  t = root;
+  return true;
+}
+
+/**
+ * @struct TriangleBatch
+ * @brief Raw view of the packed arrays handed to the SIMD kernels
+ */
+struct TriangleBatch {
+  const float *v0x, *v0y, *v0z; ///< First vertices
+  const float *e1x, *e1y, *e1z; ///< First edges (v1 - v0)
+  const float *e2x, *e2y, *e2z; ///< Second edges (v2 - v0)
+};
+
+/**
+ * @struct TriangleKernels
+ * @brief Intersection kernels for one instruction set
+ *
+ * Both kernels test the triangles in slots [first, first + count).
+ */
+struct TriangleKernels {
+  const char *name; ///< Human-readable ISA name
+  int lanes;        ///< Triangles tested per instruction
+
+  /**
+   * Closest hit: returns the slot of the nearest triangle hit in
+   * [t_min, t_max] and lowers t_max to its distance, or -1 if none.
+   */
+  int (*closest)(const TriangleBatch &triangles, const Ray &ray,
+                 uint32_t first, uint32_t count, float t_min, float &t_max);
+
+  /// Any hit: returns true if at least one triangle is hit in [t_min, t_max]
+  bool (*any)(const TriangleBatch &triangles, const Ray &ray, uint32_t first,
+              uint32_t count, float t_min, float t_max);
+};
+
+/**
+ * @brief Get the kernels selected for this build and CPU
+ * @return Kernel table, chosen once on first use (the same ISA as
+ *         sphere_kernels())
+ */
+const TriangleKernels &triangle_kernels();
+
+/**
+ * @class TriangleSoA
+ * @brief Packed triangle store in structure-of-arrays layout
+ *
+ * Slots are stored in the order given to build() (the BVH primitive order,
+ * so that each leaf is a contiguous range). Arrays are padded by at least
+ * one full 16-lane vector of degenerate triangles so kernels may load past
+ * the last slot.
+ */
+class TriangleSoA {
+public:
+  /// Padding (in slots) appended after the last triangle
+  static constexpr uint32_t PADDING = 16;
+
+  /**
+   * @brief Pack triangles into SoA arrays
+   * @param vertices Vertex positions
+   * @param indices Three vertex ids per triangle
+   * @param order Slot i receives triangle order[i]
+   */
+  void build(const std::vector<Point3> &vertices,
+             const std::vector<uint32_t> &indices,
+             const std::vector<uint32_t> &order);
+
+  /**
+   * @brief Discard the packed arrays
+   */
+  void clear();
+
+  /**
+   * @brief Number of packed triangles (excluding padding)
+   * @return Triangle count
+   */
+  uint32_t size() const { return count; }
+
+  /**
+   * @brief Find the closest triangle hit among a range of slots
+   * @param ray The ray to test
+   * @param first First slot of the range
+   * @param n Number of slots in the range
+   * @param t_min Minimum valid t parameter
+   * @param t_max In: maximum valid t. Out: distance of the closest hit
+   * @return Slot of the closest hit, or -1 if nothing was hit
+   */
+  int closest(const Ray &ray, uint32_t first, uint32_t n, float t_min,
+              float &t_max) const {
+    return kernels->closest(batch(), ray, first, n, t_min, t_max);
+  }
+
+  /**
+   * @brief Test whether any triangle in a range of slots is hit
+   * @param ray The ray to test
+   * @param first First slot of the range
+   * @param n Number of slots in the range
+   * @param t_min Minimum valid t parameter
+   * @param t_max Maximum valid t parameter
+   * @return True if at least one triangle is hit
+   */
+  bool any(const Ray &ray, uint32_t first, uint32_t n, float t_min,
+           float t_max) const {
+    return kernels->any(batch(), ray, first, n, t_min, t_max);
+  }
+
+  /**
+   * @brief Visit the packed arrays (e.g. to place their pages)
+   * @param visit Callable `void(const void *data, size_t bytes)`
+   */
+  template <typename Visitor> void for_each_array(Visitor &&visit) const {
+    for (const AlignedVector<float> *a :
+         {&v0x, &v0y, &v0z, &e1x, &e1y, &e1z, &e2x, &e2y, &e2z})
+      visit(a->data(), a->size() * sizeof(float));
+  }
+
+private:
+  AlignedVector<float> v0x, v0y, v0z, e1x, e1y, e1z, e2x, e2y, e2z;
+  uint32_t count = 0;
+  const TriangleKernels *kernels = &triangle_kernels();
+
+  TriangleBatch batch() const {
+    return {v0x.data(), v0y.data(), v0z.data(), e1x.data(), e1y.data(),
+            e1z.data(), e2x.data(), e2y.data(), e2z.data()};
+  }
+};
+
+/**
+ * @class TriangleMesh
+ * @brief Indexed triangles with one material, their BVH and packed leaves
+ */
+class TriangleMesh {
+public:
+  std::vector<Point3> vertices;  ///< Vertex positions in world space
+  std::vector<uint32_t> indices; ///< Three vertex ids per triangle
+  uint32_t material = 0;         ///< Id of the material in Scene::materials
+  BVH bvh;                       ///< Hierarchy over the triangles
+  TriangleSoA packed;            ///< Triangles in leaf order for SIMD tests
+
+  /**
+   * @brief Number of triangles
+   * @return indices.size() / 3
+   */
+  size_t triangle_count() const { return indices.size() / 3; }
+
+  /**
+   * @brief Check that every vertex id refers to a vertex
+   * @return True if the index array is whole triangles of valid ids
+   */
+  bool valid() const;
+
+  /**
+   * @brief Build the BVH and pack its leaves; call after changing the mesh
+   */
+  void build();
+
+  /**
+   * @brief Use a hierarchy built earlier over the current triangles
+   * @param nodes Flattened BVH nodes (e.g. from a scene cache)
+   * @param prim_indices Triangle id of every leaf slot
+   * @return True if the tree is well formed and has a slot per triangle;
+   *         otherwise the mesh is left without a hierarchy
+   */
+  bool adopt_bvh(std::vector<BVHNode> nodes,
+                 std::vector<uint32_t> prim_indices);
+
+  /**
+   * @brief Discard the BVH; queries fall back to a linear scan
+   */
+  void clear_bvh();
+
+  /**
+   * @brief Bounds of all vertices
+   * @return World-space box (empty without vertices)
+   */
+  AABB bounds() const;
+
+  /**
+   * @brief Find the closest triangle along a ray
+   * @param ray The ray to test
+   * @param t_min Minimum valid t parameter
+   * @param t_max In: maximum valid t parameter. Out: t of the closest hit
+   * @param triangle Output: id of the triangle hit (set only on a hit)
+   * @param stats Optional counters for the traversal work
+   * @return True if a triangle is hit before t_max
+   */
+  bool hit(const Ray &ray, float t_min, float &t_max, uint32_t &triangle,
+           TraversalStats *stats = nullptr) const;
+
+  /**
+   * @brief Test whether any triangle blocks a ray segment
+   * @param ray The ray to test
+   * @param t_min Minimum valid t parameter
+   * @param t_max Maximum valid t parameter
+   * @param stats Optional counters for the traversal work
+   * @return True if a triangle is hit within [t_min, t_max]
+   */
+  bool occluded(const Ray &ray, float t_min, float t_max,
+                TraversalStats *stats = nullptr) const;
+
+  /**
+   * @brief Fill a hit record for a hit found by hit()
+   * @param ray The ray that hit the triangle
+   * @param triangle Id of the triangle
+   * @param t Distance of the hit
+   * @param rec Output: point, geometric normal, t and material
+   */
+  void finalize(const Ray &ray, uint32_t triangle, float t,
+                HitRecord &rec) const;
+
+private:
+  /// Corners of a triangle
+  void corners(uint32_t triangle, Point3 &v0, Point3 &v1, Point3 &v2) const {
+    v0 = vertices[indices[3 * triangle]];
+    v1 = vertices[indices[3 * triangle + 1]];
+    v2 = vertices[indices[3 * triangle + 2]];
+  }
+};
+
+#endif // MESH_H
@@ -0,0 +1,37 @@
+/**
+ * @file mesh_file.h
+ * @brief Streaming OBJ and PLY readers for triangle meshes
+ * @author Alexei Czornyj
+ * @date 2025
+ *
+ * Both readers go through the file once in fixed-size chunks and append
+ * straight into the mesh's vertex and index arrays, so a mesh of millions
+ * of triangles needs no memory beyond its own arrays.
+ *
+ * OBJ: "v" and "f" statements are read (faces may use the v/vt/vn forms and
+ * negative, relative indices); every other statement is skipped. PLY: ASCII
+ * and binary files of either byte order, with the x, y and z properties of
+ * the "vertex" element and the vertex_indices (or vertex_index) list of the
+ * "face" element; other elements and properties are skipped. Polygons with
+ * more than three corners are split into a triangle fan.
+ */
+
+#ifndef MESH_FILE_H
+#define MESH_FILE_H
+
+#include "mesh.h"
+#include <string>
+
+/**
+ * @brief Read an OBJ or PLY file into a mesh
+ * @param path File to read; the format is chosen by its .obj or .ply
+ *        extension
+ * @param mesh Output: the file's vertices and triangles are appended (its
+ *        material and BVH are left alone)
+ * @param error Set to a message naming the file and line on failure
+ * @return True if the whole file was read
+ */
+bool load_mesh(const std::string &path, TriangleMesh &mesh,
+               std::string &error);
+
+#endif // MESH_FILE_H
@@ -0,0 +1,102 @@
+/**
+ * @file preview.h
+ * @brief Interactive preview: coarse-to-fine rendering that follows camera
+ *        updates read from a command stream
+ * @author Alexei Czornyj
+ * @date 2025
+ *
+ * After every camera update the preview renders the view at 1/8, 1/4 and
+ * 1/2 of the image resolution with one sample per pixel, then keeps adding
+ * passes to a full-resolution Framebuffer until the sample budget is spent.
+ * Each level is handed to a callback as soon as it is done, so the first
+ * image of a new view costs 1/64 of a full-resolution pass.
+ *
+ * Commands are read on a thread of their own, one per line:
+ *
+ *     camera <look_from> <look_at> <vfov>
+ *     quit
+ *
+ * A camera update cancels the render in flight (the threads stop at the
+ * next tile, see RenderSettings::cancel) and restarts at the coarsest
+ * level; an update to the view already shown is ignored, so its samples
+ * keep accumulating. At the end of the input the current view is refined
+ * to the end before run_preview returns; "quit" returns right away.
+ */
+
+#ifndef PREVIEW_H
+#define PREVIEW_H
+
+#include "renderer.h"
+#include "scene.h"
+#include "scene_file.h"
+#include "thread_pool.h"
+#include "vec3.h"
+#include <functional>
+#include <istream>
+#include <string>
+#include <vector>
+
+/// Resolution divisors of the preview levels, coarsest first; after the
+/// last one the image refines at full resolution
+constexpr int PREVIEW_SCALES[] = {8, 4, 2};
+
+/**
+ * @struct PreviewImage
+ * @brief One level of the preview, as handed to the PreviewCallback
+ */
+struct PreviewImage {
+  int scale = 1;             ///< Resolution divisor (1 = full resolution)
+  int width = 0;             ///< Width of this level in pixels
+  int height = 0;            ///< Height of this level in pixels
+  int samples_per_pixel = 0; ///< Samples behind every pixel so far
+  double render_ms = 0.0;    ///< Time spent rendering this level
+  double latency_ms = 0.0;   ///< Time since the camera update
+  /// Row-major linear pixels (row 0 at the bottom, as from render_scene)
+  std::vector<Color> pixels;
+};
+
+/// Called with every finished preview level, from the render loop
+using PreviewCallback = std::function<void(const PreviewImage &image)>;
+
+/**
+ * @struct PreviewReport
+ * @brief What a preview session did
+ */
+struct PreviewReport {
+  int updates = 0;           ///< Camera updates that changed the view
+  int images = 0;            ///< Images handed to the callback
+  int cancelled = 0;         ///< Renders cut short by an update
+  double max_latency_ms = 0; ///< Longest time from an update to its first
+                             ///< image
+};
+
+/**
+ * @brief Parse one line of the preview protocol
+ * @param text Command line ("#" starts a comment, blank lines are ignored)
+ * @param view Camera placement, updated by a camera command (vup is kept)
+ * @param quit Set to true by a quit command
+ * @param error Set to a message for an unknown or malformed command
+ * @return True if the line is valid
+ */
+bool parse_preview_command(const std::string &text, SceneCamera &view,
+                           bool &quit, std::string &error);
+
+/**
+ * @brief Run an interactive preview until the commands end or ask to quit
+ * @param scene Scene to render (with its BVH built)
+ * @param view Initial camera placement
+ * @param settings Full-resolution image size, tile size, engine, sampler
+ *        and light samples; samples_per_pixel is the budget of a view and
+ *        pass_samples the samples added by each full-resolution pass
+ *        (progressive and adaptive sampling do not apply)
+ * @param commands Stream the protocol is read from (e.g. std::cin)
+ * @param on_image Called with every finished level
+ * @param pool Render threads, reused for every level
+ * @return Update, image and latency counts of the session
+ */
+PreviewReport run_preview(const Scene &scene, const SceneCamera &view,
+                          const RenderSettings &settings,
+                          std::istream &commands,
+                          const PreviewCallback &on_image, ThreadPool &pool);
+
+#endif // PREVIEW_H
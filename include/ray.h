@@ -25,21 +25,24 @@ public:
   /**
    * @brief Default constructor
    */
-  HOST_DEVICE Ray() {}
+  HOST_DEVICE constexpr Ray() {}
 
   /**
    * @brief Construct ray from origin and direction
    * @param origin Starting point of the ray
    * @param direction Direction vector of the ray
    */
-  HOST_DEVICE Ray(const Point3 &origin, const Vec3 &direction);
+  HOST_DEVICE constexpr Ray(const Point3 &origin, const Vec3 &direction)
+      : origin(origin), direction(direction) {}
 
   /**
    * @brief Evaluate ray at parameter t
    * @param t Parameter value (distance along ray)
    * @return Point on the ray at distance t: origin + t * direction
    */
-  HOST_DEVICE Point3 at(float t) const;
+  HOST_DEVICE constexpr Point3 at(float t) const {
+    return origin + t * direction;
+  }
 };
 
 #endif
\ No newline at end of file
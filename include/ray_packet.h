@@ -0,0 +1,131 @@
+/**
+ * @file ray_packet.h
+ * @brief Bundle of rays from a common origin, traced through the BVH together
+ * @author Alexei Czornyj
+ * @date 2025
+ *
+ * Camera rays of neighbouring pixels leave the same eye point in almost the
+ * same direction, and so do the shadow rays cast from one point light
+ * towards a patch of surface. A packet traverses the hierarchy once for all
+ * of its rays: BVH::intersect_packet and BVH::occluded_packet first reject a
+ * node for the whole packet with one interval-arithmetic frustum test, then
+ * only test the rays after the first one that enters it.
+ */
+
+#ifndef RAY_PACKET_H
+#define RAY_PACKET_H
+
+#include "aabb.h"
+#include "ray.h"
+#include "vec3.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+/// Edge length of the pixel blocks whose camera rays form one packet
+constexpr int PACKET_EDGE = 8;
+
+/**
+ * @class RayPacket
+ * @brief Up to MAX_RAYS rays sharing an origin
+ *
+ * Keeps the range of the inverse direction of its rays on every axis. On an
+ * axis where all rays point the same way, the entry and exit distances of a
+ * box slab are linear in the inverse direction, so their bounds over the
+ * packet follow from the two ends of the range (frustum_misses).
+ */
+class RayPacket {
+public:
+  /// Largest packet: one ray per pixel of a PACKET_EDGE x PACKET_EDGE block
+  static constexpr int MAX_RAYS = PACKET_EDGE * PACKET_EDGE;
+
+  Point3 origin;            ///< Origin of every ray
+  Vec3 direction[MAX_RAYS]; ///< Direction of each ray
+  Vec3 inv_dir[MAX_RAYS];   ///< Component-wise reciprocal of direction
+  int count = 0;            ///< Rays in the packet
+
+  /**
+   * @brief Construct an empty packet at the world origin
+   */
+  RayPacket() { reset(Point3(0.0f)); }
+
+  /**
+   * @brief Empty the packet
+   * @param o Origin of the rays added next
+   */
+  void reset(const Point3 &o) {
+    origin = o;
+    count = 0;
+    for (int a = 0; a < 3; ++a) {
+      inv_lo[a] = std::numeric_limits<float>::infinity();
+      inv_hi[a] = -std::numeric_limits<float>::infinity();
+    }
+  }
+
+  /**
+   * @brief Add a ray; the packet must not be full
+   * @param d Direction of the ray (not necessarily normalized)
+   * @return Index of the ray in the packet
+   */
+  int add(const Vec3 &d) {
+    direction[count] = d;
+    inv_dir[count] = Vec3(1.0f / d.x, 1.0f / d.y, 1.0f / d.z);
+    const float inv[3] = {inv_dir[count].x, inv_dir[count].y,
+                          inv_dir[count].z};
+    for (int a = 0; a < 3; ++a) {
+      inv_lo[a] = std::min(inv_lo[a], inv[a]);
+      inv_hi[a] = std::max(inv_hi[a], inv[a]);
+      // Mixed signs (or axis-parallel rays) leave the axis unbounded
+      coherent[a] = std::isfinite(inv_lo[a]) && std::isfinite(inv_hi[a]) &&
+                    (inv_lo[a] > 0.0f || inv_hi[a] < 0.0f);
+    }
+    return count++;
+  }
+
+  /**
+   * @brief Check whether the packet is full
+   * @return True once MAX_RAYS rays have been added
+   */
+  bool full() const { return count == MAX_RAYS; }
+
+  /**
+   * @brief One ray of the packet
+   * @param i Ray index in [0, count)
+   * @return The ray
+   */
+  Ray ray(int i) const { return Ray(origin, direction[i]); }
+
+  /**
+   * @brief Conservative test that no ray of the packet overlaps a box
+   * @param box Box to test
+   * @param t_min Minimum valid t of every ray
+   * @param t_max Largest maximum valid t of any ray
+   * @return True only if every ray misses the box within [t_min, t_max];
+   *         false means some ray may hit it
+   */
+  bool frustum_misses(const AABB &box, float t_min, float t_max) const {
+    const float lo[3] = {box.min.x, box.min.y, box.min.z};
+    const float hi[3] = {box.max.x, box.max.y, box.max.z};
+    const float o[3] = {origin.x, origin.y, origin.z};
+    float t0 = t_min, t1 = t_max;
+    for (int a = 0; a < 3; ++a) {
+      if (!coherent[a])
+        continue;
+      // Rays moving towards +a enter through the min plane
+      const bool positive = inv_lo[a] > 0.0f;
+      const float d_near = (positive ? lo[a] : hi[a]) - o[a];
+      const float d_far = (positive ? hi[a] : lo[a]) - o[a];
+      // Earliest entry and latest exit of any ray on this axis
+      t0 = std::max(t0, std::min(d_near * inv_lo[a], d_near * inv_hi[a]));
+      t1 = std::min(t1, std::max(d_far * inv_lo[a], d_far * inv_hi[a]));
+    }
+    return t0 > t1;
+  }
+
+private:
+  float inv_lo[3] = {};  ///< Smallest inverse direction on each axis
+  float inv_hi[3] = {};  ///< Largest inverse direction on each axis
+  bool coherent[3] = {}; ///< All rays point the same way on the axis
+};
+
+#endif // RAY_PACKET_H
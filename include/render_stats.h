@@ -0,0 +1,141 @@
+/**
+ * @file render_stats.h
+ * @brief Per-thread render counters, stage timers and trace events
+ * @author Alexei Czornyj
+ * @date 2025
+ *
+ * Every render thread owns a RenderStats and passes it down the shading
+ * call chain next to its Sampler; render_scene merges them once the frame
+ * is done, so counting never touches shared memory. Stage timers cost two
+ * clock reads each and only measure when RenderStats::timed is set. Trace
+ * events (one per tile and pass) can be written in the Chrome trace format
+ * and opened in chrome://tracing or Perfetto.
+ */
+
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+#include "bvh.h"
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Render stages timed by ScopedTimer
+ */
+enum class RenderStage : uint8_t {
+  CAMERA,    ///< Pixel sample setup and camera ray generation
+  INTERSECT, ///< Closest-hit queries (Scene::hit)
+  SHADE,     ///< Direct lighting with its shadow rays, and path continuation
+  WRITE      ///< Writing the output image
+};
+
+/// Number of RenderStage values
+constexpr int RENDER_STAGE_COUNT = 4;
+
+/**
+ * @brief Get the display name of a stage
+ * @param stage Render stage
+ * @return "camera", "intersect", "shade" or "write"
+ */
+const char *render_stage_name(RenderStage stage);
+
+/**
+ * @struct RenderStats
+ * @brief Work counters and stage times of one thread, or of a whole frame
+ *
+ * Cache-line aligned: the render threads bump their own counters several
+ * times per ray, and neighbours in an array must not share a line.
+ */
+struct alignas(64) RenderStats {
+  uint64_t camera_rays = 0;     ///< Camera rays generated
+  uint64_t closest_queries = 0; ///< Closest-hit queries (camera and bounces)
+  uint64_t shadow_rays = 0;     ///< Any-hit queries towards the lights
+  uint64_t bounces = 0;         ///< Surface hits shaded
+  TraversalStats traversal;     ///< BVH work of both kinds of query
+  double stage_ms[RENDER_STAGE_COUNT] = {}; ///< Time per stage (if timed)
+  bool timed = false; ///< Whether ScopedTimer measures into stage_ms
+
+  /**
+   * @brief Add another thread's counters and stage times to these
+   * @param other Counters to add
+   */
+  void merge(const RenderStats &other);
+};
+
+/**
+ * @class ScopedTimer
+ * @brief Adds the lifetime of a scope to one stage of a RenderStats
+ *
+ * Does nothing (not even read the clock) when stats is null or not timed.
+ */
+class ScopedTimer {
+public:
+  /**
+   * @brief Start timing
+   * @param stats Counters to add the time to; may be null
+   * @param stage Stage the scope belongs to
+   */
+  ScopedTimer(RenderStats *stats, RenderStage stage)
+      : stats(stats && stats->timed ? stats : nullptr), stage(stage) {
+    if (this->stats)
+      start = std::chrono::steady_clock::now();
+  }
+
+  ScopedTimer(const ScopedTimer &) = delete;
+  ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+  ~ScopedTimer() {
+    if (stats)
+      stats->stage_ms[static_cast<int>(stage)] +=
+          std::chrono::duration<double, std::milli>(
+              std::chrono::steady_clock::now() - start)
+              .count();
+  }
+
+private:
+  RenderStats *stats;
+  RenderStage stage;
+  std::chrono::steady_clock::time_point start;
+};
+
+/**
+ * @struct TraceEvent
+ * @brief A span of work on one thread ("complete" event of a Chrome trace)
+ */
+struct TraceEvent {
+  std::string name;         ///< Label shown on the timeline
+  int thread = 0;           ///< Render thread (-1 for the main thread)
+  double start_us = 0.0;    ///< Start, in trace_clock_us() time
+  double duration_us = 0.0; ///< Length of the span
+  std::vector<std::pair<std::string, double>> args; ///< Values shown with it
+};
+
+/**
+ * @brief Read the clock trace events are measured with
+ * @return Microseconds since the first call in this process
+ */
+double trace_clock_us();
+
+/**
+ * @brief Print a summary of a frame's counters and stage times
+ * @param out Stream to print to
+ * @param stats Merged counters of the frame
+ */
+void print_render_stats(std::ostream &out, const RenderStats &stats);
+
+/**
+ * @brief Write trace events and counters as a Chrome trace (JSON)
+ * @param path Output file
+ * @param events Events to write
+ * @param stats Merged counters, stored in the trace's "otherData"
+ * @return True on success
+ */
+bool write_chrome_trace(const std::string &path,
+                        const std::vector<TraceEvent> &events,
+                        const RenderStats &stats);
+
+#endif // RENDER_STATS_H
@@ -0,0 +1,341 @@
+/**
+ * @file renderer.h
+ * @brief Ray shading and the multithreaded render loop
+ * @author Alexei Czornyj
+ * @date 2025
+ */
+
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include "camera.h"
+#include "framebuffer.h"
+#include "kestrel.h"
+#include "ray.h"
+#include "ray_packet.h"
+#include "render_stats.h"
+#include "sampler.h"
+#include "scene.h"
+#include "scheduler.h"
+#include "thread_pool.h"
+#include "vec3.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/// Maximum number of bounces of a camera path
+constexpr int MAX_BOUNCES = 10;
+
+/// Bounces before Russian roulette may terminate a path
+constexpr int RUSSIAN_ROULETTE_DEPTH = 2;
+
+/// Paths whose largest throughput component falls below this are subject to
+/// Russian roulette
+constexpr float RUSSIAN_ROULETTE_THRESHOLD = 0.25f;
+
+/**
+ * @struct PathState
+ * @brief Everything needed to continue a camera path at its next bounce
+ *
+ * The bounce loop carries this explicitly instead of using the call stack,
+ * so paths can be traced one at a time (ray_color) or advanced in batches
+ * one bounce at a time.
+ */
+struct PathState {
+  Ray ray;          ///< Ray to trace at the next bounce
+  Color throughput; ///< Product of the reflectances along the path so far
+  Color radiance;   ///< Radiance gathered so far
+  int bounce = 0;   ///< Number of surfaces hit so far
+
+  /**
+   * @brief Start a path along a camera ray
+   * @param ray Primary ray
+   */
+  HOST_DEVICE explicit PathState(const Ray &ray)
+      : ray(ray), throughput(1.0f), radiance(0.0f) {}
+};
+
+/**
+ * @brief Direct lighting from the scene lights at a hit point
+ * @param rec Surface hit
+ * @param scene Scene providing lights and shadow-ray occlusion
+ * @param sampler Per-thread sample source
+ * @param light_samples Lights to shade, picked by select_lights (0 = every
+ *        light)
+ * @param stats Optional per-thread counters (shadow rays)
+ * @return Unweighted direct radiance towards the viewer
+ */
+Color direct_lighting(const HitRecord &rec, const Scene &scene,
+                      Sampler &sampler, int light_samples = 0,
+                      RenderStats *stats = nullptr);
+
+/**
+ * @brief Russian roulette on a path's throughput
+ * @param throughput Path throughput, reweighted if the path survives
+ * @param bounce Number of surfaces the path has hit so far
+ * @param sampler Per-thread sample source
+ * @return False if the path should be terminated
+ */
+bool survives_roulette(Color &throughput, int bounce, Sampler &sampler);
+
+/**
+ * @brief Shade one hit and advance the path to its next bounce
+ * @param path Path to update (radiance, throughput, ray, bounce)
+ * @param rec Surface hit by path.ray
+ * @param scene Scene being rendered
+ * @param sampler Per-thread sample source
+ * @param light_samples Lights shaded per hit (0 = every light)
+ * @param stats Optional per-thread counters (bounces, shadow rays)
+ * @return True if the path continues (mirror reflection survived Russian
+ *         roulette), false if it terminated
+ */
+bool shade_hit(PathState &path, const HitRecord &rec, const Scene &scene,
+               Sampler &sampler, int light_samples = 0,
+               RenderStats *stats = nullptr);
+
+/**
+ * @brief Advance a path past a shaded hit (the second half of shade_hit)
+ * @param path Path to update (throughput, ray, bounce)
+ * @param rec Surface hit by path.ray
+ * @param scene Scene being rendered
+ * @param sampler Per-thread sample source, at the bounce of the hit
+ * @return True if the path continues along the mirror direction
+ */
+bool reflect_path(PathState &path, const HitRecord &rec, const Scene &scene,
+                  Sampler &sampler);
+
+/**
+ * @brief Trace a path from its current state until it terminates
+ * @param path Path to continue; its radiance accumulates the result
+ * @param scene Scene being rendered
+ * @param sampler Per-thread sample source
+ * @param depth Maximum number of bounces (counting those already taken)
+ * @param light_samples Lights shaded per hit (0 = every light)
+ * @param stats Optional per-thread counters and stage timers
+ */
+void trace_path(PathState &path, const Scene &scene, Sampler &sampler,
+                int depth = MAX_BOUNCES, int light_samples = 0,
+                RenderStats *stats = nullptr);
+
+/**
+ * @brief Determine pixel color by tracing a ray through the scene
+ * @param ray The ray to trace
+ * @param scene The scene to test for intersection
+ * @param sampler Per-thread sample source
+ * @param depth Maximum number of bounces
+ * @param light_samples Lights shaded per hit (0 = every light)
+ * @param stats Optional per-thread counters and stage timers
+ * @return RGB color for this ray
+ *
+ * Iteratively accumulates direct lighting along the chain of mirror
+ * reflections, weighting each bounce by the path throughput, until the
+ * path leaves the scene, reaches a non-reflective surface, hits the depth
+ * limit or is terminated by Russian roulette.
+ */
+Color ray_color(const Ray &ray, const Scene &scene, Sampler &sampler,
+                int depth = MAX_BOUNCES, int light_samples = 0,
+                RenderStats *stats = nullptr);
+
+/**
+ * @brief ray_color for a packet of camera rays
+ * @param packet Camera rays, all from the eye
+ * @param samples Pixel sample of each ray, continued at every hit
+ * @param scene The scene to test for intersection
+ * @param sampler Per-thread sample source
+ * @param radiance Output: color of each ray
+ * @param depth Maximum number of bounces
+ * @param light_samples Lights shaded per hit (0 = every light)
+ * @param stats Optional per-thread counters and stage timers
+ *
+ * The primary hits are found with one Scene::hit_packet call. When every
+ * light is shaded, each point light then casts one packet of shadow rays
+ * to all the hits it faces. Lambertian surfaces end their path there; the
+ * mirror paths no longer share an origin and continue one by one
+ * (trace_path). Same estimator as ray_color; with per-pixel seeds the
+ * images match to rounding, as the shadow rays cover the same segments.
+ */
+void packet_color(const RayPacket &packet, const PixelSample *samples,
+                  const Scene &scene, Sampler &sampler, Color *radiance,
+                  int depth = MAX_BOUNCES, int light_samples = 0,
+                  RenderStats *stats = nullptr);
+
+/**
+ * @brief How render_scene traces the camera paths of a tile
+ */
+enum class RenderEngine {
+  PATH,      ///< One path at a time, depth-first (ray_color)
+  WAVEFRONT, ///< All paths of a tile at once, bounce by bounce (Wavefront)
+  CUDA,      ///< Wavefront stages as CUDA kernels (KESTREL_CUDA builds only)
+  PACKET     ///< Camera rays of pixel blocks as packets (packet_color)
+};
+
+/**
+ * @brief Parse an engine name ("path", "wavefront", "packet" or "cuda")
+ * @param name Engine name from the command line
+ * @param engine Output parameter set on success
+ * @return True if the name is recognised ("cuda" only with KESTREL_CUDA)
+ */
+bool parse_render_engine(const std::string &name, RenderEngine &engine);
+
+/**
+ * @brief Get the command line name of an engine
+ * @param engine Render engine
+ * @return "path", "wavefront", "packet" or "cuda"
+ */
+const char *render_engine_name(RenderEngine engine);
+
+/**
+ * @struct RenderSettings
+ * @brief Image size, sampling and threading parameters for render_scene
+ */
+struct RenderSettings {
+  int image_width = 1920;     ///< Width of the image in pixels
+  int image_height = 1080;    ///< Height of the image in pixels
+  int samples_per_pixel = 10; ///< Samples per pixel (average budget when
+                              ///< adaptive)
+  int num_threads = 1;        ///< Number of threads to use for rendering
+  int tile_size = 32;         ///< Edge length of the square render tiles
+  RenderEngine engine = RenderEngine::PATH; ///< How paths are traced
+  SamplerType sampler = SamplerType::RANDOM; ///< Sequence of the samples
+
+  /// Lights shaded per hit, picked in proportion to their estimated
+  /// contribution (0 = every light; at most MAX_SELECTED_LIGHTS)
+  int light_samples = 0;
+
+  /// Progressive mode: render in passes of pass_samples samples per pixel and
+  /// report the image after every pass
+  bool progressive = false;
+  int pass_samples = 1; ///< Samples per pixel added by each progressive pass
+
+  /// Adaptive mode: stop sampling pixels whose estimate has converged and
+  /// spend the saved budget on the remaining ones
+  bool adaptive = false;
+  float noise_threshold = 0.01f; ///< Target relative standard error
+  int min_samples = 8;           ///< Samples before a pixel may converge
+  int max_samples = 0; ///< Per-pixel cap (0 = 8 x samples_per_pixel)
+
+  /// Time the render stages (RenderReport::stats.stage_ms); costs two clock
+  /// reads per stage of every path
+  bool profile = false;
+  /// Record a TraceEvent for every tile and pass in RenderReport::trace
+  bool trace = false;
+
+  /// Tiles to render, as positions in the make_tiles order (empty = every
+  /// tile); pixels outside them are left untouched
+  std::vector<uint32_t> tile_ids;
+  /// Give every tile of every pass its own PCG32 stream instead of one per
+  /// thread, so a tile renders the same whichever thread or node takes it
+  bool tile_seeds = false;
+  /// Seed every pixel sample, and each of its bounces, from its pixel,
+  /// sample number and bounce alone (Sampler::set_pixel_seeds), so the image
+  /// is the same for every thread count, tile size and tile order
+  bool pixel_seeds = false;
+  /// Do not print the tile progress
+  bool quiet = false;
+  /// Sample storage of render_scene into an image (a caller-provided
+  /// Framebuffer has its own)
+  FramebufferFormat framebuffer = FramebufferFormat::FLOAT32;
+  /// Checked before every tile: once set, the remaining tiles and passes
+  /// are skipped and RenderReport::cancelled is set (CUDA renders always
+  /// run to the end)
+  const std::atomic<bool> *cancel = nullptr;
+};
+
+/**
+ * @struct RenderReport
+ * @brief What render_scene did: scheduling and sample statistics
+ */
+struct RenderReport {
+  std::vector<ThreadTiming> threads; ///< Busy/idle time of each thread
+  int passes = 0;                    ///< Number of passes rendered
+  uint64_t samples = 0;              ///< Camera samples traced in total
+  size_t converged_pixels = 0;       ///< Pixels that met the noise threshold
+  RenderStats stats;                 ///< Counters merged over all threads
+  std::vector<TraceEvent> trace;     ///< Tile and pass spans (if traced)
+  bool cancelled = false; ///< Stopped early through RenderSettings::cancel
+};
+
+/// Called after each pass with the pass index and the current image
+using PassCallback =
+    std::function<void(int pass, const std::vector<Color> &pixels)>;
+
+/// Called after each pass with the pass index and the samples so far
+using FramebufferCallback =
+    std::function<void(int pass, const Framebuffer &framebuffer)>;
+
+/**
+ * @brief Render the scene into the pixel buffer using multithreading
+ * @param scene The scene to render
+ * @param camera The camera through which to render
+ * @param settings Image size, sampling and threading parameters
+ * @param pixels Output pixel buffer (size = image_width * image_height)
+ * @param on_pass Optional callback invoked after every pass, while no
+ *        thread is writing to pixels (e.g. to save intermediate frames)
+ * @param pool Threads to render with, kept across calls (its size
+ *        overrides settings.num_threads); without one, the call starts
+ *        settings.num_threads threads of its own
+ * @return Busy/idle time and tile counts of each thread, plus sample counts
+ *
+ * The image is split into tiles ordered along a Morton curve and handed to
+ * the threads through a work-stealing TileScheduler, so expensive regions
+ * (e.g. mirror reflections) are shared out instead of stalling one thread at
+ * the end of the frame. With RenderEngine::WAVEFRONT every camera ray of a
+ * tile is traced as one Wavefront batch instead of one ray_color call each;
+ * RenderEngine::PACKET traces the samples of PACKET_EDGE x PACKET_EDGE
+ * pixel blocks as ray packets (packet_color).
+ * RenderEngine::CUDA hands the whole frame to render_scene_cuda (see
+ * cuda_renderer.h) and falls back to the path engine if that fails.
+ *
+ * settings.tile_ids restricts the frame to some of its tiles (the sample
+ * budget then covers only their pixels); with settings.tile_seeds such a
+ * partial render matches the same tiles of a full one bit for bit, which
+ * is what the distributed renderer (distributed.h) builds on. With
+ * settings.pixel_seeds the image does not depend on the tile layout either:
+ * every tile size, thread count and tile order gives the same pixels.
+ *
+ * By default a single pass takes samples_per_pixel samples everywhere.
+ * Progressive mode splits them into passes. Adaptive mode first takes
+ * min_samples everywhere, then keeps a running mean and variance of each
+ * pixel's display luminance (samples clamped to [0, 1]) and stops sampling a
+ * pixel once the standard error of its mean drops below noise_threshold
+ * times the mean (or an absolute 0.01 x noise_threshold for dark pixels).
+ * Later passes spread the unused part of the
+ * image_width x image_height x samples_per_pixel budget over the pixels that
+ * are still noisy.
+ */
+RenderReport render_scene(const Scene &scene, const Camera &camera,
+                          const RenderSettings &settings,
+                          std::vector<Color> &pixels,
+                          const PassCallback &on_pass = PassCallback(),
+                          ThreadPool *pool = nullptr);
+
+/**
+ * @brief Render the scene, adding the samples to a framebuffer
+ * @param scene The scene to render
+ * @param camera The camera through which to render
+ * @param settings Image size, sampling and threading parameters
+ *        (settings.framebuffer is ignored)
+ * @param framebuffer Samples to add to, of image_width x image_height
+ *        pixels; may already hold samples of earlier calls
+ * @param on_pass Optional callback invoked after every pass
+ * @param pool Threads to render with (see the image overload)
+ * @return Busy/idle time and tile counts of each thread, plus sample counts
+ *
+ * The same render as the image overload, which resolves a fresh
+ * Framebuffer into the pixel buffer. Continuing into a framebuffer that
+ * already holds samples refines it: the samples per pixel, the adaptive
+ * noise estimates and the budget count only the samples of this call,
+ * while the sample sequences continue where the earlier calls stopped.
+ * RenderEngine::CUDA is not available here and renders with the path
+ * engine.
+ */
+RenderReport render_scene(const Scene &scene, const Camera &camera,
+                          const RenderSettings &settings,
+                          Framebuffer &framebuffer,
+                          const FramebufferCallback &on_pass =
+                              FramebufferCallback(),
+                          ThreadPool *pool = nullptr);
+
+#endif // RENDERER_H
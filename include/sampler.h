@@ -0,0 +1,208 @@
+/**
+ * @file sampler.h
+ * @brief Per-thread sample source for the render loop
+ * @author Alexei Czornyj
+ * @date 2025
+ *
+ * A Sampler either hands out independent PCG32 numbers (white noise) or
+ * the dimensions of a low-discrepancy sequence for the pixel sample being
+ * traced. In the latter case every pixel sample has a fixed dimension
+ * layout: the camera dimensions first, then DIMENSIONS_PER_BOUNCE per
+ * bounce (light selection, area-light shifts, Russian roulette), so the
+ * same decision of different samples of a pixel draws from the same,
+ * well-stratified dimension.
+ */
+
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include "pcg32.h"
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Sequence a Sampler draws from
+ */
+enum class SamplerType : uint8_t {
+  RANDOM, ///< Independent PCG32 numbers; converges as O(1/sqrt(N))
+  HALTON, ///< Halton sequence, randomly shifted per pixel and dimension
+  SOBOL,  ///< Owen-scrambled Sobol sequence, shuffled per pixel
+  ZSOBOL  ///< Owen-scrambled Sobol over Morton-ordered pixels, which
+          ///< spreads the remaining error as blue noise across the image
+};
+
+/**
+ * @brief Parse a sampler name ("random", "halton", "sobol" or "zsobol")
+ * @param name Sampler name from the command line
+ * @param type Output parameter set on success
+ * @return True if the name is recognised
+ */
+bool parse_sampler_type(const std::string &name, SamplerType &type);
+
+/**
+ * @brief Get the command line name of a sampler type
+ * @param type Sampler type
+ * @return "random", "halton", "sobol" or "zsobol"
+ */
+const char *sampler_type_name(SamplerType type);
+
+/**
+ * @struct PixelSample
+ * @brief Identifies one sample of one pixel
+ */
+struct PixelSample {
+  uint32_t x = 0;     ///< Pixel column
+  uint32_t y = 0;     ///< Pixel row
+  uint32_t index = 0; ///< Sample number within the pixel
+};
+
+/**
+ * @class Sampler
+ * @brief Random number context passed down the shading call chain
+ *
+ * Each render thread owns one Sampler and passes it by reference through
+ * ray_color, the BSDFs' scatter and the light sampling, so there is no
+ * shared or hidden generator state. Samplers built with the same seed but
+ * different streams produce independent sequences.
+ *
+ * render_scene calls start_pixel_sample before the camera sample and the
+ * shading code calls start_bounce at every hit. Both are no-ops for
+ * SamplerType::RANDOM. Draws past the dimensions reserved for the current
+ * stage fall back to the PCG32 stream, which keeps them unbiased.
+ *
+ * With set_pixel_seeds, both calls also restart the PCG32 stream from a
+ * hash of the frame seed, pixel, sample number and stage, so every number a
+ * path draws depends on that path alone: not on the thread, tile or order
+ * in which its pixel is rendered.
+ *
+ * Cache-line aligned, as the renderer keeps one per thread in an array and
+ * every draw writes its state.
+ */
+class alignas(64) Sampler {
+public:
+  /// Dimensions of the camera sample (subpixel position)
+  static constexpr uint32_t CAMERA_DIMENSIONS = 2;
+  /// Dimensions reserved per bounce
+  static constexpr uint32_t DIMENSIONS_PER_BOUNCE = 8;
+
+  /**
+   * @brief Construct a sampler
+   * @param seed Initial generator state, also scrambles the sequences
+   * @param stream Stream selector (e.g. the thread index); different streams
+   *        never overlap
+   * @param type Sequence to draw from
+   */
+  Sampler(uint64_t seed, uint64_t stream,
+          SamplerType type = SamplerType::RANDOM)
+      : rng(seed, stream), type(type),
+        seed(static_cast<uint32_t>(seed ^ (seed >> 32))), frame_seed(seed) {}
+
+  /**
+   * @brief Derive the PCG32 stream from the pixel sample being traced
+   * @param enabled True to restart the stream at every start_pixel_sample
+   *        and start_bounce (see the class description)
+   */
+  void set_pixel_seeds(bool enabled) { pixel_seeds = enabled; }
+
+  /**
+   * @brief Set the frame layout used by SamplerType::ZSOBOL
+   * @param width Image width in pixels
+   * @param height Image height in pixels
+   * @param samples_per_pixel Most samples any pixel will take
+   */
+  void set_resolution(int width, int height, int samples_per_pixel);
+
+  /**
+   * @brief Start drawing the camera dimensions of a pixel sample
+   * @param sample Pixel and sample number
+   */
+  void start_pixel_sample(const PixelSample &sample) {
+    if (pixel_seeds) {
+      current = sample;
+      reseed(0);
+    }
+    if (type == SamplerType::RANDOM)
+      return;
+    current = sample;
+    pixel_seed = hash(hash(seed ^ sample.x) ^ (sample.y * 0x9e3779b9U));
+    dimension = 0;
+    dimension_end = CAMERA_DIMENSIONS;
+  }
+
+  /**
+   * @brief Start drawing the dimensions of a bounce
+   * @param bounce Bounce of the current path, 0 at the camera hit
+   */
+  void start_bounce(int bounce) {
+    if (pixel_seeds)
+      reseed(1 + static_cast<uint32_t>(bounce));
+    dimension = CAMERA_DIMENSIONS +
+                static_cast<uint32_t>(bounce) * DIMENSIONS_PER_BOUNCE;
+    dimension_end = dimension + DIMENSIONS_PER_BOUNCE;
+  }
+
+  /**
+   * @brief Draw one sample
+   * @return Float in [0, 1), the next dimension of the current sample
+   */
+  float next_1d() {
+    if (type == SamplerType::RANDOM || dimension >= dimension_end)
+      return rng.next_float();
+    return sample_dimension(dimension++);
+  }
+
+  /**
+   * @brief Get the sequence this sampler draws from
+   * @return Sampler type
+   */
+  SamplerType get_type() const { return type; }
+
+private:
+  /// Dimension of the current pixel sample (sampler.cpp)
+  float sample_dimension(uint32_t dim) const;
+
+  /// Restart the PCG32 stream for a stage (0 = camera, 1 + bounce) of the
+  /// current pixel sample
+  void reseed(uint32_t stage) {
+    const uint64_t pixel =
+        (static_cast<uint64_t>(current.y) << 32) | current.x;
+    const uint64_t key = mix64(mix64(frame_seed ^ pixel) ^
+                               ((static_cast<uint64_t>(current.index) << 16) |
+                                stage));
+    rng = PCG32(key);
+  }
+
+  /// 64-bit integer hash (the splitmix64 finalizer)
+  static uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+  }
+
+  /// 32-bit integer hash (lowbias32)
+  static uint32_t hash(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+  }
+
+  PCG32 rng;                  ///< White noise and fallback dimensions
+  SamplerType type;           ///< Sequence to draw from
+  uint32_t seed;              ///< Scrambling seed shared by the frame
+  uint64_t frame_seed;        ///< Seed the pixel streams are derived from
+  bool pixel_seeds = false;   ///< Restart the stream per pixel sample stage
+  PixelSample current;        ///< Pixel sample being traced
+  uint32_t pixel_seed = 0;    ///< Per-pixel scrambling seed
+  uint32_t dimension = 0;     ///< Next dimension to hand out
+  uint32_t dimension_end = 0; ///< End of the current stage's dimensions
+  int log2_resolution = 0;    ///< ZSOBOL: log2 of the padded image edge
+  int log2_samples = 0;       ///< ZSOBOL: log2 of the padded sample count
+};
+
+#endif // SAMPLER_H
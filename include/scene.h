@@ -8,9 +8,16 @@
 #ifndef SCENE_H
 #define SCENE_H
 
+#include "bsdfs/material_table.h"
+#include "bvh.h"
 #include "camera.h"
+#include "instance.h"
 #include "light.h"
+#include "mesh.h"
+#include "ray_packet.h"
 #include "sphere.h"
+#include "sphere_soa.h"
+#include <cstdint>
 #include <vector>
 
 /**
@@ -21,6 +28,19 @@ public:
   Camera camera;               ///< Camera used for rendering
   std::vector<Sphere> objects; ///< List of objects in the scene
   std::vector<Light> lights;   ///< List of lights in the scene
+  MaterialTable materials;     ///< Materials referenced by the objects
+  BVH bvh; ///< Optional acceleration structure over objects (see build_bvh)
+  SphereSoA packed; ///< Objects packed in BVH leaf order for SIMD tests
+  CompactSphereSoA compact; ///< Quantized leaves, used instead of packed
+                            ///< when compact_leaves is set
+  /// Pack the BVH leaves quantized (CompactSphereSoA) to cut the memory
+  /// traced per ray; set before build_bvh(). Ignored with more than
+  /// CompactSphereSoA::MAX_MATERIALS materials.
+  bool compact_leaves = false;
+  std::vector<TriangleMesh> meshes;      ///< Triangle meshes, each with a BVH
+  std::vector<GeometryBlock> geometries; ///< Geometry shared by instances
+  std::vector<Instance> instances;       ///< Placed copies of geometries
+  BVH instance_bvh; ///< Top level over the world bounds of the instances
 
   /**
    * @brief Construct a new Scene object
@@ -32,23 +52,218 @@ public:
    * @brief Add an object to the scene
    * @param obj Sphere object to add
    */
-  HOST_DEVICE void add_object(const Sphere &obj) { objects.push_back(obj); }
+  HOST_DEVICE void add_object(const Sphere &obj) {
+    objects.push_back(obj);
+    // Any existing hierarchy no longer covers every object
+    bvh.clear();
+    packed.clear();
+    compact.clear();
+  }
 
   HOST_DEVICE void add_light(const Light &light) { lights.push_back(light); }
 
+  /**
+   * @brief Add a triangle mesh
+   * @param mesh Vertices, triangles and material (its BVH is built by
+   *        build_bvh())
+   * @return Index of the mesh in meshes
+   */
+  uint32_t add_mesh(TriangleMesh mesh);
+
+  /**
+   * @brief Number of triangles over all meshes
+   * @return Sum of the mesh sizes
+   */
+  size_t triangle_count() const;
+
+  /**
+   * @brief Add a geometry block that instances can reference
+   * @param block Spheres in object space (its BVH is built by build_bvh())
+   * @return Index of the block in geometries
+   */
+  uint32_t add_geometry(GeometryBlock block);
+
+  /**
+   * @brief Place a geometry block in the scene
+   * @param geometry Index of the block (see add_geometry())
+   * @param to_world Object-to-world transform
+   * @param material Material of all the block's spheres, or
+   *        Instance::KEEP_MATERIAL for their own
+   * @return False if the block does not exist or the transform is singular
+   */
+  bool add_instance(uint32_t geometry, const Transform &to_world,
+                    uint32_t material = Instance::KEEP_MATERIAL);
+
+  /**
+   * @brief Number of spheres the instances place, counting every copy
+   * @return Sum of the block sizes over all instances
+   */
+  size_t instanced_sphere_count() const;
+
+  /**
+   * @brief Build the bounding volume hierarchy over the current objects
+   *
+   * Call once after all objects have been added and before rendering.
+   * Also packs the objects into SoA arrays in leaf order (quantized if
+   * compact_leaves is set) so each leaf is intersected with the SIMD
+   * kernels. Adding an object afterwards discards both and hit() falls back
+   * to the linear scan until they are rebuilt.
+   *
+   * The BVH of every mesh and geometry block that has none and the
+   * top-level BVH over the instances are built as well.
+   */
+  void build_bvh();
+
+  /**
+   * @brief Discard every hierarchy (objects, meshes, geometry blocks,
+   *        instances); all queries fall back to linear scans
+   */
+  void clear_bvh();
+
+  /**
+   * @brief Use a hierarchy built earlier over the current objects
+   * @param nodes Flattened BVH nodes (e.g. from a scene cache)
+   * @param prim_indices Object id of every leaf slot
+   * @return True if the tree is well formed and has a slot per object;
+   *         otherwise the scene is left without a hierarchy and
+   *         build_bvh() is still needed
+   *
+   * Skips the SAH build, which dominates the startup of large scenes; the
+   * objects are still packed for the SIMD kernels. The meshes and geometry
+   * blocks without a hierarchy and the instance level are built.
+   */
+  bool adopt_bvh(std::vector<BVHNode> nodes,
+                 std::vector<uint32_t> prim_indices);
+
+  /**
+   * @brief Bring the hierarchy up to date after objects moved
+   * @param max_sah_growth Rebuild instead once the refitted tree's SAH cost
+   *        exceeds this multiple of the cost right after the last build
+   * @return True if the tree was refitted, false if it was rebuilt (also
+   *         when there was no tree yet)
+   *
+   * For animations that only change object positions and radii: the same
+   * objects must still be in the same order. The leaves are repacked for
+   * the SIMD kernels either way.
+   */
+  bool refit_bvh(float max_sah_growth = 1.5f);
+
+  /**
+   * @brief Interleave the pages of the scene data over the NUMA nodes
+   *
+   * Every render thread reads all of it, so spreading it shares the
+   * bandwidth of every node (see interleave_pages). Call after build_bvh();
+   * does nothing on single-node machines.
+   */
+  void interleave_memory() const;
+
   /**
    * @brief Test ray against all objects in the scene for intersection
    * @param ray The ray to test
    * @param t_min Minimum valid t parameter
    * @param t_max Maximum valid t parameter
    * @param rec Output parameter filled with closest intersection details
+   * @param stats Optional counters for the traversal work
    * @return True if any intersection occurs, false otherwise
    *
-   * Iterates over all objects in the scene and finds the closest intersection
-   * point along the ray within the specified t range.
+   * Finds the closest intersection point along the ray within the specified
+   * t range, walking the BVH if one has been built and otherwise iterating
+   * over all objects. Meshes and then instances are traced after the
+   * objects, each up to the closest hit so far.
    */
   HOST_DEVICE bool hit(const Ray &ray, float t_min, float t_max,
-                       HitRecord &rec) const;
+                       HitRecord &rec,
+                       TraversalStats *stats = nullptr) const;
+
+  /**
+   * @brief Test whether anything blocks a ray segment
+   * @param ray The ray to test
+   * @param t_min Minimum valid t parameter
+   * @param t_max Maximum valid t parameter
+   * @param stats Optional counters for the traversal work
+   * @return True if at least one object is hit within [t_min, t_max]
+   *
+   * Any-hit query for shadow rays: returns on the first intersection found
+   * (in any order) and never fills a HitRecord. Uses the same acceleration
+   * structure as hit().
+   */
+  HOST_DEVICE bool occluded(const Ray &ray, float t_min, float t_max,
+                            TraversalStats *stats = nullptr) const;
+
+  /**
+   * @brief Closest intersection of every ray of a packet
+   * @param packet Rays to trace, all from the same origin
+   * @param t_min Minimum valid t parameter
+   * @param t_max Maximum valid t parameter
+   * @param recs Output: hit record of each ray that hits something
+   * @param hits Output: whether each ray hit anything
+   * @param stats Optional counters for the traversal work
+   * @return Number of rays that hit something
+   *
+   * Same results as hit() for each ray, but the BVH is walked once for the
+   * whole packet (BVH::intersect_packet). Without a BVH the rays are traced
+   * one by one.
+   */
+  int hit_packet(const RayPacket &packet, float t_min, float t_max,
+                 HitRecord *recs, bool *hits,
+                 TraversalStats *stats = nullptr) const;
+
+  /**
+   * @brief Test which rays of a packet are blocked
+   * @param packet Rays to trace, all from the same origin
+   * @param t_min Minimum valid t parameter of every ray
+   * @param t_max Maximum valid t parameter of each ray
+   * @param blocked Output: whether each ray hits an object
+   * @param stats Optional counters for the traversal work
+   * @return Number of blocked rays
+   *
+   * Packet version of occluded() (BVH::occluded_packet).
+   */
+  int occluded_packet(const RayPacket &packet, float t_min,
+                      const float *t_max, bool *blocked,
+                      TraversalStats *stats = nullptr) const;
+
+private:
+  /// SAH cost of the tree when it was last built (see refit_bvh)
+  float built_sah_cost = 0.0f;
+
+  /// Pack the objects for the leaves of the current BVH
+  void pack_leaves();
+
+  /// Build the mesh BVHs that are missing
+  void build_mesh_bvhs();
+
+  /// Build the geometry block BVHs that are missing and the instance level
+  void build_instance_bvh();
+
+  /// hit() over objects only
+  bool hit_objects(const Ray &ray, float t_min, float t_max, HitRecord &rec,
+                   TraversalStats *stats) const;
+
+  /// Closest instance hit before t_max (shrunk to it); sets the instance
+  /// and the sphere of its block that were hit
+  bool hit_instances(const Ray &ray, float t_min, float &t_max,
+                     const Instance *&instance, const Sphere *&sphere,
+                     TraversalStats *stats) const;
+
+  /// Instances of a leaf of instance_bvh, like hit_instances()
+  bool hit_instance_leaf(const Ray &ray, const BVHNode &leaf, float t_min,
+                         float &t_max, const Instance *&instance,
+                         const Sphere *&sphere, TraversalStats *stats) const;
+
+  /// Closest mesh hit before t_max (shrunk to it); sets the mesh and the
+  /// triangle that were hit
+  bool hit_meshes(const Ray &ray, float t_min, float &t_max,
+                  const TriangleMesh *&mesh, uint32_t &triangle,
+                  TraversalStats *stats) const;
+
+  /// occluded() over objects only
+  bool occluded_objects(const Ray &ray, float t_min, float t_max,
+                        TraversalStats *stats) const;
+
+  /// occluded() over the instances only
+  bool occluded_instances(const Ray &ray, float t_min, float t_max,
+                          TraversalStats *stats) const;
 };
 
 #endif // SCENE_H
@@ -0,0 +1,100 @@
+/**
+ * @file scene_file.h
+ * @brief Scene description files and their binary cache
+ * @author Alexei Czornyj
+ * @date 2025
+ *
+ * A scene file is plain text with one statement per line; '#' starts a
+ * comment and all vectors are three whitespace-separated numbers:
+ *
+ *     camera <look_from> <look_at> <vup> <vfov>
+ *     material <name> lambertian|conductor <albedo>
+ *     sphere <center> <radius> <material name>
+ *     light point <position> <intensity>
+ *     light sphere <center> <radius> <intensity> [samples]
+ *     light rect <corner> <edge_u> <edge_v> <intensity> [samples]
+ *     geometry <name>
+ *     end
+ *     instance <geometry> <offset> [rotate <axis> <degrees>]
+ *              [scale <factors>] [material <name>]
+ *     mesh <file.obj|file.ply> <material name> [rotate <axis> <degrees>]
+ *          [scale <factors>] [translate <offset>]
+ *
+ * Materials must be declared before the spheres that use them. The spheres
+ * between "geometry" and "end" form a GeometryBlock (only sphere and
+ * material statements are allowed inside), and every "instance" of it is
+ * scaled, then rotated, then translated by the offset. A "mesh" reads a
+ * triangle mesh (see mesh_file.h; the path is relative to the scene file)
+ * and transforms its vertices in the same order. See scenes/default.scene
+ * for the built-in scene in this format, scenes/instances.scene for
+ * instancing and scenes/meshes.scene for meshes.
+ *
+ * The binary cache holds the same scene, plus its BVH, as flat arrays of
+ * the in-memory records. Loading one maps the file and copies each array
+ * into the Scene in a single pass, so startup is bounded by I/O instead of
+ * parsing and the BVH build.
+ */
+
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include "camera.h"
+#include "scene.h"
+#include "vec3.h"
+#include <string>
+
+/**
+ * @struct SceneCamera
+ * @brief Camera placement read from a scene file
+ *
+ * The defaults are the camera of the built-in scene. The aspect ratio is
+ * not part of the scene; it comes from the image being rendered.
+ */
+struct SceneCamera {
+  Point3 look_from = Point3(0, 0, 0); ///< Camera position
+  Point3 look_at = Point3(0, 0, -1);  ///< Point the camera looks at
+  Vec3 vup = Vec3(0, 1, 0);           ///< "Up" direction
+  float vfov = 45.0f;                 ///< Vertical field of view in degrees
+
+  /**
+   * @brief Build the camera for an image
+   * @param aspect_ratio Image width / height
+   * @return Camera at this placement
+   */
+  Camera make(float aspect_ratio) const {
+    return Camera(look_from, look_at, vup, vfov, aspect_ratio);
+  }
+};
+
+/**
+ * @brief Load a scene file or a scene cache
+ * @param path Scene file (text) or cache written by write_scene_cache
+ * @param scene Output scene; its objects, lights and materials are replaced
+ * @param camera Output camera placement
+ * @param error Set to a message (with the line number for text files) on
+ *        failure
+ * @return True on success
+ *
+ * The format is detected from the file contents. A cache also restores
+ * the BVH when it was built for the current SIMD width; otherwise
+ * scene.bvh is left empty and build_bvh() has to be called.
+ */
+bool load_scene(const std::string &path, Scene &scene, SceneCamera &camera,
+                std::string &error);
+
+/**
+ * @brief Write a scene and its BVH (if built) as a binary cache
+ * @param path Output file
+ * @param scene Scene to store
+ * @param camera Camera placement to store
+ * @param error Set to a message on failure
+ * @return True on success
+ *
+ * Caches use the native byte order and record layout. They load on
+ * machines of the same kind, which is what they are meant for; rewrite
+ * them from the scene file anywhere else.
+ */
+bool write_scene_cache(const std::string &path, const Scene &scene,
+                       const SceneCamera &camera, std::string &error);
+
+#endif // SCENE_FILE_H
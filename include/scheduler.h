@@ -0,0 +1,97 @@
+/**
+ * @file scheduler.h
+ * @brief Tile-based work-stealing scheduler for the render loop
+ * @author Alexei Czornyj
+ * @date 2025
+ *
+ * The image is cut into square tiles ordered along a Morton (Z-order)
+ * curve. Each thread starts with a contiguous run of that order in its own
+ * deque, takes work from the front of it, and when it runs dry steals from
+ * the back of another thread's deque.
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * @struct Tile
+ * @brief Rectangular block of pixels [x0, x1) x [y0, y1)
+ */
+struct Tile {
+  int x0, y0; ///< Inclusive lower corner
+  int x1, y1; ///< Exclusive upper corner
+};
+
+/**
+ * @brief Split an image into tiles ordered along a Morton curve
+ * @param width Image width in pixels
+ * @param height Image height in pixels
+ * @param tile_size Tile edge length in pixels (edge tiles may be smaller)
+ * @return Tiles covering the image exactly once
+ */
+std::vector<Tile> make_tiles(int width, int height, int tile_size);
+
+/**
+ * @struct ThreadTiming
+ * @brief Per-thread scheduling statistics for one frame
+ */
+struct ThreadTiming {
+  double busy_ms = 0.0; ///< Time spent rendering tiles
+  double idle_ms = 0.0; ///< Frame time not spent rendering tiles
+  int tiles = 0;        ///< Tiles rendered by this thread
+  int stolen = 0;       ///< Tiles taken from another thread's deque
+};
+
+/**
+ * @class TileScheduler
+ * @brief Per-thread tile deques with work stealing
+ */
+class TileScheduler {
+public:
+  /**
+   * @brief Distribute tiles over per-thread deques
+   * @param tiles Tiles in the order they should preferably be rendered
+   * @param num_threads Number of worker threads that will call next()
+   *
+   * Thread t initially owns the t-th contiguous chunk of tiles, so
+   * neighbouring tiles are rendered by the same thread.
+   */
+  TileScheduler(const std::vector<Tile> &tiles, int num_threads);
+
+  /**
+   * @brief Get the next tile for a thread
+   * @param thread_id Calling thread in [0, num_threads)
+   * @param tile Output tile
+   * @param stolen Set to true if the tile came from another thread
+   * @param index Optional output: position of the tile in the tiles passed
+   *        to the constructor
+   * @return False once every deque is empty
+   */
+  bool next(int thread_id, Tile &tile, bool &stolen,
+            uint32_t *index = nullptr);
+
+  /**
+   * @brief Total number of tiles
+   * @return Tile count
+   */
+  size_t size() const { return tiles.size(); }
+
+private:
+  /// Cache-line aligned so owners and thieves of different deques do not
+  /// contend on the same line
+  struct alignas(64) WorkQueue {
+    std::mutex mutex;
+    std::deque<uint32_t> tiles;
+  };
+
+  std::vector<Tile> tiles;
+  std::vector<std::unique_ptr<WorkQueue>> queues;
+};
+
+#endif // SCHEDULER_H
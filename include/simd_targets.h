@@ -0,0 +1,60 @@
+/**
+ * @file simd_targets.h
+ * @brief Instruction sets the SIMD kernels are compiled for
+ * @author Alexei Czornyj
+ * @date 2025
+ *
+ * Defines KESTREL_HAVE_SSE4, KESTREL_HAVE_AVX2 and KESTREL_HAVE_AVX512 for
+ * every instruction set the kernels may use, and KESTREL_TARGET_* as the
+ * attribute each variant's functions are declared with. In dispatch builds
+ * (KESTREL_SIMD_DISPATCH) every variant is compiled with its own target
+ * attribute; otherwise only those enabled by the compiler flags are
+ * available. KESTREL_BUILD_SSE4, KESTREL_BUILD_AVX2 and KESTREL_BUILD_AVX512
+ * mark the variants that are actually selected: all of them in dispatch
+ * builds, otherwise only the widest, so no unused kernels are compiled.
+ * Only for the translation units that implement kernels.
+ */
+
+#ifndef SIMD_TARGETS_H
+#define SIMD_TARGETS_H
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+#define KESTREL_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(KESTREL_X86) && defined(KESTREL_SIMD_DISPATCH)
+#define KESTREL_HAVE_SSE4 1
+#define KESTREL_HAVE_AVX2 1
+#define KESTREL_HAVE_AVX512 1
+#define KESTREL_TARGET_SSE4 __attribute__((target("sse4.1")))
+#define KESTREL_TARGET_AVX2 __attribute__((target("avx2")))
+#define KESTREL_TARGET_AVX512 __attribute__((target("avx512f")))
+#elif defined(KESTREL_X86)
+#if defined(__SSE4_1__)
+#define KESTREL_HAVE_SSE4 1
+#endif
+#if defined(__AVX2__)
+#define KESTREL_HAVE_AVX2 1
+#endif
+#if defined(__AVX512F__)
+#define KESTREL_HAVE_AVX512 1
+#endif
+#define KESTREL_TARGET_SSE4
+#define KESTREL_TARGET_AVX2
+#define KESTREL_TARGET_AVX512
+#endif
+
+#if defined(KESTREL_X86) && defined(KESTREL_SIMD_DISPATCH)
+#define KESTREL_BUILD_SSE4 1
+#define KESTREL_BUILD_AVX2 1
+#define KESTREL_BUILD_AVX512 1
+#elif defined(KESTREL_HAVE_AVX512)
+#define KESTREL_BUILD_AVX512 1
+#elif defined(KESTREL_HAVE_AVX2)
+#define KESTREL_BUILD_AVX2 1
+#elif defined(KESTREL_HAVE_SSE4)
+#define KESTREL_BUILD_SSE4 1
+#endif
+
+#endif // SIMD_TARGETS_H
@@ -8,9 +8,11 @@
 #ifndef SPHERE_H
 #define SPHERE_H
 
-#include "bsdfs/material.h"
+#include "aabb.h"
+#include "kestrel.h"
 #include "ray.h"
 #include "vec3.h"
+#include <cstdint>
 
 /**
  * @class Sphere
@@ -24,15 +26,15 @@ class Sphere {
 public:
   Point3 center;            ///< Center of the sphere in world space
   float radius;             ///< Radius of the sphere
-  const Material *material; ///< Material of the sphere
+  uint32_t material;      ///< Id of the sphere's material in Scene::materials
 
   /**
    * @brief Construct sphere from center and radius
    * @param center Center point of the sphere
    * @param radius Radius of the sphere (must be positive)
-   * @param material Material of the sphere
+   * @param material Id of the sphere's material in Scene::materials
    */
-  HOST_DEVICE Sphere(Point3 center, float radius, const Material *material)
+  HOST_DEVICE Sphere(Point3 center, float radius, uint32_t material = 0)
       : center(center), radius(radius), material(material) {}
 
   /**
@@ -52,9 +54,62 @@ public:
    * - a = direction · direction
    * - b = (origin - center) · direction
    * - c = |origin - center|² - radius²
+   *
+   * Equivalent to intersect() followed by finalize().
    */
   HOST_DEVICE bool hit(const Ray &ray, float t_min, float t_max,
                        HitRecord &rec) const;
+
+  /**
+   * @brief Find the distance to the nearest hit, without hit details
+   * @param ray The ray to test for intersection
+   * @param t_min Minimum valid t parameter
+   * @param t_max Maximum valid t parameter
+   * @param t Output parameter set to the nearest root in [t_min, t_max]
+   * @return True if intersection exists in range [t_min, t_max]
+   *
+   * The root selection of hit(), but no point or normal is computed. Loops
+   * looking for the closest of many spheres call this for every candidate
+   * and finalize() once for the winner.
+   */
+  HOST_DEVICE bool intersect(const Ray &ray, float t_min, float t_max,
+                             float &t) const;
+
+  /**
+   * @brief Fill a hit record for a hit found by intersect()
+   * @param ray The ray that hit the sphere
+   * @param t Distance of the hit
+   * @param rec Output parameter filled with the point, normal, t and
+   *        material
+   */
+  HOST_DEVICE void finalize(const Ray &ray, float t, HitRecord &rec) const {
+    rec.t = t;
+    rec.point = ray.at(t);
+    Vec3 outward_normal = (rec.point - center) / radius;
+    rec.set_face_normal(ray, outward_normal);
+    rec.material = material;
+  }
+
+  /**
+   * @brief Test whether a ray hits the sphere, without computing hit details
+   * @param ray The ray to test for intersection
+   * @param t_min Minimum valid t parameter
+   * @param t_max Maximum valid t parameter
+   * @return True if either root lies in [t_min, t_max]
+   *
+   * Same quadratic as hit(), but stops at the yes/no answer: no hit point,
+   * normal or HitRecord is produced. Used for shadow rays.
+   */
+  HOST_DEVICE bool intersects(const Ray &ray, float t_min, float t_max) const;
+
+  /**
+   * @brief Get the axis-aligned bounding box of the sphere
+   * @return Box from center - radius to center + radius
+   */
+  HOST_DEVICE AABB bounds() const {
+    Vec3 r(std::fabs(radius));
+    return AABB(center - r, center + r);
+  }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,245 @@
+/**
+ * @file sphere_soa.h
+ * @brief Structure-of-arrays sphere storage with SIMD batch intersection
+ * @author Alexei Czornyj
+ * @date 2025
+ *
+ * Sphere centers and squared radii are packed into separate, cache-line
+ * aligned arrays so that 4, 8 or 16 spheres can be tested against one ray
+ * per instruction (SSE4.1, AVX2 or AVX-512). A scalar kernel is used when
+ * none of these is available.
+ *
+ * In the default build the widest ISA enabled by the compiler flags
+ * (-march=native) is selected at compile time. When built with
+ * KESTREL_SIMD_DISPATCH every kernel is compiled and the widest one the
+ * running CPU supports is selected at startup.
+ *
+ * CompactSphereSoA is the quantized variant for scenes too large for the
+ * caches: it stores about 10 bytes per sphere and feeds the same kernels.
+ */
+
+#ifndef SPHERE_SOA_H
+#define SPHERE_SOA_H
+
+#include "aligned_allocator.h"
+#include "bvh.h"
+#include "ray.h"
+#include "sphere.h"
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+/**
+ * @struct SphereBatch
+ * @brief Raw view of the packed arrays handed to the SIMD kernels
+ */
+struct SphereBatch {
+  const float *cx; ///< Center x coordinates
+  const float *cy; ///< Center y coordinates
+  const float *cz; ///< Center z coordinates
+  const float *r2; ///< Squared radii
+};
+
+/**
+ * @struct SphereKernels
+ * @brief Intersection kernels for one instruction set
+ *
+ * Both kernels test the spheres in slots [first, first + count).
+ */
+struct SphereKernels {
+  const char *name; ///< Human-readable ISA name
+  int lanes;        ///< Spheres tested per instruction
+
+  /**
+   * Closest hit: returns the slot of the nearest sphere hit in
+   * [t_min, t_max] and lowers t_max to its distance, or -1 if none.
+   */
+  int (*closest)(const SphereBatch &spheres, const Ray &ray, uint32_t first,
+                 uint32_t count, float t_min, float &t_max);
+
+  /// Any hit: returns true if at least one sphere is hit in [t_min, t_max]
+  bool (*any)(const SphereBatch &spheres, const Ray &ray, uint32_t first,
+              uint32_t count, float t_min, float t_max);
+};
+
+/**
+ * @brief Get the kernels selected for this build and CPU
+ * @return Kernel table, chosen once on first use
+ */
+const SphereKernels &sphere_kernels();
+
+/**
+ * @class SphereSoA
+ * @brief Packed sphere store in structure-of-arrays layout
+ *
+ * Slots are stored in the order given to build() (the BVH primitive order,
+ * so that each leaf is a contiguous range). Arrays are padded by at least
+ * one full 16-lane vector so kernels may load past the last slot.
+ */
+class SphereSoA {
+public:
+  /// Padding (in slots) appended after the last sphere
+  static constexpr uint32_t PADDING = 16;
+
+  /**
+   * @brief Pack spheres into SoA arrays
+   * @param spheres Source spheres
+   * @param order Slot i receives spheres[order[i]]
+   */
+  void build(const std::vector<Sphere> &spheres,
+             const std::vector<uint32_t> &order);
+
+  /**
+   * @brief Discard the packed arrays
+   */
+  void clear();
+
+  /**
+   * @brief Number of packed spheres (excluding padding)
+   * @return Sphere count
+   */
+  uint32_t size() const { return count; }
+
+  /**
+   * @brief Find the closest sphere hit among a range of slots
+   * @param ray The ray to test
+   * @param first First slot of the range
+   * @param n Number of slots in the range
+   * @param t_min Minimum valid t parameter
+   * @param t_max In: maximum valid t. Out: distance of the closest hit
+   * @return Slot of the closest hit, or -1 if nothing was hit
+   */
+  int closest(const Ray &ray, uint32_t first, uint32_t n, float t_min,
+              float &t_max) const {
+    return kernels->closest(batch(), ray, first, n, t_min, t_max);
+  }
+
+  /**
+   * @brief Test whether any sphere in a range of slots is hit
+   * @param ray The ray to test
+   * @param first First slot of the range
+   * @param n Number of slots in the range
+   * @param t_min Minimum valid t parameter
+   * @param t_max Maximum valid t parameter
+   * @return True if at least one sphere is hit
+   */
+  bool any(const Ray &ray, uint32_t first, uint32_t n, float t_min,
+           float t_max) const {
+    return kernels->any(batch(), ray, first, n, t_min, t_max);
+  }
+
+  /**
+   * @brief Visit the packed arrays (e.g. to place their pages)
+   * @param visit Callable `void(const void *data, size_t bytes)`
+   */
+  template <typename Visitor> void for_each_array(Visitor &&visit) const {
+    for (const AlignedVector<float> *a : {&cx, &cy, &cz, &r2})
+      visit(a->data(), a->size() * sizeof(float));
+  }
+
+private:
+  AlignedVector<float> cx, cy, cz, r2;
+  uint32_t count = 0;
+  const SphereKernels *kernels = &sphere_kernels();
+
+  SphereBatch batch() const {
+    return {cx.data(), cy.data(), cz.data(), r2.data()};
+  }
+};
+
+/**
+ * @class CompactSphereSoA
+ * @brief Quantized sphere store for very large scenes
+ *
+ * Each slot keeps its center as three 16-bit fixed-point offsets within the
+ * bounds of its BVH leaf, its radius as a 16-bit fraction of the leaf's
+ * largest extent and a 16-bit material id: 10 bytes per sphere, against
+ * the 16 bytes of SphereSoA plus the Sphere and primitive index read for
+ * every hit record. Leaves are dequantized one SIMD batch at a time and
+ * tested with the regular kernels, and sphere() rebuilds the winning sphere
+ * for the hit record, so Scene::objects is not touched while tracing.
+ *
+ * The quantized spheres are what gets rendered: a center moves by at most
+ * half a step, 1/131070 of the leaf extent per axis.
+ */
+class CompactSphereSoA {
+public:
+  /// Padding (in slots) appended after the last sphere
+  static constexpr uint32_t PADDING = SphereSoA::PADDING;
+  /// Materials addressable by the 16-bit ids
+  static constexpr size_t MAX_MATERIALS = 65536;
+
+  /**
+   * @brief Quantize spheres into the leaves of a hierarchy
+   * @param spheres Source spheres; material ids must be below MAX_MATERIALS
+   * @param bvh Hierarchy built over the spheres; slot i receives
+   *        spheres[bvh.prim_indices[i]], quantized to the bounds of its leaf
+   */
+  void build(const std::vector<Sphere> &spheres, const BVH &bvh);
+
+  /**
+   * @brief Discard the packed arrays
+   */
+  void clear();
+
+  /**
+   * @brief Number of packed spheres (excluding padding)
+   * @return Sphere count
+   */
+  uint32_t size() const { return count; }
+
+  /**
+   * @brief Find the closest sphere hit in a leaf
+   * @param ray The ray to test
+   * @param leaf Leaf node whose slots are tested
+   * @param t_min Minimum valid t parameter
+   * @param t_max In: maximum valid t. Out: distance of the closest hit
+   * @return Slot of the closest hit, or -1 if nothing was hit
+   */
+  int closest(const Ray &ray, const BVHNode &leaf, float t_min,
+              float &t_max) const;
+
+  /**
+   * @brief Test whether any sphere in a leaf is hit
+   * @param ray The ray to test
+   * @param leaf Leaf node whose slots are tested
+   * @param t_min Minimum valid t parameter
+   * @param t_max Maximum valid t parameter
+   * @return True if at least one sphere is hit
+   */
+  bool any(const Ray &ray, const BVHNode &leaf, float t_min,
+           float t_max) const;
+
+  /**
+   * @brief Rebuild the sphere stored in a slot
+   * @param leaf Leaf node containing the slot
+   * @param slot Slot index
+   * @return The quantized sphere, as intersected by closest() and any()
+   */
+  Sphere sphere(const BVHNode &leaf, uint32_t slot) const;
+
+  /**
+   * @brief Visit the packed arrays (e.g. to place their pages)
+   * @param visit Callable `void(const void *data, size_t bytes)`
+   */
+  template <typename Visitor> void for_each_array(Visitor &&visit) const {
+    for (const AlignedVector<uint16_t> *a : {&qx, &qy, &qz, &qr})
+      visit(a->data(), a->size() * sizeof(uint16_t));
+    visit(material.data(), material.size() * sizeof(uint16_t));
+  }
+
+private:
+  /// Spheres dequantized per kernel call; a multiple of every SIMD width
+  static constexpr uint32_t BATCH = 16;
+
+  AlignedVector<uint16_t> qx, qy, qz, qr;
+  std::vector<uint16_t> material;
+  uint32_t count = 0;
+  const SphereKernels *kernels = &sphere_kernels();
+
+  /// Dequantize slots [first, first + BATCH) into the kernel arrays
+  void unpack(const BVHNode &leaf, uint32_t first, float *cx, float *cy,
+              float *cz, float *r2) const;
+};
+
+#endif // SPHERE_SOA_H
@@ -0,0 +1,106 @@
+/**
+ * @file thread_pool.h
+ * @brief Persistent render threads, core pinning and NUMA placement
+ * @author Alexei Czornyj
+ * @date 2025
+ *
+ * A ThreadPool starts its threads once and runs fork-join tasks on all of
+ * them, so render passes, frames of a sequence and the tile batches of a
+ * distributed worker reuse the same threads instead of spawning new ones.
+ * Threads can be pinned to the CPUs the process may run on; together with
+ * the first-touch placement in render_scene this keeps each thread's
+ * per-pixel state on its own NUMA node. Shared read-only data (the scene)
+ * is instead interleaved over all nodes with interleave_pages.
+ */
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Number of CPUs this process may run on
+ * @return Size of the affinity mask (taskset, cgroup cpusets), falling back
+ *         to std::thread::hardware_concurrency(); at least 1
+ */
+int available_cpus();
+
+/**
+ * @brief Number of NUMA nodes of the machine
+ * @return Online memory nodes (1 where unknown)
+ */
+int numa_node_count();
+
+/**
+ * @brief Spread the pages of a buffer round-robin over all NUMA nodes
+ * @param data Start of the buffer
+ * @param bytes Size of the buffer
+ *
+ * For data read by every thread: interleaving shares the memory bandwidth
+ * of all nodes instead of funnelling every thread through the node that
+ * happened to write it first. Pages already in memory are migrated. Does
+ * nothing on single-node machines or where the kernel does not support it.
+ */
+void interleave_pages(const void *data, size_t bytes);
+
+/**
+ * @class ThreadPool
+ * @brief Fixed set of threads that run a task on every thread at once
+ */
+class ThreadPool {
+public:
+  /**
+   * @brief Start the threads
+   * @param num_threads Number of threads (at least 1)
+   * @param pin Pin thread t to the t-th CPU of the affinity mask (wrapping
+   *        around when there are more threads than CPUs)
+   */
+  explicit ThreadPool(int num_threads, bool pin = false);
+
+  /// Stops and joins the threads
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  /**
+   * @brief Number of threads
+   * @return Thread count
+   */
+  int size() const { return static_cast<int>(threads.size()); }
+
+  /**
+   * @brief Check whether the threads are pinned
+   * @return True if every thread was pinned to a CPU
+   */
+  bool pinned() const { return pinned_threads; }
+
+  /**
+   * @brief Run a task on every thread and wait for all of them
+   * @param task Called once per thread with its index in [0, size())
+   *
+   * Not reentrant: a task must not call run() on the same pool.
+   */
+  void run(const std::function<void(int thread_id)> &task);
+
+private:
+  void worker(int thread_id);
+
+  std::vector<std::thread> threads;
+  bool pinned_threads = false;
+  std::mutex mutex;
+  std::condition_variable wake;     ///< Signals a new task (or stop)
+  std::condition_variable finished; ///< Signals the last thread is done
+  const std::function<void(int)> *task = nullptr;
+  uint64_t generation = 0; ///< Incremented for every task
+  int running = 0;         ///< Threads still working on the current task
+  bool stopping = false;
+};
+
+#endif // THREAD_POOL_H
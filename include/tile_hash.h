@@ -0,0 +1,115 @@
+/**
+ * @file tile_hash.h
+ * @brief Content hashes of rendered tiles, for golden-image checks and caches
+ * @author Alexei Czornyj
+ * @date 2025
+ *
+ * With RenderSettings::pixel_seeds an image depends only on the scene, the
+ * camera and the sampling settings, so two renders of the same frame can be
+ * compared bit for bit. TileHashes records a 64-bit hash of the pixels of
+ * every tile together with a frame key over everything that determines
+ * them. Comparing against the hashes of a reference render (a golden file)
+ * finds the tiles that changed; the key of a tile (frame key plus tile
+ * rectangle) names its content, e.g. in a cache of rendered tiles.
+ *
+ * Hash files are plain text:
+ *
+ *     kestrel-tiles 2 <width> <height> <tile_size> <frame key>
+ *     <tile id> <x0> <y0> <x1> <y1> <tile key> <pixel hash>
+ *
+ * with one line per tile in make_tiles order and the keys and hashes as 16
+ * hexadecimal digits.
+ */
+
+#ifndef TILE_HASH_H
+#define TILE_HASH_H
+
+#include "renderer.h"
+#include "scene.h"
+#include "scene_file.h"
+#include "scheduler.h"
+#include "vec3.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @struct TileHashes
+ * @brief Pixel hash of every tile of one image
+ */
+struct TileHashes {
+  int width = 0;                ///< Image width in pixels
+  int height = 0;               ///< Image height in pixels
+  int tile_size = 0;            ///< Edge of the tiles in pixels
+  uint64_t frame_key = 0;       ///< frame_key() of the render
+  std::vector<Tile> tiles;      ///< Tiles in make_tiles order
+  std::vector<uint64_t> hashes; ///< Hash of the pixels of each tile
+
+  /**
+   * @brief Key naming the content of a tile
+   * @param tile Index into tiles
+   * @return Hash of the frame key and the tile rectangle
+   */
+  uint64_t tile_key(size_t tile) const;
+};
+
+/**
+ * @brief Hash everything that determines a rendered frame
+ * @param scene The scene: geometry, materials and lights, with the shape,
+ *        edges and sample count of every area light (see
+ *        scene_fingerprint)
+ * @param view Camera placement
+ * @param settings Image size, tiles, sampling, engine and seeding
+ * @return 64-bit key, which also covers the KESTREL_FAST_MATH build
+ *         option; the thread count is not part of it
+ */
+uint64_t frame_key(const Scene &scene, const SceneCamera &view,
+                   const RenderSettings &settings);
+
+/**
+ * @brief Hash the tiles of an image
+ * @param pixels Image of settings.image_width x settings.image_height
+ * @param settings Settings the image was rendered with (size and tiles)
+ * @param key frame_key() of the render
+ * @return One hash per tile of the bytes of its pixels
+ */
+TileHashes hash_tiles(const std::vector<Color> &pixels,
+                      const RenderSettings &settings, uint64_t key);
+
+/**
+ * @brief Write tile hashes to a file
+ * @param path File to write
+ * @param hashes Hashes to write
+ * @param error Set to a message on failure
+ * @return True if the file was written
+ */
+bool save_tile_hashes(const std::string &path, const TileHashes &hashes,
+                      std::string &error);
+
+/**
+ * @brief Read tile hashes written by save_tile_hashes
+ * @param path File to read
+ * @param hashes Output: the hashes in the file
+ * @param error Set to a message naming the file and line on failure
+ * @return True if the whole file was read
+ */
+bool load_tile_hashes(const std::string &path, TileHashes &hashes,
+                      std::string &error);
+
+/**
+ * @brief Find the tiles of an image that differ from a reference
+ * @param golden Hashes of the reference render
+ * @param image Hashes of the image to check
+ * @param differing Output: ids of the tiles whose pixels differ
+ * @param error Set to a message if the two cannot be compared
+ * @return False if the images differ in size or tile layout
+ *
+ * The frame keys are not compared, so renders with different settings can
+ * be checked against each other; whether they should agree is up to the
+ * caller.
+ */
+bool compare_tile_hashes(const TileHashes &golden, const TileHashes &image,
+                         std::vector<uint32_t> &differing,
+                         std::string &error);
+
+#endif // TILE_HASH_H
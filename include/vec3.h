@@ -8,7 +8,7 @@
 #ifndef VEC3_H
 #define VEC3_H
 
-#include "pcg32.h"
+#include "fast_math.h"
 #include <cmath>
 #include <iostream>
 
@@ -18,12 +18,16 @@
 #define HOST_DEVICE
 #endif
 
+class Sampler;
+
 /**
  * @class Vec3
  * @brief A 3D vector class supporting both CPU and GPU execution
  *
  * This class represents a 3D vector with x, y, z components. All methods are
- * decorated with HOST_DEVICE to enable compilation for both CPU and CUDA GPU.
+ * decorated with HOST_DEVICE to enable compilation for both CPU and CUDA GPU,
+ * and the arithmetic is defined inline (constexpr where possible) so it is
+ * inlined into the intersection and shading loops without LTO.
  * Used for positions, directions, colors, and normals throughout the renderer.
  */
 class Vec3 {
@@ -33,13 +37,13 @@ public:
   /**
    * @brief Default constructor - initializes to zero vector
    */
-  HOST_DEVICE Vec3();
+  HOST_DEVICE constexpr Vec3() : x(0), y(0), z(0) {}
 
   /**
    * @brief Construct vector with all components set to the same value
    * @param v Value for x, y, and z components
    */
-  HOST_DEVICE Vec3(float v);
+  HOST_DEVICE constexpr Vec3(float v) : x(v), y(v), z(v) {}
 
   /**
    * @brief Construct vector from three components
@@ -47,73 +51,110 @@ public:
    * @param y Y component
    * @param z Z component
    */
-  HOST_DEVICE Vec3(float x, float y, float z);
+  HOST_DEVICE constexpr Vec3(float x, float y, float z) : x(x), y(y), z(z) {}
+
   /**
    * @brief Vector addition
    * @param v Vector to add
    * @return Sum of this vector and v
    */
-  HOST_DEVICE Vec3 operator+(const Vec3 &v) const;
+  HOST_DEVICE constexpr Vec3 operator+(const Vec3 &v) const {
+    return Vec3(x + v.x, y + v.y, z + v.z);
+  }
 
   /**
    * @brief Vector subtraction
    * @param v Vector to subtract
    * @return Difference of this vector and v
    */
-  HOST_DEVICE Vec3 operator-(const Vec3 &v) const;
+  HOST_DEVICE constexpr Vec3 operator-(const Vec3 &v) const {
+    return Vec3(x - v.x, y - v.y, z - v.z);
+  }
 
   /**
    * @brief Scalar multiplication
    * @param t Scalar value
    * @return This vector scaled by t
    */
-  HOST_DEVICE Vec3 operator*(float t) const;
+  HOST_DEVICE constexpr Vec3 operator*(float t) const {
+    return Vec3(x * t, y * t, z * t);
+  }
 
   /**
    * @brief Component-wise multiplication
    * @param v Vector to multiply with
    * @return Component-wise product
    */
-  HOST_DEVICE Vec3 operator*(const Vec3 &v) const;
+  HOST_DEVICE constexpr Vec3 operator*(const Vec3 &v) const {
+    return Vec3(x * v.x, y * v.y, z * v.z);
+  }
 
   /**
    * @brief Scalar division
    * @param t Scalar divisor
    * @return This vector divided by t
    */
-  HOST_DEVICE Vec3 operator/(float t) const;
+  HOST_DEVICE constexpr Vec3 operator/(float t) const {
+    return Vec3(x / t, y / t, z / t);
+  }
 
   /**
    * @brief In-place vector addition
    * @param v Vector to add
    * @return Reference to this vector after addition
    */
-  HOST_DEVICE Vec3 &operator+=(const Vec3 &v);
+  HOST_DEVICE constexpr Vec3 &operator+=(const Vec3 &v) {
+    x += v.x;
+    y += v.y;
+    z += v.z;
+    return *this;
+  }
 
   /**
    * @brief In-place scalar multiplication
    * @param t Scalar multiplier
    * @return Reference to this vector after scaling
    */
-  HOST_DEVICE Vec3 &operator*=(float t);
+  HOST_DEVICE constexpr Vec3 &operator*=(float t) {
+    x *= t;
+    y *= t;
+    z *= t;
+    return *this;
+  }
 
   /**
    * @brief Calculate the length (magnitude) of the vector
    * @return Euclidean length of the vector
    */
-  HOST_DEVICE float length() const;
+  HOST_DEVICE float length() const { return std::sqrt(length_squared()); }
 
   /**
    * @brief Calculate the squared length of the vector
    * @return Squared Euclidean length (avoids sqrt for performance)
    */
-  HOST_DEVICE float length_squared() const;
+  HOST_DEVICE constexpr float length_squared() const {
+    return x * x + y * y + z * z;
+  }
 
   /**
    * @brief Get a unit-length version of this vector
-   * @return Normalized vector with length 1
-   */
-  HOST_DEVICE Vec3 normalized() const;
+   * @return Normalized vector with length 1 (the zero vector stays zero)
+   *
+   * With KESTREL_FAST_MATH, one fast_rsqrt and three multiplies replace the
+   * square root and the divides (see fast_math.h).
+   */
+  HOST_DEVICE Vec3 normalized() const {
+    if constexpr (FAST_MATH) {
+      const float len2 = length_squared();
+      return *this * (len2 > 0.0f ? fast_rsqrt(len2) : 0.0f);
+    }
+    float len = length();
+    if (len == 0.0f) {
+      // Avoid division by zero — return a safe default zero vector
+      return Vec3(0.0f, 0.0f, 0.0f);
+    }
+    return Vec3(x / len, y / len, z / len);
+  }
 
   /**
    * @brief Compute dot product of two vectors
@@ -121,7 +162,9 @@ public:
    * @param b Second vector
    * @return Scalar dot product a · b
    */
-  HOST_DEVICE static float dot(const Vec3 &a, const Vec3 &b);
+  HOST_DEVICE static constexpr float dot(const Vec3 &a, const Vec3 &b) {
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+  }
 
   /**
    * @brief Compute cross product of two vectors
@@ -129,21 +172,42 @@ public:
    * @param b Second vector
    * @return Vector perpendicular to both a and b (a × b)
    */
-  HOST_DEVICE static Vec3 cross(const Vec3 &a, const Vec3 &b);
+  HOST_DEVICE static constexpr Vec3 cross(const Vec3 &a, const Vec3 &b) {
+    return Vec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z,
+                a.x * b.y - a.y * b.x);
+  }
 
   /**
    * @brief Generate a random vector with each component in [min, max]
+   * @param sampler Sample source
    * @param min Minimum component value
    * @param max Maximum component value
    * @return Random vector
    */
-  HOST_DEVICE static Vec3 random(float min, float max);
+  HOST_DEVICE static Vec3 random(Sampler &sampler, float min, float max);
 
-  HOST_DEVICE static Vec3 random_unit_vector();
+  /**
+   * @brief Generate a uniformly distributed direction
+   * @param sampler Sample source
+   * @return Random unit-length vector
+   */
+  HOST_DEVICE static Vec3 random_unit_vector(Sampler &sampler);
 
-  HOST_DEVICE static Vec3 random_in_unit_sphere();
+  /**
+   * @brief Generate a random point inside the unit sphere
+   * @param sampler Sample source
+   * @return Random vector with length < 1
+   */
+  HOST_DEVICE static Vec3 random_in_unit_sphere(Sampler &sampler);
 
-  HOST_DEVICE static Vec3 random_on_hemisphere(const Vec3 &normal);
+  /**
+   * @brief Generate a random vector in the hemisphere around a normal
+   * @param normal Hemisphere orientation
+   * @param sampler Sample source
+   * @return Random vector v with dot(v, normal) >= 0
+   */
+  HOST_DEVICE static Vec3 random_on_hemisphere(const Vec3 &normal,
+                                               Sampler &sampler);
 };
 
 /**
@@ -152,7 +216,9 @@ public:
  * @param v Vector to multiply
  * @return Scaled vector
  */
-HOST_DEVICE Vec3 operator*(float t, const Vec3 &v);
+HOST_DEVICE constexpr Vec3 operator*(float t, const Vec3 &v) {
+  return Vec3(t * v.x, t * v.y, t * v.z);
+}
 
 /**
  * @brief Reflect vector v around normal n
@@ -160,7 +226,9 @@ HOST_DEVICE Vec3 operator*(float t, const Vec3 &v);
  * @param n Normal vector
  * @return Reflected vector
  */
-HOST_DEVICE Vec3 reflect(const Vec3 &v, const Vec3 &n);
+HOST_DEVICE constexpr Vec3 reflect(const Vec3 &v, const Vec3 &n) {
+  return v - 2.0f * Vec3::dot(v, n) * n;
+}
 
 /**
  * @brief Stream output operator for debugging
@@ -0,0 +1,126 @@
+/**
+ * @file wavefront.h
+ * @brief Breadth-first (wavefront) path tracing of ray batches
+ * @author Alexei Czornyj
+ * @date 2025
+ *
+ * Instead of following one path from the camera to its last bounce, the
+ * wavefront engine advances a whole batch of paths one bounce at a time
+ * through separate stages: intersect, shade (sorted by material), trace the
+ * shadow rays the shading produced, then compact the surviving paths into
+ * the queue for the next bounce. Each stage touches only one kind of data
+ * (geometry, materials, lights), and the queues are kept as structures of
+ * arrays so the stages map directly onto GPU kernels.
+ */
+
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+
+#include "kestrel.h"
+#include "ray.h"
+#include "renderer.h"
+#include "sampler.h"
+#include "scene.h"
+#include "vec3.h"
+#include <cstdint>
+#include <vector>
+
+/**
+ * @class Wavefront
+ * @brief Batch of camera paths traced breadth-first
+ *
+ * Usage: stage camera rays with add_path, call trace, then read the
+ * radiance of path i from radiance()[i]. The queues keep their capacity
+ * between batches, so one Wavefront per thread allocates only once.
+ */
+class Wavefront {
+public:
+  /**
+   * @brief Drop all staged paths and results
+   */
+  void clear();
+
+  /**
+   * @brief Stage a camera ray for the next trace
+   * @param ray Primary ray
+   * @param sample Pixel sample the ray belongs to, whose sequence the
+   *        sampler continues at every hit of the path
+   * @return Index of the path in radiance()
+   */
+  uint32_t add_path(const Ray &ray, const PixelSample &sample = {});
+
+  /**
+   * @brief Number of staged paths
+   */
+  size_t size() const { return radiance_out.size(); }
+
+  /**
+   * @brief Trace every staged path to completion
+   * @param scene Scene being rendered
+   * @param sampler Per-thread sample source
+   * @param depth Maximum number of bounces
+   * @param light_samples Lights shaded per hit (0 = every light)
+   * @param stats Optional per-thread counters and stage timers
+   *
+   * Produces the same estimate as ray_color for each path, but draws the
+   * samples in a different order.
+   */
+  void trace(const Scene &scene, Sampler &sampler, int depth = MAX_BOUNCES,
+             int light_samples = 0, RenderStats *stats = nullptr);
+
+  /**
+   * @brief Radiance gathered by each path in the last trace
+   */
+  const std::vector<Color> &radiance() const { return radiance_out; }
+
+private:
+  /// Paths still alive at the current bounce
+  struct PathQueue {
+    std::vector<Point3> origin;
+    std::vector<Vec3> direction;
+    std::vector<Color> throughput;
+    std::vector<uint32_t> path; ///< Index into radiance_out
+
+    size_t size() const { return path.size(); }
+    void clear();
+    void push(const Point3 &o, const Vec3 &d, const Color &t, uint32_t p);
+  };
+
+  /// Surface hits of the current bounce, in shading order
+  struct HitQueue {
+    std::vector<Point3> point;
+    std::vector<Vec3> normal;
+    std::vector<uint32_t> material;
+    std::vector<uint32_t> ray; ///< Index into the active PathQueue
+
+    size_t size() const { return ray.size(); }
+    void clear();
+  };
+
+  /// Shadow rays and the radiance each one carries if unoccluded
+  struct ShadowQueue {
+    std::vector<Point3> origin;
+    std::vector<Vec3> direction;
+    std::vector<float> t_max;
+    std::vector<Color> contribution;
+    std::vector<uint32_t> path; ///< Index into radiance_out
+
+    size_t size() const { return path.size(); }
+    void clear();
+  };
+
+  PathQueue active, next;
+  HitQueue hits, sorted;
+  ShadowQueue shadows;
+  std::vector<uint32_t> offsets;
+  std::vector<Color> radiance_out;
+  std::vector<PixelSample> path_samples; ///< Pixel sample of each path
+
+  void intersect(const Scene &scene, TraversalStats *stats);
+  void sort_by_material(size_t material_count);
+  void shade(const Scene &scene, Sampler &sampler, int bounce,
+             int light_samples);
+  void trace_shadows(const Scene &scene, TraversalStats *stats);
+};
+
+#endif
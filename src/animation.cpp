@@ -0,0 +1,153 @@
+#include "animation.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+namespace {
+
+/// Position of frame between two keys (0 at a, 1 at b)
+float key_weight(int frame, int a, int b) {
+  return b > a ? static_cast<float>(frame - a) / static_cast<float>(b - a)
+               : 0.0f;
+}
+
+/// Index of the last key at or before frame (0 before the first one)
+template <typename Key>
+size_t key_before(const std::vector<Key> &keys, int frame) {
+  auto it = std::upper_bound(
+      keys.begin(), keys.end(), frame,
+      [](int f, const Key &key) { return f < key.frame; });
+  return it == keys.begin() ? 0 : static_cast<size_t>(it - keys.begin()) - 1;
+}
+
+Vec3 lerp(const Vec3 &a, const Vec3 &b, float w) { return a + (b - a) * w; }
+
+template <typename Key> void sort_keys(std::vector<Key> &keys) {
+  std::stable_sort(
+      keys.begin(), keys.end(),
+      [](const Key &a, const Key &b) { return a.frame < b.frame; });
+}
+
+bool read_vec3(std::istringstream &line, Vec3 &v) {
+  return static_cast<bool>(line >> v.x >> v.y >> v.z) && std::isfinite(v.x) &&
+         std::isfinite(v.y) && std::isfinite(v.z);
+}
+
+} // namespace
+
+bool Animation::bind(const Scene &scene, std::string &error) {
+  rest_centers.clear();
+  for (const ObjectTrack &track : tracks) {
+    if (track.first > scene.objects.size() ||
+        track.count > scene.objects.size() - track.first) {
+      error = "Animation moves spheres " + std::to_string(track.first) +
+              "-" + std::to_string(track.first + track.count - 1) +
+              " but the scene has " + std::to_string(scene.objects.size());
+      return false;
+    }
+    std::vector<Point3> centers(track.count);
+    for (uint32_t i = 0; i < track.count; ++i)
+      centers[i] = scene.objects[track.first + i].center;
+    rest_centers.push_back(std::move(centers));
+  }
+  return true;
+}
+
+SceneCamera Animation::camera_at(int frame, const SceneCamera &rest) const {
+  SceneCamera camera = rest;
+  if (camera_keys.empty())
+    return camera;
+  size_t k = key_before(camera_keys, frame);
+  const CameraKey &a = camera_keys[k];
+  const CameraKey &b = camera_keys[std::min(k + 1, camera_keys.size() - 1)];
+  float w = std::min(std::max(key_weight(frame, a.frame, b.frame), 0.0f), 1.0f);
+  camera.look_from = lerp(a.look_from, b.look_from, w);
+  camera.look_at = lerp(a.look_at, b.look_at, w);
+  camera.vfov = a.vfov + (b.vfov - a.vfov) * w;
+  return camera;
+}
+
+void Animation::apply(int frame, Scene &scene) const {
+  for (size_t t = 0; t < tracks.size() && t < rest_centers.size(); ++t) {
+    const ObjectTrack &track = tracks[t];
+    if (track.keys.empty())
+      continue;
+    size_t k = key_before(track.keys, frame);
+    const MotionKey &a = track.keys[k];
+    const MotionKey &b = track.keys[std::min(k + 1, track.keys.size() - 1)];
+    float w =
+        std::min(std::max(key_weight(frame, a.frame, b.frame), 0.0f), 1.0f);
+    const Vec3 offset = lerp(a.offset, b.offset, w);
+    for (uint32_t i = 0; i < track.count; ++i)
+      scene.objects[track.first + i].center = rest_centers[t][i] + offset;
+  }
+}
+
+bool load_animation(const std::string &path, Animation &animation,
+                    std::string &error) {
+  std::ifstream file(path);
+  if (!file) {
+    error = "Cannot open " + path;
+    return false;
+  }
+
+  animation = Animation();
+  size_t line_number = 0;
+  auto fail = [&](const std::string &message) {
+    error = path + ":" + std::to_string(line_number) + ": " + message;
+    return false;
+  };
+
+  std::string text;
+  while (std::getline(file, text)) {
+    ++line_number;
+    std::istringstream line(text.substr(0, text.find('#')));
+    std::string keyword;
+    if (!(line >> keyword))
+      continue;
+
+    if (keyword == "frames") {
+      if (!(line >> animation.frame_count) || animation.frame_count < 1)
+        return fail("expected: frames <count>");
+    } else if (keyword == "camera") {
+      CameraKey key;
+      if (!(line >> key.frame) || !read_vec3(line, key.look_from) ||
+          !read_vec3(line, key.look_at) || !(line >> key.vfov))
+        return fail("expected: camera <frame> <look_from> <look_at> <vfov>");
+      animation.camera_keys.push_back(key);
+    } else if (keyword == "move") {
+      long long first, count;
+      MotionKey key;
+      if (!(line >> first >> count >> key.frame) ||
+          !read_vec3(line, key.offset))
+        return fail("expected: move <first> <count> <frame> <x y z>");
+      if (first < 0 || count < 1 || first + count > UINT32_MAX)
+        return fail("invalid sphere range");
+      auto track = std::find_if(
+          animation.tracks.begin(), animation.tracks.end(),
+          [&](const ObjectTrack &t) {
+            return t.first == first && t.count == count;
+          });
+      if (track == animation.tracks.end()) {
+        ObjectTrack added;
+        added.first = static_cast<uint32_t>(first);
+        added.count = static_cast<uint32_t>(count);
+        animation.tracks.push_back(added);
+        track = animation.tracks.end() - 1;
+      }
+      track->keys.push_back(key);
+    } else {
+      return fail("unknown statement '" + keyword + "'");
+    }
+
+    std::string rest;
+    if (line >> rest)
+      return fail("unexpected input after the " + keyword);
+  }
+
+  sort_keys(animation.camera_keys);
+  for (ObjectTrack &track : animation.tracks)
+    sort_keys(track.keys);
+  return true;
+}
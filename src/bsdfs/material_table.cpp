@@ -0,0 +1,44 @@
+#include "bsdfs/material_table.h"
+
+static_assert(std::is_same_v<std::variant_alternative_t<
+                                 static_cast<size_t>(MaterialType::LAMBERTIAN),
+                                 MaterialVariant>,
+                             Lambertian> &&
+                  std::is_same_v<std::variant_alternative_t<
+                                     static_cast<size_t>(MaterialType::CONDUCTOR),
+                                     MaterialVariant>,
+                                 Conductor>,
+              "MaterialType must match the MaterialVariant alternatives");
+
+uint32_t MaterialTable::add(const MaterialVariant &material) {
+  uint32_t id = static_cast<uint32_t>(materials.size());
+  materials.push_back(material);
+  std::visit(
+      [&](const auto &m) {
+        colors.push_back(m.get_color());
+        reflectivities.push_back(m.reflectivity);
+      },
+      material);
+  return id;
+}
+
+void MaterialTable::clear() {
+  materials.clear();
+  colors.clear();
+  reflectivities.clear();
+}
+
+bool MaterialTable::scatter(uint32_t id, const Ray &incoming,
+                            const HitRecord &rec, Color &attenuation,
+                            Ray &scattered, Sampler &sampler) const {
+  const MaterialVariant &material = materials[id];
+  switch (type(id)) {
+  case MaterialType::LAMBERTIAN:
+    return std::get_if<Lambertian>(&material)->scatter(
+        incoming, rec, attenuation, scattered, sampler);
+  case MaterialType::CONDUCTOR:
+    return std::get_if<Conductor>(&material)->scatter(
+        incoming, rec, attenuation, scattered, sampler);
+  }
+  return false;
+}
@@ -0,0 +1,261 @@
+#include "bvh.h"
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+#include <utility>
+
+namespace {
+
+constexpr int SAH_BINS = 16;           // Centroid bins per axis
+constexpr float TRAVERSAL_COST = 1.0f; // Relative cost of visiting a node
+constexpr float INTERSECT_COST = 1.0f; // Relative cost of a primitive test
+
+float component(const Vec3 &v, int axis) {
+  return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+// Number of leaf intersection calls needed for count primitives
+float batches(uint32_t count, int leaf_batch) {
+  return static_cast<float>((count + leaf_batch - 1) / leaf_batch);
+}
+
+struct Bin {
+  AABB bounds;
+  uint32_t count = 0;
+};
+
+} // namespace
+
+void BVH::clear() {
+  nodes.clear();
+  prim_indices.clear();
+  build_stats = BVHStats();
+}
+
+void BVH::build(const std::vector<AABB> &prim_bounds, int max_leaf_size,
+                int leaf_batch) {
+  auto start = std::chrono::steady_clock::now();
+  clear();
+  if (prim_bounds.empty())
+    return;
+
+  uint32_t prim_count = static_cast<uint32_t>(prim_bounds.size());
+  prim_indices.resize(prim_count);
+  std::iota(prim_indices.begin(), prim_indices.end(), 0u);
+
+  std::vector<Point3> centroids(prim_count);
+  for (uint32_t i = 0; i < prim_count; ++i)
+    centroids[i] = prim_bounds[i].centroid();
+
+  // A binary tree with N leaves has at most 2N - 1 nodes, so reserving
+  // keeps node references stable during the build
+  nodes.reserve(2 * prim_count - 1);
+  nodes.emplace_back();
+  build_recursive(prim_bounds, centroids, 0, 0, prim_count, 0, max_leaf_size,
+                  leaf_batch);
+  nodes.shrink_to_fit();
+  compute_stats(leaf_batch);
+
+  auto end = std::chrono::steady_clock::now();
+  build_stats.build_ms =
+      std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+bool BVH::assign(std::vector<BVHNode> tree, std::vector<uint32_t> indices,
+                 size_t prim_count, int leaf_batch) {
+  clear();
+  if (tree.empty())
+    return indices.empty();
+
+  for (uint32_t id : indices)
+    if (id >= prim_count)
+      return false;
+
+  // Children follow their parent, so the walk cannot cycle
+  std::pair<uint32_t, int> stack[MAX_DEPTH];
+  int stack_size = 0;
+  stack[stack_size++] = {0, 0};
+  while (stack_size > 0) {
+    auto [index, depth] = stack[--stack_size];
+    const BVHNode &node = tree[index];
+    if (node.is_leaf()) {
+      if (node.left_first > indices.size() ||
+          node.prim_count > indices.size() - node.left_first)
+        return false;
+      build_stats.max_depth = std::max(build_stats.max_depth, depth);
+      continue;
+    }
+    if (node.left_first <= index || node.left_first + 1 >= tree.size() ||
+        depth + 1 >= MAX_DEPTH)
+      return false;
+    stack[stack_size++] = {node.left_first, depth + 1};
+    stack[stack_size++] = {node.left_first + 1, depth + 1};
+  }
+
+  nodes = std::move(tree);
+  prim_indices = std::move(indices);
+  compute_stats(leaf_batch);
+  return true;
+}
+
+void BVH::refit(const std::vector<AABB> &prim_bounds, int leaf_batch) {
+  auto start = std::chrono::steady_clock::now();
+  if (nodes.empty())
+    return;
+
+  // Children are stored after their parent, so a reverse sweep sees both
+  // children of a node before the node itself
+  for (size_t i = nodes.size(); i-- > 0;) {
+    BVHNode &node = nodes[i];
+    AABB bounds;
+    if (node.is_leaf()) {
+      for (uint32_t k = 0; k < node.prim_count; ++k)
+        bounds.grow(prim_bounds[prim_indices[node.left_first + k]]);
+    } else {
+      bounds = nodes[node.left_first].bounds;
+      bounds.grow(nodes[node.left_first + 1].bounds);
+    }
+    node.bounds = bounds;
+  }
+
+  const int max_depth = build_stats.max_depth;
+  build_stats = BVHStats();
+  build_stats.max_depth = max_depth;
+  compute_stats(leaf_batch);
+  build_stats.build_ms = std::chrono::duration<double, std::milli>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+}
+
+void BVH::compute_stats(int leaf_batch) {
+  // Tree statistics: SAH cost is relative to the root surface area
+  float root_area = nodes[0].bounds.surface_area();
+  build_stats.node_count = nodes.size();
+  for (const BVHNode &node : nodes) {
+    float area_ratio =
+        root_area > 0.0f ? node.bounds.surface_area() / root_area : 1.0f;
+    if (node.is_leaf()) {
+      build_stats.leaf_count++;
+      build_stats.max_leaf =
+          std::max(build_stats.max_leaf, static_cast<size_t>(node.prim_count));
+      build_stats.sah_cost +=
+          area_ratio * INTERSECT_COST * batches(node.prim_count, leaf_batch);
+    } else {
+      build_stats.sah_cost += area_ratio * TRAVERSAL_COST;
+    }
+  }
+}
+
+void BVH::build_recursive(const std::vector<AABB> &prim_bounds,
+                          const std::vector<Point3> &centroids,
+                          uint32_t node_index, uint32_t first, uint32_t count,
+                          int depth, int max_leaf_size, int leaf_batch) {
+  AABB bounds, centroid_bounds;
+  for (uint32_t i = first; i < first + count; ++i) {
+    bounds.grow(prim_bounds[prim_indices[i]]);
+    centroid_bounds.grow(centroids[prim_indices[i]]);
+  }
+  nodes[node_index].bounds = bounds;
+
+  auto make_leaf = [&]() {
+    nodes[node_index].left_first = first;
+    nodes[node_index].prim_count = count;
+    build_stats.max_depth = std::max(build_stats.max_depth, depth);
+  };
+
+  if (count <= 1 || depth >= MAX_DEPTH - 1) {
+    make_leaf();
+    return;
+  }
+
+  // Binned SAH: evaluate SAH_BINS - 1 candidate planes on each axis
+  float best_cost = std::numeric_limits<float>::infinity();
+  int best_axis = -1;
+  int best_split = 0;
+
+  for (int axis = 0; axis < 3; ++axis) {
+    float lo = component(centroid_bounds.min, axis);
+    float hi = component(centroid_bounds.max, axis);
+    if (hi <= lo)
+      continue;
+
+    Bin bins[SAH_BINS];
+    float scale = SAH_BINS / (hi - lo);
+    for (uint32_t i = first; i < first + count; ++i) {
+      uint32_t prim = prim_indices[i];
+      int b = std::min(
+          SAH_BINS - 1,
+          static_cast<int>((component(centroids[prim], axis) - lo) * scale));
+      bins[b].count++;
+      bins[b].bounds.grow(prim_bounds[prim]);
+    }
+
+    // Sweep from the left to get area/count of every left partition ...
+    float left_area[SAH_BINS - 1];
+    uint32_t left_count[SAH_BINS - 1];
+    AABB acc;
+    uint32_t acc_count = 0;
+    for (int i = 0; i < SAH_BINS - 1; ++i) {
+      acc.grow(bins[i].bounds);
+      acc_count += bins[i].count;
+      left_area[i] = acc.surface_area();
+      left_count[i] = acc_count;
+    }
+
+    // ... then from the right, evaluating the cost at every plane
+    acc = AABB();
+    acc_count = 0;
+    for (int i = SAH_BINS - 1; i > 0; --i) {
+      acc.grow(bins[i].bounds);
+      acc_count += bins[i].count;
+      if (left_count[i - 1] == 0 || acc_count == 0)
+        continue;
+      float cost = left_area[i - 1] * batches(left_count[i - 1], leaf_batch) +
+                   acc.surface_area() * batches(acc_count, leaf_batch);
+      if (cost < best_cost) {
+        best_cost = cost;
+        best_axis = axis;
+        best_split = i;
+      }
+    }
+  }
+
+  // All centroids coincide: no plane can separate the primitives
+  if (best_axis < 0) {
+    make_leaf();
+    return;
+  }
+
+  float parent_area = bounds.surface_area();
+  float split_cost =
+      TRAVERSAL_COST +
+      INTERSECT_COST * best_cost / std::max(parent_area, 1e-20f);
+  float leaf_cost = INTERSECT_COST * batches(count, leaf_batch);
+  if (count <= static_cast<uint32_t>(max_leaf_size) && leaf_cost <= split_cost) {
+    make_leaf();
+    return;
+  }
+
+  // Partition primitives with the same binning used to evaluate the cost
+  float lo = component(centroid_bounds.min, best_axis);
+  float scale = SAH_BINS / (component(centroid_bounds.max, best_axis) - lo);
+  auto begin = prim_indices.begin() + first;
+  auto mid = std::partition(begin, begin + count, [&](uint32_t prim) {
+    int b = std::min(SAH_BINS - 1,
+                     static_cast<int>(
+                         (component(centroids[prim], best_axis) - lo) * scale));
+    return b < best_split;
+  });
+  uint32_t left_count = static_cast<uint32_t>(mid - begin);
+
+  uint32_t left_index = static_cast<uint32_t>(nodes.size());
+  nodes.emplace_back();
+  nodes.emplace_back();
+  nodes[node_index].left_first = left_index;
+  nodes[node_index].prim_count = 0;
+
+  build_recursive(prim_bounds, centroids, left_index, first, left_count,
+                  depth + 1, max_leaf_size, leaf_batch);
+  build_recursive(prim_bounds, centroids, left_index + 1, first + left_count,
+                  count - left_count, depth + 1, max_leaf_size, leaf_batch);
+}
@@ -0,0 +1,695 @@
+#include "cuda_renderer.h"
+#include "bvh.h"
+#include "kestrel.h"
+#include "light_selection.h"
+#include "ray.h"
+#include <algorithm>
+#include <chrono>
+#include <cuda_runtime.h>
+#include <iostream>
+#include <utility>
+
+// Print the failing call and return false from the enclosing function
+#define CUDA_TRY(call)                                                         \
+  do {                                                                         \
+    cudaError_t cuda_err = (call);                                             \
+    if (cuda_err != cudaSuccess) {                                             \
+      std::cerr << "CUDA error: " << #call << ": "                             \
+                << cudaGetErrorString(cuda_err) << "\n";                       \
+      return false;                                                            \
+    }                                                                          \
+  } while (0)
+
+namespace {
+
+/// Paths traced per wave; bounds the size of every device queue
+constexpr uint32_t WAVE_SIZE = 1u << 18;
+
+constexpr int BLOCK_SIZE = 256;
+
+static_assert(sizeof(Color) == 3 * sizeof(float),
+              "pixels are copied to and from the device as float triples");
+
+/// Shading inputs of a material, as precomputed by the MaterialTable
+struct DeviceMaterial {
+  Color color;
+  float reflectivity;
+};
+
+/// Sphere in BVH leaf order with an index into the material table
+struct DeviceSphere {
+  Point3 center;
+  float radius;
+  uint32_t material;
+};
+
+/// Flat scene as seen by the kernels (all pointers are device pointers)
+struct DeviceScene {
+  const BVHNode *nodes;
+  const DeviceSphere *spheres;
+  const DeviceMaterial *materials;
+  const Light *lights; ///< Plain position/intensity pairs, copied as is
+  uint32_t light_count;
+};
+
+/// Image plane of the Camera, recovered through Camera::get_ray (host-only)
+struct DeviceCamera {
+  Point3 origin;
+  Vec3 corner_dir; ///< Direction towards the lower-left corner
+  Vec3 horizontal;
+  Vec3 vertical;
+};
+
+/// Paths alive at the current bounce
+struct PathQueue {
+  Point3 *origin;
+  Vec3 *direction;
+  Color *throughput;
+  uint32_t *pixel;
+  uint64_t *sample; ///< Random sequence index of the path
+};
+
+/// Closest hit of every active path (sphere < 0 on a miss)
+struct HitQueue {
+  float *t;
+  int32_t *sphere;
+};
+
+/// Shadow rays and the radiance each one carries if unoccluded
+struct ShadowQueue {
+  Point3 *origin;
+  Vec3 *direction;
+  float *t_max;
+  Color *contribution;
+  uint32_t *pixel;
+};
+
+/// Owning device allocation
+template <typename T> class DeviceBuffer {
+public:
+  DeviceBuffer() = default;
+  DeviceBuffer(const DeviceBuffer &) = delete;
+  DeviceBuffer &operator=(const DeviceBuffer &) = delete;
+  ~DeviceBuffer() { cudaFree(ptr); }
+
+  cudaError_t allocate(size_t count) {
+    return cudaMalloc(reinterpret_cast<void **>(&ptr),
+                      std::max<size_t>(count, 1) * sizeof(T));
+  }
+
+  cudaError_t upload(const std::vector<T> &data) {
+    cudaError_t err = allocate(data.size());
+    if (err != cudaSuccess || data.empty())
+      return err;
+    return cudaMemcpy(ptr, data.data(), data.size() * sizeof(T),
+                      cudaMemcpyHostToDevice);
+  }
+
+  T *get() const { return ptr; }
+
+private:
+  T *ptr = nullptr;
+};
+
+/// Device storage behind a PathQueue
+struct PathBuffers {
+  DeviceBuffer<Point3> origin;
+  DeviceBuffer<Vec3> direction;
+  DeviceBuffer<Color> throughput;
+  DeviceBuffer<uint32_t> pixel;
+  DeviceBuffer<uint64_t> sample;
+
+  cudaError_t allocate(size_t count) {
+    cudaError_t err;
+    if ((err = origin.allocate(count)) != cudaSuccess ||
+        (err = direction.allocate(count)) != cudaSuccess ||
+        (err = throughput.allocate(count)) != cudaSuccess ||
+        (err = pixel.allocate(count)) != cudaSuccess)
+      return err;
+    return sample.allocate(count);
+  }
+
+  PathQueue queue() const {
+    return {origin.get(), direction.get(), throughput.get(), pixel.get(),
+            sample.get()};
+  }
+};
+
+// Counter-based random numbers: one well-mixed 32-bit hash per (sample,
+// dimension) pair, so no generator state travels with the paths
+__device__ uint32_t hash_u32(uint32_t x) {
+  x ^= x >> 16;
+  x *= 0x7feb352dU;
+  x ^= x >> 15;
+  x *= 0x846ca68bU;
+  x ^= x >> 16;
+  return x;
+}
+
+__device__ float sample_1d(uint64_t sample, uint32_t dimension) {
+  uint32_t h = hash_u32(static_cast<uint32_t>(sample) ^
+                        hash_u32(static_cast<uint32_t>(sample >> 32) ^
+                                 hash_u32(dimension + 0x9e3779b9U)));
+  return static_cast<float>(h >> 8) * (1.0f / 16777216.0f);
+}
+
+/// Random dimensions: camera jitter first, then per bounce one for Russian
+/// roulette followed by one per selected light. The two shifts of an area
+/// light's stratified shadow samples live in a separate range, indexed by
+/// bounce and light.
+constexpr uint32_t DIM_CAMERA_U = 0;
+constexpr uint32_t DIM_CAMERA_V = 1;
+constexpr uint32_t DIM_BOUNCE = 2;
+constexpr uint32_t DIMS_PER_BOUNCE = 1 + MAX_SELECTED_LIGHTS;
+constexpr uint32_t DIM_LIGHT_SHIFT = 0x80000000U;
+
+// Device version of select_lights, drawing from the path's sequence
+__device__ int select_lights(const DeviceScene &scene, const Point3 &point,
+                             const Vec3 &normal, int count, uint64_t sample,
+                             uint32_t dimension, SelectedLight *selected) {
+  count = max(1, min(count, MAX_SELECTED_LIGHTS));
+
+  float total = 0.0f;
+  for (uint32_t l = 0; l < scene.light_count; ++l)
+    total += light_importance(scene.lights[l], point, normal);
+  if (total <= 0.0f)
+    return 0;
+
+  float targets[MAX_SELECTED_LIGHTS];
+  for (int k = 0; k < count; ++k)
+    targets[k] = (k + sample_1d(sample, dimension + k)) / count * total;
+
+  int written = 0;
+  int k = 0;
+  float cumulative = 0.0f;
+  uint32_t last = 0;
+  float last_importance = 0.0f;
+  for (uint32_t l = 0; l < scene.light_count && k < count; ++l) {
+    float importance = light_importance(scene.lights[l], point, normal);
+    if (importance <= 0.0f)
+      continue;
+    cumulative += importance;
+    last = l;
+    last_importance = importance;
+
+    int picks = 0;
+    while (k < count && targets[k] < cumulative) {
+      ++picks;
+      ++k;
+    }
+    if (picks > 0)
+      selected[written++] = {last, picks * total / (count * importance)};
+  }
+
+  if (k < count) {
+    float weight = (count - k) * total / (count * last_importance);
+    if (written > 0 && selected[written - 1].index == last)
+      selected[written - 1].weight += weight;
+    else
+      selected[written++] = {last, weight};
+  }
+  return written;
+}
+
+// Same quadratic and discriminant as Sphere::hit; returns the nearest root in
+// range
+__device__ bool hit_sphere(const DeviceSphere &sphere, const Ray &ray,
+                           float t_min, float t_max, float &t) {
+  Vec3 oc = ray.origin - sphere.center;
+  float a = ray.direction.length_squared();
+  float half_b = Vec3::dot(oc, ray.direction);
+  Vec3 f = oc - (half_b / a) * ray.direction;
+  float discriminant =
+      a * (sphere.radius * sphere.radius - f.length_squared());
+  if (discriminant < 0)
+    return false;
+
+  float sqrtd = sqrtf(discriminant);
+  float root = (-half_b - sqrtd) / a;
+  if (root < t_min || t_max < root) {
+    root = (-half_b + sqrtd) / a;
+    if (root < t_min || t_max < root)
+      return false;
+  }
+  t = root;
+  return true;
+}
+
+// Closest hit, front-to-back like BVH::intersect
+__device__ int32_t scene_hit(const DeviceScene &scene, const Ray &ray,
+                             float t_min, float &t_max) {
+  Vec3 inv_dir(1.0f / ray.direction.x, 1.0f / ray.direction.y,
+               1.0f / ray.direction.z);
+  float t_entry;
+  if (!scene.nodes[0].bounds.hit(ray, inv_dir, t_min, t_max, t_entry))
+    return -1;
+
+  uint32_t stack_node[BVH::MAX_DEPTH];
+  float stack_t[BVH::MAX_DEPTH];
+  int stack_size = 0;
+  uint32_t node_index = 0;
+  int32_t closest = -1;
+
+  while (true) {
+    const BVHNode &node = scene.nodes[node_index];
+    if (node.is_leaf()) {
+      for (uint32_t i = 0; i < node.prim_count; ++i) {
+        uint32_t slot = node.left_first + i;
+        float t;
+        if (hit_sphere(scene.spheres[slot], ray, t_min, t_max, t)) {
+          t_max = t;
+          closest = static_cast<int32_t>(slot);
+        }
+      }
+    } else {
+      uint32_t near_child = node.left_first;
+      uint32_t far_child = near_child + 1;
+      float t_near, t_far;
+      bool hit_near =
+          scene.nodes[near_child].bounds.hit(ray, inv_dir, t_min, t_max, t_near);
+      bool hit_far =
+          scene.nodes[far_child].bounds.hit(ray, inv_dir, t_min, t_max, t_far);
+
+      if (hit_near && hit_far) {
+        if (t_far < t_near) {
+          uint32_t n = near_child;
+          near_child = far_child;
+          far_child = n;
+          float tn = t_near;
+          t_near = t_far;
+          t_far = tn;
+        }
+        stack_node[stack_size] = far_child;
+        stack_t[stack_size++] = t_far;
+        node_index = near_child;
+        continue;
+      }
+      if (hit_near || hit_far) {
+        node_index = hit_near ? near_child : far_child;
+        continue;
+      }
+    }
+
+    bool found = false;
+    while (stack_size > 0) {
+      --stack_size;
+      if (stack_t[stack_size] <= t_max) {
+        node_index = stack_node[stack_size];
+        found = true;
+        break;
+      }
+    }
+    if (!found)
+      break;
+  }
+  return closest;
+}
+
+// Any hit, like BVH::occluded
+__device__ bool scene_occluded(const DeviceScene &scene, const Ray &ray,
+                               float t_min, float t_max) {
+  Vec3 inv_dir(1.0f / ray.direction.x, 1.0f / ray.direction.y,
+               1.0f / ray.direction.z);
+  uint32_t stack[BVH::MAX_DEPTH];
+  int stack_size = 0;
+  stack[stack_size++] = 0;
+
+  while (stack_size > 0) {
+    const BVHNode &node = scene.nodes[stack[--stack_size]];
+    float t_entry;
+    if (!node.bounds.hit(ray, inv_dir, t_min, t_max, t_entry))
+      continue;
+
+    if (node.is_leaf()) {
+      for (uint32_t i = 0; i < node.prim_count; ++i) {
+        float t;
+        if (hit_sphere(scene.spheres[node.left_first + i], ray, t_min, t_max,
+                       t))
+          return true;
+      }
+    } else {
+      stack[stack_size++] = node.left_first + 1;
+      stack[stack_size++] = node.left_first;
+    }
+  }
+  return false;
+}
+
+// Stage 0: one jittered camera ray per (pixel, sample) of the wave
+__global__ void camera_kernel(DeviceCamera camera, int width, int height,
+                              uint64_t first_sample, uint32_t count,
+                              PathQueue paths) {
+  uint32_t i = blockIdx.x * blockDim.x + threadIdx.x;
+  if (i >= count)
+    return;
+
+  const uint64_t pixel_count = static_cast<uint64_t>(width) * height;
+  uint64_t sample = first_sample + i;
+  uint32_t pixel = static_cast<uint32_t>(sample % pixel_count);
+  int x = static_cast<int>(pixel % width);
+  int y = static_cast<int>(pixel / width);
+
+  float u = (x + sample_1d(sample, DIM_CAMERA_U)) / (width - 1);
+  float v = (y + sample_1d(sample, DIM_CAMERA_V)) / (height - 1);
+
+  paths.origin[i] = camera.origin;
+  paths.direction[i] =
+      camera.corner_dir + u * camera.horizontal + v * camera.vertical;
+  paths.throughput[i] = Color(1.0f);
+  paths.pixel[i] = pixel;
+  paths.sample[i] = sample;
+}
+
+// Stage 1: closest hit of every active path
+__global__ void intersect_kernel(DeviceScene scene, PathQueue paths,
+                                 uint32_t count, HitQueue hits) {
+  uint32_t i = blockIdx.x * blockDim.x + threadIdx.x;
+  if (i >= count)
+    return;
+
+  float t_max = 1000.0f;
+  int32_t sphere =
+      scene_hit(scene, Ray(paths.origin[i], paths.direction[i]), 0.001f, t_max);
+  hits.t[i] = t_max;
+  hits.sphere[i] = sphere;
+}
+
+// Stage 2: direct lighting as shadow rays, plus the reflected ray of the
+// next bounce (same estimator as shade_hit)
+__global__ void shade_kernel(DeviceScene scene, PathQueue paths,
+                             uint32_t count, HitQueue hits, int bounce,
+                             int light_samples, ShadowQueue shadows, uint32_t *shadow_count,
+                             PathQueue next, uint32_t *next_count) {
+  uint32_t i = blockIdx.x * blockDim.x + threadIdx.x;
+  if (i >= count || hits.sphere[i] < 0)
+    return;
+
+  const DeviceSphere &sphere = scene.spheres[hits.sphere[i]];
+  const DeviceMaterial &material = scene.materials[sphere.material];
+  Ray ray(paths.origin[i], paths.direction[i]);
+
+  HitRecord rec;
+  rec.t = hits.t[i];
+  rec.point = ray.at(rec.t);
+  rec.set_face_normal(ray, (rec.point - sphere.center) / sphere.radius);
+
+  // Direct lighting, weighted by the non-reflective part of the surface,
+  // from every light or only from the ones picked for this hit
+  const uint32_t bounce_dims = DIM_BOUNCE + bounce * DIMS_PER_BOUNCE;
+  Color throughput = paths.throughput[i];
+  Color weight = throughput * (1.0f - material.reflectivity);
+  Point3 shadow_origin = rec.point + rec.normal * 0.001f;
+  SelectedLight selected[MAX_SELECTED_LIGHTS];
+  int light_count = static_cast<int>(scene.light_count);
+  if (light_samples > 0)
+    light_count = select_lights(scene, rec.point, rec.normal, light_samples,
+                                paths.sample[i], bounce_dims + 1, selected);
+  for (int l = 0; l < light_count; ++l) {
+    const uint32_t light_index = light_samples > 0 ? selected[l].index : l;
+    float light_weight = light_samples > 0 ? selected[l].weight : 1.0f;
+    const Light &light = scene.lights[light_index];
+    const int samples = light.sample_count();
+    const float sample_weight = light_weight / static_cast<float>(samples);
+
+    // Stratified shadow-ray targets across the light surface, each with its
+    // own cosine and distance falloff (as Wavefront::shade)
+    float shift_u = 0.0f, shift_v = 0.0f;
+    if (light.shape != LightShape::POINT) {
+      uint32_t dim =
+          DIM_LIGHT_SHIFT + 2 * (bounce * scene.light_count + light_index);
+      shift_u = sample_1d(paths.sample[i], dim);
+      shift_v = sample_1d(paths.sample[i], dim + 1);
+    }
+    uint32_t slot = atomicAdd(shadow_count, static_cast<uint32_t>(samples));
+    for (int s = 0; s < samples; ++s) {
+      Point3 target = light.sample_point(rec.point, s, shift_u, shift_v);
+      Vec3 light_dir = (target - rec.point).normalized();
+      float cos_theta = fmaxf(0.0f, Vec3::dot(rec.normal, light_dir));
+      float distance = (target - rec.point).length();
+      Vec3 to_light = target - shadow_origin;
+      float shadow_length = to_light.length();
+      // Slots were reserved for every sample: those behind the surface
+      // carry no radiance
+      shadows.origin[slot + s] = shadow_origin;
+      shadows.direction[slot + s] = to_light / shadow_length;
+      shadows.t_max[slot + s] = shadow_length - 0.001f;
+      shadows.contribution[slot + s] =
+          cos_theta > 0.0f ? weight * material.color * cos_theta *
+                                 light.intensity /
+                                 (distance * distance + 1e-4f) * sample_weight
+                           : Color(0.0f);
+      shadows.pixel[slot + s] = paths.pixel[i];
+    }
+  }
+
+  // Continue along the mirror direction if the material is reflective
+  if (material.reflectivity <= 0.0f)
+    return;
+  throughput = throughput * (material.reflectivity * material.color);
+
+  // Russian roulette, as survives_roulette
+  if (bounce + 1 >= RUSSIAN_ROULETTE_DEPTH) {
+    float max_throughput =
+        fmaxf(throughput.x, fmaxf(throughput.y, throughput.z));
+    if (max_throughput < RUSSIAN_ROULETTE_THRESHOLD) {
+      float survive = max_throughput / RUSSIAN_ROULETTE_THRESHOLD;
+      if (sample_1d(paths.sample[i], bounce_dims) >= survive)
+        return;
+      throughput *= 1.0f / survive;
+    }
+  }
+
+  Vec3 incident_dir = ray.direction.normalized();
+  Vec3 reflected_dir =
+      incident_dir - 2.0f * Vec3::dot(incident_dir, rec.normal) * rec.normal;
+  uint32_t slot = atomicAdd(next_count, 1u);
+  next.origin[slot] = shadow_origin;
+  next.direction[slot] = reflected_dir;
+  next.throughput[slot] = throughput;
+  next.pixel[slot] = paths.pixel[i];
+  next.sample[slot] = paths.sample[i];
+}
+
+// Stage 3: unoccluded shadow rays deposit their radiance on their pixel
+__global__ void shadow_kernel(DeviceScene scene, ShadowQueue shadows,
+                              uint32_t count, float *accum) {
+  uint32_t i = blockIdx.x * blockDim.x + threadIdx.x;
+  if (i >= count)
+    return;
+  if (scene_occluded(scene, Ray(shadows.origin[i], shadows.direction[i]),
+                     0.001f, shadows.t_max[i]))
+    return;
+
+  const Color &c = shadows.contribution[i];
+  float *dst = accum + 3 * static_cast<size_t>(shadows.pixel[i]);
+  atomicAdd(dst + 0, c.x);
+  atomicAdd(dst + 1, c.y);
+  atomicAdd(dst + 2, c.z);
+}
+
+uint32_t blocks_for(uint32_t count) {
+  return (count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+}
+
+} // namespace
+
+bool cuda_device_available(std::string &name) {
+  int count = 0;
+  if (cudaGetDeviceCount(&count) != cudaSuccess || count == 0)
+    return false;
+  cudaDeviceProp prop;
+  if (cudaGetDeviceProperties(&prop, 0) != cudaSuccess)
+    return false;
+  name = prop.name;
+  return true;
+}
+
+bool render_scene_cuda(const Scene &scene, const Camera &camera,
+                       const RenderSettings &settings,
+                       std::vector<Color> &pixels, RenderReport &report,
+                       const PassCallback &on_pass) {
+  const int image_width = settings.image_width;
+  const int image_height = settings.image_height;
+  const int samples_per_pixel = std::max(1, settings.samples_per_pixel);
+  const uint64_t pixel_count =
+      static_cast<uint64_t>(image_width) * image_height;
+
+  if (!scene.instances.empty()) {
+    // The device kernels trace a single flat sphere array
+    std::cerr << "CUDA engine: instances not supported\n";
+    return false;
+  }
+  if (!scene.meshes.empty()) {
+    std::cerr << "CUDA engine: meshes not supported\n";
+    return false;
+  }
+
+  if (settings.adaptive)
+    std::cerr << "CUDA engine: adaptive sampling not supported, using "
+              << samples_per_pixel << " samples per pixel\n";
+
+  // Flatten the scene: spheres in BVH leaf order and the material table
+  BVH local_bvh;
+  const BVH *bvh = &scene.bvh;
+  if (bvh->empty()) {
+    std::vector<AABB> bounds;
+    for (const auto &obj : scene.objects)
+      bounds.push_back(obj.bounds());
+    local_bvh.build(bounds);
+    bvh = &local_bvh;
+  }
+
+  std::vector<DeviceMaterial> materials;
+  for (uint32_t id = 0; id < scene.materials.size(); ++id)
+    materials.push_back(
+        {scene.materials.color(id), scene.materials.reflectivity(id)});
+
+  std::vector<DeviceSphere> spheres;
+  for (uint32_t index : bvh->prim_indices) {
+    const Sphere &obj = scene.objects[index];
+    spheres.push_back({obj.center, obj.radius, obj.material});
+  }
+
+  const std::vector<Light> &lights = scene.lights;
+
+  if (spheres.empty()) {
+    // Nothing to hit: every camera ray sees the black background
+    std::fill(pixels.begin(), pixels.end(), Color(0.0f));
+    report.samples = static_cast<uint64_t>(samples_per_pixel) * pixel_count;
+    report.passes = 1;
+    report.threads.assign(1, ThreadTiming());
+    if (on_pass)
+      on_pass(0, pixels);
+    return true;
+  }
+
+  DeviceBuffer<BVHNode> d_nodes;
+  DeviceBuffer<DeviceSphere> d_spheres;
+  DeviceBuffer<DeviceMaterial> d_materials;
+  DeviceBuffer<Light> d_lights;
+  CUDA_TRY(d_nodes.upload(bvh->nodes));
+  CUDA_TRY(d_spheres.upload(spheres));
+  CUDA_TRY(d_materials.upload(materials));
+  CUDA_TRY(d_lights.upload(lights));
+  DeviceScene d_scene = {d_nodes.get(), d_spheres.get(), d_materials.get(),
+                         d_lights.get(), static_cast<uint32_t>(lights.size())};
+
+  // get_ray is affine in (u, v): three rays pin down the image plane
+  Ray corner = camera.get_ray(0.0f, 0.0f);
+  DeviceCamera d_camera = {corner.origin, corner.direction,
+                           camera.get_ray(1.0f, 0.0f).direction -
+                               corner.direction,
+                           camera.get_ray(0.0f, 1.0f).direction -
+                               corner.direction};
+
+  // Wave-sized queues: paths ping-pong between two buffers per bounce
+  size_t shadow_rays_per_hit = 0;
+  for (const Light &light : lights)
+    shadow_rays_per_hit += static_cast<size_t>(light.sample_count());
+  const size_t shadow_capacity =
+      static_cast<size_t>(WAVE_SIZE) * shadow_rays_per_hit;
+  PathBuffers path_buffers[2];
+  CUDA_TRY(path_buffers[0].allocate(WAVE_SIZE));
+  CUDA_TRY(path_buffers[1].allocate(WAVE_SIZE));
+
+  DeviceBuffer<float> hit_t;
+  DeviceBuffer<int32_t> hit_sphere;
+  CUDA_TRY(hit_t.allocate(WAVE_SIZE));
+  CUDA_TRY(hit_sphere.allocate(WAVE_SIZE));
+  HitQueue hits = {hit_t.get(), hit_sphere.get()};
+
+  DeviceBuffer<Point3> shadow_origin;
+  DeviceBuffer<Vec3> shadow_direction;
+  DeviceBuffer<float> shadow_t_max;
+  DeviceBuffer<Color> shadow_contribution;
+  DeviceBuffer<uint32_t> shadow_pixel;
+  CUDA_TRY(shadow_origin.allocate(shadow_capacity));
+  CUDA_TRY(shadow_direction.allocate(shadow_capacity));
+  CUDA_TRY(shadow_t_max.allocate(shadow_capacity));
+  CUDA_TRY(shadow_contribution.allocate(shadow_capacity));
+  CUDA_TRY(shadow_pixel.allocate(shadow_capacity));
+  ShadowQueue shadows = {shadow_origin.get(), shadow_direction.get(),
+                         shadow_t_max.get(), shadow_contribution.get(),
+                         shadow_pixel.get()};
+
+  // counters[0] = shadow rays, counters[1] = paths of the next bounce
+  DeviceBuffer<uint32_t> counters;
+  CUDA_TRY(counters.allocate(2));
+
+  DeviceBuffer<float> accum;
+  CUDA_TRY(accum.allocate(3 * pixel_count));
+  CUDA_TRY(cudaMemset(accum.get(), 0, 3 * pixel_count * sizeof(float)));
+
+  std::cout << "Rendering " << image_width << "x" << image_height
+            << " image on the GPU in waves of " << WAVE_SIZE << " paths...\n";
+
+  auto frame_start = std::chrono::steady_clock::now();
+  const int pass_samples =
+      settings.progressive
+          ? std::max(1, std::min(settings.pass_samples, samples_per_pixel))
+          : samples_per_pixel;
+  int taken = 0;
+  while (taken < samples_per_pixel) {
+    int n = std::min(pass_samples, samples_per_pixel - taken);
+
+    // Sample indices of this pass, pixel-major within each sample
+    const uint64_t pass_first = static_cast<uint64_t>(taken) * pixel_count;
+    const uint64_t pass_end = pass_first + static_cast<uint64_t>(n) * pixel_count;
+    for (uint64_t first = pass_first; first < pass_end; first += WAVE_SIZE) {
+      uint32_t count =
+          static_cast<uint32_t>(std::min<uint64_t>(WAVE_SIZE, pass_end - first));
+      int current = 0;
+      camera_kernel<<<blocks_for(count), BLOCK_SIZE>>>(
+          d_camera, image_width, image_height, first, count,
+          path_buffers[current].queue());
+      CUDA_TRY(cudaGetLastError());
+
+      for (int bounce = 0; bounce < MAX_BOUNCES && count > 0; ++bounce) {
+        PathQueue paths = path_buffers[current].queue();
+        PathQueue next = path_buffers[1 - current].queue();
+
+        intersect_kernel<<<blocks_for(count), BLOCK_SIZE>>>(d_scene, paths,
+                                                            count, hits);
+        CUDA_TRY(cudaMemset(counters.get(), 0, 2 * sizeof(uint32_t)));
+        shade_kernel<<<blocks_for(count), BLOCK_SIZE>>>(
+            d_scene, paths, count, hits, bounce, settings.light_samples,
+            shadows, counters.get(), next, counters.get() + 1);
+        CUDA_TRY(cudaGetLastError());
+
+        uint32_t host_counters[2];
+        CUDA_TRY(cudaMemcpy(host_counters, counters.get(), sizeof(host_counters),
+                            cudaMemcpyDeviceToHost));
+        if (host_counters[0] > 0) {
+          shadow_kernel<<<blocks_for(host_counters[0]), BLOCK_SIZE>>>(
+              d_scene, shadows, host_counters[0], accum.get());
+          CUDA_TRY(cudaGetLastError());
+        }
+
+        count = host_counters[1];
+        current = 1 - current;
+      }
+    }
+
+    taken += n;
+    report.samples += static_cast<uint64_t>(n) * pixel_count;
+
+    // Resolve the running sums into the caller's pixel layout
+    CUDA_TRY(cudaMemcpy(pixels.data(), accum.get(),
+                        3 * pixel_count * sizeof(float),
+                        cudaMemcpyDeviceToHost));
+    const float inv_samples = 1.0f / static_cast<float>(taken);
+    for (auto &pixel : pixels)
+      pixel *= inv_samples;
+
+    if (on_pass)
+      on_pass(report.passes, pixels);
+    report.passes++;
+  }
+
+  ThreadTiming timing;
+  timing.busy_ms = std::chrono::duration<double, std::milli>(
+                       std::chrono::steady_clock::now() - frame_start)
+                       .count();
+  report.threads.assign(1, timing);
+  return true;
+}
@@ -0,0 +1,42 @@
+#include "default_scene.h"
+#include "bsdfs/material_table.h"
+
+void populate_default_scene(Scene &scene) {
+  MaterialTable &materials = scene.materials;
+  uint32_t lambertian = materials.add(Lambertian(Color(0.5f, 0.25f, 0.25f)));
+  uint32_t lambertian2 = materials.add(Lambertian(Color(0.25f, 0.5f, 0.75f)));
+  uint32_t lambertian3 = materials.add(Lambertian(Color(0.75f, 0.5f, 0.25f)));
+  uint32_t conductor = materials.add(Conductor(Color(0.25f, 0.75f, 0.5f)));
+  uint32_t lambertian4 = materials.add(Lambertian(Color(0.5, 0.75, 0.5)));
+  uint32_t conductor2 = materials.add(Conductor(Color(0.5, 0.5, 0.75)));
+  uint32_t lambertian5 = materials.add(Lambertian(Color(0.5, 0.5, 0.75)));
+  uint32_t lambertian6 = materials.add(Lambertian(Color(0.75, 0.75, 0.75)));
+
+  Sphere sphere1(Point3(0.0, 0.0, 0.0), 100.0f, lambertian);
+  Sphere sphere2(Point3(-0.35, 0.35, -3.5), 0.25f, lambertian2);
+  Sphere sphere3(Point3(0.35, 0.35, -2.5), 0.35f, lambertian3);
+  Sphere sphere4(Point3(0.35, -0.35, -2.0), 0.3f, conductor);
+  Sphere sphere5(Point3(-0.35, -0.35, -4.0), 0.325f, lambertian4);
+  Sphere sphere6(Point3(-1.5, 0.0, -3.0), 0.5f, conductor2);
+  Sphere sphere7(Point3(1.5, 0.0, -3.0), 0.5f, lambertian5);
+  Sphere sphere8(Point3(10.0, 0.0, -3.0), 0.5f, lambertian6);
+  Sphere sphere9(Point3(-10.0, 0.0, -3.0), 0.5f, lambertian6);
+
+  Light light2(Vec3(0, 0, 0), Vec3(10, 10, 10));
+  Light light3(Vec3(-0.4, 0.5, -3.0), Vec3(0.5, 0.5, 0.5));
+  Light light4(Vec3(0, 0, 90), Vec3(10000, 10000, 10000));
+
+  scene.add_object(sphere1);
+  scene.add_object(sphere2);
+  scene.add_object(sphere3);
+  scene.add_object(sphere4);
+  scene.add_object(sphere5);
+  scene.add_object(sphere6);
+  scene.add_object(sphere7);
+  scene.add_object(sphere8);
+  scene.add_object(sphere9);
+  scene.add_light(light2);
+  scene.add_light(light3);
+  scene.add_light(light4);
+
+}
@@ -0,0 +1,838 @@
+#include "distributed.h"
+#include "light_selection.h"
+#include "scheduler.h"
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <iostream>
+
+namespace {
+
+/// First word of every message ("KSTR"), to reject stray connections
+constexpr uint32_t PROTOCOL_MAGIC = 0x5254534bU;
+/// Bumped whenever a message layout changes
+constexpr uint32_t PROTOCOL_VERSION = 3;
+/// Largest HELLO, FRAME or BYE payload accepted from the network; once the
+/// frame is known the limit grows to its largest message (result_limit,
+/// tiles_limit)
+constexpr uint64_t MAX_CONTROL_PAYLOAD = 4096;
+/// Batches of ranges a worker has queued at a time
+constexpr size_t PIPELINE_DEPTH = 2;
+/// Copies of a range in flight at once (the original and one backup)
+constexpr int MAX_COPIES = 2;
+
+enum class MessageType : uint32_t {
+  HELLO = 1, ///< Worker -> coordinator: HelloMessage
+  FRAME,     ///< Coordinator -> worker: FrameMessage
+  TILES,     ///< Coordinator -> worker: range count, range ids
+  RESULT,    ///< Worker -> coordinator: per range its id and float pixels
+  BYE        ///< Coordinator -> worker: frame done, or why it was refused
+};
+
+struct MessageHeader {
+  uint32_t magic;
+  uint32_t type;
+  uint64_t size;
+};
+
+struct HelloMessage {
+  uint32_t version;
+  uint32_t threads;
+  uint64_t fingerprint;
+};
+
+struct FrameMessage {
+  int32_t image_width;
+  int32_t image_height;
+  int32_t samples_per_pixel;
+  int32_t tile_size;
+  int32_t light_samples;
+  int32_t pass_samples;
+  int32_t range_tiles;
+  uint8_t engine;
+  uint8_t sampler;
+  uint8_t progressive;
+  uint8_t pixel_seeds;
+  float look_from[3];
+  float look_at[3];
+  float vup[3];
+  float vfov;
+  float aspect_ratio;
+};
+
+/// Whether a received frame can be rendered: the ranges the command line
+/// clamps its options to, and engines and samplers this build knows
+bool valid_frame(const FrameMessage &frame) {
+  return frame.image_width >= 1 && frame.image_height >= 1 &&
+         frame.samples_per_pixel >= 1 && frame.tile_size >= 1 &&
+         frame.light_samples >= 0 &&
+         frame.light_samples <= MAX_SELECTED_LIGHTS &&
+         frame.pass_samples >= 1 && frame.range_tiles >= 1 &&
+         frame.engine <= static_cast<uint8_t>(RenderEngine::PACKET) &&
+         frame.sampler <= static_cast<uint8_t>(SamplerType::ZSOBOL) &&
+         frame.aspect_ratio > 0.0f;
+}
+
+/// Largest RESULT payload of a frame: every range id and float pixel of it
+uint64_t result_limit(int image_width, int image_height, size_t ranges) {
+  const uint64_t pixels = static_cast<uint64_t>(image_width) *
+                          static_cast<uint64_t>(image_height);
+  const uint64_t ids = 1 + static_cast<uint64_t>(ranges);
+  return std::max<uint64_t>(MAX_CONTROL_PAYLOAD, sizeof(uint32_t) * ids +
+                                                     sizeof(Color) * pixels);
+}
+
+/// Largest TILES payload of a frame: the count and every range id
+uint64_t tiles_limit(size_t ranges) {
+  const uint64_t ids = 1 + static_cast<uint64_t>(ranges);
+  return std::max<uint64_t>(MAX_CONTROL_PAYLOAD, sizeof(uint32_t) * ids);
+}
+
+/// Store a vector in a message field
+void put_vec3(float out[3], const Vec3 &v) {
+  out[0] = v.x;
+  out[1] = v.y;
+  out[2] = v.z;
+}
+
+/// Read a vector from a message field
+Vec3 get_vec3(const float in[3]) { return Vec3(in[0], in[1], in[2]); }
+
+/// Appends plain values to a payload
+class PayloadWriter {
+public:
+  template <typename T> void put(const T &value) {
+    const auto *bytes = reinterpret_cast<const uint8_t *>(&value);
+    data.insert(data.end(), bytes, bytes + sizeof(T));
+  }
+
+  std::vector<uint8_t> data;
+};
+
+/// Reads plain values back from a payload, failing past its end
+class PayloadReader {
+public:
+  explicit PayloadReader(const std::vector<uint8_t> &data) : data(data) {}
+
+  template <typename T> bool get(T &value) {
+    if (data.size() - offset < sizeof(T))
+      return false;
+    std::memcpy(&value, data.data() + offset, sizeof(T));
+    offset += sizeof(T);
+    return true;
+  }
+
+  bool get_bytes(void *out, size_t size) {
+    if (data.size() - offset < size)
+      return false;
+    std::memcpy(out, data.data() + offset, size);
+    offset += size;
+    return true;
+  }
+
+private:
+  const std::vector<uint8_t> &data;
+  size_t offset = 0;
+};
+
+/// A peer that has gone must fail the send, not raise SIGPIPE: per call
+/// where MSG_NOSIGNAL exists, otherwise per socket (set_no_sigpipe)
+#ifdef MSG_NOSIGNAL
+constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+constexpr int SEND_FLAGS = 0;
+#endif
+
+bool send_all(int fd, const void *data, size_t size) {
+  const auto *bytes = static_cast<const uint8_t *>(data);
+  while (size > 0) {
+    ssize_t sent = send(fd, bytes, size, SEND_FLAGS);
+    if (sent < 0 && errno == EINTR)
+      continue;
+    if (sent <= 0)
+      return false;
+    bytes += sent;
+    size -= static_cast<size_t>(sent);
+  }
+  return true;
+}
+
+bool recv_all(int fd, void *data, size_t size) {
+  auto *bytes = static_cast<uint8_t *>(data);
+  while (size > 0) {
+    ssize_t received = recv(fd, bytes, size, 0);
+    if (received < 0 && errno == EINTR)
+      continue;
+    if (received <= 0)
+      return false;
+    bytes += received;
+    size -= static_cast<size_t>(received);
+  }
+  return true;
+}
+
+bool send_message(int fd, MessageType type,
+                  const std::vector<uint8_t> &payload) {
+  MessageHeader header = {PROTOCOL_MAGIC, static_cast<uint32_t>(type),
+                          payload.size()};
+  return send_all(fd, &header, sizeof(header)) &&
+         send_all(fd, payload.data(), payload.size());
+}
+
+/// Return of take_message and recv_message
+enum class InboxStatus {
+  INCOMPLETE, ///< The next message has not fully arrived
+  MESSAGE,    ///< A message was taken off the buffer
+  MALFORMED   ///< The buffer does not start with a valid message header
+};
+
+/// Blocks until a whole message of at most max_size bytes has arrived
+/// @return INCOMPLETE if the connection closes or fails first
+InboxStatus recv_message(int fd, uint64_t max_size, MessageType &type,
+                         std::vector<uint8_t> &payload) {
+  MessageHeader header;
+  if (!recv_all(fd, &header, sizeof(header)))
+    return InboxStatus::INCOMPLETE;
+  if (header.magic != PROTOCOL_MAGIC || header.size > max_size)
+    return InboxStatus::MALFORMED;
+  type = static_cast<MessageType>(header.type);
+  payload.resize(header.size);
+  return recv_all(fd, payload.data(), payload.size())
+             ? InboxStatus::MESSAGE
+             : InboxStatus::INCOMPLETE;
+}
+
+/// Append whatever has arrived on a socket, without blocking
+/// @return False once the peer has closed the connection or it failed
+bool receive_available(int fd, std::vector<uint8_t> &inbox) {
+  uint8_t buffer[65536];
+  while (true) {
+    ssize_t received = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+    if (received > 0) {
+      inbox.insert(inbox.end(), buffer, buffer + received);
+      continue;
+    }
+    if (received < 0 && errno == EINTR)
+      continue;
+    return received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+  }
+}
+
+/// Take the first whole message of at most max_size bytes off a receive
+/// buffer
+InboxStatus take_message(std::vector<uint8_t> &inbox, uint64_t max_size,
+                         MessageType &type, std::vector<uint8_t> &payload) {
+  MessageHeader header;
+  if (inbox.size() < sizeof(header))
+    return InboxStatus::INCOMPLETE;
+  std::memcpy(&header, inbox.data(), sizeof(header));
+  if (header.magic != PROTOCOL_MAGIC || header.size > max_size)
+    return InboxStatus::MALFORMED;
+  if (inbox.size() - sizeof(header) < header.size)
+    return InboxStatus::INCOMPLETE;
+  type = static_cast<MessageType>(header.type);
+  const auto begin = inbox.begin() + sizeof(header);
+  payload.assign(begin, begin + header.size);
+  inbox.erase(inbox.begin(), begin + header.size);
+  return InboxStatus::MESSAGE;
+}
+
+void send_bye(int fd, const std::string &reason) {
+  std::vector<uint8_t> payload(reason.begin(), reason.end());
+  send_message(fd, MessageType::BYE, payload);
+}
+
+/// Disable Nagle's algorithm: the small TILES messages must not wait for
+/// the acknowledgement of the previous result
+void set_no_delay(int fd) {
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+/// Make sends on a socket whose peer has gone fail with EPIPE on systems
+/// without MSG_NOSIGNAL (macOS)
+void set_no_sigpipe(int fd) {
+#ifdef SO_NOSIGPIPE
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#else
+  (void)fd;
+#endif
+}
+
+/// Probe idle connections, so a worker that vanishes without closing its
+/// socket (power loss, a cut cable) is reported after about 25 s and its
+/// ranges are handed out again
+void set_keep_alive(int fd) {
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+#ifdef TCP_KEEPIDLE
+  int idle = 10, interval = 5, count = 3;
+  setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+  setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+  setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
+#endif
+}
+
+uint64_t fnv1a(uint64_t hash, const void *data, size_t size) {
+  const auto *bytes = static_cast<const uint8_t *>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+std::string socket_error(const std::string &what) {
+  return what + ": " + std::strerror(errno);
+}
+
+/// A range of consecutive tiles [first, end) in the make_tiles order
+struct TileRange {
+  uint32_t first = 0;
+  uint32_t end = 0;
+  bool done = false;
+  int copies = 0; ///< Workers it is queued on
+  std::chrono::steady_clock::time_point dispatched;
+};
+
+struct Connection {
+  int fd = -1;
+  size_t worker = 0;  ///< Index into CoordinatorReport::workers
+  bool ready = false; ///< HELLO accepted and FRAME sent
+  size_t batch_ranges = 1;
+  std::deque<std::vector<uint32_t>> batches; ///< Sent, not yet returned
+  std::vector<uint8_t> inbox; ///< Received bytes of unfinished messages
+};
+
+} // namespace
+
+uint64_t scene_fingerprint(const Scene &scene) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (const Sphere &sphere : scene.objects) {
+    const float values[] = {sphere.center.x, sphere.center.y,
+                            sphere.center.z, sphere.radius};
+    hash = fnv1a(hash, values, sizeof(values));
+    hash = fnv1a(hash, &sphere.material, sizeof(sphere.material));
+  }
+  for (const GeometryBlock &block : scene.geometries) {
+    for (const Sphere &sphere : block.spheres) {
+      const float values[] = {sphere.center.x, sphere.center.y,
+                              sphere.center.z, sphere.radius};
+      hash = fnv1a(hash, values, sizeof(values));
+      hash = fnv1a(hash, &sphere.material, sizeof(sphere.material));
+    }
+  }
+  for (const Instance &instance : scene.instances) {
+    hash = fnv1a(hash, instance.to_world.m, sizeof(instance.to_world.m));
+    hash = fnv1a(hash, &instance.geometry, sizeof(instance.geometry));
+    hash = fnv1a(hash, &instance.material, sizeof(instance.material));
+  }
+  for (const TriangleMesh &mesh : scene.meshes) {
+    for (const Point3 &vertex : mesh.vertices) {
+      const float values[] = {vertex.x, vertex.y, vertex.z};
+      hash = fnv1a(hash, values, sizeof(values));
+    }
+    hash = fnv1a(hash, mesh.indices.data(),
+                 mesh.indices.size() * sizeof(uint32_t));
+    hash = fnv1a(hash, &mesh.material, sizeof(mesh.material));
+  }
+  for (uint32_t id = 0; id < scene.materials.size(); ++id) {
+    const uint8_t type = static_cast<uint8_t>(scene.materials.type(id));
+    const Color &color = scene.materials.color(id);
+    const float values[] = {color.x, color.y, color.z,
+                            scene.materials.reflectivity(id)};
+    hash = fnv1a(hash, &type, sizeof(type));
+    hash = fnv1a(hash, values, sizeof(values));
+  }
+  for (const Light &light : scene.lights) {
+    const float values[] = {
+        light.position.x,  light.position.y,  light.position.z,
+        light.intensity.x, light.intensity.y, light.intensity.z,
+        light.radius,      light.edge_u.x,    light.edge_u.y,
+        light.edge_u.z,    light.edge_v.x,    light.edge_v.y,
+        light.edge_v.z};
+    const uint8_t shape = static_cast<uint8_t>(light.shape);
+    const int32_t samples = light.samples;
+    hash = fnv1a(hash, values, sizeof(values));
+    hash = fnv1a(hash, &shape, sizeof(shape));
+    hash = fnv1a(hash, &samples, sizeof(samples));
+  }
+  return hash;
+}
+
+bool run_coordinator(int port, const RenderSettings &settings,
+                     const SceneCamera &view, float aspect_ratio,
+                     uint64_t fingerprint, int range_tiles,
+                     std::vector<Color> &pixels, CoordinatorReport &report,
+                     std::string &error) {
+  if (settings.adaptive) {
+    error = "Adaptive sampling cannot be distributed";
+    return false;
+  }
+  if (settings.engine == RenderEngine::CUDA) {
+    error = "The CUDA engine cannot be distributed";
+    return false;
+  }
+
+  const int image_width = settings.image_width;
+  const std::vector<Tile> tiles =
+      make_tiles(image_width, settings.image_height, settings.tile_size);
+  range_tiles = std::max(1, range_tiles);
+  std::vector<TileRange> ranges;
+  for (size_t first = 0; first < tiles.size(); first += range_tiles) {
+    TileRange range;
+    range.first = static_cast<uint32_t>(first);
+    range.end = static_cast<uint32_t>(
+        std::min(tiles.size(), first + static_cast<size_t>(range_tiles)));
+    ranges.push_back(range);
+  }
+  report = CoordinatorReport();
+  report.ranges = static_cast<int>(ranges.size());
+  const uint64_t max_result =
+      result_limit(image_width, settings.image_height, ranges.size());
+
+  FrameMessage frame = {};
+  frame.image_width = image_width;
+  frame.image_height = settings.image_height;
+  frame.samples_per_pixel = settings.samples_per_pixel;
+  frame.tile_size = settings.tile_size;
+  frame.light_samples = settings.light_samples;
+  frame.pass_samples = settings.pass_samples;
+  frame.range_tiles = range_tiles;
+  frame.engine = static_cast<uint8_t>(settings.engine);
+  frame.sampler = static_cast<uint8_t>(settings.sampler);
+  frame.progressive = settings.progressive;
+  frame.pixel_seeds = settings.pixel_seeds;
+  put_vec3(frame.look_from, view.look_from);
+  put_vec3(frame.look_at, view.look_at);
+  put_vec3(frame.vup, view.vup);
+  frame.vfov = view.vfov;
+  frame.aspect_ratio = aspect_ratio;
+  PayloadWriter frame_payload;
+  frame_payload.put(frame);
+
+  int listener = socket(AF_INET6, SOCK_STREAM, 0);
+  if (listener < 0) {
+    error = socket_error("Cannot create the coordinator socket");
+    return false;
+  }
+  int one = 1;
+  setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  int zero = 0; // Accept IPv4 clients too
+  setsockopt(listener, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+  sockaddr_in6 address = {};
+  address.sin6_family = AF_INET6;
+  address.sin6_addr = in6addr_any;
+  address.sin6_port = htons(static_cast<uint16_t>(port));
+  if (bind(listener, reinterpret_cast<sockaddr *>(&address),
+           sizeof(address)) < 0 ||
+      listen(listener, 64) < 0) {
+    error = socket_error("Cannot listen on port " + std::to_string(port));
+    close(listener);
+    return false;
+  }
+  std::cout << "Waiting for workers on port " << port << ": "
+            << tiles.size() << " tiles in " << ranges.size()
+            << " ranges\n";
+
+  std::deque<uint32_t> pending;
+  for (uint32_t r = 0; r < ranges.size(); ++r)
+    pending.push_back(r);
+  std::vector<Connection> connections;
+  size_t done = 0;
+  const size_t progress_step = std::max<size_t>(1, ranges.size() / 10);
+
+  auto drop = [&](Connection &connection) {
+    close(connection.fd);
+    connection.fd = -1;
+    WorkerReport &worker = report.workers[connection.worker];
+    if (connection.ready) {
+      worker.lost = true;
+      std::cout << "Worker " << worker.address << " lost\n";
+    }
+    // Hand its unfinished ranges out again, first in line
+    for (const auto &batch : connection.batches) {
+      for (uint32_t r : batch) {
+        if (--ranges[r].copies == 0 && !ranges[r].done) {
+          pending.push_front(r);
+          report.reissued++;
+        }
+      }
+    }
+    connection.batches.clear();
+    connection.inbox.clear();
+  };
+
+  // Queue batches on every worker with room for them
+  auto dispatch = [&](Connection &connection) {
+    while (connection.ready && connection.batches.size() < PIPELINE_DEPTH) {
+      std::vector<uint32_t> batch;
+      while (!pending.empty() && batch.size() < connection.batch_ranges) {
+        uint32_t r = pending.front();
+        pending.pop_front();
+        if (!ranges[r].done)
+          batch.push_back(r);
+      }
+      WorkerReport &worker = report.workers[connection.worker];
+      if (batch.empty() && connection.batches.empty()) {
+        // Nothing left to hand out and this worker is idle: back up the
+        // ranges that have been running the longest elsewhere
+        std::vector<uint32_t> running;
+        for (uint32_t r = 0; r < ranges.size(); ++r)
+          if (!ranges[r].done && ranges[r].copies > 0 &&
+              ranges[r].copies < MAX_COPIES)
+            running.push_back(r);
+        std::sort(running.begin(), running.end(),
+                  [&](uint32_t a, uint32_t b) {
+                    return ranges[a].dispatched < ranges[b].dispatched;
+                  });
+        if (running.size() > connection.batch_ranges)
+          running.resize(connection.batch_ranges);
+        batch = std::move(running);
+        worker.backups += static_cast<int>(batch.size());
+      }
+      if (batch.empty())
+        return;
+
+      PayloadWriter payload;
+      payload.put(static_cast<uint32_t>(batch.size()));
+      const auto now = std::chrono::steady_clock::now();
+      for (uint32_t r : batch) {
+        payload.put(r);
+        if (ranges[r].copies++ == 0)
+          ranges[r].dispatched = now;
+      }
+      connection.batches.push_back(std::move(batch));
+      if (!send_message(connection.fd, MessageType::TILES, payload.data)) {
+        drop(connection);
+        return;
+      }
+    }
+  };
+
+  // Copy the tiles of a RESULT into the image
+  auto receive_result = [&](Connection &connection,
+                            const std::vector<uint8_t> &payload) {
+    PayloadReader reader(payload);
+    uint32_t count;
+    if (!reader.get(count) || connection.batches.empty())
+      return false;
+    WorkerReport &worker = report.workers[connection.worker];
+    std::vector<Color> row;
+    for (uint32_t k = 0; k < count; ++k) {
+      uint32_t r;
+      if (!reader.get(r) || r >= ranges.size())
+        return false;
+      TileRange &range = ranges[r];
+      for (uint32_t t = range.first; t < range.end; ++t) {
+        const Tile &tile = tiles[t];
+        row.resize(tile.x1 - tile.x0);
+        for (int j = tile.y0; j < tile.y1; ++j) {
+          if (!reader.get_bytes(row.data(), row.size() * sizeof(Color)))
+            return false;
+          if (!range.done)
+            std::copy(row.begin(), row.end(),
+                      pixels.begin() + j * image_width + tile.x0);
+        }
+      }
+      if (range.done) {
+        worker.wasted_ranges++;
+      } else {
+        range.done = true;
+        worker.ranges++;
+        if (++done % progress_step == 0 || done == ranges.size())
+          std::cout << ("Ranges " + std::to_string(done) + "/" +
+                        std::to_string(ranges.size()) + "\n");
+      }
+    }
+    // Workers return their batches in the order they were sent
+    for (uint32_t r : connection.batches.front())
+      ranges[r].copies--;
+    connection.batches.pop_front();
+    return true;
+  };
+
+  // Greet a new worker: check its scene and send it the frame
+  auto receive_hello = [&](Connection &connection,
+                           const std::vector<uint8_t> &payload) {
+    PayloadReader reader(payload);
+    HelloMessage hello;
+    WorkerReport &worker = report.workers[connection.worker];
+    if (!reader.get(hello) || hello.version != PROTOCOL_VERSION) {
+      send_bye(connection.fd, "Protocol version mismatch");
+      return false;
+    }
+    if (hello.fingerprint != fingerprint) {
+      send_bye(connection.fd, "Scene differs from the coordinator's");
+      std::cout << "Worker " << worker.address
+                << " refused: it loaded a different scene\n";
+      return false;
+    }
+    worker.threads = static_cast<int>(hello.threads);
+    // Enough tiles per batch to keep all of the worker's threads busy
+    connection.batch_ranges = std::max<size_t>(
+        1, (2 * hello.threads + range_tiles - 1) / range_tiles);
+    if (!send_message(connection.fd, MessageType::FRAME, frame_payload.data))
+      return false;
+    connection.ready = true;
+    std::cout << "Worker " << worker.address << " joined (" << hello.threads
+              << " threads)\n";
+    return true;
+  };
+
+  while (done < ranges.size()) {
+    for (Connection &connection : connections)
+      if (connection.fd >= 0)
+        dispatch(connection);
+
+    std::vector<pollfd> fds;
+    fds.push_back({listener, POLLIN, 0});
+    std::vector<size_t> polled;
+    for (size_t c = 0; c < connections.size(); ++c) {
+      if (connections[c].fd >= 0) {
+        fds.push_back({connections[c].fd, POLLIN, 0});
+        polled.push_back(c);
+      }
+    }
+    if (poll(fds.data(), fds.size(), -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      error = socket_error("poll failed");
+      break;
+    }
+
+    for (size_t f = 1; f < fds.size(); ++f) {
+      if (!(fds[f].revents & (POLLIN | POLLHUP | POLLERR)))
+        continue;
+      // Only whole messages are handled, so a worker that stalls halfway
+      // through one holds up nobody else
+      Connection &connection = connections[polled[f - 1]];
+      const bool open = receive_available(connection.fd, connection.inbox);
+      bool ok = true;
+      InboxStatus status = InboxStatus::INCOMPLETE;
+      MessageType type;
+      std::vector<uint8_t> payload;
+      // Only workers that were sent the frame may send results
+      const uint64_t max_size =
+          connection.ready ? max_result : MAX_CONTROL_PAYLOAD;
+      while (ok && (status = take_message(connection.inbox, max_size, type,
+                                          payload)) == InboxStatus::MESSAGE) {
+        if (type == MessageType::HELLO && !connection.ready)
+          ok = receive_hello(connection, payload);
+        else if (type == MessageType::RESULT && connection.ready)
+          ok = receive_result(connection, payload);
+        else
+          ok = false;
+      }
+      if (!ok || !open || status == InboxStatus::MALFORMED)
+        drop(connection);
+    }
+
+    if (fds[0].revents & POLLIN) {
+      sockaddr_storage peer = {};
+      socklen_t peer_size = sizeof(peer);
+      int fd = accept(listener, reinterpret_cast<sockaddr *>(&peer),
+                      &peer_size);
+      if (fd >= 0) {
+        set_no_delay(fd);
+        set_no_sigpipe(fd);
+        set_keep_alive(fd);
+        char host[NI_MAXHOST] = "?";
+        char service[NI_MAXSERV] = "?";
+        getnameinfo(reinterpret_cast<sockaddr *>(&peer), peer_size, host,
+                    sizeof(host), service, sizeof(service),
+                    NI_NUMERICHOST | NI_NUMERICSERV);
+        WorkerReport worker;
+        worker.address = std::string(host) + ":" + service;
+        report.workers.push_back(worker);
+        Connection connection;
+        connection.fd = fd;
+        connection.worker = report.workers.size() - 1;
+        connections.push_back(std::move(connection));
+      }
+    }
+  }
+
+  // Workers still busy with backup copies find the BYE after their result
+  for (Connection &connection : connections) {
+    if (connection.fd >= 0) {
+      send_bye(connection.fd, "");
+      close(connection.fd);
+    }
+  }
+  close(listener);
+  return done == ranges.size();
+}
+
+bool run_worker(const std::string &host, int port, const Scene &scene,
+                ThreadPool &pool, std::string &error) {
+  addrinfo hints = {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *addresses = nullptr;
+  const std::string service = std::to_string(port);
+  if (int status = getaddrinfo(host.c_str(), service.c_str(), &hints,
+                               &addresses)) {
+    error = "Cannot resolve " + host + ": " + gai_strerror(status);
+    return false;
+  }
+  int fd = -1;
+  for (addrinfo *a = addresses; a && fd < 0; a = a->ai_next) {
+    fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+    if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) < 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(addresses);
+  if (fd < 0) {
+    error = socket_error("Cannot connect to " + host + ":" + service);
+    return false;
+  }
+  set_no_delay(fd);
+  set_no_sigpipe(fd);
+
+  HelloMessage hello = {PROTOCOL_VERSION, static_cast<uint32_t>(pool.size()),
+                        scene_fingerprint(scene)};
+  PayloadWriter hello_payload;
+  hello_payload.put(hello);
+  if (!send_message(fd, MessageType::HELLO, hello_payload.data)) {
+    error = socket_error("Cannot reach the coordinator");
+    close(fd);
+    return false;
+  }
+  std::cout << "Connected to " << host << ":" << service << "\n";
+
+  RenderSettings settings;
+  Camera camera = SceneCamera().make(1.0f);
+  std::vector<Tile> tiles;
+  std::vector<Color> pixels;
+  int range_tiles = 1;
+  size_t range_count = 0;
+  uint64_t max_size = MAX_CONTROL_PAYLOAD;
+  bool have_frame = false;
+  int rendered = 0;
+  auto malformed = [&]() {
+    close(fd);
+    error = "Malformed message from the coordinator";
+    return false;
+  };
+  MessageType type;
+  std::vector<uint8_t> payload;
+  while (true) {
+    const InboxStatus status = recv_message(fd, max_size, type, payload);
+    if (status == InboxStatus::MALFORMED)
+      return malformed();
+    if (status != InboxStatus::MESSAGE) {
+      // The coordinator closes the connection once the frame is done,
+      // possibly before the result of a backup copy is read
+      close(fd);
+      if (have_frame)
+        break;
+      error = "Connection to the coordinator lost";
+      return false;
+    }
+
+    if (type == MessageType::BYE) {
+      close(fd);
+      if (!payload.empty()) {
+        error = "Refused by the coordinator: " +
+                std::string(payload.begin(), payload.end());
+        return false;
+      }
+      break;
+    }
+
+    PayloadReader reader(payload);
+    if (type == MessageType::FRAME) {
+      FrameMessage frame;
+      if (!reader.get(frame) || !valid_frame(frame))
+        return malformed();
+      settings = RenderSettings();
+      settings.image_width = frame.image_width;
+      settings.image_height = frame.image_height;
+      settings.samples_per_pixel = frame.samples_per_pixel;
+      settings.tile_size = frame.tile_size;
+      settings.light_samples = frame.light_samples;
+      settings.pass_samples = frame.pass_samples;
+      settings.engine = static_cast<RenderEngine>(frame.engine);
+      settings.sampler = static_cast<SamplerType>(frame.sampler);
+      settings.progressive = frame.progressive != 0;
+      settings.num_threads = pool.size();
+      settings.tile_seeds = true;
+      settings.pixel_seeds = frame.pixel_seeds != 0;
+      settings.quiet = true;
+      range_tiles = frame.range_tiles;
+      SceneCamera view;
+      view.look_from = get_vec3(frame.look_from);
+      view.look_at = get_vec3(frame.look_at);
+      view.vup = get_vec3(frame.vup);
+      view.vfov = frame.vfov;
+      camera = view.make(frame.aspect_ratio);
+      tiles = make_tiles(settings.image_width, settings.image_height,
+                         settings.tile_size);
+      range_count = (tiles.size() + range_tiles - 1) / range_tiles;
+      max_size = tiles_limit(range_count);
+      pixels.assign(static_cast<size_t>(settings.image_width) *
+                        settings.image_height,
+                    Color(0.0f));
+      have_frame = true;
+      std::cout << "Frame " << settings.image_width << "x"
+                << settings.image_height << ", " << settings.samples_per_pixel
+                << " spp\n";
+      continue;
+    }
+
+    // The count is checked against the payload before anything is
+    // allocated for it
+    uint32_t count;
+    if (type != MessageType::TILES || !have_frame || !reader.get(count) ||
+        count > (payload.size() - sizeof(count)) / sizeof(uint32_t))
+      return malformed();
+    std::vector<uint32_t> batch(count);
+    settings.tile_ids.clear();
+    for (uint32_t &r : batch) {
+      if (!reader.get(r) || r >= range_count)
+        return malformed();
+      for (size_t t = static_cast<size_t>(r) * range_tiles;
+           t < std::min(tiles.size(), (static_cast<size_t>(r) + 1) *
+                                          range_tiles);
+           ++t)
+        settings.tile_ids.push_back(static_cast<uint32_t>(t));
+    }
+    render_scene(scene, camera, settings, pixels, PassCallback(), &pool);
+
+    PayloadWriter result;
+    result.put(count);
+    for (uint32_t r : batch) {
+      result.put(r);
+      for (size_t t = static_cast<size_t>(r) * range_tiles;
+           t < std::min(tiles.size(), (static_cast<size_t>(r) + 1) *
+                                          range_tiles);
+           ++t) {
+        const Tile &tile = tiles[t];
+        for (int j = tile.y0; j < tile.y1; ++j)
+          for (int i = tile.x0; i < tile.x1; ++i)
+            result.put(pixels[j * settings.image_width + i]);
+      }
+    }
+    if (!send_message(fd, MessageType::RESULT, result.data)) {
+      close(fd);
+      break;
+    }
+    rendered += static_cast<int>(count);
+  }
+
+  std::cout << "Rendered " << rendered << " tile ranges\n";
+  return true;
+}
@@ -0,0 +1,179 @@
+#include "framebuffer.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+uint32_t float_bits(float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+float bits_float(uint32_t bits) {
+  float value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+/// Pixels per padding unit: tiles start on a 64-byte cache line
+constexpr size_t SLOT_ALIGNMENT = 8;
+
+} // namespace
+
+bool parse_framebuffer_format(const std::string &name,
+                              FramebufferFormat &format) {
+  if (name == "float") {
+    format = FramebufferFormat::FLOAT32;
+  } else if (name == "half") {
+    format = FramebufferFormat::FLOAT16;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+uint16_t float_to_half(float value) {
+  uint32_t x = float_bits(value);
+  const uint32_t sign = (x >> 16) & 0x8000u;
+  x &= 0x7fffffffu;
+
+  if (x >= (127u + 16u) << 23) {
+    // Too large (or NaN/infinity): infinity, quiet NaN for NaN
+    return static_cast<uint16_t>(sign | (x > 0x7f800000u ? 0x7e00u : 0x7c00u));
+  }
+  if (x < 113u << 23) {
+    // Subnormal or zero: let the FPU round by adding a magic constant that
+    // lines the half mantissa up with the float one
+    const uint32_t magic = (127u - 15u + 23u - 10u + 1u) << 23;
+    return static_cast<uint16_t>(
+        sign | (float_bits(bits_float(x) + bits_float(magic)) - magic));
+  }
+  // Normal: rebias the exponent and round the mantissa to nearest even
+  const uint32_t odd = (x >> 13) & 1u;
+  x -= (127u - 15u) << 23;
+  x += 0xfffu + odd;
+  return static_cast<uint16_t>(sign | (x >> 13));
+}
+
+float half_to_float(uint16_t bits) {
+  const uint32_t exponent_mask = 0x7c00u << 13;
+  uint32_t x = (static_cast<uint32_t>(bits) & 0x7fffu) << 13;
+  const uint32_t exponent = x & exponent_mask;
+  x += (127u - 15u) << 23;
+  if (exponent == exponent_mask) {
+    x += (128u - 16u) << 23; // Infinity or NaN
+  } else if (exponent == 0) {
+    // Subnormal: renormalize with a float subtraction
+    x += 1u << 23;
+    x = float_bits(bits_float(x) - bits_float(113u << 23));
+  }
+  return bits_float(x | (static_cast<uint32_t>(bits) & 0x8000u) << 16);
+}
+
+Framebuffer::Framebuffer(int width, int height, int tile_size,
+                         FramebufferFormat format, ThreadPool *pool)
+    : image_width(std::max(0, width)), image_height(std::max(0, height)),
+      tile_edge(std::max(1, tile_size)), pixel_format(format) {
+  tiles_x = (image_width + tile_edge - 1) / tile_edge;
+  const int tiles_y = (image_height + tile_edge - 1) / tile_edge;
+  tile_stride = (static_cast<size_t>(tile_edge) * tile_edge +
+                 SLOT_ALIGNMENT - 1) /
+                SLOT_ALIGNMENT * SLOT_ALIGNMENT;
+
+  // Tiles are stored in the order the scheduler hands them out
+  const std::vector<Tile> tiles =
+      make_tiles(image_width, image_height, tile_edge);
+  tile_count = tiles.size();
+  tile_offsets.assign(static_cast<size_t>(tiles_x) * tiles_y, 0);
+  for (size_t t = 0; t < tiles.size(); ++t)
+    tile_offsets[static_cast<size_t>(tiles[t].y0 / tile_edge) * tiles_x +
+                 tiles[t].x0 / tile_edge] = t * tile_stride;
+
+  // Left unconstructed: clear() writes every pixel
+  if (pixel_format == FramebufferFormat::FLOAT16)
+    half_pixels.resize(tile_count * tile_stride);
+  else
+    float_pixels.resize(tile_count * tile_stride);
+  clear(pool);
+}
+
+void Framebuffer::clear(ThreadPool *pool) {
+  pass_count = 0;
+  auto clear_tiles = [&](size_t begin, size_t end) {
+    const size_t first = begin * tile_stride, last = end * tile_stride;
+    if (pixel_format == FramebufferFormat::FLOAT16)
+      std::fill(half_pixels.begin() + first, half_pixels.begin() + last,
+                HalfPixel{0, 0, 0, 0});
+    else
+      std::fill(float_pixels.begin() + first, float_pixels.begin() + last,
+                FloatPixel{0.0f, 0.0f, 0.0f, 0});
+  };
+  if (!pool) {
+    clear_tiles(0, tile_count);
+    return;
+  }
+  // The same split as the initial TileScheduler deques of a full frame
+  const size_t threads = static_cast<size_t>(pool->size());
+  pool->run([&](int thread_id) {
+    const size_t t = static_cast<size_t>(thread_id);
+    clear_tiles(tile_count * t / threads, tile_count * (t + 1) / threads);
+  });
+}
+
+size_t Framebuffer::bytes() const {
+  return float_pixels.size() * sizeof(FloatPixel) +
+         half_pixels.size() * sizeof(HalfPixel);
+}
+
+void Framebuffer::add(size_t slot, const Color &sum, uint32_t n) {
+  if (n == 0)
+    return;
+  if (pixel_format == FramebufferFormat::FLOAT32) {
+    FloatPixel &pixel = float_pixels[slot];
+    pixel.r += sum.x;
+    pixel.g += sum.y;
+    pixel.b += sum.z;
+    pixel.count += n;
+    return;
+  }
+
+  HalfPixel &pixel = half_pixels[slot];
+  n = std::min(n, MAX_HALF_SAMPLES - pixel.count);
+  if (n == 0)
+    return;
+  // Blend the stored mean with the new samples in float, round once
+  const uint32_t count = pixel.count + n;
+  const float old_weight = static_cast<float>(pixel.count) / count;
+  const float new_weight = 1.0f / count;
+  pixel.r = float_to_half(half_to_float(pixel.r) * old_weight +
+                          sum.x * new_weight);
+  pixel.g = float_to_half(half_to_float(pixel.g) * old_weight +
+                          sum.y * new_weight);
+  pixel.b = float_to_half(half_to_float(pixel.b) * old_weight +
+                          sum.z * new_weight);
+  pixel.count = static_cast<uint16_t>(count);
+}
+
+Color Framebuffer::average(size_t slot) const {
+  if (pixel_format == FramebufferFormat::FLOAT16) {
+    const HalfPixel &pixel = half_pixels[slot];
+    return Color(half_to_float(pixel.r), half_to_float(pixel.g),
+                 half_to_float(pixel.b));
+  }
+  const FloatPixel &pixel = float_pixels[slot];
+  if (pixel.count == 0)
+    return Color(0.0f);
+  return Color(pixel.r, pixel.g, pixel.b) *
+         (1.0f / static_cast<float>(pixel.count));
+}
+
+void Framebuffer::resolve(std::vector<Color> &pixels) const {
+  for (int j = 0; j < image_height; ++j) {
+    for (int i = 0; i < image_width; ++i) {
+      const size_t s = slot(i, j);
+      if (count(s) > 0)
+        pixels[static_cast<size_t>(j) * image_width + i] = average(s);
+    }
+  }
+}
@@ -0,0 +1,255 @@
+#include "image.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <thread>
+#include <utility>
+
+namespace {
+
+// Reference encoding, as originally evaluated per channel in write_ppm
+int encode_reference(float value) {
+  float gamma = 1.0f / 2.2f;
+  return static_cast<int>(
+      255.99f * std::pow(std::min(std::max(value, 0.0f), 1.0f), gamma));
+}
+
+// thresholds[k] is the smallest float that encodes to k. The encoding is
+// monotonic, so an 8-step binary search over this table reproduces
+// encode_reference exactly without calling pow().
+struct GammaTable {
+  float thresholds[256];
+
+  GammaTable() {
+    thresholds[0] = -std::numeric_limits<float>::infinity();
+    for (int k = 1; k < 256; ++k) {
+      float t = static_cast<float>(std::pow(k / 255.99, 2.2));
+      while (encode_reference(t) >= k)
+        t = std::nextafter(t, -1.0f);
+      while (encode_reference(t) < k)
+        t = std::nextafter(t, 2.0f);
+      thresholds[k] = t;
+    }
+  }
+};
+
+const GammaTable gamma_table;
+
+// Run fn(begin, end) over [0, count) split into contiguous chunks
+template <typename Fn> void parallel_rows(int count, int num_threads, Fn fn) {
+  num_threads = std::max(1, std::min(num_threads, count));
+  if (num_threads == 1) {
+    fn(0, count);
+    return;
+  }
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; ++t) {
+    threads.emplace_back(fn, count * t / num_threads,
+                         count * (t + 1) / num_threads);
+  }
+  for (auto &th : threads)
+    th.join();
+}
+
+bool write_buffer(const std::string &filename, const std::string &header,
+                  const char *data, size_t size) {
+  FILE *file = std::fopen(filename.c_str(), "wb");
+  if (!file)
+    return false;
+  bool ok = std::fwrite(header.data(), 1, header.size(), file) ==
+                header.size() &&
+            std::fwrite(data, 1, size, file) == size;
+  return std::fclose(file) == 0 && ok;
+}
+
+} // namespace
+
+bool parse_image_format(const std::string &name, ImageFormat &format) {
+  if (name == "p3" || name == "ppm-ascii") {
+    format = ImageFormat::PPM_ASCII;
+  } else if (name == "p6" || name == "ppm") {
+    format = ImageFormat::PPM_BINARY;
+  } else if (name == "pfm") {
+    format = ImageFormat::PFM;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+const char *image_extension(ImageFormat format) {
+  return format == ImageFormat::PFM ? "pfm" : "ppm";
+}
+
+uint8_t encode_gamma(float value) {
+  const float *t = gamma_table.thresholds;
+  int k = 0;
+  for (int step = 128; step > 0; step >>= 1) {
+    if (value >= t[k + step])
+      k += step;
+  }
+  return static_cast<uint8_t>(k);
+}
+
+std::vector<uint8_t> tonemap_rgb8(const std::vector<Color> &pixels, int width,
+                                  int height, int num_threads) {
+  std::vector<uint8_t> rgb(static_cast<size_t>(width) * height * 3);
+  parallel_rows(height, num_threads, [&](int row_begin, int row_end) {
+    for (int row = row_begin; row < row_end; ++row) {
+      // Rows are written top to bottom (PPM convention)
+      const Color *src = &pixels[static_cast<size_t>(height - 1 - row) * width];
+      uint8_t *dst = &rgb[static_cast<size_t>(row) * width * 3];
+      for (int i = 0; i < width; ++i) {
+        dst[3 * i + 0] = encode_gamma(src[i].x);
+        dst[3 * i + 1] = encode_gamma(src[i].y);
+        dst[3 * i + 2] = encode_gamma(src[i].z);
+      }
+    }
+  });
+  return rgb;
+}
+
+bool write_ppm(const std::string &filename, const std::vector<Color> &pixels,
+               int width, int height, ImageFormat format, int num_threads) {
+  std::vector<uint8_t> rgb = tonemap_rgb8(pixels, width, height, num_threads);
+
+  if (format == ImageFormat::PPM_BINARY) {
+    // PPM header: P6 = binary color, width height, max_color_value
+    std::string header = "P6\n" + std::to_string(width) + " " +
+                         std::to_string(height) + "\n255\n";
+    return write_buffer(filename, header,
+                        reinterpret_cast<const char *>(rgb.data()), rgb.size());
+  }
+
+  // P3: format rows into per-chunk text buffers in parallel, then write
+  // them back to back
+  int chunks = std::max(1, std::min(num_threads, height));
+  std::vector<std::string> text(chunks);
+  parallel_rows(chunks, chunks, [&](int chunk_begin, int chunk_end) {
+    for (int c = chunk_begin; c < chunk_end; ++c) {
+      int row_begin = height * c / chunks;
+      int row_end = height * (c + 1) / chunks;
+      std::string &out = text[c];
+      out.reserve(static_cast<size_t>(row_end - row_begin) * width * 12);
+      char buf[16];
+      for (size_t p = static_cast<size_t>(row_begin) * width;
+           p < static_cast<size_t>(row_end) * width; ++p) {
+        int n = std::snprintf(buf, sizeof(buf), "%d %d %d\n", rgb[3 * p],
+                              rgb[3 * p + 1], rgb[3 * p + 2]);
+        out.append(buf, n);
+      }
+    }
+  });
+
+  std::string body;
+  size_t total = 0;
+  for (const auto &chunk : text)
+    total += chunk.size();
+  body.reserve(total);
+  for (const auto &chunk : text)
+    body += chunk;
+
+  // PPM header: P3 = ASCII color, width height, max_color_value
+  std::string header = "P3\n" + std::to_string(width) + " " +
+                       std::to_string(height) + "\n255\n";
+  return write_buffer(filename, header, body.data(), body.size());
+}
+
+bool write_pfm(const std::string &filename, const std::vector<Color> &pixels,
+               int width, int height) {
+  static_assert(sizeof(Color) == 3 * sizeof(float),
+                "Color must be three packed floats to be written as is");
+
+  // A negative scale marks little-endian data
+  uint16_t probe = 1;
+  bool little_endian = *reinterpret_cast<uint8_t *>(&probe) == 1;
+  std::string header = "PF\n" + std::to_string(width) + " " +
+                       std::to_string(height) + "\n" +
+                       (little_endian ? "-1.0" : "1.0") + "\n";
+  return write_buffer(filename, header,
+                      reinterpret_cast<const char *>(pixels.data()),
+                      static_cast<size_t>(width) * height * sizeof(Color));
+}
+
+bool write_image(const std::string &filename, const std::vector<Color> &pixels,
+                 int width, int height, ImageFormat format, int num_threads) {
+  if (format == ImageFormat::PFM)
+    return write_pfm(filename, pixels, width, height);
+  return write_ppm(filename, pixels, width, height, format, num_threads);
+}
+
+bool read_pfm(const std::string &filename, std::vector<Color> &pixels,
+              int &width, int &height, std::string &error) {
+  FILE *file = std::fopen(filename.c_str(), "rb");
+  if (!file) {
+    error = "Cannot open " + filename;
+    return false;
+  }
+  char magic[3] = {};
+  float scale = 0.0f;
+  // The single whitespace byte after the scale ends the header
+  bool ok = std::fscanf(file, "%2s %d %d %f", magic, &width, &height,
+                        &scale) == 4 &&
+            std::strcmp(magic, "PF") == 0 && width > 0 && height > 0 &&
+            scale != 0.0f && std::fgetc(file) != EOF;
+  if (ok) {
+    pixels.resize(static_cast<size_t>(width) * height);
+    ok = std::fread(pixels.data(), sizeof(Color), pixels.size(), file) ==
+         pixels.size();
+  }
+  std::fclose(file);
+  if (!ok) {
+    error = filename + " is not a complete RGB PFM image";
+    return false;
+  }
+
+  // The sign of the scale gives the byte order of the data
+  uint16_t probe = 1;
+  bool little_endian = *reinterpret_cast<uint8_t *>(&probe) == 1;
+  if ((scale < 0.0f) != little_endian) {
+    auto *bytes = reinterpret_cast<uint8_t *>(pixels.data());
+    for (size_t i = 0; i < pixels.size() * sizeof(Color); i += 4) {
+      std::swap(bytes[i], bytes[i + 3]);
+      std::swap(bytes[i + 1], bytes[i + 2]);
+    }
+  }
+  return true;
+}
+
+ImageDiff compare_images(const std::vector<Color> &reference,
+                         const std::vector<Color> &image) {
+  ImageDiff diff;
+  std::vector<float> relative;
+  double squared_levels = 0.0;
+  const size_t count = std::min(reference.size(), image.size());
+  for (size_t p = 0; p < count; ++p) {
+    const float wanted[] = {reference[p].x, reference[p].y, reference[p].z};
+    const float rendered[] = {image[p].x, image[p].y, image[p].z};
+    for (int c = 0; c < 3; ++c) {
+      const float want = wanted[c];
+      const float got = rendered[c];
+      const double abs_diff = std::fabs(static_cast<double>(got) - want);
+      diff.max_abs = std::max(diff.max_abs, abs_diff);
+      diff.mean_abs += abs_diff;
+      relative.push_back(static_cast<float>(
+          abs_diff / std::max(std::fabs(static_cast<double>(want)), 1e-6)));
+      const int levels = std::abs(encode_gamma(got) - encode_gamma(want));
+      diff.changed_values += levels != 0;
+      diff.max_levels = std::max(diff.max_levels, levels);
+      squared_levels += static_cast<double>(levels) * levels;
+    }
+  }
+  diff.values = relative.size();
+  if (diff.values == 0)
+    return diff;
+  diff.mean_abs /= diff.values;
+  std::nth_element(relative.begin(), relative.begin() + relative.size() / 2,
+                   relative.end());
+  diff.median_relative = relative[relative.size() / 2];
+  const double mse = squared_levels / diff.values;
+  diff.psnr = mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse)
+                        : std::numeric_limits<double>::infinity();
+  return diff;
+}
@@ -0,0 +1,192 @@
+#include "instance.h"
+#include <algorithm>
+#include <cmath>
+
+Transform Transform::translation(const Vec3 &offset) {
+  Transform t;
+  t.m[0][3] = offset.x;
+  t.m[1][3] = offset.y;
+  t.m[2][3] = offset.z;
+  return t;
+}
+
+Transform Transform::scaling(const Vec3 &factors) {
+  Transform t;
+  t.m[0][0] = factors.x;
+  t.m[1][1] = factors.y;
+  t.m[2][2] = factors.z;
+  return t;
+}
+
+Transform Transform::rotation(const Vec3 &axis, float degrees) {
+  // Rodrigues' rotation formula
+  const Vec3 a = axis.normalized();
+  const float radians = degrees * 3.14159265358979f / 180.0f;
+  const float c = std::cos(radians), s = std::sin(radians), k = 1.0f - c;
+  Transform t;
+  t.m[0][0] = c + a.x * a.x * k;
+  t.m[0][1] = a.x * a.y * k - a.z * s;
+  t.m[0][2] = a.x * a.z * k + a.y * s;
+  t.m[1][0] = a.y * a.x * k + a.z * s;
+  t.m[1][1] = c + a.y * a.y * k;
+  t.m[1][2] = a.y * a.z * k - a.x * s;
+  t.m[2][0] = a.z * a.x * k - a.y * s;
+  t.m[2][1] = a.z * a.y * k + a.x * s;
+  t.m[2][2] = c + a.z * a.z * k;
+  return t;
+}
+
+Transform Transform::then(const Transform &next) const {
+  Transform t;
+  for (int i = 0; i < 3; ++i) {
+    for (int j = 0; j < 4; ++j) {
+      float sum = j == 3 ? next.m[i][3] : 0.0f;
+      for (int k = 0; k < 3; ++k)
+        sum += next.m[i][k] * m[k][j];
+      t.m[i][j] = sum;
+    }
+  }
+  return t;
+}
+
+bool Transform::invert(Transform &inverse) const {
+  // Inverse of the linear part from its cofactors; the translation follows
+  // as -inverse * offset
+  const float c00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+  const float c01 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+  const float c02 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+  const float det = m[0][0] * c00 + m[0][1] * c01 + m[0][2] * c02;
+  if (!std::isfinite(det) || std::fabs(det) < 1e-12f)
+    return false;
+  const float r = 1.0f / det;
+  Transform t;
+  t.m[0][0] = c00 * r;
+  t.m[1][0] = c01 * r;
+  t.m[2][0] = c02 * r;
+  t.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * r;
+  t.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * r;
+  t.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * r;
+  t.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * r;
+  t.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * r;
+  t.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * r;
+  const Vec3 offset = t.vector(Vec3(m[0][3], m[1][3], m[2][3]));
+  t.m[0][3] = -offset.x;
+  t.m[1][3] = -offset.y;
+  t.m[2][3] = -offset.z;
+  inverse = t;
+  return true;
+}
+
+AABB Transform::bounds(const AABB &box) const {
+  if (box.empty())
+    return box;
+  // Arvo's method: each output axis is the translation plus, per input
+  // axis, the smaller and larger of the two products
+  const float lo[3] = {box.min.x, box.min.y, box.min.z};
+  const float hi[3] = {box.max.x, box.max.y, box.max.z};
+  float out_lo[3], out_hi[3];
+  for (int i = 0; i < 3; ++i) {
+    out_lo[i] = out_hi[i] = m[i][3];
+    for (int j = 0; j < 3; ++j) {
+      const float a = m[i][j] * lo[j], b = m[i][j] * hi[j];
+      out_lo[i] += std::min(a, b);
+      out_hi[i] += std::max(a, b);
+    }
+  }
+  return AABB(Point3(out_lo[0], out_lo[1], out_lo[2]),
+              Point3(out_hi[0], out_hi[1], out_hi[2]));
+}
+
+void GeometryBlock::build() {
+  std::vector<AABB> sphere_bounds;
+  sphere_bounds.reserve(spheres.size());
+  for (const Sphere &sphere : spheres)
+    sphere_bounds.push_back(sphere.bounds());
+  // Same leaf sizing as the scene's own BVH (see Scene::build_bvh)
+  const int lanes = sphere_kernels().lanes;
+  bvh.build(sphere_bounds, std::max(4, lanes), lanes);
+  packed.clear();
+  packed.build(spheres, bvh.prim_indices);
+}
+
+void GeometryBlock::clear_bvh() {
+  bvh.clear();
+  packed.clear();
+}
+
+AABB GeometryBlock::bounds() const {
+  AABB box;
+  for (const Sphere &sphere : spheres)
+    box.grow(sphere.bounds());
+  return box;
+}
+
+bool GeometryBlock::hit(const Ray &ray, float t_min, float &t_max,
+                        const Sphere *&sphere, TraversalStats *stats) const {
+  if (!bvh.empty()) {
+    int closest_slot = -1;
+    bool hit_anything = bvh.intersect(
+        ray, t_min, t_max,
+        [&](const BVHNode &leaf, float t0, float &t1) {
+          int slot =
+              packed.closest(ray, leaf.left_first, leaf.prim_count, t0, t1);
+          if (slot < 0)
+            return false;
+          closest_slot = slot;
+          return true;
+        },
+        stats);
+    if (hit_anything)
+      sphere = &spheres[bvh.prim_indices[closest_slot]];
+    return hit_anything;
+  }
+
+  if (stats)
+    stats->primitives += spheres.size();
+  bool hit_anything = false;
+  for (const Sphere &candidate : spheres) {
+    float t;
+    if (candidate.intersect(ray, t_min, t_max, t)) {
+      sphere = &candidate;
+      t_max = t;
+      hit_anything = true;
+    }
+  }
+  return hit_anything;
+}
+
+bool GeometryBlock::occluded(const Ray &ray, float t_min, float t_max,
+                             TraversalStats *stats) const {
+  if (!bvh.empty())
+    return bvh.occluded(
+        ray, t_min, t_max,
+        [&](const BVHNode &leaf, float t0, float t1) {
+          return packed.any(ray, leaf.left_first, leaf.prim_count, t0, t1);
+        },
+        stats);
+
+  for (size_t i = 0; i < spheres.size(); ++i) {
+    if (spheres[i].intersects(ray, t_min, t_max)) {
+      if (stats)
+        stats->primitives += i + 1;
+      return true;
+    }
+  }
+  if (stats)
+    stats->primitives += spheres.size();
+  return false;
+}
+
+void Instance::finalize(const Ray &ray, const Sphere &sphere, float t,
+                        HitRecord &rec) const {
+  const Point3 local = object_ray(ray).at(t);
+  // Non-uniform scales turn spheres into ellipsoids, whose normals no
+  // longer have unit length in world space
+  const Vec3 outward_normal =
+      to_object.transposed_vector((local - sphere.center) / sphere.radius)
+          .normalized();
+  rec.t = t;
+  rec.point = ray.at(t);
+  rec.set_face_normal(ray, outward_normal);
+  rec.material = material == KEEP_MATERIAL ? sphere.material : material;
+}
@@ -4,287 +4,624 @@
  * @author Alexei Czornyj
  * @date 2025
  *
- * This is the main rendering loop. It generates rays
- * through each pixel of the image, tests for intersection with a sphere,
- * and colors pixels based on surface normals. Output is written to PPM format.
+ * Parses the command line, sets up the camera and scene, renders it with
+ * render_scene (see renderer.h) and writes the result to a PPM/PFM file.
  */
 
 #include "kestrel.h"
-#include "bsdfs/conductor.h"
-#include "bsdfs/lambertian.h"
+#include "animation.h"
 #include "camera.h"
-#include "light.h"
-#include "ray.h"
+#ifdef KESTREL_CUDA
+#include "cuda_renderer.h"
+#endif
+#include "default_scene.h"
+#include "distributed.h"
+#include "image.h"
+#include "light_selection.h"
+#include "preview.h"
+#include "render_stats.h"
+#include "renderer.h"
 #include "scene.h"
-#include "sphere.h"
+#include "scene_file.h"
+#include "sphere_soa.h"
+#include "thread_pool.h"
+#include "tile_hash.h"
 #include "vec3.h"
-#include <atomic>
-#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
 #include <iostream>
+#include <string>
 #include <thread>
 #include <vector>
 
 /**
- * @brief Determine pixel color by tracing a ray through the scene
- * @param ray The ray to trace
- * @param scene The scene to test for intersection
- * @param depth Current recursion depth
- * @return RGB color for this ray
+ * @brief Main rendering function
+ * @return Exit code (0 = success)
  *
- * If the ray hits the sphere, returns a color based on the surface normal.
+ * Sets up the scene, camera, and image buffer, then renders by tracing
+ * samples_per_pixel rays per pixel (or adaptively) and writes the output
+ * to a PPM or PFM file.
  */
-Color ray_color(const Ray &ray, const Scene &scene, int depth = 10) {
-  if (depth <= 0) {
-    return Color(0, 0, 0); // Return black if max depth reached
-  }
-
-  HitRecord rec;
-  if (scene.hit(ray, 0.001f, 1000.0f, rec)) {
-    // Add ambient lighting to prevent completely black shadows
-    Color final_color = Color(0, 0, 0);
-
-    for (const auto &scene_light : scene.lights) {
-      // Soft shadow sampling - take multiple samples across light surface
-      const int shadow_samples = 2; // Increase for softer shadows (but slower)
-      float shadow_factor = 0.0f;
-
-      for (int i = 0; i < shadow_samples; ++i) {
-        Vec3 light_dir = scene_light.sample_direction(rec.point);
-        Vec3 light_sample_pos = scene_light.position;
-        float light_distance = (light_sample_pos - rec.point).length();
-
-        // Check for shadows
-        Vec3 shadow_origin = rec.point + rec.normal * 0.001f;
-        Ray shadow_ray(shadow_origin, light_dir);
-        HitRecord shadow_rec;
+int main(int argc, char **argv) {
+  // Image settings
+  // Take width and height from command line arguments if provided
+  int image_width = 1920;
+  const float aspect_ratio = 16.0f / 9.0f;
 
-        if (!scene.hit(shadow_ray, 0.001f, light_distance - 0.001f,
-                       shadow_rec)) {
-          shadow_factor += 1.0f; // This sample is not in shadow
-        }
+  // Separate --options from positional arguments
+  std::vector<std::string> args;
+  RenderSettings settings;
+  bool use_bvh = true;
+  bool compact = false;
+  bool pin_threads = false;
+  std::string scene_path;
+  std::string cache_path;
+  std::string trace_path;
+  std::string tile_hash_path; // Write the hash of every tile here
+  std::string golden_path;    // Compare the tiles against these hashes
+  std::string compare_path;   // Report the differences to this PFM image
+  int max_diff = -1; // Fail when a value differs by more levels (>= 0)
+  int coordinator_port = 0;  // Distribute the frame to workers (> 0)
+  std::string worker_host;   // Render tiles for this coordinator instead
+  int worker_port = DEFAULT_COORDINATOR_PORT;
+  int range_tiles = 4;
+  int frame_count = 0; // Sequence mode when > 0 or with an animation
+  std::string animation_path;
+  bool preview = false; // Follow camera updates read from stdin
+  ImageFormat format = ImageFormat::PPM_BINARY;
+  for (int a = 1; a < argc; ++a) {
+    std::string arg = argv[a];
+    if (arg == "--no-bvh") {
+      use_bvh = false;
+    } else if (arg == "--compact") {
+      compact = true;
+    } else if (arg == "--scene" && a + 1 < argc) {
+      scene_path = argv[++a];
+    } else if (arg == "--save-cache" && a + 1 < argc) {
+      cache_path = argv[++a];
+    } else if (arg == "--tile" && a + 1 < argc) {
+      settings.tile_size = std::max(1, std::stoi(argv[++a]));
+    } else if (arg == "--spp" && a + 1 < argc) {
+      settings.samples_per_pixel = std::max(1, std::stoi(argv[++a]));
+    } else if (arg == "--light-samples" && a + 1 < argc) {
+      settings.light_samples =
+          std::max(0, std::min(std::stoi(argv[++a]), MAX_SELECTED_LIGHTS));
+    } else if (arg == "--progressive") {
+      settings.progressive = true;
+    } else if (arg == "--pass-spp" && a + 1 < argc) {
+      settings.pass_samples = std::max(1, std::stoi(argv[++a]));
+    } else if (arg == "--adaptive") {
+      settings.adaptive = true;
+    } else if (arg == "--noise-threshold" && a + 1 < argc) {
+      settings.noise_threshold = std::stof(argv[++a]);
+    } else if (arg == "--min-spp" && a + 1 < argc) {
+      settings.min_samples = std::max(2, std::stoi(argv[++a]));
+    } else if (arg == "--max-spp" && a + 1 < argc) {
+      settings.max_samples = std::max(1, std::stoi(argv[++a]));
+    } else if (arg == "--engine" && a + 1 < argc) {
+      if (!parse_render_engine(argv[++a], settings.engine)) {
+        std::cerr << "Unknown render engine: " << argv[a] << "\n";
+        return 1;
       }
-
-      shadow_factor /= static_cast<float>(shadow_samples);
-
-      // Calculate lighting only for non-shadowed portion
-      Vec3 light_dir = (scene_light.position - rec.point).normalized();
-      float cos_theta = fmax(0.0f, Vec3::dot(rec.normal, light_dir));
-
-      // Calculate direct lighting with proper distance falloff
-      float distance = (scene_light.position - rec.point).length();
-      Color direct_lighting =
-          rec.material->get_color() * cos_theta * scene_light.get_intensity() *
-          shadow_factor /
-          (distance * distance + 1e-4f); // Avoid division by zero
-
-      final_color += direct_lighting;
+    } else if (arg == "--sampler" && a + 1 < argc) {
+      if (!parse_sampler_type(argv[++a], settings.sampler)) {
+        std::cerr << "Unknown sampler: " << argv[a] << "\n";
+        return 1;
+      }
+    } else if (arg == "--profile") {
+      settings.profile = true;
+    } else if (arg == "--trace" && a + 1 < argc) {
+      trace_path = argv[++a];
+      settings.trace = true;
+      settings.profile = true;
+    } else if (arg == "--frames" && a + 1 < argc) {
+      frame_count = std::max(1, std::stoi(argv[++a]));
+    } else if (arg == "--animation" && a + 1 < argc) {
+      animation_path = argv[++a];
+    } else if (arg == "--preview") {
+      preview = true;
+    } else if (arg == "--pin") {
+      pin_threads = true;
+    } else if (arg == "--tile-seeds") {
+      settings.tile_seeds = true;
+    } else if (arg == "--pixel-seeds") {
+      settings.pixel_seeds = true;
+    } else if (arg == "--tile-hashes" && a + 1 < argc) {
+      tile_hash_path = argv[++a];
+      settings.pixel_seeds = true;
+    } else if (arg == "--golden" && a + 1 < argc) {
+      golden_path = argv[++a];
+      settings.pixel_seeds = true;
+    } else if (arg == "--compare" && a + 1 < argc) {
+      compare_path = argv[++a];
+    } else if (arg == "--max-diff" && a + 1 < argc) {
+      max_diff = std::max(0, std::stoi(argv[++a]));
+    } else if (arg == "--coordinator" && a + 1 < argc) {
+      coordinator_port = std::stoi(argv[++a]);
+    } else if (arg == "--worker" && a + 1 < argc) {
+      worker_host = argv[++a];
+      size_t colon = worker_host.rfind(':');
+      if (colon != std::string::npos) {
+        worker_port = std::stoi(worker_host.substr(colon + 1));
+        worker_host.resize(colon);
+      }
+    } else if (arg == "--range-tiles" && a + 1 < argc) {
+      range_tiles = std::max(1, std::stoi(argv[++a]));
+    } else if (arg == "--format" && a + 1 < argc) {
+      if (!parse_image_format(argv[++a], format)) {
+        std::cerr << "Unknown image format: " << argv[a] << "\n";
+        return 1;
+      }
+    } else if (arg == "--framebuffer" && a + 1 < argc) {
+      if (!parse_framebuffer_format(argv[++a], settings.framebuffer)) {
+        std::cerr << "Unknown framebuffer format: " << argv[a] << "\n";
+        return 1;
+      }
+    } else if (arg.rfind("--", 0) == 0) {
+      std::cerr << "Unknown option: " << arg << "\n";
+      return 1;
+    } else {
+      args.push_back(arg);
     }
+  }
 
-    // Handle reflections if material is reflective
-    Color reflected_color(0, 0, 0);
-    if (rec.material->reflectivity > 0.0f) {
-      Vec3 incident_dir = ray.direction.normalized();
-      Vec3 reflected_dir =
-          incident_dir -
-          2.0f * Vec3::dot(incident_dir, rec.normal) * rec.normal;
-      Ray reflected_ray(rec.point + rec.normal * 0.001f, reflected_dir);
-      reflected_color = ray_color(reflected_ray, scene, depth - 1) *
-                        rec.material->reflectivity * rec.material->get_color();
-    }
+  int image_height = static_cast<int>(image_width / aspect_ratio);
+  if (args.size() >= 1) {
+    image_width = std::stoi(args[0]);
+    image_height = static_cast<int>(image_width / aspect_ratio);
+  }
+  if (args.size() >= 2) {
+    image_height = std::stoi(args[1]);
+  }
 
-    // Blend direct lighting with reflections
-    return final_color * (1.0f - rec.material->reflectivity) + reflected_color;
+  // By default one thread per CPU this process may use (so instances
+  // started under taskset or a cpuset do not oversubscribe the machine)
+  int num_threads = available_cpus();
+  if (args.size() >= 3) {
+    num_threads = std::max(1, std::stoi(args[2]));
   }
 
-  return Color(0.0f); // Background sky color
-}
+  if (args.size() >= 4) {
+    std::cout << "Usage: " << argv[0]
+              << " [image_width] [image_height] [num_threads] [--no-bvh]"
+                 " [--compact] [--scene FILE] [--save-cache FILE]"
+                 " [--tile N] [--engine path|wavefront|packet|cuda]"
+                 " [--sampler random|halton|sobol|zsobol]"
+                 " [--format p3|p6|pfm] [--framebuffer float|half]"
+                 " [--spp N] [--light-samples N]"
+                 " [--progressive] [--pass-spp N] [--adaptive]"
+                 " [--noise-threshold X] [--min-spp N] [--max-spp N]"
+                 " [--profile] [--trace FILE] [--tile-seeds] [--pixel-seeds]"
+                 " [--tile-hashes FILE] [--golden FILE] [--compare FILE]"
+                 " [--max-diff N] [--coordinator PORT] [--worker HOST[:PORT]]"
+                 " [--range-tiles N] [--frames N] [--animation FILE]"
+                 " [--preview] [--pin]\n";
+    return 1;
+  }
 
-/**
- * @brief Render the scene into the pixel buffer using multithreading
- * @param scene The scene to render
- * @param camera The camera through which to render
- * @param image_width Width of the image in pixels
- * @param image_height Height of the image in pixels
- * @param samples_per_pixel Number of samples per pixel for anti-aliasing
- * @param pixels Output pixel buffer (size = image_width * image_height)
- * @param num_threads Number of threads to use for rendering
- *
- * This function divides the rendering workload across multiple threads,
- * each processing scanlines of the image until all rows are completed.
- */
-void render_scene(const Scene &scene, const Camera &camera, int image_width,
-                  int image_height, int samples_per_pixel,
-                  std::vector<Color> &pixels, int num_threads) {
-  // Render loop
-  std::cout << "Rendering " << image_width << "x" << image_height
-            << " image...\n";
+#ifdef KESTREL_CUDA
+  if (settings.engine == RenderEngine::CUDA) {
+    std::string device;
+    if (!cuda_device_available(device)) {
+      std::cerr << "No CUDA device available\n";
+      return 1;
+    }
+    std::cout << "CUDA device: " << device << "\n";
+  }
+#endif
 
-  // Parallelize with std::thread
-  std::vector<std::thread> threads;
-  std::atomic<int> next_row(0);
-  // Initialize PCG random number generator
-  PCG32 rng;
-  auto render_worker = [&](int thread_id) {
-    PCG32 thread_rng(rng.next() + thread_id); // Per-thread RNG
-    while (true) {
-      int j = next_row.fetch_add(1);
-      if (j >= image_height)
-        break;
+  settings.image_width = image_width;
+  settings.image_height = image_height;
+  settings.num_threads = num_threads;
 
-      if (j % 50 == 0 && thread_id == 0) {
-        std::cout << "Scanline " << j << "/" << image_height << "\n";
-      }
+  // Allocate pixel buffer
+  std::vector<Color> pixels(image_width * image_height);
+  std::string filename = std::string("output.") + image_extension(format);
 
-      for (int i = 0; i < image_width; ++i) {
-        Color pixel_color(0, 0, 0);
-        for (int s = 0; s < samples_per_pixel; ++s) {
-          float u = (i + thread_rng.next_float()) / (image_width - 1);
-          float v = (j + thread_rng.next_float()) / (image_height - 1);
-          Ray ray = camera.get_ray(u, v);
-          pixel_color += ray_color(ray, scene);
-        }
-        pixel_color *= 1.0f / static_cast<float>(samples_per_pixel);
-        pixels[j * image_width + i] = pixel_color;
-      }
+  // Camera setup: the built-in scene's camera sits at the origin, looking
+  // down -Z; a scene file can place it elsewhere
+  SceneCamera view;
+  Camera camera = view.make(aspect_ratio);
+  Scene scene(camera);
+  scene.compact_leaves = compact;
+  if (scene_path.empty()) {
+    populate_default_scene(scene);
+  } else {
+    auto load_start = std::chrono::steady_clock::now();
+    std::string error;
+    if (!load_scene(scene_path, scene, view, error)) {
+      std::cerr << error << "\n";
+      return 1;
+    }
+    camera = view.make(aspect_ratio);
+    scene.camera = camera;
+    std::cout << "Scene: " << scene.objects.size() << " spheres, "
+              << scene.lights.size() << " lights loaded from " << scene_path
+              << " in "
+              << std::chrono::duration<double, std::milli>(
+                     std::chrono::steady_clock::now() - load_start)
+                     .count()
+              << " ms\n";
+    if (!scene.instances.empty()) {
+      size_t stored = 0;
+      for (const GeometryBlock &block : scene.geometries)
+        stored += block.spheres.size();
+      std::cout << "Instances: " << scene.instances.size() << " of "
+                << scene.geometries.size() << " geometry blocks, placing "
+                << scene.instanced_sphere_count() << " spheres (" << stored
+                << " stored)\n";
     }
-  };
+    if (!scene.meshes.empty()) {
+      size_t vertex_count = 0;
+      for (const TriangleMesh &mesh : scene.meshes)
+        vertex_count += mesh.vertices.size();
+      std::cout << "Meshes: " << scene.meshes.size() << " with "
+                << scene.triangle_count() << " triangles, " << vertex_count
+                << " vertices\n";
+    }
+  }
 
-  // Launch threads
-  for (int t = 0; t < num_threads; ++t) {
-    threads.emplace_back(render_worker, t);
+  if (!use_bvh) {
+    // A BVH restored from a cache is dropped as well
+    scene.clear_bvh();
+  } else if (!scene.bvh.empty()) {
+    std::cout << "BVH: " << scene.bvh.stats().node_count
+              << " nodes loaded from the scene cache\n";
+  } else {
+    scene.build_bvh();
+    const BVHStats &stats = scene.bvh.stats();
+    std::cout << "BVH: " << stats.node_count << " nodes, " << stats.leaf_count
+              << " leaves, depth " << stats.max_depth << ", SAH cost "
+              << stats.sah_cost << ", built in " << stats.build_ms << " ms\n";
   }
-  for (auto &th : threads) {
-    th.join();
+  if (use_bvh && !scene.instances.empty())
+    std::cout << "Instance BVH: " << scene.instance_bvh.stats().node_count
+              << " nodes, depth " << scene.instance_bvh.stats().max_depth
+              << ", built in " << scene.instance_bvh.stats().build_ms
+              << " ms\n";
+  if (use_bvh && !scene.meshes.empty()) {
+    size_t node_count = 0;
+    double build_ms = 0.0;
+    for (const TriangleMesh &mesh : scene.meshes) {
+      node_count += mesh.bvh.stats().node_count;
+      build_ms += mesh.bvh.stats().build_ms;
+    }
+    std::cout << "Mesh BVHs: " << node_count << " nodes, built in "
+              << build_ms << " ms\n";
+  }
+  // Every thread reads the whole scene: spread it over the NUMA nodes
+  scene.interleave_memory();
+  // The render threads live for the whole run (every pass, frame and
+  // distributed batch)
+  ThreadPool pool(num_threads, pin_threads);
+  std::cout << "Threads: " << pool.size() << " of " << available_cpus()
+            << " CPUs" << (pool.pinned() ? ", pinned" : "");
+  if (numa_node_count() > 1)
+    std::cout << ", " << numa_node_count() << " NUMA nodes";
+  std::cout << "\n";
+  if (use_bvh)
+    std::cout << "SIMD: " << sphere_kernels().name << " ("
+              << sphere_kernels().lanes << " spheres per test)\n";
+  if (FAST_MATH)
+    std::cout << "Math: fast rsqrt and sincos (KESTREL_FAST_MATH)\n";
+  if (use_bvh && compact)
+    std::cout << "Leaves: "
+              << (scene.compact.size() > 0
+                      ? "compact (quantized, 10 bytes per sphere)"
+                      : "full precision (too many materials for compact)")
+              << "\n";
+
+  if (!cache_path.empty()) {
+    std::string error;
+    if (!write_scene_cache(cache_path, scene, view, error)) {
+      std::cerr << error << "\n";
+      return 1;
+    }
+    std::cout << "Scene cache written to " << cache_path << "\n";
   }
-}
-
-/**
- * @brief Write image data to PPM file format
- * @param filename Output filename (should end in .ppm)
- * @param pixels Array of RGB colors, size width * height
- * @param width Image width in pixels
- * @param height Image height in pixels
- *
- * PPM is a simple uncompressed image format. The output can be viewed
- * with many image viewers or converted to other formats with ImageMagick.
- */
-void write_ppm(const std::string &filename, const std::vector<Color> &pixels,
-               int width, int height) {
-  std::ofstream file(filename);
-
-  // PPM header: P3 = ASCII color, width height, max_color_value
-  file << "P3\n" << width << " " << height << "\n255\n";
 
-  // Write pixels from top to bottom (PPM convention)
-  for (int j = height - 1; j >= 0; --j) {
-    for (int i = 0; i < width; ++i) {
-      Color pixel = pixels[j * width + i];
+  if (preview) {
+    if (frame_count > 0 || !animation_path.empty() || !worker_host.empty() ||
+        coordinator_port > 0) {
+      std::cerr << "The preview renders a single view on this node\n";
+      return 1;
+    }
+    // Every level replaces the output file through a temporary one, so a
+    // viewer reloading it never reads a partial image
+    const std::string partial = filename + ".tmp";
+    std::cout << "Preview: reading \"camera <look_from> <look_at> <vfov>\""
+                 " and \"quit\" from stdin" << std::endl;
+    PreviewReport preview_report = run_preview(
+        scene, view, settings, std::cin,
+        [&](const PreviewImage &image) {
+          if (!write_image(partial, image.pixels, image.width, image.height,
+                           format, num_threads) ||
+              std::rename(partial.c_str(), filename.c_str()) != 0) {
+            std::cerr << "Failed to write " << filename << "\n";
+            return;
+          }
+          // Flushed, so a client reading stdout through a pipe sees every
+          // image as it lands
+          std::cout << "Preview " << image.width << "x" << image.height
+                    << " (1/" << image.scale << "), "
+                    << image.samples_per_pixel << " spp: " << image.render_ms
+                    << " ms, " << image.latency_ms
+                    << " ms since the update -> " << filename << std::endl;
+        },
+        pool);
+    std::cout << "Preview: " << preview_report.updates << " camera updates, "
+              << preview_report.images << " images, "
+              << preview_report.cancelled << " renders cancelled, "
+              << preview_report.max_latency_ms
+              << " ms longest latency to a first image\n";
+    return 0;
+  }
 
-      // Clamp values to [0, 1] and convert to [0, 255]
-      float gamma = 1.0f / 2.2f;
-      int ir = static_cast<int>(
-          255.99f * pow(std::min(std::max(pixel.x, 0.0f), 1.0f), gamma));
-      int ig = static_cast<int>(
-          255.99f * pow(std::min(std::max(pixel.y, 0.0f), 1.0f), gamma));
-      int ib = static_cast<int>(
-          255.99f * pow(std::min(std::max(pixel.z, 0.0f), 1.0f), gamma));
+  // In progressive mode the output file is rewritten after every pass, so
+  // it can be inspected at any time during the render
+  PassCallback on_pass;
+  if (settings.progressive) {
+    on_pass = [&](int pass, const std::vector<Color> &image) {
+      write_image(filename, image, image_width, image_height, format,
+                  num_threads);
+      std::cout << "Pass " << pass + 1 << " written to " << filename << "\n";
+    };
+  }
 
-      file << ir << " " << ig << " " << ib << "\n";
+  Animation animation;
+  if (!animation_path.empty()) {
+    std::string error;
+    if (!load_animation(animation_path, animation, error) ||
+        !animation.bind(scene, error)) {
+      std::cerr << error << "\n";
+      return 1;
     }
+    if (frame_count == 0)
+      frame_count = animation.frame_count;
+  }
+  if (frame_count > 0 && (!worker_host.empty() || coordinator_port > 0)) {
+    std::cerr << "Sequences cannot be distributed yet\n";
+    return 1;
+  }
+  if ((frame_count > 0 || !worker_host.empty()) &&
+      (!tile_hash_path.empty() || !golden_path.empty())) {
+    std::cerr << "Tile hashes are taken of single frames rendered here\n";
+    return 1;
+  }
+  if ((frame_count > 0 || !worker_host.empty()) && !compare_path.empty()) {
+    std::cerr << "--compare checks single frames rendered here\n";
+    return 1;
+  }
+  if (max_diff >= 0 && compare_path.empty()) {
+    std::cerr << "--max-diff needs a --compare image\n";
+    return 1;
   }
 
-  file.close();
-}
+  if (frame_count > 0) {
+    // The scene, its BVH and the pixel buffers stay resident for the whole
+    // sequence. Frame N is written by a second thread while frame N + 1
+    // renders, from its own copy of the pixels.
+    settings.quiet = true;
+    const SceneCamera rest_view = view;
+    std::vector<Color> written(pixels.size());
+    std::thread writer;
+    bool write_ok = true;
+    auto sequence_start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < frame_count; ++frame) {
+      view = animation.camera_at(frame, rest_view);
+      camera = view.make(aspect_ratio);
+      scene.camera = camera;
+
+      double update_ms = 0.0;
+      const char *update = "static";
+      if (animation.moves_objects()) {
+        auto update_start = std::chrono::steady_clock::now();
+        animation.apply(frame, scene);
+        if (use_bvh)
+          update = scene.refit_bvh() ? "refit" : "rebuilt";
+        update_ms = std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - update_start)
+                        .count();
+      }
 
-/**
- * @brief Main rendering function
- * @return Exit code (0 = success)
- *
- * Sets up the scene, camera, and image buffer, then renders by tracing
- * one ray per pixel and writing the output to a PPM file.
- */
-int main(int argc, char **argv) {
-  // Image settings
-  // Take width and height from command line arguments if provided
-  int image_width = 1920;
-  const float aspect_ratio = 16.0f / 9.0f;
-  const int samples_per_pixel = 10;
+      auto render_start = std::chrono::steady_clock::now();
+      RenderReport report =
+          render_scene(scene, camera, settings, pixels, PassCallback(), &pool);
+      double render_ms = std::chrono::duration<double, std::milli>(
+                             std::chrono::steady_clock::now() - render_start)
+                             .count();
+
+      // Wait for the previous frame's write before reusing its buffer
+      if (writer.joinable())
+        writer.join();
+      if (!write_ok)
+        return 1;
+      std::swap(pixels, written);
+      char frame_name[32];
+      std::snprintf(frame_name, sizeof(frame_name), "output_%04d.%s", frame,
+                    image_extension(format));
+      writer = std::thread([&, name = std::string(frame_name)]() {
+        write_ok = write_image(name, written, image_width, image_height,
+                               format, 1);
+        if (!write_ok)
+          std::cerr << "Failed to write " << name << "\n";
+      });
+
+      std::cout << "Frame " << frame + 1 << "/" << frame_count << ": "
+                << render_ms << " ms, " << report.samples << " samples, BVH "
+                << update << " in " << update_ms << " ms -> " << frame_name
+                << "\n";
+    }
+    writer.join();
+    if (!write_ok)
+      return 1;
+    double sequence_ms =
+        std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - sequence_start)
+            .count();
+    std::cout << "Sequence: " << frame_count << " frames in " << sequence_ms
+              << " ms (" << sequence_ms / frame_count << " ms per frame)\n";
+    return 0;
+  }
 
-  int image_height = static_cast<int>(image_width / aspect_ratio);
-  if (argc >= 2) {
-    image_width = std::stoi(argv[1]);
-    image_height = static_cast<int>(image_width / aspect_ratio);
-  } else if (argc >= 3) {
-    image_width = std::stoi(argv[1]);
-    image_height = std::stoi(argv[2]);
+  if (!worker_host.empty()) {
+    std::string error;
+    if (!run_worker(worker_host, worker_port, scene, pool, error)) {
+      std::cerr << error << "\n";
+      return 1;
+    }
+    return 0;
   }
 
-  int num_threads = -1;
-  if (argc >= 4) {
-    num_threads =
-        std::max((int)std::thread::hardware_concurrency(), std::stoi(argv[3]));
+  auto render_start = std::chrono::steady_clock::now();
+  RenderReport report;
+  if (coordinator_port > 0) {
+    CoordinatorReport distributed;
+    std::string error;
+    if (!run_coordinator(coordinator_port, settings, view, aspect_ratio,
+                         scene_fingerprint(scene), range_tiles, pixels,
+                         distributed, error)) {
+      std::cerr << error << "\n";
+      return 1;
+    }
+    std::cout << "Distributed over " << distributed.workers.size()
+              << " workers: " << distributed.ranges << " ranges, "
+              << distributed.reissued << " reissued\n";
+    for (const WorkerReport &worker : distributed.workers)
+      std::cout << "  Worker " << worker.address << ": " << worker.threads
+                << " threads, " << worker.ranges << " ranges, "
+                << worker.backups << " backups sent, " << worker.wasted_ranges
+                << " returned late" << (worker.lost ? ", lost" : "") << "\n";
+    report.samples = static_cast<uint64_t>(image_width) * image_height *
+                     settings.samples_per_pixel;
+    report.passes = 1;
   } else {
-    num_threads = std::thread::hardware_concurrency();
+    report = render_scene(scene, camera, settings, pixels, on_pass, &pool);
+  }
+  double render_ms = std::chrono::duration<double, std::milli>(
+                         std::chrono::steady_clock::now() - render_start)
+                         .count();
+  std::cout << "Render time: " << render_ms << " ms ("
+            << (use_bvh ? "BVH" : "linear scan") << ", "
+            << render_engine_name(settings.engine) << " engine, "
+            << sampler_type_name(settings.sampler) << " sampler, "
+            << static_cast<double>(report.samples) / (render_ms * 1e3)
+            << " M primary rays/s)\n";
+  std::cout << "Samples: " << report.samples << " in " << report.passes
+            << " passes ("
+            << static_cast<double>(report.samples) / (image_width * image_height)
+            << " spp average";
+  if (settings.adaptive)
+    std::cout << ", " << report.converged_pixels << " pixels converged";
+  std::cout << ")\n";
+  for (size_t t = 0; t < report.threads.size(); ++t) {
+    const ThreadTiming &timing = report.threads[t];
+    std::cout << "  Thread " << t << ": busy " << timing.busy_ms
+              << " ms, idle " << timing.idle_ms << " ms, " << timing.tiles
+              << " tiles (" << timing.stolen << " stolen)\n";
   }
 
-  if (argc >= 5) {
-    std::cout << "Usage: " << argv[0] << " [image_width] [image_height]\n";
+  // Write output file
+  auto write_start = std::chrono::steady_clock::now();
+  const double write_start_us = trace_clock_us();
+  if (!write_image(filename, pixels, image_width, image_height, format,
+                   num_threads)) {
+    std::cerr << "Failed to write " << filename << "\n";
     return 1;
   }
+  double write_ms = std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - write_start)
+                        .count();
+  std::cout << "Write time: " << write_ms << " ms\n";
+  if (settings.profile)
+    report.stats.stage_ms[static_cast<int>(RenderStage::WRITE)] += write_ms;
+  if (coordinator_port == 0) // The workers keep their own counters
+    print_render_stats(std::cout, report.stats);
+
+  // A mismatch fails the run, but only after the trace is written too
+  bool golden_match = true;
+  bool compare_match = true;
+  if (!tile_hash_path.empty() || !golden_path.empty()) {
+    const TileHashes hashes =
+        hash_tiles(pixels, settings, frame_key(scene, view, settings));
+    std::string error;
+    if (!tile_hash_path.empty()) {
+      if (!save_tile_hashes(tile_hash_path, hashes, error)) {
+        std::cerr << error << "\n";
+        return 1;
+      }
+      std::cout << "Tile hashes written to " << tile_hash_path << "\n";
+    }
+    if (!golden_path.empty()) {
+      TileHashes golden;
+      std::vector<uint32_t> differing;
+      if (!load_tile_hashes(golden_path, golden, error) ||
+          !compare_tile_hashes(golden, hashes, differing, error)) {
+        std::cerr << "Golden: " << error << "\n";
+        return 1;
+      }
+      if (golden.frame_key != hashes.frame_key)
+        std::cout << "Golden: " << golden_path
+                  << " was rendered from another scene, camera or settings\n";
+      if (differing.empty()) {
+        std::cout << "Golden: all " << hashes.tiles.size()
+                  << " tiles match " << golden_path << "\n";
+      } else {
+        golden_match = false;
+        std::cout << "Golden: " << differing.size() << " of "
+                  << hashes.tiles.size() << " tiles differ from "
+                  << golden_path << ":";
+        for (size_t d = 0; d < differing.size() && d < 8; ++d) {
+          const Tile &tile = hashes.tiles[differing[d]];
+          std::cout << " " << differing[d] << " (" << tile.x0 << ","
+                    << tile.y0 << ")-(" << tile.x1 << "," << tile.y1 << ")";
+        }
+        std::cout << (differing.size() > 8 ? " ...\n" : "\n");
+      }
+    }
+  }
 
-  // Allocate pixel buffer
-  std::vector<Color> pixels(image_width * image_height);
-
-  // Camera setup: positioned at origin, looking down -Z axis
-  Camera camera(Point3(0, 0, 0),  // look from: camera position
-                Point3(0, 0, -1), // look at: point we're looking at
-                Vec3(0, 1, 0),    // vup: "up" direction
-                45.0f,            // vfov: vertical field of view in degrees
-                aspect_ratio);
-
-  const Lambertian lambertian(Color(0.5f, 0.25f, 0.25f));
-  const Lambertian lambertian2(Color(0.25f, 0.5f, 0.75f));
-  const Lambertian lambertian3(Color(0.75f, 0.5f, 0.25f));
-  const Conductor conductor(Color(0.25f, 0.75f, 0.5f));
-  const Lambertian lambertian4(Color(0.5, 0.75, 0.5));
-  const Conductor conductor2(Color(0.5, 0.5, 0.75));
-  const Lambertian lambertian5(Color(0.5, 0.5, 0.75));
-  const Lambertian lambertian6(Color(0.75, 0.75, 0.75));
-
-  Sphere sphere1(Point3(0.0, 0.0, 0.0), 100.0f, &lambertian);
-  Sphere sphere2(Point3(-0.35, 0.35, -3.5), 0.25f, &lambertian2);
-  Sphere sphere3(Point3(0.35, 0.35, -2.5), 0.35f, &lambertian3);
-  Sphere sphere4(Point3(0.35, -0.35, -2.0), 0.3f, &conductor);
-  Sphere sphere5(Point3(-0.35, -0.35, -4.0), 0.325f, &lambertian4);
-  Sphere sphere6(Point3(-1.5, 0.0, -3.0), 0.5f, &conductor2);
-  Sphere sphere7(Point3(1.5, 0.0, -3.0), 0.5f, &lambertian5);
-  Sphere sphere8(Point3(10.0, 0.0, -3.0), 0.5f, &lambertian6);
-  Sphere sphere9(Point3(-10.0, 0.0, -3.0), 0.5f, &lambertian6);
-
-  Light light2(Vec3(0, 0, 0), Vec3(10, 10, 10));
-  Light light3(Vec3(-0.4, 0.5, -3.0), Vec3(0.5, 0.5, 0.5));
-  Light light4(Vec3(0, 0, 90), Vec3(10000, 10000, 10000));
-
-  Scene scene(camera);
-  scene.add_object(sphere1);
-  scene.add_object(sphere2);
-  scene.add_object(sphere3);
-  scene.add_object(sphere4);
-  scene.add_object(sphere5);
-  scene.add_object(sphere6);
-  scene.add_object(sphere7);
-  scene.add_object(sphere8);
-  scene.add_object(sphere9);
-  scene.add_light(light2);
-  scene.add_light(light3);
-  scene.add_light(light4);
-
-  render_scene(scene, camera, image_width, image_height, samples_per_pixel,
-               pixels, num_threads);
+  if (!compare_path.empty()) {
+    std::vector<Color> reference;
+    int width = 0, height = 0;
+    std::string error;
+    if (!read_pfm(compare_path, reference, width, height, error)) {
+      std::cerr << "Compare: " << error << "\n";
+      return 1;
+    }
+    if (width != image_width || height != image_height) {
+      std::cerr << "Compare: " << compare_path << " is " << width << "x"
+                << height << "\n";
+      return 1;
+    }
+    const ImageDiff diff = compare_images(reference, pixels);
+    std::cout << "Compare: " << diff.changed_values << " of " << diff.values
+              << " 8-bit values differ from " << compare_path << " (up to "
+              << diff.max_levels << " levels), PSNR " << diff.psnr
+              << " dB; float difference max " << diff.max_abs << ", mean "
+              << diff.mean_abs << ", median relative "
+              << diff.median_relative << "\n";
+    if (max_diff >= 0 && diff.max_levels > max_diff) {
+      compare_match = false;
+      std::cout << "Compare: more than " << max_diff << " levels apart\n";
+    }
+  }
 
-  // Write output file
-  write_ppm("output.ppm", pixels, image_width, image_height);
-  std::cout << "Done! Output written to output.ppm\n";
+  if (!trace_path.empty()) {
+    TraceEvent write_event;
+    write_event.name = "write";
+    write_event.thread = -1;
+    write_event.start_us = write_start_us;
+    write_event.duration_us = write_ms * 1e3;
+    report.trace.push_back(write_event);
+    if (!write_chrome_trace(trace_path, report.trace, report.stats)) {
+      std::cerr << "Failed to write " << trace_path << "\n";
+      return 1;
+    }
+    std::cout << "Trace written to " << trace_path << "\n";
+  }
+  std::cout << "Done! Output written to " << filename << "\n";
 
-  return 0;
+  return golden_match && compare_match ? 0 : 1;
 }
\ No newline at end of file
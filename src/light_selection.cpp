@@ -0,0 +1,53 @@
+#include "light_selection.h"
+#include <algorithm>
+
+int select_lights(const std::vector<Light> &lights, const Point3 &point,
+                  const Vec3 &normal, int count, Sampler &sampler,
+                  SelectedLight *selected) {
+  count = std::max(1, std::min(count, MAX_SELECTED_LIGHTS));
+
+  float total = 0.0f;
+  for (const auto &light : lights)
+    total += light_importance(light, point, normal);
+  if (total <= 0.0f)
+    return 0;
+
+  // Stratified targets in [0, total), ascending, so one walk over the
+  // lights resolves all of them
+  float targets[MAX_SELECTED_LIGHTS];
+  for (int k = 0; k < count; ++k)
+    targets[k] = (k + sampler.next_1d()) / count * total;
+
+  int written = 0;
+  int k = 0;
+  float cumulative = 0.0f;
+  uint32_t last = 0; // Last light that can contribute
+  float last_importance = 0.0f;
+  for (size_t i = 0; i < lights.size() && k < count; ++i) {
+    float importance = light_importance(lights[i], point, normal);
+    if (importance <= 0.0f)
+      continue;
+    cumulative += importance;
+    last = static_cast<uint32_t>(i);
+    last_importance = importance;
+
+    int picks = 0;
+    while (k < count && targets[k] < cumulative) {
+      ++picks;
+      ++k;
+    }
+    if (picks > 0)
+      selected[written++] = {last, picks * total / (count * importance)};
+  }
+
+  // Rounding can leave the last targets at or past the final cumulative
+  // sum; they belong to the last light that can contribute
+  if (k < count) {
+    float weight = (count - k) * total / (count * last_importance);
+    if (written > 0 && selected[written - 1].index == last)
+      selected[written - 1].weight += weight;
+    else
+      selected[written++] = {last, weight};
+  }
+  return written;
+}
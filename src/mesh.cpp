@@ -0,0 +1,565 @@
+#include "mesh.h"
+#include "simd_targets.h"
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+void TriangleSoA::clear() {
+  for (AlignedVector<float> *a :
+       {&v0x, &v0y, &v0z, &e1x, &e1y, &e1z, &e2x, &e2y, &e2z})
+    a->clear();
+  count = 0;
+}
+
+void TriangleSoA::build(const std::vector<Point3> &vertices,
+                        const std::vector<uint32_t> &indices,
+                        const std::vector<uint32_t> &order) {
+  count = static_cast<uint32_t>(order.size());
+  uint32_t padded = (count + PADDING - 1) / PADDING * PADDING + PADDING;
+
+  // Padding slots are degenerate triangles at the origin (zero determinant);
+  // kernels also mask them out by lane index
+  for (AlignedVector<float> *a :
+       {&v0x, &v0y, &v0z, &e1x, &e1y, &e1z, &e2x, &e2y, &e2z})
+    a->assign(padded, 0.0f);
+
+  for (uint32_t i = 0; i < count; ++i) {
+    const uint32_t *corner = &indices[3 * static_cast<size_t>(order[i])];
+    const Point3 &v0 = vertices[corner[0]];
+    const Vec3 e1 = vertices[corner[1]] - v0;
+    const Vec3 e2 = vertices[corner[2]] - v0;
+    v0x[i] = v0.x;
+    v0y[i] = v0.y;
+    v0z[i] = v0.z;
+    e1x[i] = e1.x;
+    e1y[i] = e1.y;
+    e1z[i] = e1.z;
+    e2x[i] = e2.x;
+    e2y[i] = e2.y;
+    e2z[i] = e2.z;
+  }
+}
+
+namespace {
+
+// Scalar reference kernels, built on intersect_triangle
+
+int closest_scalar(const TriangleBatch &b, const Ray &ray, uint32_t first,
+                   uint32_t count, float t_min, float &t_max) {
+  int best = -1;
+  for (uint32_t i = first; i < first + count; ++i) {
+    float t;
+    if (intersect_triangle(ray, Point3(b.v0x[i], b.v0y[i], b.v0z[i]),
+                           Vec3(b.e1x[i], b.e1y[i], b.e1z[i]),
+                           Vec3(b.e2x[i], b.e2y[i], b.e2z[i]), t_min, t_max,
+                           t)) {
+      t_max = t;
+      best = static_cast<int>(i);
+    }
+  }
+  return best;
+}
+
+bool any_scalar(const TriangleBatch &b, const Ray &ray, uint32_t first,
+                uint32_t count, float t_min, float t_max) {
+  for (uint32_t i = first; i < first + count; ++i) {
+    float t;
+    if (intersect_triangle(ray, Point3(b.v0x[i], b.v0y[i], b.v0z[i]),
+                           Vec3(b.e1x[i], b.e1y[i], b.e1z[i]),
+                           Vec3(b.e2x[i], b.e2y[i], b.e2z[i]), t_min, t_max,
+                           t))
+      return true;
+  }
+  return false;
+}
+
+#ifdef KESTREL_BUILD_SSE4
+
+/// Ray origin and direction broadcast to every lane
+struct Ray4 {
+  __m128 ox, oy, oz, dx, dy, dz;
+};
+
+KESTREL_TARGET_SSE4 inline Ray4 broadcast_sse4(const Ray &ray) {
+  return {_mm_set1_ps(ray.origin.x),    _mm_set1_ps(ray.origin.y),
+          _mm_set1_ps(ray.origin.z),    _mm_set1_ps(ray.direction.x),
+          _mm_set1_ps(ray.direction.y), _mm_set1_ps(ray.direction.z)};
+}
+
+/// Möller-Trumbore on the 4 slots at base: the mask of the lanes hit
+/// within [t_min, t_max] (before the lane count is applied) and their t
+KESTREL_TARGET_SSE4 inline __m128 intersect_sse4(const TriangleBatch &b,
+                                                 uint32_t base, const Ray4 &r,
+                                                 __m128 tmin, __m128 tmax,
+                                                 __m128 &t) {
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.0f);
+  __m128 e1x = _mm_loadu_ps(b.e1x + base), e1y = _mm_loadu_ps(b.e1y + base),
+         e1z = _mm_loadu_ps(b.e1z + base);
+  __m128 e2x = _mm_loadu_ps(b.e2x + base), e2y = _mm_loadu_ps(b.e2y + base),
+         e2z = _mm_loadu_ps(b.e2z + base);
+  // p = d x e2, det = e1 . p
+  __m128 px = _mm_sub_ps(_mm_mul_ps(r.dy, e2z), _mm_mul_ps(r.dz, e2y));
+  __m128 py = _mm_sub_ps(_mm_mul_ps(r.dz, e2x), _mm_mul_ps(r.dx, e2z));
+  __m128 pz = _mm_sub_ps(_mm_mul_ps(r.dx, e2y), _mm_mul_ps(r.dy, e2x));
+  __m128 det = _mm_add_ps(
+      _mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)),
+      _mm_mul_ps(e1z, pz));
+  __m128 inv_det = _mm_div_ps(one, det);
+  // s = o - v0, q = s x e1
+  __m128 sx = _mm_sub_ps(r.ox, _mm_loadu_ps(b.v0x + base));
+  __m128 sy = _mm_sub_ps(r.oy, _mm_loadu_ps(b.v0y + base));
+  __m128 sz = _mm_sub_ps(r.oz, _mm_loadu_ps(b.v0z + base));
+  __m128 u = _mm_mul_ps(
+      _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)),
+                 _mm_mul_ps(sz, pz)),
+      inv_det);
+  __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+  __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+  __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+  __m128 v = _mm_mul_ps(
+      _mm_add_ps(_mm_add_ps(_mm_mul_ps(r.dx, qx), _mm_mul_ps(r.dy, qy)),
+                 _mm_mul_ps(r.dz, qz)),
+      inv_det);
+  t = _mm_mul_ps(
+      _mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)),
+                 _mm_mul_ps(e2z, qz)),
+      inv_det);
+  return _mm_and_ps(
+      _mm_and_ps(_mm_and_ps(_mm_cmpneq_ps(det, zero), _mm_cmpge_ps(u, zero)),
+                 _mm_and_ps(_mm_cmpge_ps(v, zero),
+                            _mm_cmple_ps(_mm_add_ps(u, v), one))),
+      _mm_and_ps(_mm_cmpge_ps(t, tmin), _mm_cmple_ps(t, tmax)));
+}
+
+KESTREL_TARGET_SSE4 int closest_sse4(const TriangleBatch &b, const Ray &ray,
+                                     uint32_t first, uint32_t count,
+                                     float t_min, float &t_max) {
+  const Ray4 r = broadcast_sse4(ray);
+  const __m128 tmin = _mm_set1_ps(t_min);
+  const __m128 inf = _mm_set1_ps(std::numeric_limits<float>::infinity());
+  const __m128 lane = _mm_setr_ps(0, 1, 2, 3);
+
+  int best = -1;
+  for (uint32_t i = 0; i < count; i += 4) {
+    uint32_t base = first + i;
+    __m128 t;
+    __m128 valid = _mm_and_ps(
+        intersect_sse4(b, base, r, tmin, _mm_set1_ps(t_max), t),
+        _mm_cmplt_ps(lane, _mm_set1_ps(static_cast<float>(count - i))));
+    if (_mm_movemask_ps(valid) == 0)
+      continue;
+
+    __m128 root = _mm_blendv_ps(inf, t, valid);
+    __m128 m =
+        _mm_min_ps(root, _mm_shuffle_ps(root, root, _MM_SHUFFLE(2, 3, 0, 1)));
+    m = _mm_min_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+    int mask = _mm_movemask_ps(_mm_cmpeq_ps(root, m));
+    t_max = _mm_cvtss_f32(m);
+    best = static_cast<int>(base) + __builtin_ctz(mask);
+  }
+  return best;
+}
+
+KESTREL_TARGET_SSE4 bool any_sse4(const TriangleBatch &b, const Ray &ray,
+                                  uint32_t first, uint32_t count, float t_min,
+                                  float t_max) {
+  const Ray4 r = broadcast_sse4(ray);
+  const __m128 tmin = _mm_set1_ps(t_min);
+  const __m128 tmax = _mm_set1_ps(t_max);
+  const __m128 lane = _mm_setr_ps(0, 1, 2, 3);
+
+  for (uint32_t i = 0; i < count; i += 4) {
+    __m128 t;
+    __m128 valid = _mm_and_ps(
+        intersect_sse4(b, first + i, r, tmin, tmax, t),
+        _mm_cmplt_ps(lane, _mm_set1_ps(static_cast<float>(count - i))));
+    if (_mm_movemask_ps(valid) != 0)
+      return true;
+  }
+  return false;
+}
+
+#endif // KESTREL_BUILD_SSE4
+
+#ifdef KESTREL_BUILD_AVX2
+
+/// Ray origin and direction broadcast to every lane
+struct Ray8 {
+  __m256 ox, oy, oz, dx, dy, dz;
+};
+
+KESTREL_TARGET_AVX2 inline Ray8 broadcast_avx2(const Ray &ray) {
+  return {_mm256_set1_ps(ray.origin.x),    _mm256_set1_ps(ray.origin.y),
+          _mm256_set1_ps(ray.origin.z),    _mm256_set1_ps(ray.direction.x),
+          _mm256_set1_ps(ray.direction.y), _mm256_set1_ps(ray.direction.z)};
+}
+
+/// Möller-Trumbore on the 8 slots at base, as intersect_sse4()
+KESTREL_TARGET_AVX2 inline __m256 intersect_avx2(const TriangleBatch &b,
+                                                 uint32_t base, const Ray8 &r,
+                                                 __m256 tmin, __m256 tmax,
+                                                 __m256 &t) {
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 one = _mm256_set1_ps(1.0f);
+  __m256 e1x = _mm256_loadu_ps(b.e1x + base),
+         e1y = _mm256_loadu_ps(b.e1y + base),
+         e1z = _mm256_loadu_ps(b.e1z + base);
+  __m256 e2x = _mm256_loadu_ps(b.e2x + base),
+         e2y = _mm256_loadu_ps(b.e2y + base),
+         e2z = _mm256_loadu_ps(b.e2z + base);
+  __m256 px = _mm256_sub_ps(_mm256_mul_ps(r.dy, e2z), _mm256_mul_ps(r.dz, e2y));
+  __m256 py = _mm256_sub_ps(_mm256_mul_ps(r.dz, e2x), _mm256_mul_ps(r.dx, e2z));
+  __m256 pz = _mm256_sub_ps(_mm256_mul_ps(r.dx, e2y), _mm256_mul_ps(r.dy, e2x));
+  __m256 det = _mm256_add_ps(
+      _mm256_add_ps(_mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py)),
+      _mm256_mul_ps(e1z, pz));
+  __m256 inv_det = _mm256_div_ps(one, det);
+  __m256 sx = _mm256_sub_ps(r.ox, _mm256_loadu_ps(b.v0x + base));
+  __m256 sy = _mm256_sub_ps(r.oy, _mm256_loadu_ps(b.v0y + base));
+  __m256 sz = _mm256_sub_ps(r.oz, _mm256_loadu_ps(b.v0z + base));
+  __m256 u = _mm256_mul_ps(
+      _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sx, px), _mm256_mul_ps(sy, py)),
+                    _mm256_mul_ps(sz, pz)),
+      inv_det);
+  __m256 qx = _mm256_sub_ps(_mm256_mul_ps(sy, e1z), _mm256_mul_ps(sz, e1y));
+  __m256 qy = _mm256_sub_ps(_mm256_mul_ps(sz, e1x), _mm256_mul_ps(sx, e1z));
+  __m256 qz = _mm256_sub_ps(_mm256_mul_ps(sx, e1y), _mm256_mul_ps(sy, e1x));
+  __m256 v = _mm256_mul_ps(
+      _mm256_add_ps(
+          _mm256_add_ps(_mm256_mul_ps(r.dx, qx), _mm256_mul_ps(r.dy, qy)),
+          _mm256_mul_ps(r.dz, qz)),
+      inv_det);
+  t = _mm256_mul_ps(
+      _mm256_add_ps(
+          _mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)),
+          _mm256_mul_ps(e2z, qz)),
+      inv_det);
+  __m256 inside = _mm256_and_ps(
+      _mm256_and_ps(_mm256_cmp_ps(det, zero, _CMP_NEQ_OQ),
+                    _mm256_cmp_ps(u, zero, _CMP_GE_OQ)),
+      _mm256_and_ps(_mm256_cmp_ps(v, zero, _CMP_GE_OQ),
+                    _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ)));
+  return _mm256_and_ps(inside,
+                       _mm256_and_ps(_mm256_cmp_ps(t, tmin, _CMP_GE_OQ),
+                                     _mm256_cmp_ps(t, tmax, _CMP_LE_OQ)));
+}
+
+KESTREL_TARGET_AVX2 int closest_avx2(const TriangleBatch &b, const Ray &ray,
+                                     uint32_t first, uint32_t count,
+                                     float t_min, float &t_max) {
+  const Ray8 r = broadcast_avx2(ray);
+  const __m256 tmin = _mm256_set1_ps(t_min);
+  const __m256 inf = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+  const __m256 lane = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+
+  int best = -1;
+  for (uint32_t i = 0; i < count; i += 8) {
+    uint32_t base = first + i;
+    __m256 t;
+    __m256 valid = _mm256_and_ps(
+        intersect_avx2(b, base, r, tmin, _mm256_set1_ps(t_max), t),
+        _mm256_cmp_ps(lane, _mm256_set1_ps(static_cast<float>(count - i)),
+                      _CMP_LT_OQ));
+    if (_mm256_movemask_ps(valid) == 0)
+      continue;
+
+    __m256 root = _mm256_blendv_ps(inf, t, valid);
+    __m256 m = _mm256_min_ps(root, _mm256_permute2f128_ps(root, root, 1));
+    m = _mm256_min_ps(m, _mm256_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+    m = _mm256_min_ps(m, _mm256_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+    int mask = _mm256_movemask_ps(_mm256_cmp_ps(root, m, _CMP_EQ_OQ));
+    t_max = _mm256_cvtss_f32(m);
+    best = static_cast<int>(base) + __builtin_ctz(mask);
+  }
+  return best;
+}
+
+KESTREL_TARGET_AVX2 bool any_avx2(const TriangleBatch &b, const Ray &ray,
+                                  uint32_t first, uint32_t count, float t_min,
+                                  float t_max) {
+  const Ray8 r = broadcast_avx2(ray);
+  const __m256 tmin = _mm256_set1_ps(t_min);
+  const __m256 tmax = _mm256_set1_ps(t_max);
+  const __m256 lane = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+
+  for (uint32_t i = 0; i < count; i += 8) {
+    __m256 t;
+    __m256 valid = _mm256_and_ps(
+        intersect_avx2(b, first + i, r, tmin, tmax, t),
+        _mm256_cmp_ps(lane, _mm256_set1_ps(static_cast<float>(count - i)),
+                      _CMP_LT_OQ));
+    if (_mm256_movemask_ps(valid) != 0)
+      return true;
+  }
+  return false;
+}
+
+#endif // KESTREL_BUILD_AVX2
+
+#ifdef KESTREL_BUILD_AVX512
+
+/// Ray origin and direction broadcast to every lane
+struct Ray16 {
+  __m512 ox, oy, oz, dx, dy, dz;
+};
+
+KESTREL_TARGET_AVX512 inline Ray16 broadcast_avx512(const Ray &ray) {
+  return {_mm512_set1_ps(ray.origin.x),    _mm512_set1_ps(ray.origin.y),
+          _mm512_set1_ps(ray.origin.z),    _mm512_set1_ps(ray.direction.x),
+          _mm512_set1_ps(ray.direction.y), _mm512_set1_ps(ray.direction.z)};
+}
+
+/// Möller-Trumbore on the lanes of the 16 slots at base; returns the lanes
+/// hit within [t_min, t_max] and their t
+KESTREL_TARGET_AVX512 inline __mmask16
+intersect_avx512(const TriangleBatch &b, uint32_t base, __mmask16 lanes,
+                 const Ray16 &r, __m512 tmin, __m512 tmax, __m512 &t) {
+  const __m512 zero = _mm512_setzero_ps();
+  const __m512 one = _mm512_set1_ps(1.0f);
+  __m512 e1x = _mm512_loadu_ps(b.e1x + base),
+         e1y = _mm512_loadu_ps(b.e1y + base),
+         e1z = _mm512_loadu_ps(b.e1z + base);
+  __m512 e2x = _mm512_loadu_ps(b.e2x + base),
+         e2y = _mm512_loadu_ps(b.e2y + base),
+         e2z = _mm512_loadu_ps(b.e2z + base);
+  __m512 px = _mm512_sub_ps(_mm512_mul_ps(r.dy, e2z), _mm512_mul_ps(r.dz, e2y));
+  __m512 py = _mm512_sub_ps(_mm512_mul_ps(r.dz, e2x), _mm512_mul_ps(r.dx, e2z));
+  __m512 pz = _mm512_sub_ps(_mm512_mul_ps(r.dx, e2y), _mm512_mul_ps(r.dy, e2x));
+  __m512 det = _mm512_add_ps(
+      _mm512_add_ps(_mm512_mul_ps(e1x, px), _mm512_mul_ps(e1y, py)),
+      _mm512_mul_ps(e1z, pz));
+  __mmask16 valid = _mm512_mask_cmp_ps_mask(lanes, det, zero, _CMP_NEQ_OQ);
+  if (valid == 0)
+    return 0;
+
+  __m512 inv_det = _mm512_div_ps(one, det);
+  __m512 sx = _mm512_sub_ps(r.ox, _mm512_loadu_ps(b.v0x + base));
+  __m512 sy = _mm512_sub_ps(r.oy, _mm512_loadu_ps(b.v0y + base));
+  __m512 sz = _mm512_sub_ps(r.oz, _mm512_loadu_ps(b.v0z + base));
+  __m512 u = _mm512_mul_ps(
+      _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(sx, px), _mm512_mul_ps(sy, py)),
+                    _mm512_mul_ps(sz, pz)),
+      inv_det);
+  __m512 qx = _mm512_sub_ps(_mm512_mul_ps(sy, e1z), _mm512_mul_ps(sz, e1y));
+  __m512 qy = _mm512_sub_ps(_mm512_mul_ps(sz, e1x), _mm512_mul_ps(sx, e1z));
+  __m512 qz = _mm512_sub_ps(_mm512_mul_ps(sx, e1y), _mm512_mul_ps(sy, e1x));
+  __m512 v = _mm512_mul_ps(
+      _mm512_add_ps(
+          _mm512_add_ps(_mm512_mul_ps(r.dx, qx), _mm512_mul_ps(r.dy, qy)),
+          _mm512_mul_ps(r.dz, qz)),
+      inv_det);
+  t = _mm512_mul_ps(
+      _mm512_add_ps(
+          _mm512_add_ps(_mm512_mul_ps(e2x, qx), _mm512_mul_ps(e2y, qy)),
+          _mm512_mul_ps(e2z, qz)),
+      inv_det);
+  valid = _mm512_mask_cmp_ps_mask(valid, u, zero, _CMP_GE_OQ);
+  valid = _mm512_mask_cmp_ps_mask(valid, v, zero, _CMP_GE_OQ);
+  valid = _mm512_mask_cmp_ps_mask(valid, _mm512_add_ps(u, v), one, _CMP_LE_OQ);
+  valid = _mm512_mask_cmp_ps_mask(valid, t, tmin, _CMP_GE_OQ);
+  return _mm512_mask_cmp_ps_mask(valid, t, tmax, _CMP_LE_OQ);
+}
+
+KESTREL_TARGET_AVX512 int closest_avx512(const TriangleBatch &b,
+                                         const Ray &ray, uint32_t first,
+                                         uint32_t count, float t_min,
+                                         float &t_max) {
+  const Ray16 r = broadcast_avx512(ray);
+  const __m512 tmin = _mm512_set1_ps(t_min);
+  const __m512 inf = _mm512_set1_ps(std::numeric_limits<float>::infinity());
+
+  int best = -1;
+  for (uint32_t i = 0; i < count; i += 16) {
+    uint32_t base = first + i;
+    uint32_t remaining = count - i;
+    __mmask16 lanes = remaining >= 16
+                          ? static_cast<__mmask16>(0xFFFF)
+                          : static_cast<__mmask16>((1u << remaining) - 1u);
+    __m512 t;
+    __mmask16 valid =
+        intersect_avx512(b, base, lanes, r, tmin, _mm512_set1_ps(t_max), t);
+    if (valid == 0)
+      continue;
+
+    __m512 root = _mm512_mask_blend_ps(valid, inf, t);
+    float m = _mm512_reduce_min_ps(root);
+    __mmask16 mask = _mm512_cmp_ps_mask(root, _mm512_set1_ps(m), _CMP_EQ_OQ);
+    t_max = m;
+    best = static_cast<int>(base) + __builtin_ctz(mask);
+  }
+  return best;
+}
+
+KESTREL_TARGET_AVX512 bool any_avx512(const TriangleBatch &b, const Ray &ray,
+                                      uint32_t first, uint32_t count,
+                                      float t_min, float t_max) {
+  const Ray16 r = broadcast_avx512(ray);
+  const __m512 tmin = _mm512_set1_ps(t_min);
+  const __m512 tmax = _mm512_set1_ps(t_max);
+
+  for (uint32_t i = 0; i < count; i += 16) {
+    uint32_t remaining = count - i;
+    __mmask16 lanes = remaining >= 16
+                          ? static_cast<__mmask16>(0xFFFF)
+                          : static_cast<__mmask16>((1u << remaining) - 1u);
+    __m512 t;
+    if (intersect_avx512(b, first + i, lanes, r, tmin, tmax, t) != 0)
+      return true;
+  }
+  return false;
+}
+
+#endif // KESTREL_BUILD_AVX512
+
+TriangleKernels select_kernels() {
+#if defined(KESTREL_SIMD_DISPATCH) && defined(KESTREL_X86)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    return {"AVX-512", 16, closest_avx512, any_avx512};
+  if (__builtin_cpu_supports("avx2"))
+    return {"AVX2", 8, closest_avx2, any_avx2};
+  if (__builtin_cpu_supports("sse4.1"))
+    return {"SSE4.1", 4, closest_sse4, any_sse4};
+#elif defined(KESTREL_BUILD_AVX512)
+  return {"AVX-512", 16, closest_avx512, any_avx512};
+#elif defined(KESTREL_BUILD_AVX2)
+  return {"AVX2", 8, closest_avx2, any_avx2};
+#elif defined(KESTREL_BUILD_SSE4)
+  return {"SSE4.1", 4, closest_sse4, any_sse4};
+#endif
+  return {"scalar", 1, closest_scalar, any_scalar};
+}
+
+} // namespace
+
+const TriangleKernels &triangle_kernels() {
+  static const TriangleKernels kernels = select_kernels();
+  return kernels;
+}
+
+bool TriangleMesh::valid() const {
+  if (indices.size() % 3 != 0)
+    return false;
+  const size_t vertex_count = vertices.size();
+  return std::all_of(indices.begin(), indices.end(),
+                     [&](uint32_t id) { return id < vertex_count; });
+}
+
+void TriangleMesh::build() {
+  const size_t count = triangle_count();
+  std::vector<AABB> triangle_bounds;
+  triangle_bounds.reserve(count);
+  for (uint32_t i = 0; i < count; ++i) {
+    Point3 v0, v1, v2;
+    corners(i, v0, v1, v2);
+    AABB box(v0, v0);
+    box.grow(v1);
+    box.grow(v2);
+    triangle_bounds.push_back(box);
+  }
+  // Same leaf sizing as the scene's own BVH (see Scene::build_bvh)
+  const int lanes = triangle_kernels().lanes;
+  bvh.build(triangle_bounds, std::max(4, lanes), lanes);
+  packed.clear();
+  packed.build(vertices, indices, bvh.prim_indices);
+}
+
+bool TriangleMesh::adopt_bvh(std::vector<BVHNode> nodes,
+                             std::vector<uint32_t> prim_indices) {
+  packed.clear();
+  if (prim_indices.size() != triangle_count()) {
+    bvh.clear();
+    return false;
+  }
+  if (!bvh.assign(std::move(nodes), std::move(prim_indices), triangle_count(),
+                  triangle_kernels().lanes))
+    return false;
+  packed.build(vertices, indices, bvh.prim_indices);
+  return true;
+}
+
+void TriangleMesh::clear_bvh() {
+  bvh.clear();
+  packed.clear();
+}
+
+AABB TriangleMesh::bounds() const {
+  AABB box;
+  for (const Point3 &vertex : vertices)
+    box.grow(vertex);
+  return box;
+}
+
+bool TriangleMesh::hit(const Ray &ray, float t_min, float &t_max,
+                       uint32_t &triangle, TraversalStats *stats) const {
+  if (!bvh.empty()) {
+    int closest_slot = -1;
+    bool hit_anything = bvh.intersect(
+        ray, t_min, t_max,
+        [&](const BVHNode &leaf, float t0, float &t1) {
+          int slot =
+              packed.closest(ray, leaf.left_first, leaf.prim_count, t0, t1);
+          if (slot < 0)
+            return false;
+          closest_slot = slot;
+          return true;
+        },
+        stats);
+    if (hit_anything)
+      triangle = bvh.prim_indices[closest_slot];
+    return hit_anything;
+  }
+
+  const uint32_t count = static_cast<uint32_t>(triangle_count());
+  if (stats)
+    stats->primitives += count;
+  bool hit_anything = false;
+  for (uint32_t i = 0; i < count; ++i) {
+    Point3 v0, v1, v2;
+    corners(i, v0, v1, v2);
+    float t;
+    if (intersect_triangle(ray, v0, v1 - v0, v2 - v0, t_min, t_max, t)) {
+      triangle = i;
+      t_max = t;
+      hit_anything = true;
+    }
+  }
+  return hit_anything;
+}
+
+bool TriangleMesh::occluded(const Ray &ray, float t_min, float t_max,
+                            TraversalStats *stats) const {
+  if (!bvh.empty())
+    return bvh.occluded(
+        ray, t_min, t_max,
+        [&](const BVHNode &leaf, float t0, float t1) {
+          return packed.any(ray, leaf.left_first, leaf.prim_count, t0, t1);
+        },
+        stats);
+
+  const uint32_t count = static_cast<uint32_t>(triangle_count());
+  for (uint32_t i = 0; i < count; ++i) {
+    Point3 v0, v1, v2;
+    corners(i, v0, v1, v2);
+    float t;
+    if (intersect_triangle(ray, v0, v1 - v0, v2 - v0, t_min, t_max, t)) {
+      if (stats)
+        stats->primitives += i + 1;
+      return true;
+    }
+  }
+  if (stats)
+    stats->primitives += count;
+  return false;
+}
+
+void TriangleMesh::finalize(const Ray &ray, uint32_t triangle, float t,
+                            HitRecord &rec) const {
+  Point3 v0, v1, v2;
+  corners(triangle, v0, v1, v2);
+  rec.t = t;
+  rec.point = ray.at(t);
+  rec.set_face_normal(ray, Vec3::cross(v1 - v0, v2 - v0).normalized());
+  rec.material = material;
+}
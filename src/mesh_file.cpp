@@ -0,0 +1,452 @@
+#include "mesh_file.h"
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace {
+
+/// Bytes read from the file at a time
+constexpr size_t CHUNK_SIZE = 1 << 20;
+
+/// Chunked reader that hands out lines (NUL terminated in place) and raw
+/// bytes, so the file is never held in memory as a whole
+class StreamReader {
+public:
+  explicit StreamReader(FILE *file) : file(file), buffer(CHUNK_SIZE + 1) {}
+
+  /// Next line without its line break; false at the end of the file
+  bool line(char *&text) {
+    while (true) {
+      char *start = buffer.data() + begin;
+      char *newline =
+          static_cast<char *>(std::memchr(start, '\n', end - begin));
+      if (!newline && eof && begin == end)
+        return false;
+      if (newline || eof) {
+        // fill() keeps a spare byte after the data for the last line's NUL
+        char *stop = newline ? newline : buffer.data() + end;
+        *stop = '\0';
+        if (stop > start && stop[-1] == '\r')
+          stop[-1] = '\0';
+        begin = static_cast<size_t>(stop - buffer.data()) + (newline ? 1 : 0);
+        text = start;
+        return true;
+      }
+      fill();
+    }
+  }
+
+  /// Copy the next n bytes; false if the file ends first
+  bool bytes(void *out, size_t n) {
+    while (end - begin < n) {
+      if (eof)
+        return false;
+      fill();
+    }
+    std::memcpy(out, buffer.data() + begin, n);
+    begin += n;
+    return true;
+  }
+
+  bool failed() const { return std::ferror(file) != 0; }
+
+private:
+  void fill() {
+    // Keep the unread tail, growing the buffer for lines longer than it
+    std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+    end -= begin;
+    begin = 0;
+    if (end + 1 >= buffer.size())
+      buffer.resize(buffer.size() * 2);
+    size_t n =
+        std::fread(buffer.data() + end, 1, buffer.size() - 1 - end, file);
+    end += n;
+    eof = n == 0;
+  }
+
+  FILE *file;
+  std::vector<char> buffer;
+  size_t begin = 0, end = 0;
+  bool eof = false;
+};
+
+/// Closes the file when the reader is done, however it returns
+struct FileCloser {
+  FILE *file;
+  ~FileCloser() {
+    if (file)
+      std::fclose(file);
+  }
+};
+
+bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+const char *skip_space(const char *p) {
+  while (is_space(*p))
+    ++p;
+  return p;
+}
+
+/// Whitespace-delimited word at p (p is advanced past it)
+std::string_view next_word(const char *&p) {
+  p = skip_space(p);
+  const char *start = p;
+  while (*p && !is_space(*p))
+    ++p;
+  return std::string_view(start, static_cast<size_t>(p - start));
+}
+
+bool read_obj(StreamReader &reader, const std::string &path,
+              TriangleMesh &mesh, std::string &error) {
+  const size_t first_vertex = mesh.vertices.size();
+  size_t line_number = 0;
+  std::vector<uint32_t> polygon;
+  auto fail = [&](const std::string &message) {
+    error = path + ":" + std::to_string(line_number) + ": " + message;
+    return false;
+  };
+
+  char *text;
+  while (reader.line(text)) {
+    ++line_number;
+    const char *p = skip_space(text);
+    if (p[0] == 'v' && is_space(p[1])) {
+      // Optional w and per-vertex colors after x y z are ignored
+      float xyz[3];
+      ++p;
+      for (float &value : xyz) {
+        char *stop;
+        value = std::strtof(p, &stop);
+        if (stop == p || !std::isfinite(value))
+          return fail("expected: v <x y z>");
+        p = stop;
+      }
+      mesh.vertices.emplace_back(xyz[0], xyz[1], xyz[2]);
+      if (mesh.vertices.size() > std::numeric_limits<uint32_t>::max())
+        return fail("too many vertices");
+    } else if (p[0] == 'f' && is_space(p[1])) {
+      const long defined =
+          static_cast<long>(mesh.vertices.size() - first_vertex);
+      polygon.clear();
+      ++p;
+      while (true) {
+        p = skip_space(p);
+        if (*p == '\0' || *p == '#')
+          break;
+        char *stop;
+        long id = std::strtol(p, &stop, 10);
+        if (stop == p)
+          return fail("expected: f <v[/vt][/vn]> ... (at least 3)");
+        // Texture and normal ids (v/vt, v//vn, v/vt/vn) are skipped
+        p = stop;
+        while (*p && !is_space(*p))
+          ++p;
+        long local = id > 0 ? id - 1 : defined + id;
+        if (id == 0 || local < 0 || local >= defined)
+          return fail("face refers to vertex " + std::to_string(id) +
+                      ", which is not defined");
+        polygon.push_back(static_cast<uint32_t>(first_vertex + local));
+      }
+      if (polygon.size() < 3)
+        return fail("face with fewer than 3 vertices");
+      for (size_t k = 1; k + 1 < polygon.size(); ++k)
+        mesh.indices.insert(mesh.indices.end(),
+                            {polygon[0], polygon[k], polygon[k + 1]});
+    }
+  }
+  if (reader.failed()) {
+    error = "error reading " + path;
+    return false;
+  }
+  return true;
+}
+
+enum class PlyType { INT8, UINT8, INT16, UINT16, INT32, UINT32, FLOAT32,
+                     FLOAT64 };
+
+bool parse_ply_type(std::string_view name, PlyType &type) {
+  static const struct {
+    const char *name;
+    PlyType type;
+  } names[] = {{"char", PlyType::INT8},       {"int8", PlyType::INT8},
+               {"uchar", PlyType::UINT8},     {"uint8", PlyType::UINT8},
+               {"short", PlyType::INT16},     {"int16", PlyType::INT16},
+               {"ushort", PlyType::UINT16},   {"uint16", PlyType::UINT16},
+               {"int", PlyType::INT32},       {"int32", PlyType::INT32},
+               {"uint", PlyType::UINT32},     {"uint32", PlyType::UINT32},
+               {"float", PlyType::FLOAT32},   {"float32", PlyType::FLOAT32},
+               {"double", PlyType::FLOAT64},  {"float64", PlyType::FLOAT64}};
+  for (const auto &entry : names) {
+    if (name == entry.name) {
+      type = entry.type;
+      return true;
+    }
+  }
+  return false;
+}
+
+size_t ply_size(PlyType type) {
+  switch (type) {
+  case PlyType::INT8:
+  case PlyType::UINT8:
+    return 1;
+  case PlyType::INT16:
+  case PlyType::UINT16:
+    return 2;
+  case PlyType::INT32:
+  case PlyType::UINT32:
+  case PlyType::FLOAT32:
+    return 4;
+  case PlyType::FLOAT64:
+    return 8;
+  }
+  return 0;
+}
+
+struct PlyProperty {
+  std::string name;
+  PlyType type = PlyType::FLOAT32; ///< Value type (of the items for lists)
+  bool list = false;
+  PlyType count_type = PlyType::UINT8; ///< Type of a list's length
+};
+
+struct PlyElement {
+  std::string name;
+  uint64_t count = 0;
+  std::vector<PlyProperty> properties;
+};
+
+/// Values of the PLY body, one at a time, from text or binary records
+class PlyValues {
+public:
+  PlyValues(StreamReader &reader, bool ascii, bool swap)
+      : reader(reader), ascii(ascii), swap(swap) {}
+
+  bool next(PlyType type, double &value) {
+    if (ascii) {
+      p = skip_space(p);
+      while (*p == '\0') {
+        char *text;
+        if (!reader.line(text))
+          return false;
+        p = skip_space(text);
+      }
+      char *stop;
+      value = std::strtod(p, &stop);
+      if (stop == p || (*stop && !is_space(*stop)))
+        return false;
+      p = stop;
+      return true;
+    }
+
+    unsigned char bytes[8];
+    const size_t size = ply_size(type);
+    if (!reader.bytes(bytes, size))
+      return false;
+    if (swap)
+      for (size_t i = 0; i < size / 2; ++i)
+        std::swap(bytes[i], bytes[size - 1 - i]);
+    switch (type) {
+    case PlyType::INT8: value = load<int8_t>(bytes); break;
+    case PlyType::UINT8: value = load<uint8_t>(bytes); break;
+    case PlyType::INT16: value = load<int16_t>(bytes); break;
+    case PlyType::UINT16: value = load<uint16_t>(bytes); break;
+    case PlyType::INT32: value = load<int32_t>(bytes); break;
+    case PlyType::UINT32: value = load<uint32_t>(bytes); break;
+    case PlyType::FLOAT32: value = load<float>(bytes); break;
+    case PlyType::FLOAT64: value = load<double>(bytes); break;
+    }
+    return true;
+  }
+
+private:
+  template <typename T> static double load(const unsigned char *bytes) {
+    T v;
+    std::memcpy(&v, bytes, sizeof(T));
+    return static_cast<double>(v);
+  }
+
+  StreamReader &reader;
+  bool ascii, swap;
+  const char *p = "";
+};
+
+bool read_ply(StreamReader &reader, const std::string &path,
+              TriangleMesh &mesh, std::string &error) {
+  auto fail = [&](const std::string &message) {
+    error = path + ": " + message;
+    return false;
+  };
+
+  // Header
+  char *text;
+  if (!reader.line(text) || std::string_view(skip_space(text)) != "ply")
+    return fail("not a PLY file");
+  std::string format;
+  std::vector<PlyElement> elements;
+  while (true) {
+    if (!reader.line(text))
+      return fail("header ends before end_header");
+    const char *p = text;
+    std::string_view keyword = next_word(p);
+    if (keyword == "end_header") {
+      break;
+    } else if (keyword == "format") {
+      format = std::string(next_word(p));
+    } else if (keyword == "element") {
+      PlyElement element;
+      element.name = std::string(next_word(p));
+      char *stop;
+      p = skip_space(p);
+      element.count = std::strtoull(p, &stop, 10);
+      if (element.name.empty() || stop == p)
+        return fail("expected: element <name> <count>");
+      elements.push_back(element);
+    } else if (keyword == "property") {
+      if (elements.empty())
+        return fail("property before the first element");
+      PlyProperty property;
+      std::string_view type = next_word(p);
+      if (type == "list") {
+        property.list = true;
+        if (!parse_ply_type(next_word(p), property.count_type) ||
+            !parse_ply_type(next_word(p), property.type))
+          return fail("unknown list property type");
+      } else if (!parse_ply_type(type, property.type)) {
+        return fail("unknown property type '" + std::string(type) + "'");
+      }
+      property.name = std::string(next_word(p));
+      elements.back().properties.push_back(property);
+    }
+    // comment, obj_info and unknown header lines are skipped
+  }
+
+  const bool ascii = format == "ascii";
+  if (!ascii && format != "binary_little_endian" &&
+      format != "binary_big_endian")
+    return fail("unsupported PLY format '" + format + "'");
+  const uint16_t probe = 1;
+  unsigned char first_byte;
+  std::memcpy(&first_byte, &probe, 1);
+  const bool little_endian_host = first_byte == 1;
+  const bool swap = !ascii && (format == "binary_little_endian") !=
+                                  little_endian_host;
+  PlyValues values(reader, ascii, swap);
+
+  // The vertex count is known from the header, so faces may come first
+  const size_t first_vertex = mesh.vertices.size();
+  uint64_t vertex_count = 0;
+  for (const PlyElement &element : elements)
+    if (element.name == "vertex")
+      vertex_count = element.count;
+  if (first_vertex + vertex_count > std::numeric_limits<uint32_t>::max())
+    return fail("too many vertices");
+
+  std::vector<uint32_t> polygon;
+  for (const PlyElement &element : elements) {
+    const bool is_vertex = element.name == "vertex";
+    const bool is_face = element.name == "face";
+    int coordinate[3] = {-1, -1, -1}; // Property of x, y and z
+    int corner_list = -1;             // Property of the face's vertex ids
+    for (size_t i = 0; i < element.properties.size(); ++i) {
+      const PlyProperty &property = element.properties[i];
+      if (is_vertex && !property.list && property.name.size() == 1 &&
+          property.name[0] >= 'x' && property.name[0] <= 'z')
+        coordinate[property.name[0] - 'x'] = static_cast<int>(i);
+      if (is_face && property.list &&
+          (property.name == "vertex_indices" ||
+           property.name == "vertex_index"))
+        corner_list = static_cast<int>(i);
+    }
+    if (is_vertex &&
+        (coordinate[0] < 0 || coordinate[1] < 0 || coordinate[2] < 0))
+      return fail("vertex element without x, y and z properties");
+    if (is_face && corner_list < 0)
+      return fail("face element without a vertex_indices list");
+    if (is_vertex)
+      mesh.vertices.reserve(first_vertex + vertex_count);
+
+    for (uint64_t record = 0; record < element.count; ++record) {
+      double xyz[3] = {0.0, 0.0, 0.0};
+      polygon.clear();
+      for (size_t i = 0; i < element.properties.size(); ++i) {
+        const PlyProperty &property = element.properties[i];
+        double value;
+        if (!property.list) {
+          if (!values.next(property.type, value))
+            return fail("truncated or malformed " + element.name + " " +
+                        std::to_string(record));
+          for (int axis = 0; axis < 3; ++axis)
+            if (coordinate[axis] == static_cast<int>(i))
+              xyz[axis] = value;
+          continue;
+        }
+        double length;
+        if (!values.next(property.count_type, length) || length < 0)
+          return fail("truncated or malformed " + element.name + " " +
+                      std::to_string(record));
+        for (uint64_t k = 0; k < static_cast<uint64_t>(length); ++k) {
+          if (!values.next(property.type, value))
+            return fail("truncated or malformed " + element.name + " " +
+                        std::to_string(record));
+          if (corner_list != static_cast<int>(i))
+            continue;
+          if (!(value >= 0.0 && value < static_cast<double>(vertex_count)))
+            return fail("face " + std::to_string(record) +
+                        " refers to a vertex that is not defined");
+          polygon.push_back(
+              static_cast<uint32_t>(first_vertex + static_cast<size_t>(value)));
+        }
+      }
+
+      if (is_vertex) {
+        Point3 vertex(static_cast<float>(xyz[0]), static_cast<float>(xyz[1]),
+                      static_cast<float>(xyz[2]));
+        if (!std::isfinite(vertex.x) || !std::isfinite(vertex.y) ||
+            !std::isfinite(vertex.z))
+          return fail("vertex " + std::to_string(record) + " is not finite");
+        mesh.vertices.push_back(vertex);
+      } else if (is_face) {
+        if (polygon.size() < 3)
+          return fail("face " + std::to_string(record) +
+                      " has fewer than 3 vertices");
+        for (size_t k = 1; k + 1 < polygon.size(); ++k)
+          mesh.indices.insert(mesh.indices.end(),
+                              {polygon[0], polygon[k], polygon[k + 1]});
+      }
+    }
+  }
+  if (reader.failed()) {
+    error = "error reading " + path;
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+bool load_mesh(const std::string &path, TriangleMesh &mesh,
+               std::string &error) {
+  std::string extension = path.substr(path.find_last_of('.') + 1);
+  for (char &c : extension)
+    c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  if (extension != "obj" && extension != "ply") {
+    error = path + ": unknown mesh format (expected .obj or .ply)";
+    return false;
+  }
+  FileCloser closer{std::fopen(path.c_str(), "rb")};
+  if (!closer.file) {
+    error = "cannot open " + path;
+    return false;
+  }
+  StreamReader reader(closer.file);
+  return extension == "obj" ? read_obj(reader, path, mesh, error)
+                            : read_ply(reader, path, mesh, error);
+}
@@ -0,0 +1,230 @@
+#include "preview.h"
+#include "framebuffer.h"
+#include "ray_packet.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double ms_since(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+
+bool read_vec3(std::istringstream &line, Vec3 &v) {
+  return static_cast<bool>(line >> v.x >> v.y >> v.z) && std::isfinite(v.x) &&
+         std::isfinite(v.y) && std::isfinite(v.z);
+}
+
+bool same_point(const Point3 &a, const Point3 &b) {
+  return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+bool same_view(const SceneCamera &a, const SceneCamera &b) {
+  return same_point(a.look_from, b.look_from) &&
+         same_point(a.look_at, b.look_at) && same_point(a.vup, b.vup) &&
+         a.vfov == b.vfov;
+}
+
+/// State shared by the command thread and the render loop
+struct CommandQueue {
+  std::mutex mutex;
+  std::condition_variable wake;
+  SceneCamera view;                ///< Latest placement asked for
+  Clock::time_point updated_at;    ///< When view was received
+  bool updated = false;            ///< view has not been picked up yet
+  bool closed = false;             ///< The input has ended
+  bool quit = false;               ///< A quit command was received
+  std::atomic<bool> cancel{false}; ///< Stop the render in flight
+};
+
+} // namespace
+
+bool parse_preview_command(const std::string &text, SceneCamera &view,
+                           bool &quit, std::string &error) {
+  std::istringstream line(text.substr(0, text.find('#')));
+  std::string keyword;
+  if (!(line >> keyword))
+    return true;
+
+  if (keyword == "camera") {
+    SceneCamera next = view;
+    if (!read_vec3(line, next.look_from) || !read_vec3(line, next.look_at) ||
+        !(line >> next.vfov) || !(next.vfov > 0.0f && next.vfov < 180.0f)) {
+      error = "expected: camera <look_from> <look_at> <vfov>";
+      return false;
+    }
+    view = next;
+  } else if (keyword == "quit") {
+    quit = true;
+  } else {
+    error = "unknown command: " + keyword;
+    return false;
+  }
+  std::string extra;
+  if (line >> extra) {
+    error = "unexpected \"" + extra + "\" after " + keyword;
+    return false;
+  }
+  return true;
+}
+
+PreviewReport run_preview(const Scene &scene, const SceneCamera &view,
+                          const RenderSettings &settings,
+                          std::istream &commands,
+                          const PreviewCallback &on_image, ThreadPool &pool) {
+  PreviewReport report;
+  CommandQueue queue;
+  queue.view = view;
+
+  std::thread reader([&]() {
+    SceneCamera requested = view;
+    std::string text;
+    size_t line_number = 0;
+    while (std::getline(commands, text)) {
+      ++line_number;
+      SceneCamera next = requested;
+      bool quit = false;
+      std::string error;
+      if (!parse_preview_command(text, next, quit, error)) {
+        std::cerr << "Preview command " << line_number << ": " << error
+                  << "\n";
+        continue;
+      }
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (quit) {
+        queue.quit = true;
+        queue.cancel = true;
+        queue.wake.notify_one();
+        return;
+      }
+      if (same_view(next, requested))
+        continue;
+      requested = next;
+      queue.view = next;
+      queue.updated_at = Clock::now();
+      queue.updated = true;
+      queue.cancel = true;
+      queue.wake.notify_one();
+    }
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.closed = true;
+    queue.wake.notify_one();
+  });
+
+  const int width = std::max(1, settings.image_width);
+  const int height = std::max(1, settings.image_height);
+  const float aspect_ratio = static_cast<float>(width) / height;
+  const size_t level_count = std::size(PREVIEW_SCALES);
+
+  // Every level keeps its framebuffer across updates; the coarse levels
+  // use proportionally smaller tiles so they still split over the threads
+  // and can be cancelled as quickly
+  std::vector<Framebuffer> levels;
+  for (int scale : PREVIEW_SCALES)
+    levels.emplace_back(std::max(1, (width + scale - 1) / scale),
+                        std::max(1, (height + scale - 1) / scale),
+                        std::max(PACKET_EDGE, settings.tile_size / scale),
+                        settings.framebuffer, &pool);
+  Framebuffer full(width, height, settings.tile_size, settings.framebuffer,
+                   &pool);
+
+  RenderSettings base = settings;
+  base.progressive = false;
+  base.adaptive = false;
+  base.quiet = true;
+  base.tile_ids.clear();
+  base.cancel = &queue.cancel;
+  const int budget = std::max(1, settings.samples_per_pixel);
+  const int pass_samples = std::max(1, settings.pass_samples);
+
+  SceneCamera current = view;
+  Clock::time_point updated_at = Clock::now();
+  bool first_image = true; // The next image is the first of its view
+  size_t stage = 0;        // Level being rendered; level_count = full
+  int full_samples = 0;    // Samples per pixel in full
+  PreviewImage image;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(queue.mutex);
+      const bool refined = stage == level_count && full_samples >= budget;
+      if (refined)
+        queue.wake.wait(lock, [&]() {
+          return queue.quit || queue.updated || queue.closed;
+        });
+      if (queue.quit || (refined && !queue.updated))
+        break;
+      if (queue.updated) {
+        current = queue.view;
+        updated_at = queue.updated_at;
+        queue.updated = false;
+        queue.cancel = false;
+        report.updates++;
+        first_image = true;
+        stage = 0;
+        full_samples = 0;
+        full.clear(&pool);
+      }
+    }
+
+    Framebuffer &target = stage < level_count ? levels[stage] : full;
+    RenderSettings stage_settings = base;
+    stage_settings.image_width = target.width();
+    stage_settings.image_height = target.height();
+    stage_settings.tile_size = target.tile_size();
+    if (stage < level_count) {
+      target.clear(&pool);
+      stage_settings.samples_per_pixel = 1;
+    } else {
+      stage_settings.samples_per_pixel =
+          std::min(pass_samples, budget - full_samples);
+    }
+
+    const Camera camera = current.make(aspect_ratio);
+    auto render_start = Clock::now();
+    RenderReport rendered =
+        render_scene(scene, camera, stage_settings, target, {}, &pool);
+    if (rendered.cancelled) {
+      report.cancelled++;
+      continue;
+    }
+
+    image.scale = stage < level_count ? PREVIEW_SCALES[stage] : 1;
+    image.width = target.width();
+    image.height = target.height();
+    image.render_ms = ms_since(render_start);
+    if (stage < level_count) {
+      image.samples_per_pixel = 1;
+      stage++;
+    } else {
+      full_samples += stage_settings.samples_per_pixel;
+      image.samples_per_pixel = full_samples;
+    }
+    image.pixels.assign(static_cast<size_t>(image.width) * image.height,
+                        Color(0.0f));
+    target.resolve(image.pixels);
+    image.latency_ms = ms_since(updated_at);
+    if (first_image)
+      report.max_latency_ms =
+          std::max(report.max_latency_ms, image.latency_ms);
+    first_image = false;
+    report.images++;
+    if (on_image)
+      on_image(image);
+  }
+
+  // The reader ends with the input, or after a quit
+  reader.join();
+  return report;
+}
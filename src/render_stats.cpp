@@ -0,0 +1,102 @@
+#include "render_stats.h"
+#include <fstream>
+#include <iomanip>
+
+const char *render_stage_name(RenderStage stage) {
+  switch (stage) {
+  case RenderStage::CAMERA:
+    return "camera";
+  case RenderStage::INTERSECT:
+    return "intersect";
+  case RenderStage::SHADE:
+    return "shade";
+  default:
+    return "write";
+  }
+}
+
+void RenderStats::merge(const RenderStats &other) {
+  camera_rays += other.camera_rays;
+  closest_queries += other.closest_queries;
+  shadow_rays += other.shadow_rays;
+  bounces += other.bounces;
+  traversal.nodes += other.traversal.nodes;
+  traversal.primitives += other.traversal.primitives;
+  for (int s = 0; s < RENDER_STAGE_COUNT; ++s)
+    stage_ms[s] += other.stage_ms[s];
+  timed = timed || other.timed;
+}
+
+double trace_clock_us() {
+  static const auto epoch = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::micro>(
+             std::chrono::steady_clock::now() - epoch)
+      .count();
+}
+
+namespace {
+
+double per(uint64_t count, uint64_t items) {
+  return items > 0 ? static_cast<double>(count) / static_cast<double>(items)
+                   : 0.0;
+}
+
+} // namespace
+
+void print_render_stats(std::ostream &out, const RenderStats &stats) {
+  const uint64_t queries = stats.closest_queries + stats.shadow_rays;
+  out << "Rays: " << stats.camera_rays << " camera, " << stats.closest_queries
+      << " closest-hit, " << stats.shadow_rays << " shadow; "
+      << per(stats.bounces, stats.camera_rays) << " bounces per path\n";
+  out << "Traversal: " << per(stats.traversal.nodes, queries)
+      << " nodes and " << per(stats.traversal.primitives, queries)
+      << " sphere tests per ray\n";
+  if (stats.timed) {
+    // Thread time: with several threads the stages add up to more than the
+    // wall-clock frame time
+    out << "Stages (thread ms):";
+    for (int s = 0; s < RENDER_STAGE_COUNT; ++s)
+      out << (s > 0 ? ", " : " ")
+          << render_stage_name(static_cast<RenderStage>(s)) << " "
+          << stats.stage_ms[s];
+    out << "\n";
+  }
+}
+
+bool write_chrome_trace(const std::string &path,
+                        const std::vector<TraceEvent> &events,
+                        const RenderStats &stats) {
+  std::ofstream out(path);
+  if (!out)
+    return false;
+  out << std::setprecision(12);
+  out << "{\n  \"traceEvents\": [\n";
+  for (size_t i = 0; i < events.size(); ++i) {
+    const TraceEvent &e = events[i];
+    // Event names are generated by the renderer and need no escaping
+    out << "    {\"name\": \"" << e.name << "\", \"ph\": \"X\", \"pid\": 0"
+        << ", \"tid\": " << e.thread << ", \"ts\": " << e.start_us
+        << ", \"dur\": " << e.duration_us;
+    if (!e.args.empty()) {
+      out << ", \"args\": {";
+      for (size_t a = 0; a < e.args.size(); ++a)
+        out << (a > 0 ? ", " : "") << "\"" << e.args[a].first
+            << "\": " << e.args[a].second;
+      out << "}";
+    }
+    out << "}" << (i + 1 < events.size() ? ",\n" : "\n");
+  }
+  out << "  ],\n  \"displayTimeUnit\": \"ms\",\n  \"otherData\": {"
+      << "\"camera_rays\": " << stats.camera_rays
+      << ", \"closest_queries\": " << stats.closest_queries
+      << ", \"shadow_rays\": " << stats.shadow_rays
+      << ", \"bounces\": " << stats.bounces
+      << ", \"bvh_nodes\": " << stats.traversal.nodes
+      << ", \"sphere_tests\": " << stats.traversal.primitives;
+  if (stats.timed)
+    for (int s = 0; s < RENDER_STAGE_COUNT; ++s)
+      out << ", \"" << render_stage_name(static_cast<RenderStage>(s))
+          << "_ms\": " << stats.stage_ms[s];
+  out << "}\n}\n";
+  return static_cast<bool>(out);
+}
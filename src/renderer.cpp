@@ -0,0 +1,850 @@
+#include "renderer.h"
+#include "aligned_allocator.h"
+#include "kestrel.h"
+#include "light_selection.h"
+#include "wavefront.h"
+#ifdef KESTREL_CUDA
+#include "cuda_renderer.h"
+#endif
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <numeric>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+namespace {
+
+// Unweighted contribution of one light, with soft shadow sampling
+Color light_contribution(const Light &scene_light, const HitRecord &rec,
+                         const Scene &scene, Sampler &sampler,
+                         RenderStats *stats) {
+  // Stratified samples across the light surface (a single one at the
+  // position for point lights), each shaded as a point emitter with its
+  // own cosine and distance falloff
+  const int samples = scene_light.sample_count();
+  float shift_u = 0.0f, shift_v = 0.0f;
+  if (scene_light.shape != LightShape::POINT) {
+    shift_u = sampler.next_1d();
+    shift_v = sampler.next_1d();
+  }
+  Color total(0.0f);
+  TraversalStats *traversal = stats ? &stats->traversal : nullptr;
+  Vec3 shadow_origin = rec.point + rec.normal * 0.001f;
+  for (int i = 0; i < samples; ++i) {
+    Vec3 light_sample_pos =
+        scene_light.sample_point(rec.point, i, shift_u, shift_v);
+    Vec3 sample_dir = (light_sample_pos - rec.point).normalized();
+
+    // Samples behind the surface contribute nothing: skip their shadow rays
+    float cos_theta = std::max(0.0f, Vec3::dot(rec.normal, sample_dir));
+    if (cos_theta <= 0.0f)
+      continue;
+
+    // The shadow ray runs from the offset origin to the sample itself: the
+    // same segment the packet engine walks back from a point light
+    float light_distance = (light_sample_pos - rec.point).length();
+    Vec3 to_light = light_sample_pos - shadow_origin;
+    float shadow_length = to_light.length();
+    if (stats)
+      stats->shadow_rays++;
+    if (!scene.occluded(Ray(shadow_origin, to_light / shadow_length), 0.001f,
+                        shadow_length - 0.001f, traversal)) {
+      total += scene.materials.color(rec.material) * cos_theta *
+               scene_light.get_intensity() /
+               (light_distance * light_distance + 1e-4f); // Avoid 1/0
+    }
+  }
+  return total / static_cast<float>(samples);
+}
+
+} // namespace
+
+Color direct_lighting(const HitRecord &rec, const Scene &scene,
+                      Sampler &sampler, int light_samples,
+                      RenderStats *stats) {
+  Color final_color = Color(0, 0, 0);
+
+  if (light_samples > 0) {
+    // Shade only a few lights, picked by estimated contribution
+    SelectedLight selected[MAX_SELECTED_LIGHTS];
+    int count = select_lights(scene.lights, rec.point, rec.normal,
+                              light_samples, sampler, selected);
+    for (int s = 0; s < count; ++s)
+      final_color += light_contribution(scene.lights[selected[s].index], rec,
+                                        scene, sampler, stats) *
+                     selected[s].weight;
+    return final_color;
+  }
+
+  for (const auto &scene_light : scene.lights)
+    final_color += light_contribution(scene_light, rec, scene, sampler, stats);
+  return final_color;
+}
+
+bool survives_roulette(Color &throughput, int bounce, Sampler &sampler) {
+  // Once past the first bounces, paths with little throughput left survive
+  // with probability proportional to it and are reweighted so the estimate
+  // stays unbiased
+  if (bounce < RUSSIAN_ROULETTE_DEPTH) {
+    return true;
+  }
+  float max_throughput =
+      std::max(throughput.x, std::max(throughput.y, throughput.z));
+  if (max_throughput >= RUSSIAN_ROULETTE_THRESHOLD) {
+    return true;
+  }
+  float survive = max_throughput / RUSSIAN_ROULETTE_THRESHOLD;
+  if (sampler.next_1d() >= survive) {
+    return false;
+  }
+  throughput *= 1.0f / survive;
+  return true;
+}
+
+bool shade_hit(PathState &path, const HitRecord &rec, const Scene &scene,
+               Sampler &sampler, int light_samples, RenderStats *stats) {
+  const float reflectivity = scene.materials.reflectivity(rec.material);
+  sampler.start_bounce(path.bounce);
+  if (stats)
+    stats->bounces++;
+
+  // Direct lighting, weighted by the non-reflective part of the surface
+  path.radiance +=
+      path.throughput *
+      direct_lighting(rec, scene, sampler, light_samples, stats) *
+      (1.0f - reflectivity);
+  return reflect_path(path, rec, scene, sampler);
+}
+
+bool reflect_path(PathState &path, const HitRecord &rec, const Scene &scene,
+                  Sampler &sampler) {
+  const float reflectivity = scene.materials.reflectivity(rec.material);
+  path.bounce++;
+
+  // Continue along the mirror direction if the material is reflective
+  if (reflectivity <= 0.0f) {
+    return false;
+  }
+  path.throughput = path.throughput *
+                    (reflectivity * scene.materials.color(rec.material));
+
+  if (!survives_roulette(path.throughput, path.bounce, sampler)) {
+    return false;
+  }
+
+  Vec3 incident_dir = path.ray.direction.normalized();
+  Vec3 reflected_dir =
+      incident_dir - 2.0f * Vec3::dot(incident_dir, rec.normal) * rec.normal;
+  path.ray = Ray(rec.point + rec.normal * 0.001f, reflected_dir);
+  return true;
+}
+
+void trace_path(PathState &path, const Scene &scene, Sampler &sampler,
+                int depth, int light_samples, RenderStats *stats) {
+  TraversalStats *traversal = stats ? &stats->traversal : nullptr;
+
+  while (path.bounce < depth) {
+    HitRecord rec;
+    bool hit;
+    {
+      ScopedTimer timer(stats, RenderStage::INTERSECT);
+      if (stats)
+        stats->closest_queries++;
+      hit = scene.hit(path.ray, 0.001f, 1000.0f, rec, traversal);
+    }
+    if (!hit) {
+      break; // Background sky color is black
+    }
+    ScopedTimer timer(stats, RenderStage::SHADE);
+    if (!shade_hit(path, rec, scene, sampler, light_samples, stats)) {
+      break;
+    }
+  }
+}
+
+Color ray_color(const Ray &ray, const Scene &scene, Sampler &sampler,
+                int depth, int light_samples, RenderStats *stats) {
+  PathState path(ray);
+  trace_path(path, scene, sampler, depth, light_samples, stats);
+  return path.radiance;
+}
+
+void packet_color(const RayPacket &packet, const PixelSample *samples,
+                  const Scene &scene, Sampler &sampler, Color *radiance,
+                  int depth, int light_samples, RenderStats *stats) {
+  TraversalStats *traversal = stats ? &stats->traversal : nullptr;
+  std::fill(radiance, radiance + packet.count, Color(0.0f));
+  if (depth <= 0)
+    return;
+
+  HitRecord recs[RayPacket::MAX_RAYS];
+  bool hits[RayPacket::MAX_RAYS];
+  {
+    ScopedTimer timer(stats, RenderStage::INTERSECT);
+    if (stats)
+      stats->closest_queries += packet.count;
+    if (scene.hit_packet(packet, 0.001f, 1000.0f, recs, hits, traversal) ==
+        0)
+      return;
+  }
+
+  // Mirror paths leave the packet after the first hit and go on alone
+  Ray next_ray[RayPacket::MAX_RAYS];
+  Color next_throughput[RayPacket::MAX_RAYS];
+  bool continues[RayPacket::MAX_RAYS] = {};
+  {
+    ScopedTimer timer(stats, RenderStage::SHADE);
+    // When every light is shaded, the point lights get packets of shadow
+    // rays below; everything else is shaded per ray as in shade_hit
+    const bool packet_shadows = light_samples == 0;
+    for (int r = 0; r < packet.count; ++r) {
+      if (!hits[r])
+        continue;
+      const HitRecord &rec = recs[r];
+      const float diffuse = 1.0f - scene.materials.reflectivity(rec.material);
+      sampler.start_pixel_sample(samples[r]);
+      sampler.start_bounce(0);
+      if (stats)
+        stats->bounces++;
+
+      PathState path(packet.ray(r));
+      if (!packet_shadows) {
+        path.radiance +=
+            direct_lighting(rec, scene, sampler, light_samples, stats) *
+            diffuse;
+      } else {
+        for (const Light &scene_light : scene.lights)
+          if (scene_light.shape != LightShape::POINT)
+            path.radiance += light_contribution(scene_light, rec, scene,
+                                                sampler, stats) *
+                             diffuse;
+      }
+      radiance[r] = path.radiance;
+      if (reflect_path(path, rec, scene, sampler)) {
+        continues[r] = true;
+        next_ray[r] = path.ray;
+        next_throughput[r] = path.throughput;
+      }
+    }
+
+    // Shadow rays towards a point light all end at it: walk each one back
+    // from the light, so the packet shares its origin
+    for (const Light &scene_light : scene.lights) {
+      if (!packet_shadows || scene_light.shape != LightShape::POINT)
+        continue;
+      RayPacket shadows;
+      shadows.reset(scene_light.position);
+      float t_max[RayPacket::MAX_RAYS];
+      Color contribution[RayPacket::MAX_RAYS];
+      int ray_of[RayPacket::MAX_RAYS];
+      for (int r = 0; r < packet.count; ++r) {
+        if (!hits[r])
+          continue;
+        const HitRecord &rec = recs[r];
+        Vec3 light_dir = (scene_light.position - rec.point).normalized();
+        float cos_theta = std::max(0.0f, Vec3::dot(rec.normal, light_dir));
+        if (cos_theta <= 0.0f)
+          continue;
+        float distance = (scene_light.position - rec.point).length();
+        Vec3 to_surface =
+            rec.point + rec.normal * 0.001f - scene_light.position;
+        float length = to_surface.length();
+        int k = shadows.add(to_surface / length);
+        t_max[k] = length - 0.001f;
+        contribution[k] = scene.materials.color(rec.material) * cos_theta *
+                          scene_light.get_intensity() *
+                          (1.0f - scene.materials.reflectivity(rec.material)) /
+                          (distance * distance + 1e-4f);
+        ray_of[k] = r;
+      }
+      if (shadows.count == 0)
+        continue;
+      if (stats)
+        stats->shadow_rays += shadows.count;
+      bool blocked[RayPacket::MAX_RAYS];
+      scene.occluded_packet(shadows, 0.001f, t_max, blocked, traversal);
+      for (int k = 0; k < shadows.count; ++k)
+        if (!blocked[k])
+          radiance[ray_of[k]] += contribution[k];
+    }
+  }
+
+  for (int r = 0; r < packet.count; ++r) {
+    if (!continues[r])
+      continue;
+    sampler.start_pixel_sample(samples[r]);
+    PathState path(next_ray[r]);
+    path.throughput = next_throughput[r];
+    path.bounce = 1;
+    trace_path(path, scene, sampler, depth, light_samples, stats);
+    radiance[r] += path.radiance;
+  }
+}
+
+bool parse_render_engine(const std::string &name, RenderEngine &engine) {
+  if (name == "path") {
+    engine = RenderEngine::PATH;
+  } else if (name == "wavefront") {
+    engine = RenderEngine::WAVEFRONT;
+  } else if (name == "packet") {
+    engine = RenderEngine::PACKET;
+#ifdef KESTREL_CUDA
+  } else if (name == "cuda") {
+    engine = RenderEngine::CUDA;
+#endif
+  } else {
+    return false;
+  }
+  return true;
+}
+
+const char *render_engine_name(RenderEngine engine) {
+  switch (engine) {
+  case RenderEngine::WAVEFRONT:
+    return "wavefront";
+  case RenderEngine::PACKET:
+    return "packet";
+  case RenderEngine::CUDA:
+    return "cuda";
+  default:
+    return "path";
+  }
+}
+
+namespace {
+
+/// Samples each adaptive pass adds to every pixel that is still noisy
+constexpr int ADAPTIVE_PASS_SAMPLES = 4;
+
+/// Welford mean/variance of a pixel's display luminance over the samples of
+/// one render, for adaptive sampling
+struct PixelStatistics {
+  float mean = 0.0f;
+  float m2 = 0.0f;
+  int count = 0;
+  bool active = true;
+
+  void add(const Color &c) {
+    float lum = 0.2126f * std::min(std::max(c.x, 0.0f), 1.0f) +
+                0.7152f * std::min(std::max(c.y, 0.0f), 1.0f) +
+                0.0722f * std::min(std::max(c.z, 0.0f), 1.0f);
+    count++;
+    float delta = lum - mean;
+    mean += delta / count;
+    m2 += delta * (lum - mean);
+  }
+
+  bool converged(float threshold) const {
+    if (count < 2)
+      return false;
+    float variance = m2 / (count - 1);
+    float std_error = std::sqrt(variance / count);
+    return std_error <= threshold * std::max(mean, 0.01f);
+  }
+};
+
+} // namespace
+
+RenderReport render_scene(const Scene &scene, const Camera &camera,
+                          const RenderSettings &settings,
+                          std::vector<Color> &pixels,
+                          const PassCallback &on_pass, ThreadPool *pool) {
+#ifdef KESTREL_CUDA
+  if (settings.engine == RenderEngine::CUDA) {
+    RenderReport report;
+    if (render_scene_cuda(scene, camera, settings, pixels, report, on_pass))
+      return report;
+    std::cerr << "CUDA render failed, falling back to the path engine\n";
+    RenderSettings cpu_settings = settings;
+    cpu_settings.engine = RenderEngine::PATH;
+    return render_scene(scene, camera, cpu_settings, pixels, on_pass, pool);
+  }
+#endif
+
+  std::unique_ptr<ThreadPool> frame_pool;
+  if (!pool) {
+    frame_pool =
+        std::make_unique<ThreadPool>(std::max(1, settings.num_threads));
+    pool = frame_pool.get();
+  }
+  Framebuffer framebuffer(settings.image_width, settings.image_height,
+                          settings.tile_size, settings.framebuffer, pool);
+  FramebufferCallback on_framebuffer_pass;
+  if (on_pass)
+    on_framebuffer_pass = [&](int pass, const Framebuffer &accumulated) {
+      accumulated.resolve(pixels);
+      on_pass(pass, pixels);
+    };
+  RenderReport report = render_scene(scene, camera, settings, framebuffer,
+                                     on_framebuffer_pass, pool);
+  framebuffer.resolve(pixels);
+  return report;
+}
+
+RenderReport render_scene(const Scene &scene, const Camera &camera,
+                          const RenderSettings &settings,
+                          Framebuffer &framebuffer,
+                          const FramebufferCallback &on_pass,
+                          ThreadPool *pool) {
+  const int image_width = settings.image_width;
+  const int image_height = settings.image_height;
+  if (framebuffer.width() != image_width ||
+      framebuffer.height() != image_height) {
+    std::cerr << "Framebuffer is " << framebuffer.width() << "x"
+              << framebuffer.height() << ", not " << image_width << "x"
+              << image_height << "\n";
+    return RenderReport();
+  }
+#ifdef KESTREL_CUDA
+  if (settings.engine == RenderEngine::CUDA) {
+    std::cerr << "The CUDA engine renders images only, using the path "
+                 "engine\n";
+    RenderSettings cpu_settings = settings;
+    cpu_settings.engine = RenderEngine::PATH;
+    return render_scene(scene, camera, cpu_settings, framebuffer, on_pass,
+                        pool);
+  }
+#endif
+
+  const int num_threads =
+      pool ? pool->size() : std::max(1, settings.num_threads);
+  const int tile_size = settings.tile_size;
+  const int samples_per_pixel = std::max(1, settings.samples_per_pixel);
+  const size_t pixel_count = static_cast<size_t>(image_width) * image_height;
+  const int min_samples =
+      std::max(2, std::min(settings.min_samples, samples_per_pixel));
+  const int max_samples = settings.max_samples > 0 ? settings.max_samples
+                                                   : 8 * samples_per_pixel;
+
+  // Render loop
+  if (!settings.quiet)
+    std::cout << "Rendering " << image_width << "x" << image_height
+              << " image in " << tile_size << "x" << tile_size
+              << " tiles...\n";
+
+  const std::vector<Tile> frame_tiles =
+      make_tiles(image_width, image_height, tile_size);
+  const uint64_t frame_tile_count = frame_tiles.size();
+
+  // The tiles to render and their positions in the frame
+  std::vector<uint32_t> tile_ids;
+  std::vector<Tile> tiles;
+  if (settings.tile_ids.empty()) {
+    tile_ids.resize(frame_tiles.size());
+    std::iota(tile_ids.begin(), tile_ids.end(), 0U);
+    tiles = frame_tiles;
+  } else {
+    for (uint32_t id : settings.tile_ids) {
+      if (id < frame_tiles.size()) {
+        tile_ids.push_back(id);
+        tiles.push_back(frame_tiles[id]);
+      }
+    }
+  }
+
+  std::unique_ptr<ThreadPool> frame_pool;
+  if (!pool) {
+    frame_pool = std::make_unique<ThreadPool>(num_threads);
+    pool = frame_pool.get();
+  }
+
+  // Adaptive sampling tracks the noise of every pixel. First touch: every
+  // thread constructs the statistics of the tiles its TileScheduler deque
+  // starts with, so on NUMA machines their pages land on that thread's node
+  static_assert(std::is_trivially_destructible_v<PixelStatistics>,
+                "Statistics are constructed by the render threads");
+  std::vector<PixelStatistics, FirstTouchAllocator<PixelStatistics, 64>>
+      statistics(settings.adaptive ? pixel_count : 0);
+  if (settings.adaptive) {
+    pool->run([&](int thread_id) {
+      const size_t begin = tiles.size() * thread_id / num_threads;
+      const size_t end = tiles.size() * (thread_id + 1) / num_threads;
+      for (size_t t = begin; t < end; ++t)
+        for (int j = tiles[t].y0; j < tiles[t].y1; ++j)
+          for (int i = tiles[t].x0; i < tiles[t].x1; ++i)
+            new (&statistics[j * image_width + i]) PixelStatistics();
+    });
+  }
+
+  // Only pixels of the rendered tiles take samples
+  uint64_t budget = 0;
+  if (tiles.size() < frame_tiles.size()) {
+    std::vector<bool> rendered(frame_tiles.size(), false);
+    for (uint32_t id : tile_ids)
+      rendered[id] = true;
+    for (size_t t = 0; t < frame_tiles.size(); ++t) {
+      const Tile &tile = frame_tiles[t];
+      if (rendered[t]) {
+        budget += static_cast<uint64_t>(tile.x1 - tile.x0) *
+                  (tile.y1 - tile.y0) * samples_per_pixel;
+        continue;
+      }
+      for (int j = tile.y0; j < tile.y1 && settings.adaptive; ++j)
+        for (int i = tile.x0; i < tile.x1; ++i)
+          (new (&statistics[j * image_width + i]) PixelStatistics())
+              ->active = false;
+    }
+  } else {
+    budget = pixel_count * samples_per_pixel;
+  }
+
+  RenderReport report;
+  report.threads.resize(num_threads);
+
+  // Counters and trace events of each thread, merged after the frame
+  std::vector<RenderStats> thread_stats(num_threads);
+  for (RenderStats &stats : thread_stats)
+    stats.timed = settings.profile;
+  std::vector<std::vector<TraceEvent>> thread_events(num_threads);
+
+  // Same seed, one PCG32 stream per thread: independent, nothing shared.
+  // Samplers persist across passes so passes draw fresh samples; the
+  // low-discrepancy ones continue each pixel's sequence at its sample
+  // count. With tile_seeds the streams are numbered by pass and tile
+  // instead. Passes already in the framebuffer move both numberings on, so
+  // continuing an image does not repeat its samples.
+  const uint64_t first_pass = framebuffer.passes();
+  auto make_sampler = [&](uint64_t stream) {
+    Sampler sampler(0x853c49e6748fea9bULL, stream, settings.sampler);
+    sampler.set_pixel_seeds(settings.pixel_seeds);
+    sampler.set_resolution(image_width, image_height,
+                           settings.adaptive ? max_samples
+                                             : samples_per_pixel);
+    return sampler;
+  };
+  std::vector<Sampler> samplers;
+  for (int t = 0; t < num_threads; ++t)
+    samplers.push_back(make_sampler((first_pass << 32) +
+                                    static_cast<uint64_t>(t)));
+
+  // Path queues of the wavefront engine, reused by every tile of a thread
+  std::vector<Wavefront> wavefronts(
+      settings.engine == RenderEngine::WAVEFRONT ? num_threads : 0);
+
+  auto frame_start = std::chrono::steady_clock::now();
+  int taken = 0; // Samples per pixel so far, when not adaptive
+
+  auto cancelled = [&]() {
+    return settings.cancel && settings.cancel->load(std::memory_order_relaxed);
+  };
+
+  // Render one pass: every active pixel gets pass_samples more samples
+  auto render_pass = [&](int pass_samples) {
+    const double pass_start_us = settings.trace ? trace_clock_us() : 0.0;
+    TileScheduler scheduler(tiles, num_threads);
+    const int total_tiles = static_cast<int>(scheduler.size());
+    const int progress_step = std::max(1, total_tiles / 10);
+    std::atomic<int> tiles_done(0);
+    std::atomic<uint64_t> samples_taken(0);
+    const int uniform_samples = std::min(pass_samples, max_samples - taken);
+
+    // Samples a pixel takes in this pass
+    auto pixel_samples = [&](size_t index) {
+      if (!settings.adaptive)
+        return std::max(0, uniform_samples);
+      const PixelStatistics &st = statistics[index];
+      return st.active ? std::min(pass_samples, max_samples - st.count) : 0;
+    };
+
+    auto render_worker = [&](int thread_id) {
+      Sampler &sampler = samplers[thread_id];
+      ThreadTiming &timing = report.threads[thread_id];
+      RenderStats &stats = thread_stats[thread_id];
+      Wavefront *wavefront =
+          settings.engine == RenderEngine::WAVEFRONT ? &wavefronts[thread_id]
+                                                     : nullptr;
+      std::vector<uint32_t> path_pixels; // Pixel of each staged path
+      // Camera rays of the packet engine, with their pixels and samples
+      RayPacket packet;
+      uint32_t packet_pixels[RayPacket::MAX_RAYS];
+      PixelSample packet_samples[RayPacket::MAX_RAYS];
+      Color packet_radiance[RayPacket::MAX_RAYS];
+      uint64_t thread_samples = 0;
+      Tile tile;
+      bool stolen;
+      uint32_t index;
+      while (!cancelled() &&
+             scheduler.next(thread_id, tile, stolen, &index)) {
+        if (settings.tile_seeds)
+          sampler = make_sampler((first_pass + report.passes) *
+                                     frame_tile_count +
+                                 tile_ids[index]);
+        auto tile_start = std::chrono::steady_clock::now();
+        const double tile_start_us = settings.trace ? trace_clock_us() : 0.0;
+        const RenderStats tile_stats = stats;
+        const uint64_t tile_samples = thread_samples;
+
+        // Add one sample to the noise estimate of a pixel
+        auto track_sample = [&](size_t index, const Color &sample) {
+          if (settings.adaptive)
+            statistics[index].add(sample);
+        };
+        // Add the samples of this pass to a pixel and retire it once it is
+        // done
+        auto finish_pixel = [&](int x, int y, const Color &sum, int n) {
+          framebuffer.add(framebuffer.slot(x, y), sum,
+                          static_cast<uint32_t>(n));
+          if (!settings.adaptive)
+            return;
+          PixelStatistics &st =
+              statistics[static_cast<size_t>(y) * image_width + x];
+          if (st.count >= max_samples ||
+              (st.count >= min_samples &&
+               st.converged(settings.noise_threshold)))
+            st.active = false;
+        };
+
+        if (wavefront) {
+          // Stage every camera ray of the tile, trace them as one batch,
+          // then hand the results back to their pixels in order
+          wavefront->clear();
+          path_pixels.clear();
+          {
+            ScopedTimer timer(&stats, RenderStage::CAMERA);
+            for (int j = tile.y0; j < tile.y1; ++j) {
+              for (int i = tile.x0; i < tile.x1; ++i) {
+                const uint32_t first_sample =
+                    framebuffer.count(framebuffer.slot(i, j));
+                int n = pixel_samples(j * image_width + i);
+                for (int s = 0; s < n; ++s) {
+                  PixelSample sample = {static_cast<uint32_t>(i),
+                                        static_cast<uint32_t>(j),
+                                        first_sample + s};
+                  sampler.start_pixel_sample(sample);
+                  float u = (i + sampler.next_1d()) / (image_width - 1);
+                  float v = (j + sampler.next_1d()) / (image_height - 1);
+                  wavefront->add_path(camera.get_ray(u, v), sample);
+                  stats.camera_rays++;
+                  path_pixels.push_back(
+                      static_cast<uint32_t>(j * image_width + i));
+                }
+              }
+            }
+          }
+          wavefront->trace(scene, sampler, MAX_BOUNCES,
+                           settings.light_samples, &stats);
+
+          const std::vector<Color> &radiance = wavefront->radiance();
+          Color sum(0.0f);
+          int n = 0;
+          for (size_t p = 0; p < path_pixels.size(); ++p) {
+            track_sample(path_pixels[p], radiance[p]);
+            sum += radiance[p];
+            n++;
+            if (p + 1 == path_pixels.size() ||
+                path_pixels[p + 1] != path_pixels[p]) {
+              finish_pixel(path_pixels[p] % image_width,
+                           path_pixels[p] / image_width, sum, n);
+              sum = Color(0.0f);
+              n = 0;
+            }
+          }
+          thread_samples += path_pixels.size();
+        } else if (settings.engine == RenderEngine::PACKET) {
+          // One packet per block of PACKET_EDGE x PACKET_EDGE pixels and
+          // sample index, holding that sample of every pixel that takes it
+          for (int by = tile.y0; by < tile.y1; by += PACKET_EDGE) {
+            for (int bx = tile.x0; bx < tile.x1; bx += PACKET_EDGE) {
+              const int bx1 = std::min(bx + PACKET_EDGE, tile.x1);
+              const int by1 = std::min(by + PACKET_EDGE, tile.y1);
+              // Samples each pixel of the block takes in this pass, its
+              // first sample index and the sum of its new samples
+              int block_n[PACKET_EDGE][PACKET_EDGE] = {};
+              uint32_t block_first[PACKET_EDGE][PACKET_EDGE];
+              Color block_sum[PACKET_EDGE][PACKET_EDGE];
+              int block_samples = 0;
+              for (int j = by; j < by1; ++j) {
+                for (int i = bx; i < bx1; ++i) {
+                  int n = pixel_samples(j * image_width + i);
+                  block_n[j - by][i - bx] = n;
+                  block_first[j - by][i - bx] =
+                      framebuffer.count(framebuffer.slot(i, j));
+                  block_sum[j - by][i - bx] = Color(0.0f);
+                  block_samples = std::max(block_samples, n);
+                }
+              }
+
+              for (int s = 0; s < block_samples; ++s) {
+                {
+                  ScopedTimer timer(&stats, RenderStage::CAMERA);
+                  packet.reset(camera.get_ray(0.0f, 0.0f).origin);
+                  for (int j = by; j < by1; ++j) {
+                    for (int i = bx; i < bx1; ++i) {
+                      if (s >= block_n[j - by][i - bx])
+                        continue;
+                      PixelSample sample = {
+                          static_cast<uint32_t>(i), static_cast<uint32_t>(j),
+                          block_first[j - by][i - bx] + s};
+                      sampler.start_pixel_sample(sample);
+                      float u = (i + sampler.next_1d()) / (image_width - 1);
+                      float v = (j + sampler.next_1d()) / (image_height - 1);
+                      packet_pixels[packet.count] =
+                          static_cast<uint32_t>(j * image_width + i);
+                      packet_samples[packet.count] = sample;
+                      packet.add(camera.get_ray(u, v).direction);
+                      stats.camera_rays++;
+                    }
+                  }
+                }
+                packet_color(packet, packet_samples, scene, sampler,
+                             packet_radiance, MAX_BOUNCES,
+                             settings.light_samples, &stats);
+                for (int r = 0; r < packet.count; ++r) {
+                  track_sample(packet_pixels[r], packet_radiance[r]);
+                  block_sum[packet_samples[r].y - by]
+                           [packet_samples[r].x - bx] += packet_radiance[r];
+                }
+                thread_samples += packet.count;
+              }
+
+              for (int j = by; j < by1; ++j)
+                for (int i = bx; i < bx1; ++i)
+                  if (block_n[j - by][i - bx] > 0)
+                    finish_pixel(i, j, block_sum[j - by][i - bx],
+                                 block_n[j - by][i - bx]);
+            }
+          }
+        } else {
+          for (int j = tile.y0; j < tile.y1; ++j) {
+            for (int i = tile.x0; i < tile.x1; ++i) {
+              const size_t pixel = static_cast<size_t>(j) * image_width + i;
+              int n = pixel_samples(pixel);
+              if (n == 0)
+                continue;
+
+              const uint32_t first_sample =
+                  framebuffer.count(framebuffer.slot(i, j));
+              Color sum(0.0f);
+              for (int s = 0; s < n; ++s) {
+                Ray ray;
+                {
+                  ScopedTimer timer(&stats, RenderStage::CAMERA);
+                  sampler.start_pixel_sample(
+                      {static_cast<uint32_t>(i), static_cast<uint32_t>(j),
+                       first_sample + s});
+                  float u = (i + sampler.next_1d()) / (image_width - 1);
+                  float v = (j + sampler.next_1d()) / (image_height - 1);
+                  ray = camera.get_ray(u, v);
+                  stats.camera_rays++;
+                }
+                Color sample = ray_color(ray, scene, sampler, MAX_BOUNCES,
+                                         settings.light_samples, &stats);
+                track_sample(pixel, sample);
+                sum += sample;
+              }
+              thread_samples += n;
+              finish_pixel(i, j, sum, n);
+            }
+          }
+        }
+        timing.busy_ms += std::chrono::duration<double, std::milli>(
+                              std::chrono::steady_clock::now() - tile_start)
+                              .count();
+        timing.tiles++;
+        if (stolen)
+          timing.stolen++;
+
+        if (settings.trace) {
+          TraceEvent event;
+          event.name = "tile";
+          event.thread = thread_id;
+          event.start_us = tile_start_us;
+          event.duration_us = trace_clock_us() - tile_start_us;
+          event.args = {
+              {"x", tile.x0},
+              {"y", tile.y0},
+              {"samples", static_cast<double>(thread_samples - tile_samples)},
+              {"stolen", stolen ? 1.0 : 0.0},
+              {"shadow_rays", static_cast<double>(stats.shadow_rays -
+                                                  tile_stats.shadow_rays)}};
+          for (int st = 0; st < RENDER_STAGE_COUNT && stats.timed; ++st)
+            event.args.emplace_back(
+                std::string(render_stage_name(static_cast<RenderStage>(st))) +
+                    "_ms",
+                stats.stage_ms[st] - tile_stats.stage_ms[st]);
+          thread_events[thread_id].push_back(std::move(event));
+        }
+
+        int done = tiles_done.fetch_add(1) + 1;
+        if (!settings.quiet && done % progress_step == 0) {
+          std::cout << ("Tiles " + std::to_string(done) + "/" +
+                        std::to_string(total_tiles) + "\n");
+        }
+      }
+      samples_taken += thread_samples;
+    };
+
+    pool->run(render_worker);
+    report.samples += samples_taken;
+    if (cancelled()) {
+      // The samples of a cancelled pass stay in the framebuffer, but it
+      // does not count as a pass
+      report.cancelled = true;
+      return;
+    }
+    if (settings.trace) {
+      TraceEvent event;
+      event.name = "pass " + std::to_string(report.passes);
+      event.thread = -1;
+      event.start_us = pass_start_us;
+      event.duration_us = trace_clock_us() - pass_start_us;
+      event.args = {{"samples_per_pixel", static_cast<double>(pass_samples)}};
+      report.trace.push_back(std::move(event));
+    }
+    if (!settings.adaptive)
+      taken += std::max(0, uniform_samples);
+    framebuffer.add_pass();
+    if (on_pass)
+      on_pass(report.passes, framebuffer);
+    report.passes++;
+  };
+
+  if (settings.adaptive) {
+    render_pass(min_samples);
+    while (!report.cancelled && report.samples < budget) {
+      size_t active = 0;
+      for (const auto &st : statistics)
+        active += st.active;
+      if (active == 0)
+        break;
+
+      uint64_t share = (budget - report.samples) / active;
+      if (share == 0)
+        break;
+      render_pass(static_cast<int>(
+          std::min<uint64_t>(share, ADAPTIVE_PASS_SAMPLES)));
+    }
+  } else {
+    int pass_samples = settings.progressive
+                           ? std::max(1, std::min(settings.pass_samples,
+                                                  samples_per_pixel))
+                           : samples_per_pixel;
+    for (int passed = 0; passed < samples_per_pixel && !report.cancelled;) {
+      int n = std::min(pass_samples, samples_per_pixel - passed);
+      render_pass(n);
+      passed += n;
+    }
+  }
+
+  for (const auto &st : statistics)
+    report.converged_pixels += st.converged(settings.noise_threshold);
+
+  double frame_ms = std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - frame_start)
+                        .count();
+  for (auto &timing : report.threads)
+    timing.idle_ms = std::max(0.0, frame_ms - timing.busy_ms);
+  for (int t = 0; t < num_threads; ++t) {
+    report.stats.merge(thread_stats[t]);
+    report.trace.insert(report.trace.end(),
+                        std::make_move_iterator(thread_events[t].begin()),
+                        std::make_move_iterator(thread_events[t].end()));
+  }
+  return report;
+}
@@ -0,0 +1,258 @@
+#include "sampler.h"
+#include <algorithm>
+#include <array>
+
+namespace {
+
+/// Sobol dimensions with generator matrices; longer samples are padded
+/// with independently shuffled copies of this 4D sequence
+constexpr int SOBOL_DIMENSIONS = 4;
+
+/// Index bits the generator matrices cover: ZSOBOL indices carry the
+/// Morton pixel index above the sample index
+constexpr int SOBOL_INDEX_BITS = 64;
+
+/// Generator matrix columns of the first Sobol dimensions (Joe-Kuo
+/// direction numbers; dimension 0 is the van der Corput sequence), each
+/// truncated to the 32 bits of the point
+constexpr std::array<std::array<uint32_t, SOBOL_INDEX_BITS>, SOBOL_DIMENSIONS>
+make_sobol_matrices() {
+  // Degree s, coefficients a and initial direction numbers m per dimension
+  constexpr uint32_t degree[SOBOL_DIMENSIONS] = {0, 1, 2, 3};
+  constexpr uint32_t coefficients[SOBOL_DIMENSIONS] = {0, 0, 1, 1};
+  constexpr uint32_t initial[SOBOL_DIMENSIONS][3] = {
+      {0, 0, 0}, {1, 0, 0}, {1, 3, 0}, {1, 3, 1}};
+
+  std::array<std::array<uint32_t, SOBOL_INDEX_BITS>, SOBOL_DIMENSIONS>
+      matrices{};
+  for (int i = 0; i < 32; ++i)
+    matrices[0][i] = 1U << (31 - i);
+  for (int d = 1; d < SOBOL_DIMENSIONS; ++d) {
+    const uint32_t s = degree[d];
+    std::array<uint32_t, SOBOL_INDEX_BITS> &v = matrices[d];
+    for (uint32_t i = 0; i < s; ++i)
+      v[i] = initial[d][i] << (31 - i);
+    // Shifting and xor-ing only move bits down, so the truncated columns
+    // are exact
+    for (uint32_t i = s; i < SOBOL_INDEX_BITS; ++i) {
+      v[i] = v[i - s] ^ (v[i - s] >> s);
+      for (uint32_t k = 1; k < s; ++k)
+        if ((coefficients[d] >> (s - 1 - k)) & 1U)
+          v[i] ^= v[i - k];
+    }
+  }
+  return matrices;
+}
+
+/// The generator matrices applied to every value of each index byte, so a
+/// Sobol point costs one lookup per index byte instead of a pass over the
+/// index bits
+using SobolTables =
+    std::array<std::array<std::array<uint32_t, 256>, SOBOL_INDEX_BITS / 8>,
+               SOBOL_DIMENSIONS>;
+
+constexpr SobolTables make_sobol_tables() {
+  constexpr auto matrices = make_sobol_matrices();
+  SobolTables tables{};
+  for (int d = 0; d < SOBOL_DIMENSIONS; ++d)
+    for (int b = 0; b < SOBOL_INDEX_BITS / 8; ++b)
+      for (uint32_t value = 0; value < 256; ++value)
+        for (int bit = 0; bit < 8; ++bit)
+          if ((value >> bit) & 1U)
+            tables[d][b][value] ^= matrices[d][8 * b + bit];
+  return tables;
+}
+
+constexpr SobolTables SOBOL_TABLES = make_sobol_tables();
+
+/// One Halton base per dimension of a MAX_BOUNCES path (2 + 8 * 10)
+constexpr uint32_t HALTON_PRIMES[] = {
+    2,   3,   5,   7,   11,  13,  17,  19,  23,  29,  31,  37,  41,  43,
+    47,  53,  59,  61,  67,  71,  73,  79,  83,  89,  97,  101, 103, 107,
+    109, 113, 127, 131, 137, 139, 149, 151, 157, 163, 167, 173, 179, 181,
+    191, 193, 197, 199, 211, 223, 227, 229, 233, 239, 241, 251, 257, 263,
+    269, 271, 277, 281, 283, 293, 307, 311, 313, 317, 331, 337, 347, 349,
+    353, 359, 367, 373, 379, 383, 389, 397, 401, 409, 419, 421};
+constexpr uint32_t HALTON_DIMENSIONS =
+    sizeof(HALTON_PRIMES) / sizeof(HALTON_PRIMES[0]);
+
+/// The 24 permutations of a base-4 digit
+constexpr uint8_t DIGIT_PERMUTATIONS[24][4] = {
+    {0, 1, 2, 3}, {0, 1, 3, 2}, {0, 2, 1, 3}, {0, 2, 3, 1}, {0, 3, 2, 1},
+    {0, 3, 1, 2}, {1, 0, 2, 3}, {1, 0, 3, 2}, {1, 2, 0, 3}, {1, 2, 3, 0},
+    {1, 3, 2, 0}, {1, 3, 0, 2}, {2, 1, 0, 3}, {2, 1, 3, 0}, {2, 0, 1, 3},
+    {2, 0, 3, 1}, {2, 3, 0, 1}, {2, 3, 1, 0}, {3, 1, 2, 0}, {3, 1, 0, 2},
+    {3, 2, 1, 0}, {3, 2, 0, 1}, {3, 0, 2, 1}, {3, 0, 1, 2}};
+
+uint64_t mix_bits(uint64_t v) {
+  v ^= v >> 31;
+  v *= 0x7fb5d329728ea185ULL;
+  v ^= v >> 27;
+  v *= 0x81dadef4bc2dd44dULL;
+  v ^= v >> 33;
+  return v;
+}
+
+uint32_t reverse_bits(uint32_t v) {
+  v = (v << 16) | (v >> 16);
+  v = ((v & 0x00ff00ffU) << 8) | ((v & 0xff00ff00U) >> 8);
+  v = ((v & 0x0f0f0f0fU) << 4) | ((v & 0xf0f0f0f0U) >> 4);
+  v = ((v & 0x33333333U) << 2) | ((v & 0xccccccccU) >> 2);
+  v = ((v & 0x55555555U) << 1) | ((v & 0xaaaaaaaaU) >> 1);
+  return v;
+}
+
+/// Hash-based nested uniform (Owen) scrambling of a 32-bit fixed-point
+/// value: every bit is flipped depending only on the bits above it
+uint32_t owen_scramble(uint32_t v, uint32_t seed) {
+  v = reverse_bits(v);
+  v ^= v * 0x3d20adeaU;
+  v += seed;
+  v *= (seed >> 16) | 1U;
+  v ^= v * 0x05526c56U;
+  v ^= v * 0x53a22864U;
+  return reverse_bits(v);
+}
+
+uint32_t sobol(uint64_t index, int dim) {
+  const auto &table = SOBOL_TABLES[dim];
+  uint32_t v = table[0][index & 0xffU] ^ table[1][(index >> 8) & 0xffU] ^
+               table[2][(index >> 16) & 0xffU] ^
+               table[3][(index >> 24) & 0xffU];
+  // Only ZSOBOL indices of large frames reach the upper bytes
+  for (int b = 4; b < SOBOL_INDEX_BITS / 8 && (index >> (8 * b)) != 0; ++b)
+    v ^= table[b][(index >> (8 * b)) & 0xffU];
+  return v;
+}
+
+float radical_inverse(uint32_t base, uint32_t index) {
+  const double inv_base = 1.0 / base;
+  uint64_t reversed = 0;
+  double inv_base_n = 1.0;
+  while (index != 0) {
+    uint32_t next = index / base;
+    reversed = reversed * base + (index - next * base);
+    inv_base_n *= inv_base;
+    index = next;
+  }
+  return static_cast<float>(reversed * inv_base_n);
+}
+
+/// Float in [0, 1) from the top 24 bits
+float to_unit_float(uint32_t v) {
+  return static_cast<float>(v >> 8) * (1.0f / 16777216.0f);
+}
+
+uint64_t morton_2d(uint32_t x, uint32_t y) {
+  auto spread = [](uint64_t v) {
+    v &= 0xffffffffULL;
+    v = (v | (v << 16)) & 0x0000ffff0000ffffULL;
+    v = (v | (v << 8)) & 0x00ff00ff00ff00ffULL;
+    v = (v | (v << 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    v = (v | (v << 2)) & 0x3333333333333333ULL;
+    v = (v | (v << 1)) & 0x5555555555555555ULL;
+    return v;
+  };
+  return (spread(y) << 1) | spread(x);
+}
+
+int ceil_log2(int n) {
+  int log2 = 0;
+  while ((1 << log2) < n)
+    ++log2;
+  return log2;
+}
+
+} // namespace
+
+bool parse_sampler_type(const std::string &name, SamplerType &type) {
+  if (name == "random") {
+    type = SamplerType::RANDOM;
+  } else if (name == "halton") {
+    type = SamplerType::HALTON;
+  } else if (name == "sobol") {
+    type = SamplerType::SOBOL;
+  } else if (name == "zsobol") {
+    type = SamplerType::ZSOBOL;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+const char *sampler_type_name(SamplerType type) {
+  switch (type) {
+  case SamplerType::HALTON:
+    return "halton";
+  case SamplerType::SOBOL:
+    return "sobol";
+  case SamplerType::ZSOBOL:
+    return "zsobol";
+  default:
+    return "random";
+  }
+}
+
+void Sampler::set_resolution(int width, int height, int samples_per_pixel) {
+  log2_resolution = ceil_log2(std::max({width, height, 1}));
+  log2_samples = ceil_log2(std::max(samples_per_pixel, 1));
+}
+
+float Sampler::sample_dimension(uint32_t dim) const {
+  switch (type) {
+  case SamplerType::HALTON: {
+    // Cranley-Patterson rotation, different for every pixel and dimension
+    uint32_t shift = hash(pixel_seed ^ (dim * 0x9e3779b9U));
+    if (dim >= HALTON_DIMENSIONS)
+      return to_unit_float(hash(shift ^ hash(current.index)));
+    float u = radical_inverse(HALTON_PRIMES[dim], current.index) +
+              to_unit_float(shift);
+    return u >= 1.0f ? u - 1.0f : u;
+  }
+  case SamplerType::ZSOBOL: {
+    // One Sobol sequence spans the frame in Morton order, so neighbouring
+    // pixels take consecutive, complementary blocks of it. The base-4
+    // digits of the index are randomly permuted per pair of dimensions
+    // (Ahmed and Wonka 2020) to keep the pairs uncorrelated; the two
+    // dimensions of a pair are the first two Sobol dimensions.
+    if (current.index < (1U << log2_samples)) {
+      const uint32_t pair = dim / 2;
+      uint64_t morton =
+          (morton_2d(current.x, current.y) << log2_samples) | current.index;
+      const bool odd_log2 = log2_samples & 1;
+      const int digits = log2_resolution + (log2_samples + 1) / 2;
+      uint64_t index = 0;
+      for (int i = digits - 1; i >= (odd_log2 ? 1 : 0); --i) {
+        const int shift = 2 * i - (odd_log2 ? 1 : 0);
+        int digit = static_cast<int>((morton >> shift) & 3U);
+        uint64_t higher = morton >> (shift + 2);
+        int p = static_cast<int>(
+            (mix_bits(higher ^ (0x55555555ULL * pair)) >> 24) % 24);
+        index |= static_cast<uint64_t>(DIGIT_PERMUTATIONS[p][digit])
+                 << shift;
+      }
+      if (odd_log2)
+        index |= (morton & 1U) ^
+                 (mix_bits((morton >> 1) ^ (0x55555555ULL * pair)) & 1U);
+      return to_unit_float(
+          owen_scramble(sobol(index, dim % 2),
+                        hash(seed ^ dim)));
+    }
+    // Past the padded sample count: continue with the per-pixel sequence
+    [[fallthrough]];
+  }
+  case SamplerType::SOBOL: {
+    // Padded 4D Sobol (Burley 2020): each group of four dimensions uses its
+    // own Owen-scrambled sample order, so the groups are uncorrelated
+    uint32_t group_seed =
+        hash(pixel_seed ^ ((dim / SOBOL_DIMENSIONS) * 0x9e3779b9U));
+    uint32_t index = owen_scramble(current.index, group_seed);
+    int component = static_cast<int>(dim % SOBOL_DIMENSIONS);
+    return to_unit_float(owen_scramble(
+        sobol(index, component),
+        hash(group_seed + static_cast<uint32_t>(component))));
+  }
+  default:
+    return 0.0f;
+  }
+}
@@ -1,16 +1,562 @@
 #include "scene.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <utility>
 
-HOST_DEVICE bool Scene::hit(const Ray &ray, float t_min, float t_max, HitRecord &rec) const {
+void Scene::build_bvh() {
+  std::vector<AABB> bounds;
+  bounds.reserve(objects.size());
+  for (const auto &obj : objects)
+    bounds.push_back(obj.bounds());
+
+  // Leaves hold up to one SIMD batch so they cost a single kernel call
+  int lanes = sphere_kernels().lanes;
+  bvh.build(bounds, std::max(4, lanes), lanes);
+  built_sah_cost = bvh.stats().sah_cost;
+  pack_leaves();
+  build_mesh_bvhs();
+  build_instance_bvh();
+}
+
+void Scene::clear_bvh() {
+  bvh.clear();
+  packed.clear();
+  compact.clear();
+  for (TriangleMesh &mesh : meshes)
+    mesh.clear_bvh();
+  instance_bvh.clear();
+  for (GeometryBlock &block : geometries)
+    block.clear_bvh();
+}
+
+uint32_t Scene::add_mesh(TriangleMesh mesh) {
+  meshes.push_back(std::move(mesh));
+  return static_cast<uint32_t>(meshes.size() - 1);
+}
+
+size_t Scene::triangle_count() const {
+  size_t count = 0;
+  for (const TriangleMesh &mesh : meshes)
+    count += mesh.triangle_count();
+  return count;
+}
+
+void Scene::build_mesh_bvhs() {
+  for (TriangleMesh &mesh : meshes)
+    if (mesh.bvh.empty() && mesh.triangle_count() > 0)
+      mesh.build();
+}
+
+uint32_t Scene::add_geometry(GeometryBlock block) {
+  geometries.push_back(std::move(block));
+  return static_cast<uint32_t>(geometries.size() - 1);
+}
+
+bool Scene::add_instance(uint32_t geometry, const Transform &to_world,
+                         uint32_t material) {
+  Instance instance;
+  if (geometry >= geometries.size() || !to_world.invert(instance.to_object))
+    return false;
+  instance.to_world = to_world;
+  instance.geometry = geometry;
+  instance.material = material;
+  instances.push_back(instance);
+  // The top level no longer covers every instance
+  instance_bvh.clear();
+  return true;
+}
+
+size_t Scene::instanced_sphere_count() const {
+  size_t count = 0;
+  for (const Instance &instance : instances)
+    count += geometries[instance.geometry].spheres.size();
+  return count;
+}
+
+void Scene::build_instance_bvh() {
+  std::vector<AABB> block_bounds;
+  block_bounds.reserve(geometries.size());
+  for (GeometryBlock &block : geometries) {
+    if (block.bvh.empty() && !block.spheres.empty())
+      block.build();
+    block_bounds.push_back(block.bounds());
+  }
+
+  std::vector<AABB> bounds;
+  bounds.reserve(instances.size());
+  for (const Instance &instance : instances)
+    bounds.push_back(
+        instance.to_world.bounds(block_bounds[instance.geometry]));
+  instance_bvh.build(bounds);
+}
+
+bool Scene::refit_bvh(float max_sah_growth) {
+  if (bvh.empty() || bvh.prim_indices.size() != objects.size()) {
+    build_bvh();
+    return false;
+  }
+
+  std::vector<AABB> bounds;
+  bounds.reserve(objects.size());
+  for (const auto &obj : objects)
+    bounds.push_back(obj.bounds());
+  bvh.refit(bounds, sphere_kernels().lanes);
+  if (bvh.stats().sah_cost > max_sah_growth * built_sah_cost) {
+    build_bvh();
+    return false;
+  }
+  pack_leaves();
+  return true;
+}
+
+bool Scene::adopt_bvh(std::vector<BVHNode> nodes,
+                      std::vector<uint32_t> prim_indices) {
+  packed.clear();
+  compact.clear();
+  if (prim_indices.size() != objects.size()) {
+    bvh.clear();
+    return false;
+  }
+  if (!bvh.assign(std::move(nodes), std::move(prim_indices), objects.size(),
+                  sphere_kernels().lanes))
+    return false;
+  built_sah_cost = bvh.stats().sah_cost;
+  pack_leaves();
+  build_mesh_bvhs();
+  build_instance_bvh();
+  return true;
+}
+
+void Scene::interleave_memory() const {
+  auto interleave = [](const void *data, size_t bytes) {
+    interleave_pages(data, bytes);
+  };
+  interleave(objects.data(), objects.size() * sizeof(Sphere));
+  interleave(bvh.nodes.data(), bvh.nodes.size() * sizeof(BVHNode));
+  interleave(bvh.prim_indices.data(),
+             bvh.prim_indices.size() * sizeof(uint32_t));
+  packed.for_each_array(interleave);
+  compact.for_each_array(interleave);
+  for (const TriangleMesh &mesh : meshes) {
+    interleave(mesh.vertices.data(), mesh.vertices.size() * sizeof(Point3));
+    interleave(mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+    interleave(mesh.bvh.nodes.data(), mesh.bvh.nodes.size() * sizeof(BVHNode));
+    interleave(mesh.bvh.prim_indices.data(),
+               mesh.bvh.prim_indices.size() * sizeof(uint32_t));
+    mesh.packed.for_each_array(interleave);
+  }
+  interleave(instances.data(), instances.size() * sizeof(Instance));
+  interleave(instance_bvh.nodes.data(),
+             instance_bvh.nodes.size() * sizeof(BVHNode));
+  interleave(instance_bvh.prim_indices.data(),
+             instance_bvh.prim_indices.size() * sizeof(uint32_t));
+  for (const GeometryBlock &block : geometries) {
+    interleave(block.spheres.data(), block.spheres.size() * sizeof(Sphere));
+    interleave(block.bvh.nodes.data(),
+               block.bvh.nodes.size() * sizeof(BVHNode));
+    interleave(block.bvh.prim_indices.data(),
+               block.bvh.prim_indices.size() * sizeof(uint32_t));
+    block.packed.for_each_array(interleave);
+  }
+}
+
+void Scene::pack_leaves() {
+  packed.clear();
+  compact.clear();
+  if (compact_leaves && materials.size() <= CompactSphereSoA::MAX_MATERIALS)
+    compact.build(objects, bvh);
+  else
+    packed.build(objects, bvh.prim_indices);
+}
+
+HOST_DEVICE bool Scene::hit(const Ray &ray, float t_min, float t_max,
+                            HitRecord &rec, TraversalStats *stats) const {
+  bool hit_anything = hit_objects(ray, t_min, t_max, rec, stats);
+  if (meshes.empty() && instances.empty())
+    return hit_anything;
+
+  // Meshes only need to beat the closest object, instances the closest
+  // object or triangle
+  float closest = hit_anything ? rec.t : t_max;
+  const TriangleMesh *mesh = nullptr;
+  uint32_t triangle = 0;
+  hit_meshes(ray, t_min, closest, mesh, triangle, stats);
+  const Instance *instance = nullptr;
+  const Sphere *sphere = nullptr;
+  if (!instances.empty() &&
+      hit_instances(ray, t_min, closest, instance, sphere, stats)) {
+    instance->finalize(ray, *sphere, closest, rec);
+    return true;
+  }
+  if (!mesh)
+    return hit_anything;
+  mesh->finalize(ray, triangle, closest, rec);
+  return true;
+}
+
+bool Scene::hit_meshes(const Ray &ray, float t_min, float &t_max,
+                       const TriangleMesh *&mesh, uint32_t &triangle,
+                       TraversalStats *stats) const {
   bool hit_anything = false;
+  for (const TriangleMesh &candidate : meshes) {
+    if (candidate.hit(ray, t_min, t_max, triangle, stats)) {
+      mesh = &candidate;
+      hit_anything = true;
+    }
+  }
+  return hit_anything;
+}
+
+bool Scene::hit_objects(const Ray &ray, float t_min, float t_max,
+                        HitRecord &rec, TraversalStats *stats) const {
+  if (!bvh.empty()) {
+    const bool use_compact = compact.size() > 0;
+    const BVHNode *closest_leaf = nullptr;
+    int closest_slot = -1;
+    bool hit_anything = bvh.intersect(
+        ray, t_min, t_max, [&](const BVHNode &leaf, float t0, float &t1) {
+          int slot = use_compact ? compact.closest(ray, leaf, t0, t1)
+                                 : packed.closest(ray, leaf.left_first,
+                                                  leaf.prim_count, t0, t1);
+          if (slot < 0)
+            return false;
+          closest_leaf = &leaf;
+          closest_slot = slot;
+          return true;
+        },
+        stats);
+    if (!hit_anything)
+      return false;
+
+    // Only the winning sphere needs a hit point and normal
+    if (use_compact)
+      compact.sphere(*closest_leaf, closest_slot).finalize(ray, t_max, rec);
+    else
+      objects[bvh.prim_indices[closest_slot]].finalize(ray, t_max, rec);
+    return true;
+  }
+
+  // Candidates only narrow the distance; the winner gets its hit record
+  if (stats)
+    stats->primitives += objects.size();
+  const Sphere *closest = nullptr;
   float closest_so_far = t_max;
 
   for (const auto &obj : objects) {
-    if (obj.hit(ray, t_min, closest_so_far, rec)) {
+    float t;
+    if (obj.intersect(ray, t_min, closest_so_far, t)) {
+      closest = &obj;
+      closest_so_far = t;
+    }
+  }
+
+  if (!closest)
+    return false;
+  closest->finalize(ray, closest_so_far, rec);
+  return true;
+}
+
+HOST_DEVICE bool Scene::occluded(const Ray &ray, float t_min, float t_max,
+                                 TraversalStats *stats) const {
+  if (occluded_objects(ray, t_min, t_max, stats))
+    return true;
+  for (const TriangleMesh &mesh : meshes)
+    if (mesh.occluded(ray, t_min, t_max, stats))
+      return true;
+  return !instances.empty() && occluded_instances(ray, t_min, t_max, stats);
+}
+
+bool Scene::occluded_objects(const Ray &ray, float t_min, float t_max,
+                             TraversalStats *stats) const {
+  if (!bvh.empty()) {
+    const bool use_compact = compact.size() > 0;
+    return bvh.occluded(
+        ray, t_min, t_max, [&](const BVHNode &leaf, float t0, float t1) {
+          return use_compact ? compact.any(ray, leaf, t0, t1)
+                             : packed.any(ray, leaf.left_first,
+                                          leaf.prim_count, t0, t1);
+        },
+        stats);
+  }
+
+  for (size_t i = 0; i < objects.size(); ++i) {
+    if (objects[i].intersects(ray, t_min, t_max)) {
+      if (stats)
+        stats->primitives += i + 1;
+      return true;
+    }
+  }
+
+  if (stats)
+    stats->primitives += objects.size();
+  return false;
+}
+
+bool Scene::hit_instances(const Ray &ray, float t_min, float &t_max,
+                          const Instance *&instance, const Sphere *&sphere,
+                          TraversalStats *stats) const {
+  if (!instance_bvh.empty())
+    return instance_bvh.intersect(
+        ray, t_min, t_max,
+        [&](const BVHNode &leaf, float t0, float &t1) {
+          return hit_instance_leaf(ray, leaf, t0, t1, instance, sphere,
+                                   stats);
+        },
+        stats);
+
+  bool hit_anything = false;
+  for (const Instance &candidate : instances) {
+    if (geometries[candidate.geometry].hit(candidate.object_ray(ray), t_min,
+                                           t_max, sphere, stats)) {
+      instance = &candidate;
       hit_anything = true;
-      closest_so_far = rec.t;
-      rec.material = obj.material;
     }
   }
+  return hit_anything;
+}
 
+bool Scene::hit_instance_leaf(const Ray &ray, const BVHNode &leaf,
+                              float t_min, float &t_max,
+                              const Instance *&instance, const Sphere *&sphere,
+                              TraversalStats *stats) const {
+  bool hit_anything = false;
+  for (uint32_t k = leaf.left_first; k < leaf.left_first + leaf.prim_count;
+       ++k) {
+    const Instance &candidate = instances[instance_bvh.prim_indices[k]];
+    if (geometries[candidate.geometry].hit(candidate.object_ray(ray), t_min,
+                                           t_max, sphere, stats)) {
+      instance = &candidate;
+      hit_anything = true;
+    }
+  }
   return hit_anything;
-}
\ No newline at end of file
+}
+
+bool Scene::occluded_instances(const Ray &ray, float t_min, float t_max,
+                               TraversalStats *stats) const {
+  auto blocks = [&](const Instance &instance) {
+    return geometries[instance.geometry].occluded(instance.object_ray(ray),
+                                                  t_min, t_max, stats);
+  };
+  if (!instance_bvh.empty())
+    return instance_bvh.occluded(
+        ray, t_min, t_max,
+        [&](const BVHNode &leaf, float, float) {
+          for (uint32_t k = leaf.left_first;
+               k < leaf.left_first + leaf.prim_count; ++k)
+            if (blocks(instances[instance_bvh.prim_indices[k]]))
+              return true;
+          return false;
+        },
+        stats);
+
+  for (const Instance &instance : instances)
+    if (blocks(instance))
+      return true;
+  return false;
+}
+
+int Scene::hit_packet(const RayPacket &packet, float t_min, float t_max,
+                      HitRecord *recs, bool *hits,
+                      TraversalStats *stats) const {
+  if (bvh.empty()) {
+    for (int r = 0; r < packet.count; ++r)
+      hits[r] = hit_objects(packet.ray(r), t_min, t_max, recs[r], stats);
+  } else {
+    const bool use_compact = compact.size() > 0;
+    float closest_t[RayPacket::MAX_RAYS];
+    const BVHNode *closest_leaf[RayPacket::MAX_RAYS];
+    int closest_slot[RayPacket::MAX_RAYS];
+    std::fill(closest_t, closest_t + packet.count, t_max);
+    std::fill(closest_slot, closest_slot + packet.count, -1);
+    bvh.intersect_packet(
+        packet, t_min, closest_t,
+        [&](int r, const BVHNode &leaf, float t0, float &t1) {
+          const Ray ray = packet.ray(r);
+          int slot = use_compact ? compact.closest(ray, leaf, t0, t1)
+                                 : packed.closest(ray, leaf.left_first,
+                                                  leaf.prim_count, t0, t1);
+          if (slot < 0)
+            return false;
+          closest_leaf[r] = &leaf;
+          closest_slot[r] = slot;
+          return true;
+        },
+        stats);
+
+    for (int r = 0; r < packet.count; ++r) {
+      hits[r] = closest_slot[r] >= 0;
+      if (!hits[r])
+        continue;
+      if (use_compact)
+        compact.sphere(*closest_leaf[r], closest_slot[r])
+            .finalize(packet.ray(r), closest_t[r], recs[r]);
+      else
+        objects[bvh.prim_indices[closest_slot[r]]].finalize(
+            packet.ray(r), closest_t[r], recs[r]);
+    }
+  }
+
+  if (!meshes.empty()) {
+    float closest_t[RayPacket::MAX_RAYS];
+    const TriangleMesh *mesh[RayPacket::MAX_RAYS];
+    uint32_t triangle[RayPacket::MAX_RAYS];
+    for (int r = 0; r < packet.count; ++r) {
+      closest_t[r] = hits[r] ? recs[r].t : t_max;
+      mesh[r] = nullptr;
+    }
+    for (const TriangleMesh &candidate : meshes) {
+      if (candidate.bvh.empty()) {
+        for (int r = 0; r < packet.count; ++r)
+          if (candidate.hit(packet.ray(r), t_min, closest_t[r], triangle[r],
+                            stats))
+            mesh[r] = &candidate;
+        continue;
+      }
+      candidate.bvh.intersect_packet(
+          packet, t_min, closest_t,
+          [&](int r, const BVHNode &leaf, float t0, float &t1) {
+            int slot = candidate.packed.closest(
+                packet.ray(r), leaf.left_first, leaf.prim_count, t0, t1);
+            if (slot < 0)
+              return false;
+            mesh[r] = &candidate;
+            triangle[r] = candidate.bvh.prim_indices[slot];
+            return true;
+          },
+          stats);
+    }
+
+    for (int r = 0; r < packet.count; ++r) {
+      if (!mesh[r])
+        continue;
+      mesh[r]->finalize(packet.ray(r), triangle[r], closest_t[r], recs[r]);
+      hits[r] = true;
+    }
+  }
+
+  if (!instances.empty()) {
+    // The packet keeps its common origin in the object space of every
+    // instance, but each ray is mapped there on its own once it reaches a
+    // leaf of the top level
+    float closest_t[RayPacket::MAX_RAYS];
+    const Instance *instance[RayPacket::MAX_RAYS];
+    const Sphere *sphere[RayPacket::MAX_RAYS];
+    for (int r = 0; r < packet.count; ++r) {
+      closest_t[r] = hits[r] ? recs[r].t : t_max;
+      instance[r] = nullptr;
+    }
+    if (!instance_bvh.empty())
+      instance_bvh.intersect_packet(
+          packet, t_min, closest_t,
+          [&](int r, const BVHNode &leaf, float t0, float &t1) {
+            return hit_instance_leaf(packet.ray(r), leaf, t0, t1, instance[r],
+                                     sphere[r], stats);
+          },
+          stats);
+    else
+      for (int r = 0; r < packet.count; ++r)
+        hit_instances(packet.ray(r), t_min, closest_t[r], instance[r],
+                      sphere[r], stats);
+
+    for (int r = 0; r < packet.count; ++r) {
+      if (!instance[r])
+        continue;
+      instance[r]->finalize(packet.ray(r), *sphere[r], closest_t[r], recs[r]);
+      hits[r] = true;
+    }
+  }
+
+  int hit_count = 0;
+  for (int r = 0; r < packet.count; ++r)
+    hit_count += hits[r];
+  return hit_count;
+}
+
+int Scene::occluded_packet(const RayPacket &packet, float t_min,
+                           const float *t_max, bool *blocked,
+                           TraversalStats *stats) const {
+  int count = 0;
+  if (!bvh.empty()) {
+    const bool use_compact = compact.size() > 0;
+    count = bvh.occluded_packet(
+        packet, t_min, t_max, blocked,
+        [&](int r, const BVHNode &leaf, float t0, float t1) {
+          const Ray ray = packet.ray(r);
+          return use_compact ? compact.any(ray, leaf, t0, t1)
+                             : packed.any(ray, leaf.left_first,
+                                          leaf.prim_count, t0, t1);
+        },
+        stats);
+  } else {
+    for (int r = 0; r < packet.count; ++r) {
+      blocked[r] = occluded_objects(packet.ray(r), t_min, t_max[r], stats);
+      count += blocked[r];
+    }
+  }
+
+  // Every further hierarchy traces the rays that are still unblocked:
+  // blocked rays get an empty interval, so it culls them at its first box,
+  // and their flags are kept in a mask meanwhile
+  static_assert(RayPacket::MAX_RAYS <= 64, "One mask bit per ray");
+  float remaining_t[RayPacket::MAX_RAYS];
+  auto trace_level = [&](const BVH &level, auto &&occludes_leaf) {
+    uint64_t already_blocked = 0;
+    for (int r = 0; r < packet.count; ++r) {
+      remaining_t[r] = blocked[r] ? -1.0f : t_max[r];
+      already_blocked |= static_cast<uint64_t>(blocked[r]) << r;
+    }
+    level.occluded_packet(packet, t_min, remaining_t, blocked, occludes_leaf,
+                          stats);
+    count = 0;
+    for (int r = 0; r < packet.count; ++r) {
+      blocked[r] = blocked[r] || ((already_blocked >> r) & 1);
+      count += blocked[r];
+    }
+  };
+  // Levels without a hierarchy test the unblocked rays one by one
+  auto trace_rays = [&](auto &&occludes) {
+    for (int r = 0; r < packet.count; ++r)
+      if (!blocked[r] && occludes(packet.ray(r), t_max[r])) {
+        blocked[r] = true;
+        count++;
+      }
+  };
+
+  for (const TriangleMesh &mesh : meshes) {
+    if (count >= packet.count)
+      return count;
+    if (mesh.bvh.empty())
+      trace_rays([&](const Ray &ray, float t1) {
+        return mesh.occluded(ray, t_min, t1, stats);
+      });
+    else
+      trace_level(mesh.bvh,
+                  [&](int r, const BVHNode &leaf, float t0, float t1) {
+                    return mesh.packed.any(packet.ray(r), leaf.left_first,
+                                           leaf.prim_count, t0, t1);
+                  });
+  }
+  if (instances.empty() || count >= packet.count)
+    return count;
+
+  if (instance_bvh.empty()) {
+    trace_rays([&](const Ray &ray, float t1) {
+      return occluded_instances(ray, t_min, t1, stats);
+    });
+    return count;
+  }
+  trace_level(instance_bvh, [&](int r, const BVHNode &leaf, float t0,
+                                float t1) {
+    const Ray ray = packet.ray(r);
+    for (uint32_t k = leaf.left_first; k < leaf.left_first + leaf.prim_count;
+         ++k) {
+      const Instance &instance = instances[instance_bvh.prim_indices[k]];
+      if (geometries[instance.geometry].occluded(instance.object_ray(ray), t0,
+                                                 t1, stats))
+        return true;
+    }
+    return false;
+  });
+  return count;
+}
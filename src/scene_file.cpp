@@ -0,0 +1,821 @@
+#include "scene_file.h"
+#include "bsdfs/conductor.h"
+#include "bsdfs/lambertian.h"
+#include "mesh_file.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define KESTREL_HAVE_MMAP 1
+#endif
+
+namespace {
+
+constexpr char CACHE_MAGIC[8] = {'K', 'S', 'C', 'A', 'C', 'H', 'E', '\0'};
+constexpr uint32_t CACHE_VERSION = 3;
+
+/// Every array starts at a multiple of this, so mapped records are aligned
+constexpr size_t CACHE_ALIGNMENT = 64;
+
+static_assert(std::is_trivially_copyable_v<Sphere> &&
+                  std::is_trivially_copyable_v<Light> &&
+                  std::is_trivially_copyable_v<BVHNode> &&
+                  std::is_trivially_copyable_v<Instance> &&
+                  std::is_trivially_copyable_v<Point3> &&
+                  std::is_trivially_copyable_v<SceneCamera>,
+              "Cached records are stored as raw bytes");
+
+/// Cache file header; the arrays follow in this order, each aligned to
+/// CACHE_ALIGNMENT
+struct CacheHeader {
+  char magic[8];          ///< CACHE_MAGIC
+  uint32_t version;       ///< CACHE_VERSION
+  uint32_t leaf_batch;    ///< SIMD lanes the BVHs were built for (0 = none)
+  uint32_t sphere_size;   ///< Record sizes of the writer, checked on load
+  uint32_t light_size;
+  uint32_t material_size;
+  uint32_t node_size;
+  uint32_t instance_size;
+  uint32_t vertex_size;
+  uint64_t sphere_count;
+  uint64_t light_count;
+  uint64_t material_count;
+  uint64_t node_count;
+  uint64_t index_count;
+  uint64_t geometry_count;        ///< Geometry blocks
+  uint64_t geometry_sphere_count; ///< Spheres of all blocks together
+  uint64_t instance_count;
+  uint64_t mesh_count;
+  uint64_t mesh_vertex_count; ///< Vertices of all meshes together
+  uint64_t mesh_index_count;  ///< Vertex ids of all meshes together
+  uint64_t mesh_node_count;   ///< BVH nodes of all meshes together
+  uint64_t mesh_prim_count;   ///< BVH leaf slots of all meshes together
+  SceneCamera camera;
+};
+
+// Value-initialized headers are written as raw bytes, so every byte must
+// belong to a member
+static_assert(offsetof(CacheHeader, camera) + sizeof(SceneCamera) ==
+                  sizeof(CacheHeader),
+              "CacheHeader must have no padding");
+
+/// A mesh as stored in the cache; its arrays are stored back to back with
+/// those of the other meshes
+struct MeshRecord {
+  uint32_t material;
+  uint32_t reserved;
+  uint64_t vertex_count;
+  uint64_t index_count;
+  uint64_t node_count; ///< 0 if the mesh had no BVH
+};
+
+static_assert(sizeof(MeshRecord) == 4 * sizeof(uint64_t),
+              "MeshRecord must have no padding");
+
+/// A material as stored in the cache: its type tag and constructor argument
+struct MaterialRecord {
+  uint32_t type;
+  Color albedo;
+};
+
+size_t align_up(size_t offset) {
+  return (offset + CACHE_ALIGNMENT - 1) / CACHE_ALIGNMENT * CACHE_ALIGNMENT;
+}
+
+/**
+ * Read-only view of a whole file: memory-mapped where available, read into
+ * a buffer otherwise
+ */
+class MappedFile {
+public:
+  MappedFile() = default;
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  ~MappedFile() {
+#ifdef KESTREL_HAVE_MMAP
+    if (mapped)
+      munmap(mapped, length);
+#endif
+  }
+
+  bool open(const std::string &path) {
+#ifdef KESTREL_HAVE_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+      ::close(fd);
+      return false;
+    }
+    length = static_cast<size_t>(info.st_size);
+    if (length > 0) {
+      mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapped == MAP_FAILED) {
+        mapped = nullptr;
+        ::close(fd);
+        return false;
+      }
+#ifdef MADV_SEQUENTIAL
+      madvise(mapped, length, MADV_SEQUENTIAL);
+#endif
+      bytes = static_cast<const unsigned char *>(mapped);
+    }
+    ::close(fd);
+    return true;
+#else
+    FILE *file = std::fopen(path.c_str(), "rb");
+    if (!file)
+      return false;
+    unsigned char chunk[1 << 16];
+    size_t n;
+    while ((n = std::fread(chunk, 1, sizeof(chunk), file)) > 0)
+      buffer.insert(buffer.end(), chunk, chunk + n);
+    bool ok = !std::ferror(file);
+    std::fclose(file);
+    bytes = buffer.data();
+    length = buffer.size();
+    return ok;
+#endif
+  }
+
+  const unsigned char *data() const { return bytes; }
+  size_t size() const { return length; }
+
+private:
+  const unsigned char *bytes = nullptr;
+  size_t length = 0;
+#ifdef KESTREL_HAVE_MMAP
+  void *mapped = nullptr;
+#else
+  std::vector<unsigned char> buffer;
+#endif
+};
+
+/// Whitespace-separated tokens of one line of a scene file
+class LineParser {
+public:
+  LineParser(const char *begin, const char *end) : p(begin), end(end) {}
+
+  bool word(std::string_view &out) {
+    skip_space();
+    const char *start = p;
+    while (p < end && !is_space(*p))
+      ++p;
+    out = std::string_view(start, static_cast<size_t>(p - start));
+    return !out.empty();
+  }
+
+  bool number(float &out) {
+    std::string_view token;
+    if (!word(token))
+      return false;
+    // The text buffer is NUL terminated and tokens end at whitespace, so
+    // strtof cannot read past the line
+    char *stop = nullptr;
+    out = std::strtof(token.data(), &stop);
+    return stop == token.data() + token.size() && std::isfinite(out);
+  }
+
+  bool vec3(Vec3 &out) {
+    return number(out.x) && number(out.y) && number(out.z);
+  }
+
+  bool integer(int &out) {
+    std::string_view token;
+    if (!word(token))
+      return false;
+    char *stop = nullptr;
+    long value = std::strtol(token.data(), &stop, 10);
+    out = static_cast<int>(value);
+    return stop == token.data() + token.size() && value >= 0 &&
+           value <= 1 << 16;
+  }
+
+  bool at_end() {
+    skip_space();
+    return p == end;
+  }
+
+private:
+  static bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+  void skip_space() {
+    while (p < end && is_space(*p))
+      ++p;
+  }
+
+  const char *p;
+  const char *end;
+};
+
+/// How parse_transform_option() fared with an option word
+enum class OptionResult { PARSED, UNKNOWN, INVALID };
+
+/**
+ * Parse a "rotate <axis> <degrees>" or "scale <x y z>" placement option,
+ * setting the rotation or scale it describes
+ */
+OptionResult parse_transform_option(std::string_view option, LineParser &line,
+                                    Transform &rotate, Transform &scale,
+                                    std::string &message) {
+  if (option == "rotate") {
+    Vec3 axis;
+    float degrees;
+    if (!line.vec3(axis) || !line.number(degrees) ||
+        axis.length_squared() == 0.0f) {
+      message = "expected: rotate <axis x y z> <degrees>";
+      return OptionResult::INVALID;
+    }
+    rotate = Transform::rotation(axis, degrees);
+    return OptionResult::PARSED;
+  }
+  if (option == "scale") {
+    Vec3 factors;
+    if (!line.vec3(factors) || factors.x == 0.0f || factors.y == 0.0f ||
+        factors.z == 0.0f) {
+      message = "expected: scale <x y z>, all non-zero";
+      return OptionResult::INVALID;
+    }
+    scale = Transform::scaling(factors);
+    return OptionResult::PARSED;
+  }
+  return OptionResult::UNKNOWN;
+}
+
+/// Path of a file named in a scene file, relative to the scene file
+std::string resolve_path(const std::string &scene_path,
+                         std::string_view name) {
+  if (!name.empty() && name[0] == '/')
+    return std::string(name);
+  size_t slash = scene_path.find_last_of('/');
+  return slash == std::string::npos
+             ? std::string(name)
+             : scene_path.substr(0, slash + 1) + std::string(name);
+}
+
+bool parse_scene_text(const std::string &path, const std::string &text,
+                      Scene &scene, SceneCamera &camera, std::string &error) {
+  std::unordered_map<std::string_view, uint32_t> material_ids;
+  std::unordered_map<std::string_view, uint32_t> geometry_ids;
+  size_t line_number = 0;
+  // Geometry block the spheres go to until its "end" (-1 = the scene)
+  int open_block = -1;
+  std::string_view open_name;
+  size_t open_line = 0;
+  auto fail = [&](const std::string &message) {
+    error = path + ":" + std::to_string(line_number) + ": " + message;
+    return false;
+  };
+
+  // Most lines of a large scene are spheres: reserving one slot per line
+  // avoids every reallocation of the object array
+  scene.objects.reserve(
+      static_cast<size_t>(std::count(text.begin(), text.end(), '\n')) + 1);
+
+  const char *p = text.data();
+  const char *const end = p + text.size();
+  while (p < end) {
+    const char *line_end =
+        static_cast<const char *>(std::memchr(p, '\n', end - p));
+    if (!line_end)
+      line_end = end;
+    const char *comment =
+        static_cast<const char *>(std::memchr(p, '#', line_end - p));
+    LineParser line(p, comment ? comment : line_end);
+    p = line_end < end ? line_end + 1 : end;
+    ++line_number;
+
+    std::string_view keyword;
+    if (!line.word(keyword))
+      continue;
+
+    if (keyword == "sphere") {
+      Point3 center;
+      float radius;
+      std::string_view name;
+      if (!line.vec3(center) || !line.number(radius) || !line.word(name))
+        return fail("expected: sphere <x y z> <radius> <material>");
+      if (radius <= 0.0f)
+        return fail("sphere radius must be positive");
+      auto it = material_ids.find(name);
+      if (it == material_ids.end())
+        return fail("unknown material '" + std::string(name) + "'");
+      std::vector<Sphere> &spheres =
+          open_block >= 0 ? scene.geometries[open_block].spheres
+                          : scene.objects;
+      spheres.emplace_back(center, radius, it->second);
+    } else if (keyword == "geometry") {
+      std::string_view name;
+      if (!line.word(name))
+        return fail("expected: geometry <name>");
+      if (open_block >= 0)
+        return fail("geometry blocks cannot be nested");
+      if (geometry_ids.count(name))
+        return fail("geometry '" + std::string(name) + "' is already defined");
+      open_block = static_cast<int>(scene.add_geometry(GeometryBlock()));
+      geometry_ids[name] = static_cast<uint32_t>(open_block);
+      open_name = name;
+      open_line = line_number;
+    } else if (keyword == "end") {
+      if (open_block < 0)
+        return fail("'end' outside a geometry block");
+      if (scene.geometries[open_block].spheres.empty())
+        return fail("geometry '" + std::string(open_name) +
+                    "' has no spheres");
+      open_block = -1;
+    } else if (open_block >= 0 && keyword != "material") {
+      return fail("only spheres and materials can be part of a geometry "
+                  "block");
+    } else if (keyword == "instance") {
+      const char *usage = "expected: instance <geometry> <x y z> "
+                          "[rotate <axis> <degrees>] [scale <x y z>] "
+                          "[material <name>]";
+      std::string_view name, option;
+      Vec3 offset;
+      if (!line.word(name) || !line.vec3(offset))
+        return fail(usage);
+      auto geometry = geometry_ids.find(name);
+      if (geometry == geometry_ids.end())
+        return fail("unknown geometry '" + std::string(name) + "'");
+      // Scale, then rotate, then translate, whatever order they are given
+      Transform rotate, scale;
+      uint32_t material = Instance::KEEP_MATERIAL;
+      while (line.word(option)) {
+        std::string message;
+        OptionResult result =
+            parse_transform_option(option, line, rotate, scale, message);
+        if (result == OptionResult::INVALID)
+          return fail(message);
+        if (result == OptionResult::PARSED)
+          continue;
+        if (option == "material") {
+          std::string_view material_name;
+          if (!line.word(material_name))
+            return fail(usage);
+          auto it = material_ids.find(material_name);
+          if (it == material_ids.end())
+            return fail("unknown material '" + std::string(material_name) +
+                        "'");
+          material = it->second;
+        } else {
+          return fail(usage);
+        }
+      }
+      if (!scene.add_instance(
+              geometry->second,
+              scale.then(rotate).then(Transform::translation(offset)),
+              material))
+        return fail("instance transform is singular");
+    } else if (keyword == "mesh") {
+      const char *usage = "expected: mesh <file.obj|file.ply> <material> "
+                          "[rotate <axis> <degrees>] [scale <x y z>] "
+                          "[translate <x y z>]";
+      std::string_view file, material_name, option;
+      if (!line.word(file) || !line.word(material_name))
+        return fail(usage);
+      auto material = material_ids.find(material_name);
+      if (material == material_ids.end())
+        return fail("unknown material '" + std::string(material_name) + "'");
+      // Scale, then rotate, then translate, as for instances
+      Transform rotate, scale;
+      Vec3 offset(0.0f);
+      while (line.word(option)) {
+        std::string message;
+        OptionResult result =
+            parse_transform_option(option, line, rotate, scale, message);
+        if (result == OptionResult::INVALID)
+          return fail(message);
+        if (result == OptionResult::UNKNOWN &&
+            (option != "translate" || !line.vec3(offset)))
+          return fail(usage);
+      }
+
+      TriangleMesh mesh;
+      mesh.material = material->second;
+      std::string mesh_error;
+      if (!load_mesh(resolve_path(path, file), mesh, mesh_error))
+        return fail(mesh_error);
+      if (mesh.triangle_count() == 0)
+        return fail("mesh " + std::string(file) + " has no triangles");
+      const Transform to_world =
+          scale.then(rotate).then(Transform::translation(offset));
+      for (Point3 &vertex : mesh.vertices)
+        vertex = to_world.point(vertex);
+      scene.add_mesh(std::move(mesh));
+    } else if (keyword == "material") {
+      std::string_view name, type;
+      Color albedo;
+      if (!line.word(name) || !line.word(type) || !line.vec3(albedo))
+        return fail("expected: material <name> lambertian|conductor <r g b>");
+      if (material_ids.count(name))
+        return fail("material '" + std::string(name) + "' is already defined");
+      if (type == "lambertian")
+        material_ids[name] = scene.materials.add(Lambertian(albedo));
+      else if (type == "conductor")
+        material_ids[name] = scene.materials.add(Conductor(albedo));
+      else
+        return fail("unknown material type '" + std::string(type) + "'");
+    } else if (keyword == "light") {
+      std::string_view shape;
+      Point3 position;
+      Vec3 edge_u, edge_v, intensity;
+      float radius = 0.0f;
+      int samples = Light::DEFAULT_AREA_SAMPLES;
+      if (!line.word(shape))
+        return fail("expected: light point|sphere|rect ...");
+      if (shape == "point") {
+        if (!line.vec3(position) || !line.vec3(intensity))
+          return fail("expected: light point <x y z> <r g b>");
+        scene.lights.emplace_back(position, intensity);
+      } else if (shape == "sphere") {
+        if (!line.vec3(position) || !line.number(radius) ||
+            !line.vec3(intensity) ||
+            (!line.at_end() && !line.integer(samples)))
+          return fail(
+              "expected: light sphere <x y z> <radius> <r g b> [samples]");
+        scene.lights.push_back(
+            Light::sphere(position, radius, intensity, samples));
+      } else if (shape == "rect") {
+        if (!line.vec3(position) || !line.vec3(edge_u) ||
+            !line.vec3(edge_v) || !line.vec3(intensity) ||
+            (!line.at_end() && !line.integer(samples)))
+          return fail("expected: light rect <corner> <edge_u> <edge_v> "
+                      "<r g b> [samples]");
+        scene.lights.push_back(
+            Light::rect(position, edge_u, edge_v, intensity, samples));
+      } else {
+        return fail("unknown light shape '" + std::string(shape) + "'");
+      }
+    } else if (keyword == "camera") {
+      if (!line.vec3(camera.look_from) || !line.vec3(camera.look_at) ||
+          !line.vec3(camera.vup) || !line.number(camera.vfov))
+        return fail("expected: camera <look_from> <look_at> <vup> <vfov>");
+    } else {
+      return fail("unknown statement '" + std::string(keyword) + "'");
+    }
+
+    if (!line.at_end())
+      return fail("unexpected input after the " + std::string(keyword));
+  }
+  if (open_block >= 0) {
+    line_number = open_line;
+    return fail("geometry '" + std::string(open_name) +
+                "' is not closed with 'end'");
+  }
+  // Instanced scenes have far more lines than spheres
+  if (scene.objects.size() < scene.objects.capacity() / 2)
+    scene.objects.shrink_to_fit();
+  return true;
+}
+
+bool load_scene_cache(const std::string &path, const MappedFile &file,
+                      Scene &scene, SceneCamera &camera, std::string &error) {
+  const unsigned char *const bytes = file.data();
+  const size_t size = file.size();
+  CacheHeader header;
+  if (size < sizeof(header)) {
+    error = path + ": truncated scene cache";
+    return false;
+  }
+  std::memcpy(&header, bytes, sizeof(header));
+  if (header.version != CACHE_VERSION) {
+    error = path + ": scene cache version " + std::to_string(header.version) +
+            ", expected " + std::to_string(CACHE_VERSION) +
+            "; rewrite it from the scene file";
+    return false;
+  }
+  if (header.sphere_size != sizeof(Sphere) ||
+      header.light_size != sizeof(Light) ||
+      header.material_size != sizeof(MaterialRecord) ||
+      header.node_size != sizeof(BVHNode) ||
+      header.instance_size != sizeof(Instance) ||
+      header.vertex_size != sizeof(Point3)) {
+    error = path + ": scene cache written by an incompatible build";
+    return false;
+  }
+
+  // Locate each array, checking it lies inside the file
+  size_t offset = sizeof(header);
+  auto section = [&](uint64_t count, size_t record_size,
+                     const unsigned char *&data) {
+    offset = align_up(offset);
+    if (offset > size || count > (size - offset) / record_size)
+      return false;
+    data = bytes + offset;
+    offset += static_cast<size_t>(count) * record_size;
+    return true;
+  };
+  const unsigned char *spheres, *lights, *materials, *nodes, *indices;
+  const unsigned char *block_sizes, *block_spheres, *instances;
+  const unsigned char *mesh_records, *vertices, *vertex_ids, *mesh_nodes,
+      *mesh_prims;
+  if (!section(header.sphere_count, sizeof(Sphere), spheres) ||
+      !section(header.light_count, sizeof(Light), lights) ||
+      !section(header.material_count, sizeof(MaterialRecord), materials) ||
+      !section(header.node_count, sizeof(BVHNode), nodes) ||
+      !section(header.index_count, sizeof(uint32_t), indices) ||
+      !section(header.geometry_count, sizeof(uint64_t), block_sizes) ||
+      !section(header.geometry_sphere_count, sizeof(Sphere), block_spheres) ||
+      !section(header.instance_count, sizeof(Instance), instances) ||
+      !section(header.mesh_count, sizeof(MeshRecord), mesh_records) ||
+      !section(header.mesh_vertex_count, sizeof(Point3), vertices) ||
+      !section(header.mesh_index_count, sizeof(uint32_t), vertex_ids) ||
+      !section(header.mesh_node_count, sizeof(BVHNode), mesh_nodes) ||
+      !section(header.mesh_prim_count, sizeof(uint32_t), mesh_prims)) {
+    error = path + ": truncated scene cache";
+    return false;
+  }
+
+  // The mapping is page aligned and every array is CACHE_ALIGNMENT aligned,
+  // so the records can be copied straight out of it
+  const Sphere *first_sphere = reinterpret_cast<const Sphere *>(spheres);
+  scene.objects.assign(first_sphere, first_sphere + header.sphere_count);
+  const Light *first_light = reinterpret_cast<const Light *>(lights);
+  scene.lights.assign(first_light, first_light + header.light_count);
+
+  for (uint64_t m = 0; m < header.material_count; ++m) {
+    MaterialRecord record;
+    std::memcpy(&record, materials + m * sizeof(record), sizeof(record));
+    switch (static_cast<MaterialType>(record.type)) {
+    case MaterialType::LAMBERTIAN:
+      scene.materials.add(Lambertian(record.albedo));
+      break;
+    case MaterialType::CONDUCTOR:
+      scene.materials.add(Conductor(record.albedo));
+      break;
+    default:
+      error = path + ": unknown material type in scene cache";
+      return false;
+    }
+  }
+
+  // Geometry blocks are stored back to back; their BVHs are rebuilt
+  const Sphere *first_block_sphere =
+      reinterpret_cast<const Sphere *>(block_spheres);
+  uint64_t block_first = 0;
+  for (uint64_t g = 0; g < header.geometry_count; ++g) {
+    uint64_t count;
+    std::memcpy(&count, block_sizes + g * sizeof(count), sizeof(count));
+    if (count > header.geometry_sphere_count - block_first) {
+      error = path + ": invalid geometry block in scene cache";
+      return false;
+    }
+    GeometryBlock block;
+    block.spheres.assign(first_block_sphere + block_first,
+                         first_block_sphere + block_first + count);
+    block_first += count;
+    scene.add_geometry(std::move(block));
+  }
+  const Instance *first_instance =
+      reinterpret_cast<const Instance *>(instances);
+  scene.instances.assign(first_instance,
+                         first_instance + header.instance_count);
+
+  auto valid_sphere = [&](const Sphere &sphere) {
+    return sphere.material < scene.materials.size() && sphere.radius > 0.0f;
+  };
+  bool valid = block_first == header.geometry_sphere_count &&
+               std::all_of(scene.objects.begin(), scene.objects.end(),
+                           valid_sphere);
+  for (const GeometryBlock &block : scene.geometries)
+    valid = valid && std::all_of(block.spheres.begin(), block.spheres.end(),
+                                 valid_sphere);
+  for (const Instance &instance : scene.instances)
+    valid = valid && instance.geometry < scene.geometries.size() &&
+            (instance.material == Instance::KEEP_MATERIAL ||
+             instance.material < scene.materials.size());
+  if (!valid) {
+    error = path + ": invalid sphere or instance in scene cache";
+    return false;
+  }
+  // Meshes are stored back to back too; their BVHs are reused like the
+  // scene's (the triangle kernels have the sphere kernels' width)
+  const bool reuse_bvh =
+      header.leaf_batch == static_cast<uint32_t>(sphere_kernels().lanes);
+  const Point3 *first_vertex = reinterpret_cast<const Point3 *>(vertices);
+  const uint32_t *first_id = reinterpret_cast<const uint32_t *>(vertex_ids);
+  const BVHNode *first_mesh_node =
+      reinterpret_cast<const BVHNode *>(mesh_nodes);
+  const uint32_t *first_prim = reinterpret_cast<const uint32_t *>(mesh_prims);
+  uint64_t vertex_first = 0, id_first = 0, node_first = 0, prim_first = 0;
+  for (uint64_t m = 0; m < header.mesh_count; ++m) {
+    MeshRecord record;
+    std::memcpy(&record, mesh_records + m * sizeof(record), sizeof(record));
+    const uint64_t prim_count = record.node_count > 0 ? record.index_count / 3
+                                                      : 0;
+    if (record.vertex_count > header.mesh_vertex_count - vertex_first ||
+        record.index_count > header.mesh_index_count - id_first ||
+        record.node_count > header.mesh_node_count - node_first ||
+        prim_count > header.mesh_prim_count - prim_first ||
+        record.material >= scene.materials.size()) {
+      error = path + ": invalid mesh in scene cache";
+      return false;
+    }
+    TriangleMesh mesh;
+    mesh.material = record.material;
+    mesh.vertices.assign(first_vertex + vertex_first,
+                         first_vertex + vertex_first + record.vertex_count);
+    mesh.indices.assign(first_id + id_first,
+                        first_id + id_first + record.index_count);
+    if (!mesh.valid()) {
+      error = path + ": invalid mesh in scene cache";
+      return false;
+    }
+    if (record.node_count > 0 && reuse_bvh &&
+        !mesh.adopt_bvh(
+            std::vector<BVHNode>(first_mesh_node + node_first,
+                                 first_mesh_node + node_first +
+                                     record.node_count),
+            std::vector<uint32_t>(first_prim + prim_first,
+                                  first_prim + prim_first + prim_count))) {
+      error = path + ": invalid mesh BVH in scene cache";
+      return false;
+    }
+    vertex_first += record.vertex_count;
+    id_first += record.index_count;
+    node_first += record.node_count;
+    prim_first += prim_count;
+    scene.add_mesh(std::move(mesh));
+  }
+
+  for (const Light &light : scene.lights) {
+    if (static_cast<uint8_t>(light.shape) >
+        static_cast<uint8_t>(LightShape::RECT)) {
+      error = path + ": invalid light in scene cache";
+      return false;
+    }
+  }
+
+  // Reuse the BVH if its leaves were sized for the SIMD kernels in use
+  if (header.node_count > 0 && reuse_bvh) {
+    const BVHNode *first_node = reinterpret_cast<const BVHNode *>(nodes);
+    const uint32_t *first_index = reinterpret_cast<const uint32_t *>(indices);
+    if (!scene.adopt_bvh(
+            std::vector<BVHNode>(first_node, first_node + header.node_count),
+            std::vector<uint32_t>(first_index,
+                                  first_index + header.index_count))) {
+      error = path + ": invalid BVH in scene cache";
+      return false;
+    }
+  }
+
+  camera = header.camera;
+  return true;
+}
+
+} // namespace
+
+bool load_scene(const std::string &path, Scene &scene, SceneCamera &camera,
+                std::string &error) {
+  MappedFile file;
+  if (!file.open(path)) {
+    error = "cannot open " + path;
+    return false;
+  }
+
+  scene.objects.clear();
+  scene.lights.clear();
+  scene.materials.clear();
+  scene.meshes.clear();
+  scene.geometries.clear();
+  scene.instances.clear();
+  scene.clear_bvh();
+  camera = SceneCamera();
+
+  if (file.size() >= sizeof(CACHE_MAGIC) &&
+      std::memcmp(file.data(), CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0)
+    return load_scene_cache(path, file, scene, camera, error);
+
+  const std::string text(reinterpret_cast<const char *>(file.data()),
+                         file.size());
+  return parse_scene_text(path, text, scene, camera, error);
+}
+
+bool write_scene_cache(const std::string &path, const Scene &scene,
+                       const SceneCamera &camera, std::string &error) {
+  std::vector<MaterialRecord> materials(scene.materials.size());
+  for (size_t m = 0; m < materials.size(); ++m) {
+    uint32_t id = static_cast<uint32_t>(m);
+    materials[m].type = static_cast<uint32_t>(scene.materials.type(id));
+    std::visit([&](const auto &material) {
+      materials[m].albedo = material.get_albedo();
+    }, scene.materials[id]);
+  }
+
+  CacheHeader header{};
+  std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+  header.version = CACHE_VERSION;
+  const bool has_bvh =
+      !scene.bvh.empty() ||
+      std::any_of(scene.meshes.begin(), scene.meshes.end(),
+                  [](const TriangleMesh &mesh) { return !mesh.bvh.empty(); });
+  header.leaf_batch =
+      has_bvh ? static_cast<uint32_t>(sphere_kernels().lanes) : 0;
+  header.sphere_size = sizeof(Sphere);
+  header.light_size = sizeof(Light);
+  header.material_size = sizeof(MaterialRecord);
+  header.node_size = sizeof(BVHNode);
+  header.sphere_count = scene.objects.size();
+  header.light_count = scene.lights.size();
+  header.material_count = materials.size();
+  header.node_count = scene.bvh.nodes.size();
+  header.index_count = scene.bvh.prim_indices.size();
+  header.instance_size = sizeof(Instance);
+  header.vertex_size = sizeof(Point3);
+  header.geometry_count = scene.geometries.size();
+  header.instance_count = scene.instances.size();
+  header.camera = camera;
+
+  std::vector<uint64_t> block_sizes;
+  std::vector<Sphere> block_spheres;
+  for (const GeometryBlock &block : scene.geometries) {
+    block_sizes.push_back(block.spheres.size());
+    block_spheres.insert(block_spheres.end(), block.spheres.begin(),
+                         block.spheres.end());
+  }
+  header.geometry_sphere_count = block_spheres.size();
+
+  std::vector<MeshRecord> mesh_records;
+  std::vector<Point3> mesh_vertices;
+  std::vector<uint32_t> mesh_ids, mesh_prims;
+  std::vector<BVHNode> mesh_nodes;
+  for (const TriangleMesh &mesh : scene.meshes) {
+    MeshRecord record{};
+    record.material = mesh.material;
+    record.vertex_count = mesh.vertices.size();
+    record.index_count = mesh.indices.size();
+    record.node_count = mesh.bvh.nodes.size();
+    mesh_records.push_back(record);
+    mesh_vertices.insert(mesh_vertices.end(), mesh.vertices.begin(),
+                         mesh.vertices.end());
+    mesh_ids.insert(mesh_ids.end(), mesh.indices.begin(), mesh.indices.end());
+    mesh_nodes.insert(mesh_nodes.end(), mesh.bvh.nodes.begin(),
+                      mesh.bvh.nodes.end());
+    mesh_prims.insert(mesh_prims.end(), mesh.bvh.prim_indices.begin(),
+                      mesh.bvh.prim_indices.end());
+  }
+  header.mesh_count = mesh_records.size();
+  header.mesh_vertex_count = mesh_vertices.size();
+  header.mesh_index_count = mesh_ids.size();
+  header.mesh_node_count = mesh_nodes.size();
+  header.mesh_prim_count = mesh_prims.size();
+
+  FILE *file = std::fopen(path.c_str(), "wb");
+  if (!file) {
+    error = "cannot open " + path + " for writing";
+    return false;
+  }
+  size_t offset = 0;
+  auto write_section = [&](const void *data, size_t size) {
+    static const char zeros[CACHE_ALIGNMENT] = {};
+    size_t padding = align_up(offset) - offset;
+    offset += padding + size;
+    return std::fwrite(zeros, 1, padding, file) == padding &&
+           (size == 0 || std::fwrite(data, 1, size, file) == size);
+  };
+  bool ok =
+      write_section(&header, sizeof(header)) &&
+      write_section(scene.objects.data(),
+                    scene.objects.size() * sizeof(Sphere)) &&
+      write_section(scene.lights.data(), scene.lights.size() * sizeof(Light)) &&
+      write_section(materials.data(),
+                    materials.size() * sizeof(MaterialRecord)) &&
+      write_section(scene.bvh.nodes.data(),
+                    scene.bvh.nodes.size() * sizeof(BVHNode)) &&
+      write_section(scene.bvh.prim_indices.data(),
+                    scene.bvh.prim_indices.size() * sizeof(uint32_t)) &&
+      write_section(block_sizes.data(),
+                    block_sizes.size() * sizeof(uint64_t)) &&
+      write_section(block_spheres.data(),
+                    block_spheres.size() * sizeof(Sphere)) &&
+      write_section(scene.instances.data(),
+                    scene.instances.size() * sizeof(Instance)) &&
+      write_section(mesh_records.data(),
+                    mesh_records.size() * sizeof(MeshRecord)) &&
+      write_section(mesh_vertices.data(),
+                    mesh_vertices.size() * sizeof(Point3)) &&
+      write_section(mesh_ids.data(), mesh_ids.size() * sizeof(uint32_t)) &&
+      write_section(mesh_nodes.data(),
+                    mesh_nodes.size() * sizeof(BVHNode)) &&
+      write_section(mesh_prims.data(), mesh_prims.size() * sizeof(uint32_t));
+  ok = std::fclose(file) == 0 && ok;
+  if (!ok)
+    error = "failed to write " + path;
+  return ok;
+}
@@ -0,0 +1,96 @@
+#include "scheduler.h"
+#include <algorithm>
+
+namespace {
+
+// Spread the low 16 bits of v so that bit i moves to bit 2i
+uint32_t part_1by1(uint32_t v) {
+  v &= 0x0000ffff;
+  v = (v | (v << 8)) & 0x00ff00ff;
+  v = (v | (v << 4)) & 0x0f0f0f0f;
+  v = (v | (v << 2)) & 0x33333333;
+  v = (v | (v << 1)) & 0x55555555;
+  return v;
+}
+
+uint32_t morton_code(uint32_t x, uint32_t y) {
+  return part_1by1(x) | (part_1by1(y) << 1);
+}
+
+} // namespace
+
+std::vector<Tile> make_tiles(int width, int height, int tile_size) {
+  tile_size = std::max(1, tile_size);
+  int tiles_x = (width + tile_size - 1) / tile_size;
+  int tiles_y = (height + tile_size - 1) / tile_size;
+
+  std::vector<std::pair<uint32_t, Tile>> ordered;
+  ordered.reserve(static_cast<size_t>(tiles_x) * tiles_y);
+  for (int ty = 0; ty < tiles_y; ++ty) {
+    for (int tx = 0; tx < tiles_x; ++tx) {
+      Tile tile{tx * tile_size, ty * tile_size,
+                std::min(width, (tx + 1) * tile_size),
+                std::min(height, (ty + 1) * tile_size)};
+      ordered.emplace_back(morton_code(tx, ty), tile);
+    }
+  }
+
+  std::sort(ordered.begin(), ordered.end(),
+            [](const auto &a, const auto &b) { return a.first < b.first; });
+
+  std::vector<Tile> tiles;
+  tiles.reserve(ordered.size());
+  for (const auto &entry : ordered)
+    tiles.push_back(entry.second);
+  return tiles;
+}
+
+TileScheduler::TileScheduler(const std::vector<Tile> &tiles, int num_threads)
+    : tiles(tiles) {
+  num_threads = std::max(1, num_threads);
+  for (int t = 0; t < num_threads; ++t)
+    queues.push_back(std::make_unique<WorkQueue>());
+
+  size_t count = tiles.size();
+  for (int t = 0; t < num_threads; ++t) {
+    size_t begin = count * t / num_threads;
+    size_t end = count * (t + 1) / num_threads;
+    for (size_t i = begin; i < end; ++i)
+      queues[t]->tiles.push_back(static_cast<uint32_t>(i));
+  }
+}
+
+bool TileScheduler::next(int thread_id, Tile &tile, bool &stolen,
+                         uint32_t *index) {
+  int num_queues = static_cast<int>(queues.size());
+
+  // Own work first, from the front to follow the curve
+  {
+    WorkQueue &own = *queues[thread_id];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tiles.empty()) {
+      if (index)
+        *index = own.tiles.front();
+      tile = tiles[own.tiles.front()];
+      own.tiles.pop_front();
+      stolen = false;
+      return true;
+    }
+  }
+
+  // Steal from the back of the other deques, furthest from their owner
+  for (int offset = 1; offset < num_queues; ++offset) {
+    WorkQueue &victim = *queues[(thread_id + offset) % num_queues];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tiles.empty()) {
+      if (index)
+        *index = victim.tiles.back();
+      tile = tiles[victim.tiles.back()];
+      victim.tiles.pop_back();
+      stolen = true;
+      return true;
+    }
+  }
+
+  return false;
+}
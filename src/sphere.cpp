@@ -2,14 +2,28 @@
 
 HOST_DEVICE bool Sphere::hit(const Ray &ray, float t_min, float t_max,
                  HitRecord &rec) const {
+  float t;
+  if (!intersect(ray, t_min, t_max, t))
+    return false;
+
+  // Fill hit record with intersection information
+  finalize(ray, t, rec);
+  return true;
+}
+
+HOST_DEVICE bool Sphere::intersect(const Ray &ray, float t_min, float t_max,
+                                   float &t) const {
   // Solve quadratic equation for ray-sphere intersection
   Vec3 oc = ray.origin - center;
   float a = ray.direction.length_squared();
   float half_b = Vec3::dot(oc, ray.direction);
-  float c = oc.length_squared() - radius * radius;
 
-  // Check discriminant to determine if intersection exists
-  float discriminant = half_b * half_b - a * c;
+  // Check discriminant to determine if intersection exists. Measuring it from
+  // the centre to the ray's closest point, a * (r^2 - |f|^2), equals
+  // half_b^2 - a * c but avoids the cancellation in |oc|^2 - r^2 when the
+  // origin is far away relative to the radius
+  Vec3 f = oc - (half_b / a) * ray.direction;
+  float discriminant = a * (radius * radius - f.length_squared());
   if (discriminant < 0)
     return false;
 
@@ -24,11 +38,24 @@ HOST_DEVICE bool Sphere::hit(const Ray &ray, float t_min, float t_max,
       return false;
   }
 
-  // Fill hit record with intersection information
-  rec.t = root;
-  rec.point = ray.at(rec.t);
-  Vec3 outward_normal = (rec.point - center) / radius;
-  rec.set_face_normal(ray, outward_normal);
-
+  t = root;
   return true;
-}
\ No newline at end of file
+}
+
+HOST_DEVICE bool Sphere::intersects(const Ray &ray, float t_min,
+                                    float t_max) const {
+  Vec3 oc = ray.origin - center;
+  float a = ray.direction.length_squared();
+  float half_b = Vec3::dot(oc, ray.direction);
+  Vec3 f = oc - (half_b / a) * ray.direction;
+  float discriminant = a * (radius * radius - f.length_squared());
+  if (discriminant < 0)
+    return false;
+
+  float sqrtd = std::sqrt(discriminant);
+  float root = (-half_b - sqrtd) / a;
+  if (root >= t_min && root <= t_max)
+    return true;
+  root = (-half_b + sqrtd) / a;
+  return root >= t_min && root <= t_max;
+}
@@ -0,0 +1,603 @@
+#include "sphere_soa.h"
+#include "simd_targets.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+void SphereSoA::clear() {
+  cx.clear();
+  cy.clear();
+  cz.clear();
+  r2.clear();
+  count = 0;
+}
+
+void SphereSoA::build(const std::vector<Sphere> &spheres,
+                      const std::vector<uint32_t> &order) {
+  count = static_cast<uint32_t>(order.size());
+  uint32_t padded = (count + PADDING - 1) / PADDING * PADDING + PADDING;
+
+  // Padding slots are zero-radius spheres at the origin; kernels mask them
+  // out by lane index, the values only need to be finite
+  cx.assign(padded, 0.0f);
+  cy.assign(padded, 0.0f);
+  cz.assign(padded, 0.0f);
+  r2.assign(padded, 0.0f);
+
+  for (uint32_t i = 0; i < count; ++i) {
+    const Sphere &s = spheres[order[i]];
+    cx[i] = s.center.x;
+    cy[i] = s.center.y;
+    cz[i] = s.center.z;
+    r2[i] = s.radius * s.radius;
+  }
+}
+
+namespace {
+
+// Scalar reference kernel, using the same discriminant and root selection as
+// Sphere::hit
+
+int closest_scalar(const SphereBatch &s, const Ray &ray, uint32_t first,
+                   uint32_t count, float t_min, float &t_max) {
+  float a = ray.direction.length_squared();
+  float inv_a = 1.0f / a;
+  int best = -1;
+  for (uint32_t i = first; i < first + count; ++i) {
+    Vec3 oc = ray.origin - Vec3(s.cx[i], s.cy[i], s.cz[i]);
+    float half_b = Vec3::dot(oc, ray.direction);
+    Vec3 f = oc - (half_b * inv_a) * ray.direction;
+    float discriminant = a * (s.r2[i] - f.length_squared());
+    if (discriminant < 0)
+      continue;
+
+    float sqrtd = std::sqrt(discriminant);
+    float root = (-half_b - sqrtd) / a;
+    if (root < t_min || t_max < root) {
+      root = (-half_b + sqrtd) / a;
+      if (root < t_min || t_max < root)
+        continue;
+    }
+    t_max = root;
+    best = static_cast<int>(i);
+  }
+  return best;
+}
+
+bool any_scalar(const SphereBatch &s, const Ray &ray, uint32_t first,
+                uint32_t count, float t_min, float t_max) {
+  float a = ray.direction.length_squared();
+  float inv_a = 1.0f / a;
+  for (uint32_t i = first; i < first + count; ++i) {
+    Vec3 oc = ray.origin - Vec3(s.cx[i], s.cy[i], s.cz[i]);
+    float half_b = Vec3::dot(oc, ray.direction);
+    Vec3 f = oc - (half_b * inv_a) * ray.direction;
+    float discriminant = a * (s.r2[i] - f.length_squared());
+    if (discriminant < 0)
+      continue;
+
+    float sqrtd = std::sqrt(discriminant);
+    float root = (-half_b - sqrtd) / a;
+    if (root >= t_min && root <= t_max)
+      return true;
+    root = (-half_b + sqrtd) / a;
+    if (root >= t_min && root <= t_max)
+      return true;
+  }
+  return false;
+}
+
+#ifdef KESTREL_BUILD_SSE4
+
+KESTREL_TARGET_SSE4 int closest_sse4(const SphereBatch &s, const Ray &ray,
+                                     uint32_t first, uint32_t count,
+                                     float t_min, float &t_max) {
+  const __m128 ox = _mm_set1_ps(ray.origin.x);
+  const __m128 oy = _mm_set1_ps(ray.origin.y);
+  const __m128 oz = _mm_set1_ps(ray.origin.z);
+  const __m128 dx = _mm_set1_ps(ray.direction.x);
+  const __m128 dy = _mm_set1_ps(ray.direction.y);
+  const __m128 dz = _mm_set1_ps(ray.direction.z);
+  const __m128 a = _mm_set1_ps(ray.direction.length_squared());
+  const __m128 inv_a = _mm_set1_ps(1.0f / ray.direction.length_squared());
+  const __m128 tmin = _mm_set1_ps(t_min);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 sign = _mm_set1_ps(-0.0f);
+  const __m128 inf = _mm_set1_ps(std::numeric_limits<float>::infinity());
+  const __m128 lane = _mm_setr_ps(0, 1, 2, 3);
+
+  int best = -1;
+  for (uint32_t i = 0; i < count; i += 4) {
+    uint32_t base = first + i;
+    __m128 tmax = _mm_set1_ps(t_max);
+    __m128 ocx = _mm_sub_ps(ox, _mm_loadu_ps(s.cx + base));
+    __m128 ocy = _mm_sub_ps(oy, _mm_loadu_ps(s.cy + base));
+    __m128 ocz = _mm_sub_ps(oz, _mm_loadu_ps(s.cz + base));
+    __m128 half_b = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(ocx, dx), _mm_mul_ps(ocy, dy)),
+        _mm_mul_ps(ocz, dz));
+    __m128 k = _mm_mul_ps(half_b, inv_a);
+    __m128 fx = _mm_sub_ps(ocx, _mm_mul_ps(k, dx));
+    __m128 fy = _mm_sub_ps(ocy, _mm_mul_ps(k, dy));
+    __m128 fz = _mm_sub_ps(ocz, _mm_mul_ps(k, dz));
+    __m128 ff = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(fx, fx), _mm_mul_ps(fy, fy)),
+        _mm_mul_ps(fz, fz));
+    __m128 disc = _mm_mul_ps(a, _mm_sub_ps(_mm_loadu_ps(s.r2 + base), ff));
+    __m128 sqrtd = _mm_sqrt_ps(_mm_max_ps(disc, zero));
+    __m128 neg_b = _mm_xor_ps(half_b, sign);
+    __m128 root0 = _mm_div_ps(_mm_sub_ps(neg_b, sqrtd), a);
+    __m128 root1 = _mm_div_ps(_mm_add_ps(neg_b, sqrtd), a);
+
+    __m128 in0 = _mm_and_ps(_mm_cmpge_ps(root0, tmin), _mm_cmple_ps(root0, tmax));
+    __m128 in1 = _mm_and_ps(_mm_cmpge_ps(root1, tmin), _mm_cmple_ps(root1, tmax));
+    __m128 valid = _mm_and_ps(
+        _mm_and_ps(_mm_cmpge_ps(disc, zero), _mm_or_ps(in0, in1)),
+        _mm_cmplt_ps(lane, _mm_set1_ps(static_cast<float>(count - i))));
+    if (_mm_movemask_ps(valid) == 0)
+      continue;
+
+    __m128 root = _mm_blendv_ps(inf, _mm_blendv_ps(root1, root0, in0), valid);
+    __m128 m = _mm_min_ps(root, _mm_shuffle_ps(root, root, _MM_SHUFFLE(2, 3, 0, 1)));
+    m = _mm_min_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+    int mask = _mm_movemask_ps(_mm_cmpeq_ps(root, m));
+    t_max = _mm_cvtss_f32(m);
+    best = static_cast<int>(base) + __builtin_ctz(mask);
+  }
+  return best;
+}
+
+KESTREL_TARGET_SSE4 bool any_sse4(const SphereBatch &s, const Ray &ray,
+                                  uint32_t first, uint32_t count, float t_min,
+                                  float t_max) {
+  const __m128 ox = _mm_set1_ps(ray.origin.x);
+  const __m128 oy = _mm_set1_ps(ray.origin.y);
+  const __m128 oz = _mm_set1_ps(ray.origin.z);
+  const __m128 dx = _mm_set1_ps(ray.direction.x);
+  const __m128 dy = _mm_set1_ps(ray.direction.y);
+  const __m128 dz = _mm_set1_ps(ray.direction.z);
+  const __m128 a = _mm_set1_ps(ray.direction.length_squared());
+  const __m128 inv_a = _mm_set1_ps(1.0f / ray.direction.length_squared());
+  const __m128 tmin = _mm_set1_ps(t_min);
+  const __m128 tmax = _mm_set1_ps(t_max);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 sign = _mm_set1_ps(-0.0f);
+  const __m128 lane = _mm_setr_ps(0, 1, 2, 3);
+
+  for (uint32_t i = 0; i < count; i += 4) {
+    uint32_t base = first + i;
+    __m128 ocx = _mm_sub_ps(ox, _mm_loadu_ps(s.cx + base));
+    __m128 ocy = _mm_sub_ps(oy, _mm_loadu_ps(s.cy + base));
+    __m128 ocz = _mm_sub_ps(oz, _mm_loadu_ps(s.cz + base));
+    __m128 half_b = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(ocx, dx), _mm_mul_ps(ocy, dy)),
+        _mm_mul_ps(ocz, dz));
+    __m128 k = _mm_mul_ps(half_b, inv_a);
+    __m128 fx = _mm_sub_ps(ocx, _mm_mul_ps(k, dx));
+    __m128 fy = _mm_sub_ps(ocy, _mm_mul_ps(k, dy));
+    __m128 fz = _mm_sub_ps(ocz, _mm_mul_ps(k, dz));
+    __m128 ff = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(fx, fx), _mm_mul_ps(fy, fy)),
+        _mm_mul_ps(fz, fz));
+    __m128 disc = _mm_mul_ps(a, _mm_sub_ps(_mm_loadu_ps(s.r2 + base), ff));
+    __m128 sqrtd = _mm_sqrt_ps(_mm_max_ps(disc, zero));
+    __m128 neg_b = _mm_xor_ps(half_b, sign);
+    __m128 root0 = _mm_div_ps(_mm_sub_ps(neg_b, sqrtd), a);
+    __m128 root1 = _mm_div_ps(_mm_add_ps(neg_b, sqrtd), a);
+
+    __m128 in0 = _mm_and_ps(_mm_cmpge_ps(root0, tmin), _mm_cmple_ps(root0, tmax));
+    __m128 in1 = _mm_and_ps(_mm_cmpge_ps(root1, tmin), _mm_cmple_ps(root1, tmax));
+    __m128 valid = _mm_and_ps(
+        _mm_and_ps(_mm_cmpge_ps(disc, zero), _mm_or_ps(in0, in1)),
+        _mm_cmplt_ps(lane, _mm_set1_ps(static_cast<float>(count - i))));
+    if (_mm_movemask_ps(valid) != 0)
+      return true;
+  }
+  return false;
+}
+
+#endif // KESTREL_BUILD_SSE4
+
+#ifdef KESTREL_BUILD_AVX2
+
+KESTREL_TARGET_AVX2 int closest_avx2(const SphereBatch &s, const Ray &ray,
+                                     uint32_t first, uint32_t count,
+                                     float t_min, float &t_max) {
+  const __m256 ox = _mm256_set1_ps(ray.origin.x);
+  const __m256 oy = _mm256_set1_ps(ray.origin.y);
+  const __m256 oz = _mm256_set1_ps(ray.origin.z);
+  const __m256 dx = _mm256_set1_ps(ray.direction.x);
+  const __m256 dy = _mm256_set1_ps(ray.direction.y);
+  const __m256 dz = _mm256_set1_ps(ray.direction.z);
+  const __m256 a = _mm256_set1_ps(ray.direction.length_squared());
+  const __m256 inv_a =
+      _mm256_set1_ps(1.0f / ray.direction.length_squared());
+  const __m256 tmin = _mm256_set1_ps(t_min);
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 sign = _mm256_set1_ps(-0.0f);
+  const __m256 inf = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+  const __m256 lane = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+
+  int best = -1;
+  for (uint32_t i = 0; i < count; i += 8) {
+    uint32_t base = first + i;
+    __m256 tmax = _mm256_set1_ps(t_max);
+    __m256 ocx = _mm256_sub_ps(ox, _mm256_loadu_ps(s.cx + base));
+    __m256 ocy = _mm256_sub_ps(oy, _mm256_loadu_ps(s.cy + base));
+    __m256 ocz = _mm256_sub_ps(oz, _mm256_loadu_ps(s.cz + base));
+    __m256 half_b = _mm256_add_ps(
+        _mm256_add_ps(_mm256_mul_ps(ocx, dx), _mm256_mul_ps(ocy, dy)),
+        _mm256_mul_ps(ocz, dz));
+    __m256 k = _mm256_mul_ps(half_b, inv_a);
+    __m256 fx = _mm256_sub_ps(ocx, _mm256_mul_ps(k, dx));
+    __m256 fy = _mm256_sub_ps(ocy, _mm256_mul_ps(k, dy));
+    __m256 fz = _mm256_sub_ps(ocz, _mm256_mul_ps(k, dz));
+    __m256 ff = _mm256_add_ps(
+        _mm256_add_ps(_mm256_mul_ps(fx, fx), _mm256_mul_ps(fy, fy)),
+        _mm256_mul_ps(fz, fz));
+    __m256 disc =
+        _mm256_mul_ps(a, _mm256_sub_ps(_mm256_loadu_ps(s.r2 + base), ff));
+    __m256 sqrtd = _mm256_sqrt_ps(_mm256_max_ps(disc, zero));
+    __m256 neg_b = _mm256_xor_ps(half_b, sign);
+    __m256 root0 = _mm256_div_ps(_mm256_sub_ps(neg_b, sqrtd), a);
+    __m256 root1 = _mm256_div_ps(_mm256_add_ps(neg_b, sqrtd), a);
+
+    __m256 in0 = _mm256_and_ps(_mm256_cmp_ps(root0, tmin, _CMP_GE_OQ),
+                               _mm256_cmp_ps(root0, tmax, _CMP_LE_OQ));
+    __m256 in1 = _mm256_and_ps(_mm256_cmp_ps(root1, tmin, _CMP_GE_OQ),
+                               _mm256_cmp_ps(root1, tmax, _CMP_LE_OQ));
+    __m256 valid = _mm256_and_ps(
+        _mm256_and_ps(_mm256_cmp_ps(disc, zero, _CMP_GE_OQ),
+                      _mm256_or_ps(in0, in1)),
+        _mm256_cmp_ps(lane, _mm256_set1_ps(static_cast<float>(count - i)),
+                      _CMP_LT_OQ));
+    if (_mm256_movemask_ps(valid) == 0)
+      continue;
+
+    __m256 root = _mm256_blendv_ps(inf, _mm256_blendv_ps(root1, root0, in0),
+                                   valid);
+    __m256 m = _mm256_min_ps(root, _mm256_permute2f128_ps(root, root, 1));
+    m = _mm256_min_ps(m, _mm256_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+    m = _mm256_min_ps(m, _mm256_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+    int mask = _mm256_movemask_ps(_mm256_cmp_ps(root, m, _CMP_EQ_OQ));
+    t_max = _mm256_cvtss_f32(m);
+    best = static_cast<int>(base) + __builtin_ctz(mask);
+  }
+  return best;
+}
+
+KESTREL_TARGET_AVX2 bool any_avx2(const SphereBatch &s, const Ray &ray,
+                                  uint32_t first, uint32_t count, float t_min,
+                                  float t_max) {
+  const __m256 ox = _mm256_set1_ps(ray.origin.x);
+  const __m256 oy = _mm256_set1_ps(ray.origin.y);
+  const __m256 oz = _mm256_set1_ps(ray.origin.z);
+  const __m256 dx = _mm256_set1_ps(ray.direction.x);
+  const __m256 dy = _mm256_set1_ps(ray.direction.y);
+  const __m256 dz = _mm256_set1_ps(ray.direction.z);
+  const __m256 a = _mm256_set1_ps(ray.direction.length_squared());
+  const __m256 inv_a =
+      _mm256_set1_ps(1.0f / ray.direction.length_squared());
+  const __m256 tmin = _mm256_set1_ps(t_min);
+  const __m256 tmax = _mm256_set1_ps(t_max);
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 sign = _mm256_set1_ps(-0.0f);
+  const __m256 lane = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+
+  for (uint32_t i = 0; i < count; i += 8) {
+    uint32_t base = first + i;
+    __m256 ocx = _mm256_sub_ps(ox, _mm256_loadu_ps(s.cx + base));
+    __m256 ocy = _mm256_sub_ps(oy, _mm256_loadu_ps(s.cy + base));
+    __m256 ocz = _mm256_sub_ps(oz, _mm256_loadu_ps(s.cz + base));
+    __m256 half_b = _mm256_add_ps(
+        _mm256_add_ps(_mm256_mul_ps(ocx, dx), _mm256_mul_ps(ocy, dy)),
+        _mm256_mul_ps(ocz, dz));
+    __m256 k = _mm256_mul_ps(half_b, inv_a);
+    __m256 fx = _mm256_sub_ps(ocx, _mm256_mul_ps(k, dx));
+    __m256 fy = _mm256_sub_ps(ocy, _mm256_mul_ps(k, dy));
+    __m256 fz = _mm256_sub_ps(ocz, _mm256_mul_ps(k, dz));
+    __m256 ff = _mm256_add_ps(
+        _mm256_add_ps(_mm256_mul_ps(fx, fx), _mm256_mul_ps(fy, fy)),
+        _mm256_mul_ps(fz, fz));
+    __m256 disc =
+        _mm256_mul_ps(a, _mm256_sub_ps(_mm256_loadu_ps(s.r2 + base), ff));
+    __m256 sqrtd = _mm256_sqrt_ps(_mm256_max_ps(disc, zero));
+    __m256 neg_b = _mm256_xor_ps(half_b, sign);
+    __m256 root0 = _mm256_div_ps(_mm256_sub_ps(neg_b, sqrtd), a);
+    __m256 root1 = _mm256_div_ps(_mm256_add_ps(neg_b, sqrtd), a);
+
+    __m256 in0 = _mm256_and_ps(_mm256_cmp_ps(root0, tmin, _CMP_GE_OQ),
+                               _mm256_cmp_ps(root0, tmax, _CMP_LE_OQ));
+    __m256 in1 = _mm256_and_ps(_mm256_cmp_ps(root1, tmin, _CMP_GE_OQ),
+                               _mm256_cmp_ps(root1, tmax, _CMP_LE_OQ));
+    __m256 valid = _mm256_and_ps(
+        _mm256_and_ps(_mm256_cmp_ps(disc, zero, _CMP_GE_OQ),
+                      _mm256_or_ps(in0, in1)),
+        _mm256_cmp_ps(lane, _mm256_set1_ps(static_cast<float>(count - i)),
+                      _CMP_LT_OQ));
+    if (_mm256_movemask_ps(valid) != 0)
+      return true;
+  }
+  return false;
+}
+
+#endif // KESTREL_BUILD_AVX2
+
+#ifdef KESTREL_BUILD_AVX512
+
+KESTREL_TARGET_AVX512 int closest_avx512(const SphereBatch &s, const Ray &ray,
+                                         uint32_t first, uint32_t count,
+                                         float t_min, float &t_max) {
+  const __m512 ox = _mm512_set1_ps(ray.origin.x);
+  const __m512 oy = _mm512_set1_ps(ray.origin.y);
+  const __m512 oz = _mm512_set1_ps(ray.origin.z);
+  const __m512 dx = _mm512_set1_ps(ray.direction.x);
+  const __m512 dy = _mm512_set1_ps(ray.direction.y);
+  const __m512 dz = _mm512_set1_ps(ray.direction.z);
+  const __m512 a = _mm512_set1_ps(ray.direction.length_squared());
+  const __m512 inv_a =
+      _mm512_set1_ps(1.0f / ray.direction.length_squared());
+  const __m512 tmin = _mm512_set1_ps(t_min);
+  const __m512 zero = _mm512_setzero_ps();
+  const __m512 inf = _mm512_set1_ps(std::numeric_limits<float>::infinity());
+
+  int best = -1;
+  for (uint32_t i = 0; i < count; i += 16) {
+    uint32_t base = first + i;
+    uint32_t remaining = count - i;
+    __mmask16 lanes = remaining >= 16
+                          ? static_cast<__mmask16>(0xFFFF)
+                          : static_cast<__mmask16>((1u << remaining) - 1u);
+    __m512 tmax = _mm512_set1_ps(t_max);
+    __m512 ocx = _mm512_sub_ps(ox, _mm512_loadu_ps(s.cx + base));
+    __m512 ocy = _mm512_sub_ps(oy, _mm512_loadu_ps(s.cy + base));
+    __m512 ocz = _mm512_sub_ps(oz, _mm512_loadu_ps(s.cz + base));
+    __m512 half_b = _mm512_add_ps(
+        _mm512_add_ps(_mm512_mul_ps(ocx, dx), _mm512_mul_ps(ocy, dy)),
+        _mm512_mul_ps(ocz, dz));
+    __m512 k = _mm512_mul_ps(half_b, inv_a);
+    __m512 fx = _mm512_sub_ps(ocx, _mm512_mul_ps(k, dx));
+    __m512 fy = _mm512_sub_ps(ocy, _mm512_mul_ps(k, dy));
+    __m512 fz = _mm512_sub_ps(ocz, _mm512_mul_ps(k, dz));
+    __m512 ff = _mm512_add_ps(
+        _mm512_add_ps(_mm512_mul_ps(fx, fx), _mm512_mul_ps(fy, fy)),
+        _mm512_mul_ps(fz, fz));
+    __m512 disc =
+        _mm512_mul_ps(a, _mm512_sub_ps(_mm512_loadu_ps(s.r2 + base), ff));
+    __mmask16 valid =
+        _mm512_mask_cmp_ps_mask(lanes, disc, zero, _CMP_GE_OQ);
+    if (valid == 0)
+      continue;
+
+    __m512 sqrtd = _mm512_sqrt_ps(_mm512_max_ps(disc, zero));
+    __m512 neg_b = _mm512_castsi512_ps(_mm512_xor_si512(
+        _mm512_castps_si512(half_b), _mm512_set1_epi32(INT32_MIN)));
+    __m512 root0 = _mm512_div_ps(_mm512_sub_ps(neg_b, sqrtd), a);
+    __m512 root1 = _mm512_div_ps(_mm512_add_ps(neg_b, sqrtd), a);
+
+    __mmask16 in0 = _mm512_cmp_ps_mask(root0, tmin, _CMP_GE_OQ) &
+                    _mm512_cmp_ps_mask(root0, tmax, _CMP_LE_OQ);
+    __mmask16 in1 = _mm512_cmp_ps_mask(root1, tmin, _CMP_GE_OQ) &
+                    _mm512_cmp_ps_mask(root1, tmax, _CMP_LE_OQ);
+    valid &= (in0 | in1);
+    if (valid == 0)
+      continue;
+
+    __m512 root = _mm512_mask_blend_ps(in0, root1, root0);
+    root = _mm512_mask_blend_ps(valid, inf, root);
+    float m = _mm512_reduce_min_ps(root);
+    __mmask16 mask = _mm512_cmp_ps_mask(root, _mm512_set1_ps(m), _CMP_EQ_OQ);
+    t_max = m;
+    best = static_cast<int>(base) + __builtin_ctz(mask);
+  }
+  return best;
+}
+
+KESTREL_TARGET_AVX512 bool any_avx512(const SphereBatch &s, const Ray &ray,
+                                      uint32_t first, uint32_t count,
+                                      float t_min, float t_max) {
+  const __m512 ox = _mm512_set1_ps(ray.origin.x);
+  const __m512 oy = _mm512_set1_ps(ray.origin.y);
+  const __m512 oz = _mm512_set1_ps(ray.origin.z);
+  const __m512 dx = _mm512_set1_ps(ray.direction.x);
+  const __m512 dy = _mm512_set1_ps(ray.direction.y);
+  const __m512 dz = _mm512_set1_ps(ray.direction.z);
+  const __m512 a = _mm512_set1_ps(ray.direction.length_squared());
+  const __m512 inv_a =
+      _mm512_set1_ps(1.0f / ray.direction.length_squared());
+  const __m512 tmin = _mm512_set1_ps(t_min);
+  const __m512 tmax = _mm512_set1_ps(t_max);
+  const __m512 zero = _mm512_setzero_ps();
+
+  for (uint32_t i = 0; i < count; i += 16) {
+    uint32_t base = first + i;
+    uint32_t remaining = count - i;
+    __mmask16 lanes = remaining >= 16
+                          ? static_cast<__mmask16>(0xFFFF)
+                          : static_cast<__mmask16>((1u << remaining) - 1u);
+    __m512 ocx = _mm512_sub_ps(ox, _mm512_loadu_ps(s.cx + base));
+    __m512 ocy = _mm512_sub_ps(oy, _mm512_loadu_ps(s.cy + base));
+    __m512 ocz = _mm512_sub_ps(oz, _mm512_loadu_ps(s.cz + base));
+    __m512 half_b = _mm512_add_ps(
+        _mm512_add_ps(_mm512_mul_ps(ocx, dx), _mm512_mul_ps(ocy, dy)),
+        _mm512_mul_ps(ocz, dz));
+    __m512 k = _mm512_mul_ps(half_b, inv_a);
+    __m512 fx = _mm512_sub_ps(ocx, _mm512_mul_ps(k, dx));
+    __m512 fy = _mm512_sub_ps(ocy, _mm512_mul_ps(k, dy));
+    __m512 fz = _mm512_sub_ps(ocz, _mm512_mul_ps(k, dz));
+    __m512 ff = _mm512_add_ps(
+        _mm512_add_ps(_mm512_mul_ps(fx, fx), _mm512_mul_ps(fy, fy)),
+        _mm512_mul_ps(fz, fz));
+    __m512 disc =
+        _mm512_mul_ps(a, _mm512_sub_ps(_mm512_loadu_ps(s.r2 + base), ff));
+    __mmask16 valid =
+        _mm512_mask_cmp_ps_mask(lanes, disc, zero, _CMP_GE_OQ);
+    if (valid == 0)
+      continue;
+
+    __m512 sqrtd = _mm512_sqrt_ps(_mm512_max_ps(disc, zero));
+    __m512 neg_b = _mm512_castsi512_ps(_mm512_xor_si512(
+        _mm512_castps_si512(half_b), _mm512_set1_epi32(INT32_MIN)));
+    __m512 root0 = _mm512_div_ps(_mm512_sub_ps(neg_b, sqrtd), a);
+    __m512 root1 = _mm512_div_ps(_mm512_add_ps(neg_b, sqrtd), a);
+
+    __mmask16 in0 = _mm512_cmp_ps_mask(root0, tmin, _CMP_GE_OQ) &
+                    _mm512_cmp_ps_mask(root0, tmax, _CMP_LE_OQ);
+    __mmask16 in1 = _mm512_cmp_ps_mask(root1, tmin, _CMP_GE_OQ) &
+                    _mm512_cmp_ps_mask(root1, tmax, _CMP_LE_OQ);
+    if ((valid & (in0 | in1)) != 0)
+      return true;
+  }
+  return false;
+}
+
+#endif // KESTREL_BUILD_AVX512
+
+SphereKernels select_kernels() {
+#if defined(KESTREL_SIMD_DISPATCH) && defined(KESTREL_X86)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    return {"AVX-512", 16, closest_avx512, any_avx512};
+  if (__builtin_cpu_supports("avx2"))
+    return {"AVX2", 8, closest_avx2, any_avx2};
+  if (__builtin_cpu_supports("sse4.1"))
+    return {"SSE4.1", 4, closest_sse4, any_sse4};
+#elif defined(KESTREL_BUILD_AVX512)
+  return {"AVX-512", 16, closest_avx512, any_avx512};
+#elif defined(KESTREL_BUILD_AVX2)
+  return {"AVX2", 8, closest_avx2, any_avx2};
+#elif defined(KESTREL_BUILD_SSE4)
+  return {"SSE4.1", 4, closest_sse4, any_sse4};
+#endif
+  return {"scalar", 1, closest_scalar, any_scalar};
+}
+
+} // namespace
+
+const SphereKernels &sphere_kernels() {
+  static const SphereKernels kernels = select_kernels();
+  return kernels;
+}
+
+namespace {
+
+/// Steps of the 16-bit quantization grid spanning a leaf
+constexpr float QUANTIZATION_STEPS = 65535.0f;
+
+/// Grid a leaf's spheres are quantized to
+struct QuantizationFrame {
+  Point3 origin;     ///< Minimum corner of the leaf bounds
+  Vec3 step;         ///< Center step per axis
+  float radius_step; ///< Radius step
+};
+
+QuantizationFrame quantization_frame(const AABB &bounds) {
+  Vec3 extent = bounds.max - bounds.min;
+  // Every sphere fits in its leaf, so no radius exceeds half the extent
+  float largest = std::max({extent.x, extent.y, extent.z});
+  const float inv_steps = 1.0f / QUANTIZATION_STEPS;
+  return {bounds.min, extent * inv_steps, 0.5f * largest * inv_steps};
+}
+
+uint16_t quantize(float value, float step) {
+  if (!(step > 0.0f))
+    return 0;
+  return static_cast<uint16_t>(
+      std::clamp(std::round(value / step), 0.0f, QUANTIZATION_STEPS));
+}
+
+} // namespace
+
+void CompactSphereSoA::clear() {
+  qx.clear();
+  qy.clear();
+  qz.clear();
+  qr.clear();
+  material.clear();
+  count = 0;
+}
+
+void CompactSphereSoA::build(const std::vector<Sphere> &spheres,
+                             const BVH &bvh) {
+  count = static_cast<uint32_t>(bvh.prim_indices.size());
+  uint32_t padded = (count + PADDING - 1) / PADDING * PADDING + PADDING;
+
+  // Padding slots dequantize to zero-radius spheres in the leaf corner;
+  // kernels mask them out by lane index
+  qx.assign(padded, 0);
+  qy.assign(padded, 0);
+  qz.assign(padded, 0);
+  qr.assign(padded, 0);
+  material.assign(count, 0);
+
+  for (const BVHNode &node : bvh.nodes) {
+    if (!node.is_leaf())
+      continue;
+    const QuantizationFrame frame = quantization_frame(node.bounds);
+    for (uint32_t i = node.left_first; i < node.left_first + node.prim_count;
+         ++i) {
+      const Sphere &s = spheres[bvh.prim_indices[i]];
+      qx[i] = quantize(s.center.x - frame.origin.x, frame.step.x);
+      qy[i] = quantize(s.center.y - frame.origin.y, frame.step.y);
+      qz[i] = quantize(s.center.z - frame.origin.z, frame.step.z);
+      // Never round a sphere away entirely
+      qr[i] = std::max<uint16_t>(1, quantize(s.radius, frame.radius_step));
+      material[i] = static_cast<uint16_t>(s.material);
+    }
+  }
+}
+
+void CompactSphereSoA::unpack(const BVHNode &leaf, uint32_t first, float *cx,
+                              float *cy, float *cz, float *r2) const {
+  const QuantizationFrame frame = quantization_frame(leaf.bounds);
+  const uint16_t *x = qx.data() + first;
+  const uint16_t *y = qy.data() + first;
+  const uint16_t *z = qz.data() + first;
+  const uint16_t *r = qr.data() + first;
+  for (uint32_t i = 0; i < BATCH; ++i) {
+    cx[i] = frame.origin.x + static_cast<float>(x[i]) * frame.step.x;
+    cy[i] = frame.origin.y + static_cast<float>(y[i]) * frame.step.y;
+    cz[i] = frame.origin.z + static_cast<float>(z[i]) * frame.step.z;
+    float radius = static_cast<float>(r[i]) * frame.radius_step;
+    r2[i] = radius * radius;
+  }
+}
+
+int CompactSphereSoA::closest(const Ray &ray, const BVHNode &leaf,
+                              float t_min, float &t_max) const {
+  alignas(64) float cx[BATCH], cy[BATCH], cz[BATCH], r2[BATCH];
+  const SphereBatch batch = {cx, cy, cz, r2};
+  int best = -1;
+  for (uint32_t done = 0; done < leaf.prim_count; done += BATCH) {
+    uint32_t first = leaf.left_first + done;
+    unpack(leaf, first, cx, cy, cz, r2);
+    int slot = kernels->closest(batch, ray, 0,
+                                std::min(BATCH, leaf.prim_count - done),
+                                t_min, t_max);
+    if (slot >= 0)
+      best = static_cast<int>(first) + slot;
+  }
+  return best;
+}
+
+bool CompactSphereSoA::any(const Ray &ray, const BVHNode &leaf, float t_min,
+                           float t_max) const {
+  alignas(64) float cx[BATCH], cy[BATCH], cz[BATCH], r2[BATCH];
+  const SphereBatch batch = {cx, cy, cz, r2};
+  for (uint32_t done = 0; done < leaf.prim_count; done += BATCH) {
+    unpack(leaf, leaf.left_first + done, cx, cy, cz, r2);
+    if (kernels->any(batch, ray, 0, std::min(BATCH, leaf.prim_count - done),
+                     t_min, t_max))
+      return true;
+  }
+  return false;
+}
+
+Sphere CompactSphereSoA::sphere(const BVHNode &leaf, uint32_t slot) const {
+  const QuantizationFrame frame = quantization_frame(leaf.bounds);
+  Point3 center(frame.origin.x + static_cast<float>(qx[slot]) * frame.step.x,
+                frame.origin.y + static_cast<float>(qy[slot]) * frame.step.y,
+                frame.origin.z + static_cast<float>(qz[slot]) * frame.step.z);
+  return Sphere(center, static_cast<float>(qr[slot]) * frame.radius_step,
+                material[slot]);
+}
@@ -0,0 +1,143 @@
+#include "thread_pool.h"
+#include <algorithm>
+#include <fstream>
+#include <string>
+
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+/// CPUs of the affinity mask, in increasing order
+std::vector<int> allowed_cpus() {
+  std::vector<int> cpus;
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0)
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+      if (CPU_ISSET(cpu, &set))
+        cpus.push_back(cpu);
+#endif
+  return cpus;
+}
+
+} // namespace
+
+int available_cpus() {
+  size_t count = allowed_cpus().size();
+  if (count == 0)
+    count = std::thread::hardware_concurrency();
+  return std::max(1, static_cast<int>(count));
+}
+
+int numa_node_count() {
+  // "0", "0-1", "0,2-3", ...: count the nodes in the list
+  std::ifstream file("/sys/devices/system/node/online");
+  std::string list;
+  if (!(file >> list))
+    return 1;
+  int nodes = 0;
+  size_t start = 0;
+  while (start < list.size()) {
+    size_t end = list.find(',', start);
+    std::string range = list.substr(start, end - start);
+    size_t dash = range.find('-');
+    nodes += dash == std::string::npos
+                 ? 1
+                 : std::stoi(range.substr(dash + 1)) -
+                       std::stoi(range.substr(0, dash)) + 1;
+    if (end == std::string::npos)
+      break;
+    start = end + 1;
+  }
+  return std::max(1, nodes);
+}
+
+void interleave_pages(const void *data, size_t bytes) {
+#if defined(__linux__) && defined(SYS_mbind)
+  static const int nodes = numa_node_count();
+  if (nodes < 2 || bytes == 0)
+    return;
+  // mbind works on whole pages
+  const uintptr_t page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+  uintptr_t begin = reinterpret_cast<uintptr_t>(data) & ~(page - 1);
+  uintptr_t end = reinterpret_cast<uintptr_t>(data) + bytes;
+  unsigned long mask[16] = {};
+  const int max_nodes = static_cast<int>(sizeof(mask) * 8);
+  for (int n = 0; n < std::min(nodes, max_nodes); ++n)
+    mask[n / (8 * sizeof(unsigned long))] |=
+        1UL << (n % (8 * sizeof(unsigned long)));
+  // Best effort: without permission to migrate, new pages still interleave
+  syscall(SYS_mbind, begin, end - begin, MPOL_INTERLEAVE, mask,
+          static_cast<unsigned long>(max_nodes), MPOL_MF_MOVE);
+#else
+  (void)data;
+  (void)bytes;
+#endif
+}
+
+ThreadPool::ThreadPool(int num_threads, bool pin) {
+  num_threads = std::max(1, num_threads);
+  const std::vector<int> cpus = pin ? allowed_cpus() : std::vector<int>();
+  pinned_threads = !cpus.empty();
+  for (int t = 0; t < num_threads; ++t) {
+    threads.emplace_back(&ThreadPool::worker, this, t);
+#ifdef __linux__
+    if (pinned_threads) {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(cpus[t % cpus.size()], &set);
+      pinned_threads = pthread_setaffinity_np(threads.back().native_handle(),
+                                              sizeof(set), &set) == 0 &&
+                       pinned_threads;
+    }
+#endif
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (std::thread &thread : threads)
+    thread.join();
+}
+
+void ThreadPool::run(const std::function<void(int)> &task_fn) {
+  std::unique_lock<std::mutex> lock(mutex);
+  task = &task_fn;
+  running = size();
+  generation++;
+  wake.notify_all();
+  finished.wait(lock, [this] { return running == 0; });
+  task = nullptr;
+}
+
+void ThreadPool::worker(int thread_id) {
+  uint64_t seen = 0;
+  while (true) {
+    const std::function<void(int)> *current;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock, [&] { return stopping || generation != seen; });
+      if (stopping)
+        return;
+      seen = generation;
+      current = task;
+    }
+    (*current)(thread_id);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (--running == 0)
+        finished.notify_one();
+    }
+  }
+}
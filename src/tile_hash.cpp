@@ -0,0 +1,179 @@
+#include "tile_hash.h"
+#include "distributed.h"
+#include <cinttypes>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+namespace {
+
+/// Version 2: frame keys cover the materials and the shape, edges and
+/// sample counts of the lights (through scene_fingerprint)
+constexpr int TILE_HASH_VERSION = 2;
+
+uint64_t fnv1a(uint64_t hash, const void *data, size_t size) {
+  const auto *bytes = static_cast<const uint8_t *>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+template <typename T> uint64_t fnv1a(uint64_t hash, const T &value) {
+  return fnv1a(hash, &value, sizeof(value));
+}
+
+std::string hex(uint64_t value) {
+  char text[17];
+  std::snprintf(text, sizeof(text), "%016" PRIx64, value);
+  return text;
+}
+
+} // namespace
+
+uint64_t TileHashes::tile_key(size_t tile) const {
+  const Tile &t = tiles[tile];
+  const int32_t rect[] = {t.x0, t.y0, t.x1, t.y1};
+  return fnv1a(frame_key, rect, sizeof(rect));
+}
+
+uint64_t frame_key(const Scene &scene, const SceneCamera &view,
+                   const RenderSettings &settings) {
+  uint64_t key = scene_fingerprint(scene);
+  const float camera[] = {view.look_from.x, view.look_from.y,
+                          view.look_from.z, view.look_at.x,
+                          view.look_at.y,   view.look_at.z,
+                          view.vup.x,       view.vup.y,
+                          view.vup.z,       view.vfov};
+  key = fnv1a(key, camera, sizeof(camera));
+  const int32_t sizes[] = {settings.image_width, settings.image_height,
+                           settings.tile_size,   settings.samples_per_pixel,
+                           settings.light_samples, settings.pass_samples,
+                           settings.min_samples, settings.max_samples};
+  key = fnv1a(key, sizes, sizeof(sizes));
+  const uint8_t modes[] = {static_cast<uint8_t>(settings.engine),
+                           static_cast<uint8_t>(settings.sampler),
+                           static_cast<uint8_t>(settings.framebuffer),
+                           settings.progressive,
+                           settings.adaptive,
+                           settings.tile_seeds,
+                           settings.pixel_seeds,
+                           FAST_MATH};
+  key = fnv1a(key, modes, sizeof(modes));
+  return fnv1a(key, settings.noise_threshold);
+}
+
+TileHashes hash_tiles(const std::vector<Color> &pixels,
+                      const RenderSettings &settings, uint64_t key) {
+  TileHashes hashes;
+  hashes.width = settings.image_width;
+  hashes.height = settings.image_height;
+  hashes.tile_size = settings.tile_size;
+  hashes.frame_key = key;
+  hashes.tiles =
+      make_tiles(settings.image_width, settings.image_height,
+                 settings.tile_size);
+  for (const Tile &tile : hashes.tiles) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int j = tile.y0; j < tile.y1; ++j)
+      hash = fnv1a(hash, &pixels[static_cast<size_t>(j) * hashes.width +
+                                 tile.x0],
+                   (tile.x1 - tile.x0) * sizeof(Color));
+    hashes.hashes.push_back(hash);
+  }
+  return hashes;
+}
+
+bool save_tile_hashes(const std::string &path, const TileHashes &hashes,
+                      std::string &error) {
+  std::ofstream file(path);
+  if (!file) {
+    error = "Cannot open " + path + " for writing";
+    return false;
+  }
+  file << "kestrel-tiles " << TILE_HASH_VERSION << " " << hashes.width << " "
+       << hashes.height << " " << hashes.tile_size << " "
+       << hex(hashes.frame_key) << "\n";
+  for (size_t t = 0; t < hashes.tiles.size(); ++t) {
+    const Tile &tile = hashes.tiles[t];
+    file << t << " " << tile.x0 << " " << tile.y0 << " " << tile.x1 << " "
+         << tile.y1 << " " << hex(hashes.tile_key(t)) << " "
+         << hex(hashes.hashes[t]) << "\n";
+  }
+  file.close();
+  if (!file) {
+    error = "Failed to write " + path;
+    return false;
+  }
+  return true;
+}
+
+bool load_tile_hashes(const std::string &path, TileHashes &hashes,
+                      std::string &error) {
+  std::ifstream file(path);
+  if (!file) {
+    error = "Cannot open " + path;
+    return false;
+  }
+
+  hashes = TileHashes();
+  size_t line_number = 1;
+  auto fail = [&](const std::string &message) {
+    error = path + ":" + std::to_string(line_number) + ": " + message;
+    return false;
+  };
+
+  std::string text, magic;
+  int version = 0;
+  if (!std::getline(file, text))
+    return fail("empty file");
+  std::istringstream header(text);
+  if (!(header >> magic >> version) || magic != "kestrel-tiles")
+    return fail("not a tile hash file");
+  if (version != TILE_HASH_VERSION)
+    return fail("unsupported version " + std::to_string(version));
+  if (!(header >> hashes.width >> hashes.height >> hashes.tile_size >>
+        std::hex >> hashes.frame_key) ||
+      hashes.width < 1 || hashes.height < 1 || hashes.tile_size < 1)
+    return fail("expected: kestrel-tiles " +
+                std::to_string(TILE_HASH_VERSION) +
+                " <width> <height> <tile_size> <frame key>");
+
+  while (std::getline(file, text)) {
+    ++line_number;
+    std::istringstream line(text);
+    size_t id;
+    Tile tile;
+    uint64_t key, hash;
+    if (!(line >> id >> tile.x0 >> tile.y0 >> tile.x1 >> tile.y1 >>
+          std::hex >> key >> hash))
+      return fail("expected: <tile id> <x0> <y0> <x1> <y1> <key> <hash>");
+    if (id != hashes.tiles.size())
+      return fail("tiles out of order");
+    hashes.tiles.push_back(tile);
+    hashes.hashes.push_back(hash);
+    if (hashes.tile_key(id) != key)
+      return fail("tile key does not match the frame key");
+  }
+  return true;
+}
+
+bool compare_tile_hashes(const TileHashes &golden, const TileHashes &image,
+                         std::vector<uint32_t> &differing,
+                         std::string &error) {
+  differing.clear();
+  if (golden.width != image.width || golden.height != image.height ||
+      golden.tile_size != image.tile_size ||
+      golden.tiles.size() != image.tiles.size()) {
+    error = "the golden image has another size or tile layout (" +
+            std::to_string(golden.width) + "x" +
+            std::to_string(golden.height) + ", " +
+            std::to_string(golden.tile_size) + "-pixel tiles)";
+    return false;
+  }
+  for (size_t t = 0; t < image.tiles.size(); ++t)
+    if (golden.hashes[t] != image.hashes[t])
+      differing.push_back(static_cast<uint32_t>(t));
+  return true;
+}
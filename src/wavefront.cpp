@@ -0,0 +1,199 @@
+#include "wavefront.h"
+#include "light_selection.h"
+#include "renderer.h"
+#include <algorithm>
+#include <utility>
+
+void Wavefront::PathQueue::clear() {
+  origin.clear();
+  direction.clear();
+  throughput.clear();
+  path.clear();
+}
+
+void Wavefront::PathQueue::push(const Point3 &o, const Vec3 &d,
+                                const Color &t, uint32_t p) {
+  origin.push_back(o);
+  direction.push_back(d);
+  throughput.push_back(t);
+  path.push_back(p);
+}
+
+void Wavefront::HitQueue::clear() {
+  point.clear();
+  normal.clear();
+  material.clear();
+  ray.clear();
+}
+
+void Wavefront::ShadowQueue::clear() {
+  origin.clear();
+  direction.clear();
+  t_max.clear();
+  contribution.clear();
+  path.clear();
+}
+
+void Wavefront::clear() {
+  active.clear();
+  radiance_out.clear();
+  path_samples.clear();
+}
+
+uint32_t Wavefront::add_path(const Ray &ray, const PixelSample &sample) {
+  uint32_t index = static_cast<uint32_t>(radiance_out.size());
+  active.push(ray.origin, ray.direction, Color(1.0f), index);
+  radiance_out.push_back(Color(0.0f));
+  path_samples.push_back(sample);
+  return index;
+}
+
+void Wavefront::trace(const Scene &scene, Sampler &sampler, int depth,
+                      int light_samples, RenderStats *stats) {
+  TraversalStats *traversal = stats ? &stats->traversal : nullptr;
+  for (int bounce = 0; bounce < depth && active.size() > 0; ++bounce) {
+    {
+      ScopedTimer timer(stats, RenderStage::INTERSECT);
+      intersect(scene, traversal);
+    }
+    {
+      ScopedTimer timer(stats, RenderStage::SHADE);
+      sort_by_material(scene.materials.size());
+      shade(scene, sampler, bounce, light_samples);
+      trace_shadows(scene, traversal);
+    }
+    if (stats) {
+      stats->closest_queries += active.size();
+      stats->bounces += hits.size();
+      stats->shadow_rays += shadows.size();
+    }
+    std::swap(active, next);
+  }
+  active.clear();
+}
+
+// Stage 1: closest hit of every active ray; misses leave the batch
+void Wavefront::intersect(const Scene &scene, TraversalStats *stats) {
+  hits.clear();
+  for (size_t i = 0; i < active.size(); ++i) {
+    HitRecord rec;
+    if (scene.hit(Ray(active.origin[i], active.direction[i]), 0.001f, 1000.0f,
+                  rec, stats)) {
+      hits.point.push_back(rec.point);
+      hits.normal.push_back(rec.normal);
+      hits.material.push_back(rec.material);
+      hits.ray.push_back(static_cast<uint32_t>(i));
+    }
+  }
+}
+
+// Stage 2: group hits by material so shading runs one material at a time.
+// Material ids are small and dense, so a stable counting sort does it in
+// two linear passes.
+void Wavefront::sort_by_material(size_t material_count) {
+  offsets.assign(material_count + 1, 0);
+  for (uint32_t id : hits.material)
+    offsets[id + 1]++;
+  for (size_t m = 0; m < material_count; ++m)
+    offsets[m + 1] += offsets[m];
+
+  const size_t n = hits.size();
+  sorted.point.resize(n);
+  sorted.normal.resize(n);
+  sorted.material.resize(n);
+  sorted.ray.resize(n);
+  for (size_t h = 0; h < n; ++h) {
+    uint32_t slot = offsets[hits.material[h]]++;
+    sorted.point[slot] = hits.point[h];
+    sorted.normal[slot] = hits.normal[h];
+    sorted.material[slot] = hits.material[h];
+    sorted.ray[slot] = hits.ray[h];
+  }
+}
+
+// Stage 3: emit shadow rays for direct lighting and the reflected rays of
+// the next bounce (same estimator as shade_hit)
+void Wavefront::shade(const Scene &scene, Sampler &sampler, int bounce,
+                      int light_samples) {
+  shadows.clear();
+  next.clear();
+  for (size_t h = 0; h < sorted.size(); ++h) {
+    const uint32_t material = sorted.material[h];
+    const Color &color = scene.materials.color(material);
+    const float reflectivity = scene.materials.reflectivity(material);
+    const Point3 &point = sorted.point[h];
+    const Vec3 &normal = sorted.normal[h];
+    uint32_t ray = sorted.ray[h];
+    uint32_t path = active.path[ray];
+    Color throughput = active.throughput[ray];
+    sampler.start_pixel_sample(path_samples[path]);
+    sampler.start_bounce(bounce);
+
+    // Direct lighting, weighted by the non-reflective part of the surface,
+    // from every light or only from the ones picked for this hit
+    Color weight = throughput * (1.0f - reflectivity);
+    Point3 shadow_origin = point + normal * 0.001f;
+    SelectedLight selected[MAX_SELECTED_LIGHTS];
+    int light_count = static_cast<int>(scene.lights.size());
+    if (light_samples > 0)
+      light_count = select_lights(scene.lights, point, normal, light_samples,
+                                  sampler, selected);
+    for (int l = 0; l < light_count; ++l) {
+      const Light &scene_light =
+          scene.lights[light_samples > 0 ? selected[l].index : l];
+      float light_weight = light_samples > 0 ? selected[l].weight : 1.0f;
+      const int samples = scene_light.sample_count();
+      const float sample_weight = light_weight / static_cast<float>(samples);
+
+      // Stratified shadow-ray targets across the light surface, each with
+      // its own cosine and distance falloff
+      float shift_u = 0.0f, shift_v = 0.0f;
+      if (scene_light.shape != LightShape::POINT) {
+        shift_u = sampler.next_1d();
+        shift_v = sampler.next_1d();
+      }
+      for (int i = 0; i < samples; ++i) {
+        Point3 target = scene_light.sample_point(point, i, shift_u, shift_v);
+        Vec3 light_dir = (target - point).normalized();
+        float cos_theta = std::max(0.0f, Vec3::dot(normal, light_dir));
+        if (cos_theta <= 0.0f) {
+          continue; // No contribution, whatever the shadow ray finds
+        }
+        float distance = (target - point).length();
+        Color unshadowed = color * cos_theta * scene_light.get_intensity() /
+                           (distance * distance + 1e-4f);
+        Vec3 to_light = target - shadow_origin;
+        float shadow_length = to_light.length();
+        shadows.origin.push_back(shadow_origin);
+        shadows.direction.push_back(to_light / shadow_length);
+        shadows.t_max.push_back(shadow_length - 0.001f);
+        shadows.contribution.push_back(weight * unshadowed * sample_weight);
+        shadows.path.push_back(path);
+      }
+    }
+
+    // Continue along the mirror direction if the material is reflective
+    if (reflectivity <= 0.0f) {
+      continue;
+    }
+    throughput = throughput * (reflectivity * color);
+    if (!survives_roulette(throughput, bounce + 1, sampler)) {
+      continue;
+    }
+    Vec3 incident_dir = active.direction[ray].normalized();
+    Vec3 reflected_dir =
+        incident_dir - 2.0f * Vec3::dot(incident_dir, normal) * normal;
+    next.push(shadow_origin, reflected_dir, throughput, path);
+  }
+}
+
+// Stage 4: any-hit test of every shadow ray; unoccluded ones deposit their
+// radiance on their path
+void Wavefront::trace_shadows(const Scene &scene, TraversalStats *stats) {
+  for (size_t i = 0; i < shadows.size(); ++i) {
+    if (!scene.occluded(Ray(shadows.origin[i], shadows.direction[i]), 0.001f,
+                        shadows.t_max[i], stats)) {
+      radiance_out[shadows.path[i]] += shadows.contribution[i];
+    }
+  }
+}